@@ -185,3 +185,255 @@ void HX711_power_down(HX711 *hx) {
 void HX711_power_up(HX711 *hx) {
 	HAL_GPIO_WritePin(hx->PD_SCK_Port, hx->PD_SCK_Pin, GPIO_PIN_RESET);
 }
+
+void HX711_multi_begin(HX711_Multi *hx, GPIO_TypeDef* PD_SCK_Port, uint16_t PD_SCK_Pin, GPIO_TypeDef* DOUT_Port, const uint16_t *DOUT_Pins, uint8_t channels, uint8_t gain) {
+	if (channels > HX711_MAX_CHANNELS) {
+		channels = HX711_MAX_CHANNELS;
+	}
+	// Digital output
+	hx->PD_SCK_Port = PD_SCK_Port;
+	hx->PD_SCK_Pin = PD_SCK_Pin;
+	// Digital pull-up inputs
+	hx->DOUT_Port = DOUT_Port;
+	hx->DOUT_Mask = 0;
+	hx->channels = channels;
+	for (uint8_t c = 0; c < channels; c++) {
+		hx->DOUT_Pins[c] = DOUT_Pins[c];
+		hx->DOUT_Mask |= DOUT_Pins[c];
+		hx->OFFSET[c] = 0;
+		hx->SCALE[c] = 1;
+	}
+	hx->saturated = 0;
+	hx->RATE_Port = NULL;
+	hx->RATE_Pin = 0;
+	hx->rate = 10;
+	// Set gain
+	HX711_multi_set_gain(hx, gain);
+}
+
+uint16_t HX711_multi_ready_mask(HX711_Multi *hx) {
+	uint16_t idr = hx->DOUT_Port->IDR;
+	uint16_t mask = 0;
+	for (uint8_t c = 0; c < hx->channels; c++) {
+		if (!(idr & hx->DOUT_Pins[c])) {
+			mask |= 1 << c;
+		}
+	}
+	return mask;
+}
+
+bool HX711_multi_is_ready(HX711_Multi *hx) {
+	return !(hx->DOUT_Port->IDR & hx->DOUT_Mask);
+}
+
+bool HX711_multi_wait_ready_timeout(HX711_Multi *hx, unsigned long timeout, unsigned long delay_ms) {
+	unsigned long millisStarted = HAL_GetTick();
+	while (HAL_GetTick() - millisStarted < timeout) {
+		if (HX711_multi_is_ready(hx)) {
+			return true;
+		}
+		HAL_Delay(delay_ms);
+	}
+	return false;
+}
+
+void HX711_multi_set_gain(HX711_Multi *hx, uint8_t gain) {
+	switch (gain) {
+	case 128:		// channel A, gain factor 128
+		hx->GAIN = 1;
+		break;
+	case 64:		// channel A, gain factor 64
+		hx->GAIN = 3;
+		break;
+	case 32:		// channel B, gain factor 32
+		hx->GAIN = 2;
+		break;
+	}
+}
+
+void HX711_multi_set_rate_pin(HX711_Multi *hx, GPIO_TypeDef* RATE_Port, uint16_t RATE_Pin) {
+	hx->RATE_Port = RATE_Port;
+	hx->RATE_Pin = RATE_Pin;
+	HX711_multi_set_rate(hx, hx->rate);
+}
+
+bool HX711_multi_set_rate(HX711_Multi *hx, uint8_t rate) {
+	if (hx->RATE_Port == NULL) {
+		return false;
+	}
+	hx->rate = rate == 80 ? 80 : 10;
+	HAL_GPIO_WritePin(hx->RATE_Port, hx->RATE_Pin, hx->rate == 80 ? GPIO_PIN_SET : GPIO_PIN_RESET);
+	return true;
+}
+
+void HX711_multi_read(HX711_Multi *hx, long *values) {
+	// One port snapshot per bit, MSB first; they are taken apart after the
+	// clocking so the clock high time stays as short as for one chip
+	uint16_t samples[24];
+
+	// Wait for every chip to become ready.
+	while (!HX711_multi_is_ready(hx)) {
+		HAL_Delay(0);
+	}
+
+	// Pulse the shared clock pin 24 times to read the data of all chips.
+	for (uint8_t i = 0; i < 24; i++) {
+		HAL_GPIO_WritePin(hx->PD_SCK_Port, hx->PD_SCK_Pin, GPIO_PIN_SET);
+		for (uint16_t i = 0; i < SMALL_DELAY; i++) {} // Small delay
+		samples[i] = hx->DOUT_Port->IDR;
+		HAL_GPIO_WritePin(hx->PD_SCK_Port, hx->PD_SCK_Pin, GPIO_PIN_RESET);
+		for (uint16_t i = 0; i < SMALL_DELAY; i++) {} // Small delay
+	}
+
+	// Set the channel and the gain factor for the next reading using the clock pin.
+	for (unsigned int i = 0; i < hx->GAIN; i++) {
+		HAL_GPIO_WritePin(hx->PD_SCK_Port, hx->PD_SCK_Pin, GPIO_PIN_SET);
+		for (uint16_t i = 0; i < SMALL_DELAY; i++) {} // Small delay
+		HAL_GPIO_WritePin(hx->PD_SCK_Port, hx->PD_SCK_Pin, GPIO_PIN_RESET);
+		for (uint16_t i = 0; i < SMALL_DELAY; i++) { } // Small delay
+	}
+
+	// Pick each channel's bit out of the snapshots
+	hx->saturated = 0;
+	for (uint8_t c = 0; c < hx->channels; c++) {
+		uint16_t pin = hx->DOUT_Pins[c];
+		uint32_t value = 0;
+		for (uint8_t i = 0; i < 24; i++) {
+			value = (value << 1) | ((samples[i] & pin) ? 1 : 0);
+		}
+		// The chip clamps to 0x7FFFFF / 0x800000 outside its input range
+		if (value == 0x7FFFFF || value == 0x800000) {
+			hx->saturated |= 1 << c;
+		}
+		// Replicate the most significant bit to pad out a 32-bit signed integer
+		if (value & 0x800000) {
+			value |= 0xFF000000;
+		}
+		values[c] = (long) (int32_t) value;
+	}
+}
+
+void HX711_multi_read_average(HX711_Multi *hx, uint8_t times, long *values) {
+	long sample[HX711_MAX_CHANNELS];
+	long sum[HX711_MAX_CHANNELS] = { 0 };
+	for (uint8_t i = 0; i < times; i++) {
+		HX711_multi_read(hx, sample);
+		for (uint8_t c = 0; c < hx->channels; c++) {
+			sum[c] += sample[c];
+		}
+		HAL_Delay(0);
+	}
+	for (uint8_t c = 0; c < hx->channels; c++) {
+		values[c] = sum[c] / times;
+	}
+}
+
+void HX711_multi_get_units(HX711_Multi *hx, uint8_t times, float *units) {
+	long values[HX711_MAX_CHANNELS];
+	HX711_multi_read_average(hx, times, values);
+	for (uint8_t c = 0; c < hx->channels; c++) {
+		units[c] = (values[c] - hx->OFFSET[c]) / hx->SCALE[c];
+	}
+}
+
+float HX711_multi_get_total(HX711_Multi *hx, uint8_t times) {
+	float units[HX711_MAX_CHANNELS];
+	float total = 0;
+	HX711_multi_get_units(hx, times, units);
+	for (uint8_t c = 0; c < hx->channels; c++) {
+		total += units[c];
+	}
+	return total;
+}
+
+void HX711_multi_tare(HX711_Multi *hx, uint8_t times) {
+	HX711_multi_read_average(hx, times, hx->OFFSET);
+}
+
+void HX711_multi_set_scale(HX711_Multi *hx, uint8_t channel, float scale) {
+	if (channel < hx->channels) {
+		hx->SCALE[channel] = scale;
+	}
+}
+
+void HX711_multi_set_offset(HX711_Multi *hx, uint8_t channel, long offset) {
+	if (channel < hx->channels) {
+		hx->OFFSET[channel] = offset;
+	}
+}
+
+void HX711_schedule_begin(HX711_Schedule *s, HX711_Multi *hx, const HX711_Slot *slots, uint8_t slotCount, uint8_t settle) {
+	if (slotCount > HX711_SCHEDULE_MAX) {
+		slotCount = HX711_SCHEDULE_MAX;
+	}
+	s->hx = hx;
+	s->slotCount = slotCount;
+	s->settle = settle;
+	for (uint8_t i = 0; i < slotCount; i++) {
+		s->slots[i] = slots[i];
+		s->count[i] = 0;
+	}
+	s->dropped = 0;
+	HX711_schedule_restart(s, settle);
+}
+
+void HX711_schedule_restart(HX711_Schedule *s, uint8_t settle) {
+	// What the chips are converting now is not known; the first sample is
+	// dropped and selects slot 0
+	s->primed = false;
+	s->slot = 0;
+	s->position = 0;
+	s->slotSettle = settle;
+}
+
+int HX711_schedule_poll(HX711_Schedule *s) {
+	long values[HX711_MAX_CHANNELS];
+	uint8_t nextSlot = s->slot;
+	uint8_t nextPosition = s->position + 1;
+	uint8_t nextSettle = s->slotSettle;
+	int kept = -1;
+
+	if (s->slotCount == 0 || !HX711_multi_is_ready(s->hx)) {
+		return -1;
+	}
+
+	// Pick the conversion after this one, which this read programs
+	if (!s->primed) {
+		nextSlot = 0;
+		nextPosition = 0;
+	} else if (nextPosition >= s->slotSettle + s->slots[s->slot].samples) {
+		nextSlot = (s->slot + 1) % s->slotCount;
+		nextPosition = 0;
+		nextSettle = s->slots[nextSlot].gain != s->slots[s->slot].gain ? s->settle : 0;
+	}
+	HX711_multi_set_gain(s->hx, s->slots[nextSlot].gain);
+	HX711_multi_read(s->hx, values);
+
+	if (s->primed && s->position >= s->slotSettle) {
+		// A settled sample of the current slot
+		uint8_t slot = s->slot;
+		float alpha = s->slots[slot].alpha;
+		for (uint8_t c = 0; c < s->hx->channels; c++) {
+			s->last[slot][c] = values[c];
+			if (s->count[slot] == 0) {
+				s->filtered[slot][c] = values[c];
+			} else {
+				s->filtered[slot][c] += alpha * (values[c] - s->filtered[slot][c]);
+			}
+		}
+		s->count[slot]++;
+		kept = slot;
+	} else {
+		s->dropped++;
+	}
+
+	s->primed = true;
+	s->slot = nextSlot;
+	s->position = nextPosition;
+	s->slotSettle = nextSettle;
+	return kept;
+}
+
+float HX711_schedule_value(HX711_Schedule *s, uint8_t slot, uint8_t channel) {
+	return s->filtered[slot][channel];
+}
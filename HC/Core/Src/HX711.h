@@ -84,4 +84,124 @@ void HX711_power_down(HX711 *hx);
 // wakes up the chip after power down mode
 void HX711_power_up(HX711 *hx);
 
+// Several HX711s on one shared PD_SCK, e.g. the four load cells of a platform
+// scale. All DOUT pins must be on the same GPIO port; every clock edge then
+// samples all channels with a single IDR read, so N channels take as long to
+// read as one.
+#define HX711_MAX_CHANNELS 8
+
+typedef struct {
+	// Shared Power Down and Serial Clock Input Pin - This must be output!
+	GPIO_TypeDef *PD_SCK_Port;
+	uint16_t PD_SCK_Pin;
+
+	// Serial Data Output Pins, one per channel - These must be pull-up!
+	GPIO_TypeDef *DOUT_Port;
+	uint16_t DOUT_Pins[HX711_MAX_CHANNELS];
+	uint16_t DOUT_Mask;	// all DOUT pins
+	uint8_t channels;
+
+	uint8_t GAIN;		// same for every channel, see HX711_set_gain()
+
+	// RATE pin of the chips if a GPIO drives it, else NULL
+	GPIO_TypeDef *RATE_Port;
+	uint16_t RATE_Pin;
+	uint8_t rate;		// samples per second, 10 or 80
+
+	long OFFSET[HX711_MAX_CHANNELS];
+	float SCALE[HX711_MAX_CHANNELS];
+
+	// Diagnostics of the last read: channels that were at full scale
+	uint16_t saturated;
+} HX711_Multi;
+
+// Initialize with the shared clock pin and the DOUT pin of each channel
+void HX711_multi_begin(HX711_Multi *hx, GPIO_TypeDef* PD_SCK_Port, uint16_t PD_SCK_Pin, GPIO_TypeDef* DOUT_Port, const uint16_t *DOUT_Pins, uint8_t channels, uint8_t gain);
+
+// Bit per channel whose DOUT is low (data ready); a channel that never shows up
+// here is not connected or not powered
+uint16_t HX711_multi_ready_mask(HX711_Multi *hx);
+
+// Check if every channel is ready
+bool HX711_multi_is_ready(HX711_Multi *hx);
+
+// Wait for every channel to become ready until timeout
+bool HX711_multi_wait_ready_timeout(HX711_Multi *hx, unsigned long timeout, unsigned long delay_ms);
+
+// Same as HX711_set_gain(), for every channel
+void HX711_multi_set_gain(HX711_Multi *hx, uint8_t gain);
+
+// GPIO output wired to the RATE pin of every chip (low = 10 SPS, high = 80 SPS)
+void HX711_multi_set_rate_pin(HX711_Multi *hx, GPIO_TypeDef* RATE_Port, uint16_t RATE_Pin);
+
+// Select 10 or 80 samples per second. Returns false if no RATE pin is set.
+// The chips need about 4 conversions to settle at the new rate.
+bool HX711_multi_set_rate(HX711_Multi *hx, uint8_t rate);
+
+// Waits for every channel to be ready and reads all of them in one pass;
+// values gets one reading per channel
+void HX711_multi_read(HX711_Multi *hx, long *values);
+
+// Average of times readings per channel
+void HX711_multi_read_average(HX711_Multi *hx, uint8_t times, long *values);
+
+// (reading - OFFSET) / SCALE per channel
+void HX711_multi_get_units(HX711_Multi *hx, uint8_t times, float *units);
+
+// Sum of the units of every channel, e.g. the load on all corners
+float HX711_multi_get_total(HX711_Multi *hx, uint8_t times);
+
+// Set the OFFSET of every channel to its current reading
+void HX711_multi_tare(HX711_Multi *hx, uint8_t times);
+
+void HX711_multi_set_scale(HX711_Multi *hx, uint8_t channel, float scale);
+void HX711_multi_set_offset(HX711_Multi *hx, uint8_t channel, long offset);
+
+// Time-multiplexing of channel A and B (or two gains) on the same chips.
+// The gain pulses of one read select the next conversion, so the schedule
+// programs each conversion one read ahead. After a change of channel or
+// gain the first `settle` samples are dropped, and each slot of the
+// schedule feeds its own filtered stream. For example {128, 4} and {32, 1}
+// with settle 1 take 7 conversions per round: 4 kept on A, 1 dropped,
+// 1 kept on B, 1 dropped.
+#define HX711_SCHEDULE_MAX 4
+
+typedef struct {
+	uint8_t gain;		// 128 or 64 for channel A, 32 for channel B
+	uint8_t samples;	// samples kept per turn, after the dropped ones
+	float alpha;		// smoothing of the stream, 1 = none
+} HX711_Slot;
+
+typedef struct {
+	HX711_Multi *hx;
+	HX711_Slot slots[HX711_SCHEDULE_MAX];
+	uint8_t slotCount;
+	uint8_t settle;		// samples dropped after a change of channel or gain
+
+	// The conversion in progress
+	bool primed;		// false until the chips run a scheduled conversion
+	uint8_t slot;
+	uint8_t position;	// samples of this turn so far, including dropped ones
+	uint8_t slotSettle;	// samples this turn drops, 0 if the gain did not change
+
+	// One stream per slot
+	long last[HX711_SCHEDULE_MAX][HX711_MAX_CHANNELS];
+	float filtered[HX711_SCHEDULE_MAX][HX711_MAX_CHANNELS];
+	uint32_t count[HX711_SCHEDULE_MAX];
+	uint32_t dropped;
+} HX711_Schedule;
+
+void HX711_schedule_begin(HX711_Schedule *s, HX711_Multi *hx, const HX711_Slot *slots, uint8_t slotCount, uint8_t settle);
+
+// Reads a sample if every chip has one ready, without waiting. Returns the
+// slot whose stream got a new sample, or -1 (nothing ready, or dropped).
+int HX711_schedule_poll(HX711_Schedule *s);
+
+// Start over from slot 0, dropping `settle` samples first; after a rate
+// change, or anything else that disturbs the chips
+void HX711_schedule_restart(HX711_Schedule *s, uint8_t settle);
+
+// Filtered raw value of one channel in a slot's stream
+float HX711_schedule_value(HX711_Schedule *s, uint8_t slot, uint8_t channel);
+
 #endif /* SRC_HX711_HX711_H_ */
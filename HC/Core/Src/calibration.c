@@ -0,0 +1,128 @@
+/*
+ * calibration.c
+ */
+
+#include "calibration.h"
+#include <stddef.h>
+#include <string.h>
+
+// CRC-32 (IEEE), nibble-wise table as in Webcode/src/crc32.cpp
+static const uint32_t crc_nibble_table[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+	0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+	0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint32_t crc32(const void *data, size_t len) {
+	const uint8_t *p = (const uint8_t *)data;
+	uint32_t crc = 0xFFFFFFFF;
+	while (len--) {
+		crc ^= *p++;
+		crc = (crc >> 4) ^ crc_nibble_table[crc & 0x0F];
+		crc = (crc >> 4) ^ crc_nibble_table[crc & 0x0F];
+	}
+	return ~crc;
+}
+
+// Slopes from each point to the next; the last segment continues the one
+// before it. False if a slope does not fit the fixed-point format.
+static bool Calibration_fit(Calibration *cal) {
+	Calibration_Segment *s = cal->segment;
+	for (uint8_t i = 0; i + 1 < cal->points; i++) {
+		int64_t slope = ((int64_t)(s[i + 1].grams - s[i].grams) << CAL_FRAC_BITS) / (s[i + 1].counts - s[i].counts);
+		if (slope <= 0 || slope > INT32_MAX) {
+			return false;
+		}
+		s[i].slope = (int32_t)slope;
+	}
+	s[cal->points - 1].slope = cal->points > 1 ? s[cal->points - 2].slope : CAL_DEFAULT_SLOPE;
+	return true;
+}
+
+void Calibration_default(Calibration *cal, uint8_t cells) {
+	memset(cal, 0, sizeof(*cal));
+	cal->cells = cells > CAL_MAX_CELLS ? CAL_MAX_CELLS : cells;
+	cal->offset[0] = CAL_DEFAULT_OFFSET;
+	Calibration_clear_points(cal);
+}
+
+void Calibration_clear_points(Calibration *cal) {
+	cal->points = 1;
+	cal->segment[0].counts = 0;
+	cal->segment[0].grams = 0;
+	cal->segment[0].slope = CAL_DEFAULT_SLOPE;
+}
+
+Calibration_Status Calibration_add_point(Calibration *cal, int32_t counts, int32_t grams) {
+	Calibration next = *cal;
+	Calibration_Segment *s = next.segment;
+	uint8_t i;
+
+	// Every point lies above the zero point, which the insertion below
+	// relies on to stop at index 1
+	if (grams <= 0 || counts - s[0].counts < CAL_MIN_SPAN) {
+		return CAL_BAD_ARG;
+	}
+
+	// Re-measuring a weight replaces its old point
+	for (i = 1; i < next.points; i++) {
+		if (s[i].grams == grams) {
+			memmove(&s[i], &s[i + 1], (next.points - i - 1) * sizeof(s[0]));
+			next.points--;
+			break;
+		}
+	}
+	if (next.points >= CAL_MAX_POINTS) {
+		return CAL_FULL;
+	}
+
+	// Insert in order; both neighbours must be lighter below and heavier above
+	for (i = next.points; i > 1 && s[i - 1].counts > counts; i--);
+	if (counts - s[i - 1].counts < CAL_MIN_SPAN || grams <= s[i - 1].grams) {
+		return CAL_BAD_ARG;
+	}
+	if (i < next.points && (s[i].counts - counts < CAL_MIN_SPAN || grams >= s[i].grams)) {
+		return CAL_BAD_ARG;
+	}
+	memmove(&s[i + 1], &s[i], (next.points - i) * sizeof(s[0]));
+	s[i].counts = counts;
+	s[i].grams = grams;
+	next.points++;
+
+	if (!Calibration_fit(&next)) {
+		return CAL_BAD_ARG;
+	}
+	*cal = next;
+	return CAL_OK;
+}
+
+void Calibration_seal(Calibration *cal, uint32_t sequence) {
+	cal->magic = CAL_MAGIC;
+	cal->version = CAL_VERSION;
+	cal->size = sizeof(Calibration);
+	cal->sequence = sequence;
+	cal->reserved = 0;
+	cal->crc = crc32(cal, offsetof(Calibration, crc));
+}
+
+bool Calibration_valid(const Calibration *cal) {
+	if (cal->magic != CAL_MAGIC || cal->version != CAL_VERSION || cal->size != sizeof(Calibration)) {
+		return false;
+	}
+	if (cal->crc != crc32(cal, offsetof(Calibration, crc))) {
+		return false;
+	}
+	if (cal->cells < 1 || cal->cells > CAL_MAX_CELLS || cal->points < 1 || cal->points > CAL_MAX_POINTS) {
+		return false;
+	}
+	if (cal->segment[0].counts != 0 || cal->segment[0].grams != 0) {
+		return false;
+	}
+	for (uint8_t i = 1; i < cal->points; i++) {
+		if (cal->segment[i].counts <= cal->segment[i - 1].counts) {
+			return false;
+		}
+	}
+	return true;
+}
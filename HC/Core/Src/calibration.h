@@ -0,0 +1,99 @@
+/*
+ * calibration.h
+ *
+ * Multi-point scale calibration. Known weights put on the scale give
+ * calibration points (net counts, grams); between neighbouring points the
+ * weight is interpolated linearly, beyond the first and last point the
+ * nearest segment is extended. The tare is the zero point, so a single
+ * known weight gives the usual two-point line and more weights correct a
+ * load cell that is not linear over its range.
+ *
+ * Each segment keeps its slope as grams per count in fixed point, so a
+ * conversion is a segment lookup, one 64-bit multiply and a shift. The
+ * whole calibration is one record that calibration_store.c writes to
+ * flash; the CRC and version are checked here. Plain C without HAL so the
+ * host build (Webcode/bench) runs the same code.
+ */
+
+#ifndef CALIBRATION_H_
+#define CALIBRATION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAL_MAGIC          0x4C414348U   // "HCAL"
+#define CAL_VERSION        1
+#define CAL_MAX_CELLS      8             // HX711_MAX_CHANNELS
+#define CAL_MAX_POINTS     8             // including the zero point
+#define CAL_FRAC_BITS      24            // fraction bits of a slope
+#define CAL_MIN_SPAN       100           // counts between two points
+
+// Until the scale is calibrated: the conversion the firmware used to have
+// hard-coded, grams = (raw - 511400) / 200
+#define CAL_DEFAULT_OFFSET 511400
+#define CAL_DEFAULT_SLOPE  ((int32_t)((1 << CAL_FRAC_BITS) / 200))
+
+// Results of calibration commands; also the status byte of the reply frame
+typedef enum {
+	CAL_OK = 0,
+	CAL_BUSY,			// a tare or point is still being measured
+	CAL_BAD_ARG,		// unknown command, or a point that does not fit
+	CAL_FULL,			// CAL_MAX_POINTS reached
+	CAL_UNSTABLE,		// the reading moved while it was measured
+	CAL_FLASH_ERROR
+} Calibration_Status;
+
+typedef struct {
+	int32_t counts;		// net counts where the segment starts
+	int32_t grams;		// weight there
+	int32_t slope;		// grams per count << CAL_FRAC_BITS, up to the next point
+} Calibration_Segment;
+
+// The flash record; written as is, so only fixed-size fields
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t size;		// sizeof(Calibration)
+	uint32_t sequence;	// the newest valid record in flash wins
+	uint8_t cells;
+	uint8_t points;		// segments in use, at least 1 (the zero point)
+	uint16_t reserved;
+	int32_t offset[CAL_MAX_CELLS];	// tare per cell, raw counts
+	Calibration_Segment segment[CAL_MAX_POINTS];	// sorted by counts
+	uint32_t crc;		// CRC-32 of everything above
+} Calibration;
+
+// The uncalibrated default: CAL_DEFAULT_OFFSET on cell 0, CAL_DEFAULT_SLOPE
+void Calibration_default(Calibration *cal, uint8_t cells);
+
+// Drop every point but the zero point; the slope falls back to the default
+void Calibration_clear_points(Calibration *cal);
+
+// Add a point, or re-measure the point with the same weight. The points
+// must keep rising: CAL_BAD_ARG if grams is not positive or the point
+// would fall within CAL_MIN_SPAN counts of, or out of order with, another.
+Calibration_Status Calibration_add_point(Calibration *cal, int32_t counts, int32_t grams);
+
+// Net counts (sum over the cells of raw - offset) to grams
+static inline int32_t Calibration_to_grams(const Calibration *cal, int32_t counts) {
+	const Calibration_Segment *s = &cal->segment[cal->points - 1];
+	while (s > cal->segment && counts < s->counts) s--;
+	int64_t delta = (int64_t)(counts - s->counts) * s->slope;
+	return s->grams + (int32_t)((delta + (1 << (CAL_FRAC_BITS - 1))) >> CAL_FRAC_BITS);
+}
+
+// Fill in the header and CRC before writing
+void Calibration_seal(Calibration *cal, uint32_t sequence);
+
+// A record read back from flash: magic, version, size, CRC and contents
+bool Calibration_valid(const Calibration *cal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CALIBRATION_H_ */
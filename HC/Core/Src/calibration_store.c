@@ -0,0 +1,76 @@
+/*
+ * calibration_store.c
+ */
+
+#include "calibration_store.h"
+#include <string.h>
+
+#define CAL_STORE_SLOTS (CAL_STORE_SIZE / CAL_STORE_SLOT)
+#define CAL_ERASED      0xFFFFFFFFU
+
+_Static_assert(sizeof(Calibration) <= CAL_STORE_SLOT && sizeof(Calibration) % 4 == 0,
+		"a calibration record is programmed word by word into one slot");
+
+static const Calibration *CalibrationStore_slot(uint32_t slot) {
+	return (const Calibration *)(uintptr_t)(CAL_STORE_ADDR + slot * CAL_STORE_SLOT);
+}
+
+// Slots are used in order, so the first erased one ends the log
+static uint32_t CalibrationStore_scan(const Calibration **newest) {
+	uint32_t slot;
+	*newest = NULL;
+	for (slot = 0; slot < CAL_STORE_SLOTS; slot++) {
+		const Calibration *rec = CalibrationStore_slot(slot);
+		if (rec->magic == CAL_ERASED) {
+			break;
+		}
+		if (Calibration_valid(rec) && (!*newest || rec->sequence > (*newest)->sequence)) {
+			*newest = rec;
+		}
+	}
+	return slot;
+}
+
+bool CalibrationStore_load(Calibration *cal) {
+	const Calibration *newest;
+	CalibrationStore_scan(&newest);
+	if (!newest) {
+		return false;
+	}
+	memcpy(cal, newest, sizeof(*cal));
+	return true;
+}
+
+Calibration_Status CalibrationStore_save(Calibration *cal) {
+	const Calibration *newest;
+	uint32_t slot = CalibrationStore_scan(&newest);
+	HAL_StatusTypeDef status = HAL_OK;
+
+	Calibration_seal(cal, newest ? newest->sequence + 1 : 1);
+
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+			FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+	if (slot >= CAL_STORE_SLOTS) {
+		FLASH_EraseInitTypeDef erase = {
+			.TypeErase = FLASH_TYPEERASE_SECTORS,
+			.Sector = CAL_STORE_SECTOR,
+			.NbSectors = 1,
+			.VoltageRange = FLASH_VOLTAGE_RANGE_3,
+		};
+		uint32_t badSector;
+		status = HAL_FLASHEx_Erase(&erase, &badSector);
+		slot = 0;
+	}
+	const uint32_t *words = (const uint32_t *)cal;
+	uint32_t address = CAL_STORE_ADDR + slot * CAL_STORE_SLOT;
+	for (uint32_t i = 0; status == HAL_OK && i < sizeof(*cal) / 4; i++) {
+		status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + i * 4, words[i]);
+	}
+	HAL_FLASH_Lock();
+
+	if (status != HAL_OK || memcmp(CalibrationStore_slot(slot), cal, sizeof(*cal)) != 0) {
+		return CAL_FLASH_ERROR;
+	}
+	return CAL_OK;
+}
@@ -0,0 +1,30 @@
+/*
+ * calibration_store.h
+ *
+ * Keeps the scale calibration in the last flash sector (sector 23, 128 KB
+ * at 0x081E0000), which STM32F429ZITX_FLASH.ld leaves out of the program
+ * area so a reflash does not touch it. Saves are appended in 256-byte
+ * slots; the sector is only erased when all 512 are used, and at boot the
+ * newest record with a good CRC is loaded. A record interrupted by a reset
+ * fails its CRC and the one before it is used.
+ */
+
+#ifndef CALIBRATION_STORE_H_
+#define CALIBRATION_STORE_H_
+
+#include "main.h"
+#include "calibration.h"
+#include "stdbool.h"
+
+#define CAL_STORE_SECTOR   FLASH_SECTOR_23
+#define CAL_STORE_ADDR     0x081E0000U
+#define CAL_STORE_SIZE     0x20000U
+#define CAL_STORE_SLOT     256U
+
+// Load the newest valid record. False (and cal untouched) if there is none.
+bool CalibrationStore_load(Calibration *cal);
+
+// Seal and append cal. Erasing a full sector blocks for about a second.
+Calibration_Status CalibrationStore_save(Calibration *cal);
+
+#endif /* CALIBRATION_STORE_H_ */
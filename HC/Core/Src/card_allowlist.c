@@ -0,0 +1,75 @@
+/*
+ * card_allowlist.c
+ */
+
+#include "card_allowlist.h"
+#include <string.h>
+
+static uint32_t CardAllowlist_key(const uint8_t *uid) {
+	return ((uint32_t)uid[0] << 24) | ((uint32_t)uid[1] << 16) | ((uint32_t)uid[2] << 8) | uid[3];
+}
+
+// Index of key, or where it would be inserted
+static uint16_t CardAllowlist_search(const CardAllowlist *list, uint32_t key) {
+	uint16_t lo = 0, hi = list->count;
+	while (lo < hi) {
+		uint16_t mid = (lo + hi) / 2;
+		if (list->uids[mid] < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+void CardAllowlist_begin(CardAllowlist *list) {
+	CardAllowlist_clear(list);
+	list->synced = false;
+}
+
+void CardAllowlist_clear(CardAllowlist *list) {
+	list->count = 0;
+	list->checksum = 0;
+}
+
+bool CardAllowlist_add(CardAllowlist *list, const uint8_t *uid) {
+	uint32_t key = CardAllowlist_key(uid);
+	uint16_t i = CardAllowlist_search(list, key);
+	if ((i < list->count && list->uids[i] == key) || list->count >= ALLOWLIST_MAX_CARDS) {
+		return false;
+	}
+	memmove(&list->uids[i + 1], &list->uids[i], (list->count - i) * sizeof(list->uids[0]));
+	list->uids[i] = key;
+	list->count++;
+	list->checksum ^= CardAllowlist_mix(uid);
+	return true;
+}
+
+bool CardAllowlist_remove(CardAllowlist *list, const uint8_t *uid) {
+	uint32_t key = CardAllowlist_key(uid);
+	uint16_t i = CardAllowlist_search(list, key);
+	if (i >= list->count || list->uids[i] != key) {
+		return false;
+	}
+	memmove(&list->uids[i], &list->uids[i + 1], (list->count - i - 1) * sizeof(list->uids[0]));
+	list->count--;
+	list->checksum ^= CardAllowlist_mix(uid);
+	return true;
+}
+
+bool CardAllowlist_contains(const CardAllowlist *list, const uint8_t *uid) {
+	uint32_t key = CardAllowlist_key(uid);
+	uint16_t i = CardAllowlist_search(list, key);
+	return i < list->count && list->uids[i] == key;
+}
+
+uint32_t CardAllowlist_mix(const uint8_t *uid) {
+	uint32_t h = CardAllowlist_key(uid);
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35;
+	h ^= h >> 16;
+	return h;
+}
@@ -0,0 +1,50 @@
+/*
+ * card_allowlist.h
+ *
+ * Local copy of the ESP32's valid cards, so a card can be accepted or
+ * rejected the moment it is read. The 4-byte UIDs are kept as a sorted
+ * array of big-endian integers and found by binary search. The ESP32 owns
+ * the list: it sends every add and remove as a delta, and the whole list
+ * when the count and checksum this side reports do not match its own.
+ * The checksum is the XOR of CardAllowlist_mix() over the cards, so both
+ * sides get the same value whatever order they hold the cards in. Plain C
+ * without HAL.
+ */
+
+#ifndef CARD_ALLOWLIST_H_
+#define CARD_ALLOWLIST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ALLOWLIST_MAX_CARDS  1024   // MAX_VALID_CARDS on the ESP32
+
+typedef struct {
+	uint32_t uids[ALLOWLIST_MAX_CARDS];	// sorted
+	uint16_t count;
+	uint32_t checksum;
+	bool synced;		// the last full list arrived complete
+} CardAllowlist;
+
+// Empty list, not synced
+void CardAllowlist_begin(CardAllowlist *list);
+void CardAllowlist_clear(CardAllowlist *list);
+
+// False if the card is already there (add), missing (remove) or the list is full
+bool CardAllowlist_add(CardAllowlist *list, const uint8_t *uid);
+bool CardAllowlist_remove(CardAllowlist *list, const uint8_t *uid);
+
+bool CardAllowlist_contains(const CardAllowlist *list, const uint8_t *uid);
+
+// Checksum term of one card (the murmur3 finalizer of its UID)
+uint32_t CardAllowlist_mix(const uint8_t *uid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CARD_ALLOWLIST_H_ */
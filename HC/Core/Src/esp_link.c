@@ -0,0 +1,81 @@
+/*
+ * esp_link.c
+ */
+
+#include "esp_link.h"
+#include <string.h>
+
+// Payload bytes between the type and end byte, 0 for an unknown type
+static uint8_t EspLink_payload_size(uint8_t type) {
+	switch (type) {
+	case ESP_LINK_TYPE_VALID_CARD:
+	case ESP_LINK_TYPE_SCALE:
+		return 5;
+	default:
+		return 0;
+	}
+}
+
+void EspLink_begin(EspLink *link, UART_HandleTypeDef *huart) {
+	memset(link, 0, sizeof(*link));
+	link->huart = huart;
+	HAL_UART_Receive_IT(huart, &link->rxByte, 1);
+}
+
+void EspLink_rx_complete(EspLink *link) {
+	uint16_t next = (link->head + 1) & (ESP_LINK_RX_BUFFER - 1);
+	if (next != link->tail) {
+		link->ring[link->head] = link->rxByte;
+		link->head = next;
+	} else {
+		link->overruns++;
+	}
+	HAL_UART_Receive_IT(link->huart, &link->rxByte, 1);
+}
+
+void EspLink_rx_error(EspLink *link) {
+	// An overrun or framing error ends the reception; pick it up again
+	link->overruns++;
+	HAL_UART_Receive_IT(link->huart, &link->rxByte, 1);
+}
+
+bool EspLink_poll(EspLink *link, EspLink_Frame *frame) {
+	if (link->len && HAL_GetTick() - link->startTick > ESP_LINK_TIMEOUT_MS) {
+		link->len = 0;
+		link->dropped++;
+	}
+
+	while (link->tail != link->head) {
+		uint8_t byte = link->ring[link->tail];
+		link->tail = (link->tail + 1) & (ESP_LINK_RX_BUFFER - 1);
+
+		if (link->len == 0) {
+			if (byte == ESP_LINK_START) {
+				link->len = 1;
+				link->startTick = HAL_GetTick();
+			}
+		} else if (link->len == 1) {
+			link->payload = EspLink_payload_size(byte);
+			if (link->payload == 0) {
+				link->len = 0;
+				link->dropped++;
+			} else {
+				link->frame.type = byte;
+				link->frame.length = link->payload;
+				link->len = 2;
+			}
+		} else if (link->len < 2 + link->payload) {
+			link->frame.data[link->len - 2] = byte;
+			link->len++;
+		} else {
+			link->len = 0;
+			if (byte != ESP_LINK_END) {
+				link->dropped++;
+				continue;
+			}
+			*frame = link->frame;
+			return true;
+		}
+	}
+	return false;
+}
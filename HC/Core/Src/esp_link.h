@@ -0,0 +1,62 @@
+/*
+ * esp_link.h
+ *
+ * Frames the ESP32 sends to this board on USART1, the same line the card
+ * frames and debug text go out on:
+ *   AA 02 OP UID[4] 55                    valid card list change
+ *   AA 05 OP VALUE[4, big-endian] 55      scale calibration command
+ * Bytes arrive by interrupt into a ring buffer; EspLink_poll() takes them
+ * out in the main loop and returns each complete frame. Bytes outside a
+ * frame, frames of unknown type or without the end byte, and frames left
+ * incomplete for ESP_LINK_TIMEOUT_MS are dropped.
+ */
+
+#ifndef ESP_LINK_H_
+#define ESP_LINK_H_
+
+#include "main.h"
+#include "stdbool.h"
+
+#define ESP_LINK_START             0xAA
+#define ESP_LINK_END               0x55
+#define ESP_LINK_TYPE_VALID_CARD   0x02    // allowlist delta, see card_allowlist.h
+#define ESP_LINK_TYPE_SCALE        0x05    // calibration command, answered with 0x06
+#define ESP_LINK_RX_BUFFER         256     // ring buffer, power of two
+#define ESP_LINK_MAX_PAYLOAD       16
+#define ESP_LINK_TIMEOUT_MS        100
+
+typedef struct {
+	uint8_t type;
+	uint8_t length;
+	uint8_t data[ESP_LINK_MAX_PAYLOAD];
+} EspLink_Frame;
+
+typedef struct {
+	UART_HandleTypeDef *huart;
+
+	// Written by the receive interrupt
+	uint8_t rxByte;
+	volatile uint8_t ring[ESP_LINK_RX_BUFFER];
+	volatile uint16_t head;
+	volatile uint32_t overruns;	// bytes lost to a full ring or a UART overrun
+
+	// Frame in progress, main loop only
+	uint16_t tail;
+	EspLink_Frame frame;
+	uint8_t len;				// bytes of the frame seen, start byte included
+	uint8_t payload;			// payload bytes the frame type needs
+	uint32_t startTick;
+	uint32_t dropped;			// frames dropped
+} EspLink;
+
+// Start receiving on huart; the UART interrupt must be enabled
+void EspLink_begin(EspLink *link, UART_HandleTypeDef *huart);
+
+// Call from HAL_UART_RxCpltCallback and HAL_UART_ErrorCallback for link->huart
+void EspLink_rx_complete(EspLink *link);
+void EspLink_rx_error(EspLink *link);
+
+// Take the received bytes; true and frame filled for each complete frame
+bool EspLink_poll(EspLink *link, EspLink_Frame *frame);
+
+#endif /* ESP_LINK_H_ */
@@ -23,18 +23,70 @@
 /* USER CODE BEGIN Includes */
 #include "tm_stm32f4_mfrc522.h"
 #include "HX711.h"
+#include "weight_filter.h"
+#include "calibration.h"
+#include "calibration_store.h"
+#include "esp_link.h"
+#include "zero_tracker.h"
+#include "card_allowlist.h"
 #include <string.h>
 #include <stdio.h>
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
-
+// One MFRC522 per weighing station, all on SPI4 with their own CS pin
+typedef struct {
+    TM_MFRC522_t dev;
+    GPIO_TypeDef* csPort;
+    uint16_t csPin;
+    const char* csName;
+    TM_MFRC522_Status_t status;   // last finished check
+    uint8_t lastId[5];            // last card sent, for READER_REPEAT_MS
+    uint32_t lastSentTick;
+} Reader;
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-
+#define READER_COUNT           2       // entries in readers[]
+#define READER_REPEAT_MS       1000    // a card left on a reader is sent again this often
+#define LED_ON_MS              500
+#define ALLOWLIST_REPORT_MS    30000   // allowlist count and checksum to the ESP32
+#define STATUS_INTERVAL_MS     5000    // "Waiting for card" debug line
+#define SCALE_CELLS            1       // load cells in scale_dout_pins
+#define SCALE_CHANNEL_B        0       // 1 = also sample channel B, see scale_slots
+#define SCALE_SETTLE           1       // samples dropped after a channel/gain switch
+#define SCALE_RATE_SETTLE      4       // samples dropped after a rate switch
+#define SCALE_STEP_GRAMS       2000    // load change that counts as stepping on
+#define CAL_CAPTURE_SAMPLES    16      // weight values averaged for a tare or calibration point
+#define CAL_STABLE_GRAMS       20      // largest spread of those values
+#define BUTTON_DEBOUNCE_MS     50
+
+// Protocol: AA 04 READER UID[4] WEIGHT[4] 55
+#define FRAME_TYPE_READER_CARD 0x04
+#define FRAME_READER_CARD_SIZE 12
+
+// Calibration commands from the ESP32: AA 05 OP VALUE[4] 55, answered with
+// AA 06 OP STATUS POINTS WEIGHT[4] 55 (STATUS is a Calibration_Status)
+#define FRAME_TYPE_SCALE_REPLY 0x06
+#define FRAME_SCALE_REPLY_SIZE 10
+#define SCALE_OP_STATUS        0
+#define SCALE_OP_TARE          1
+#define SCALE_OP_POINT         2       // VALUE = grams now on the scale
+#define SCALE_OP_CLEAR         3
+#define SCALE_OP_SAVE          4
+
+// Valid card list from the ESP32: AA 02 OP UID[4] 55. A full list is
+// CLEAR, one ADD per card and END with the card count in place of the UID.
+// This side reports AA 07 COUNT[2] CHECKSUM[4] 55 and the ESP32 sends the
+// full list when it does not match.
+#define FRAME_TYPE_ALLOWLIST_STATE 0x07
+#define FRAME_ALLOWLIST_STATE_SIZE 9
+#define ALLOWLIST_OP_ADD       1
+#define ALLOWLIST_OP_REMOVE    2
+#define ALLOWLIST_OP_CLEAR     3
+#define ALLOWLIST_OP_END       4
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -49,8 +101,66 @@ UART_HandleTypeDef huart1;
 UART_HandleTypeDef huart2;
 
 /* USER CODE BEGIN PV */
-HX711 hx;
-uint32_t no_card_counter = 0;
+// Load cells of the scale: HX711s sharing PD_SCK on PD0, DOUT pins on GPIOD.
+// A platform scale adds its other corners here (e.g. PD2, PD3, PD4).
+const uint16_t scale_dout_pins[SCALE_CELLS] = { GPIO_PIN_1 };
+HX711_Multi scale;
+// Sampling schedule: the weight on channel A at gain 128, and with
+// SCALE_CHANNEL_B a second cell or reference on channel B at gain 32 once
+// every 4 weight samples. Slot 0 is the weight.
+const HX711_Slot scale_slots[] = {
+    { .gain = 128, .samples = 4, .alpha = 0.5f },
+#if SCALE_CHANNEL_B
+    { .gain = 32, .samples = 1, .alpha = 0.25f },
+#endif
+};
+HX711_Schedule scale_schedule;
+// At 80 SPS (RATE pin on PD7, toggled with the user button on PA0) each
+// cell gets a decimating filter: CIC order 3, decimation 8 gives a settled
+// value 10 times a second for the readings, the average of the last 4
+// samples (50 ms) follows stepping on and off. At 10 SPS the weight is the
+// schedule's smoothed stream.
+const WeightFilter_Config scale_filter_config = { .order = 3, .decimation = 8, .window = 4 };
+WeightFilter cell_filter[SCALE_CELLS];
+// Tare offsets and calibration points, loaded from flash at boot
+Calibration calibration;
+// Zero tracking: once the empty scale has held within 20 g for 5 s the
+// tare follows it by up to 5 g, 1 kg in all until the next tare. After
+// boot the first correction may take up to 2 kg, the drift since the
+// calibration was saved.
+const ZeroTracker_Config zero_config = {
+    .band = 300, .initialBand = 2000, .stable = 20, .window = 10,
+    .holdMs = 5000, .maxStep = 5, .maxTotal = 1000,
+};
+ZeroTracker zero_tracker;
+// Valid cards, kept in step with the ESP32; 4 KB in CCMRAM, which only the
+// CPU uses. NOLOAD, so it costs no flash; CardAllowlist_begin() sets it up.
+CardAllowlist allowlist __attribute__((section(".ccmbss")));
+uint32_t allowlist_tick = 0;
+EspLink esp_link;
+Reader readers[READER_COUNT] = {
+    { .csPort = GPIOE, .csPin = GPIO_PIN_4, .csName = "PE4" },
+    { .csPort = GPIOE, .csPin = GPIO_PIN_3, .csName = "PE3" },
+};
+long raw_value = 0;     // latest HX711 sample, sum of the cells
+long cell_raw[HX711_MAX_CHANNELS];  // the same sample per cell
+int32_t cell_net[HX711_MAX_CHANNELS];  // filtered counts above the tare, per cell
+int weight = 0;        // slow, precise weight in grams
+int fast_weight = 0;   // fast estimate, same units
+int empty_weight = 0;  // weight while nobody is on the scale
+// Tare or calibration point being measured, SCALE_OP_STATUS when none
+uint8_t cal_op = SCALE_OP_STATUS;
+int32_t cal_grams = 0;
+uint8_t cal_samples = 0;
+int64_t cal_sum[HX711_MAX_CHANNELS];
+int cal_min = 0;
+int cal_max = 0;
+bool empty_known = false;
+bool occupied = false;
+uint32_t button_tick = 0;
+GPIO_PinState button_last = GPIO_PIN_RESET;
+uint32_t led_off_tick = 0;
+uint32_t status_tick = 0;
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -67,30 +177,27 @@ static void MX_USART2_UART_Init(void);
 /* USER CODE BEGIN 0 */
 
 // Function to send card data to ESP32 in the required format
-void SendCardDataToESP32(uint8_t* cardId, int32_t weight) {
-    uint8_t data[11];
+void SendCardDataToESP32(uint8_t reader, uint8_t* cardId, int32_t weight) {
+    uint8_t data[FRAME_READER_CARD_SIZE];
 
-    // Protocol: AA 01 UID[4] WEIGHT[4] 55
+    // Protocol: AA 04 READER UID[4] WEIGHT[4] 55
     data[0] = 0xAA;      // Start byte
-    data[1] = 0x01;      // Type (card data)
+    data[1] = FRAME_TYPE_READER_CARD;
+    data[2] = reader;    // Trạm cân đã đọc thẻ
 
     // Sao chép 4 byte UID
-    memcpy(&data[2], cardId, 4);
+    memcpy(&data[3], cardId, 4);
 
     // Gửi weight dưới dạng big-endian
-    data[6] = (weight >> 24) & 0xFF; // Byte cao nhất
-    data[7] = (weight >> 16) & 0xFF;
-    data[8] = (weight >> 8) & 0xFF;
-    data[9] = weight & 0xFF;         // Byte thấp nhất
-
-    data[10] = 0x55;     // End byte
-
-    // Debug dữ liệu gửi đi
+    data[7] = (weight >> 24) & 0xFF; // Byte cao nhất
+    data[8] = (weight >> 16) & 0xFF;
+    data[9] = (weight >> 8) & 0xFF;
+    data[10] = weight & 0xFF;        // Byte thấp nhất
 
+    data[11] = 0x55;     // End byte
 
-
-    // Gửi qua UART2 (kết nối với ESP32)
-    HAL_UART_Transmit(&huart1, data, 11, 1000);
+    // Gửi qua UART1 (kết nối với ESP32)
+    HAL_UART_Transmit(&huart1, data, FRAME_READER_CARD_SIZE, 1000);
 }
 
 void Test_SPI_Connection(void) {
@@ -101,11 +208,13 @@ void Test_SPI_Connection(void) {
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
 
     // Test CS pin control
-    HAL_GPIO_WritePin(GPIOE, GPIO_PIN_4, GPIO_PIN_SET);
-    HAL_Delay(10);
-    HAL_GPIO_WritePin(GPIOE, GPIO_PIN_4, GPIO_PIN_RESET);
-    HAL_Delay(10);
-    HAL_GPIO_WritePin(GPIOE, GPIO_PIN_4, GPIO_PIN_SET);
+    for (int r = 0; r < READER_COUNT; r++) {
+        HAL_GPIO_WritePin(readers[r].csPort, readers[r].csPin, GPIO_PIN_SET);
+        HAL_Delay(10);
+        HAL_GPIO_WritePin(readers[r].csPort, readers[r].csPin, GPIO_PIN_RESET);
+        HAL_Delay(10);
+        HAL_GPIO_WritePin(readers[r].csPort, readers[r].csPin, GPIO_PIN_SET);
+    }
 
     sprintf(debug_buf, "CS Pin Test: OK\r\n");
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
@@ -113,38 +222,35 @@ void Test_SPI_Connection(void) {
 
 void Test_HX711_Connection(void) {
     char debug_buf[150];
+    long raw[HX711_MAX_CHANNELS];
+    float units[HX711_MAX_CHANNELS];
 
-    sprintf(debug_buf, "=== HX711 Test ===\r\n");
+    sprintf(debug_buf, "=== HX711 Test (%d cells) ===\r\n", SCALE_CELLS);
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
 
-    // Test HX711 ready state
-    if (HX711_is_ready(&hx)) {
-        sprintf(debug_buf, "HX711 Ready: YES\r\n");
-    } else {
-        sprintf(debug_buf, "HX711 Ready: NO (Check DT pin PD1)\r\n");
+    // Test HX711 ready state; a cell that never gets ready is not connected
+    if (!HX711_multi_wait_ready_timeout(&scale, 1000, 1)) {
+        uint16_t ready = HX711_multi_ready_mask(&scale);
+        for (int c = 0; c < SCALE_CELLS; c++) {
+            if (!(ready & (1 << c))) {
+                sprintf(debug_buf, "HX711 cell %d Ready: NO (Check DT pin 0x%04X on GPIOD)\r\n", c, scale_dout_pins[c]);
+                HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
+            }
+        }
+        return;
     }
+    sprintf(debug_buf, "HX711 Ready: YES\r\n");
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
 
-    // Test raw reading
-    long raw_value = HX711_read(&hx);
-    sprintf(debug_buf, "HX711 Raw Value: %ld\r\n", raw_value);
-    HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
-
-    // Test get_value function
-    float get_value = HX711_get_value(&hx, 1);
-    sprintf(debug_buf, "HX711 Get Value: %.2f\r\n", get_value);
-    HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
-
-    // Test get_units function
-    float get_units = HX711_get_units(&hx, 1);
-    sprintf(debug_buf, "HX711 Get Units: %.2f\r\n", get_units);
-    HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
-
-    // Check scale and offset
-    float scale = HX711_get_scale(&hx);
-    long offset = HX711_get_offset(&hx);
-    sprintf(debug_buf, "HX711 Scale: %.2f, Offset: %ld\r\n", scale, offset);
-    HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
+    // Test raw reading and get_units, per cell
+    HX711_multi_read(&scale, raw);
+    HX711_multi_get_units(&scale, 1, units);
+    for (int c = 0; c < SCALE_CELLS; c++) {
+        sprintf(debug_buf, "HX711 cell %d Raw Value: %ld | Units: %.2f | Scale: %.2f, Offset: %ld%s\r\n",
+                c, raw[c], units[c], scale.SCALE[c], scale.OFFSET[c],
+                (scale.saturated & (1 << c)) ? " | SATURATED" : "");
+        HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
+    }
 
     // Test SCK pin toggle
     HAL_GPIO_WritePin(GPIOD, GPIO_PIN_0, GPIO_PIN_SET);
@@ -154,29 +260,30 @@ void Test_HX711_Connection(void) {
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
 }
 
-void MFRC522_Debug(void) {
+void MFRC522_Debug(uint8_t r) {
     char debug_buf[150];
+    TM_MFRC522_t* dev = &readers[r].dev;
 
-    sprintf(debug_buf, "=== MFRC522 Debug ===\r\n");
+    sprintf(debug_buf, "=== MFRC522 Debug (reader %d) ===\r\n", r);
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
 
     // Test MFRC522 communication
-    uint8_t version = TM_MFRC522_ReadRegister(0x37); // Version register
+    uint8_t version = TM_MFRC522_ReadRegister(dev, 0x37); // Version register
     sprintf(debug_buf, "MFRC522 Version: 0x%02X (Expected: 0x91 or 0x92)\r\n", version);
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
 
     // Test antenna
-    uint8_t antenna = TM_MFRC522_ReadRegister(0x14); // TxControlReg
+    uint8_t antenna = TM_MFRC522_ReadRegister(dev, 0x14); // TxControlReg
     sprintf(debug_buf, "Antenna Status: 0x%02X\r\n", antenna);
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
 
     // Test CommandReg
-    uint8_t command = TM_MFRC522_ReadRegister(0x01); // CommandReg
+    uint8_t command = TM_MFRC522_ReadRegister(dev, 0x01); // CommandReg
     sprintf(debug_buf, "Command Reg: 0x%02X\r\n", command);
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
 
     // Test Status1Reg
-    uint8_t status1 = TM_MFRC522_ReadRegister(0x07); // Status1Reg
+    uint8_t status1 = TM_MFRC522_ReadRegister(dev, 0x07); // Status1Reg
     sprintf(debug_buf, "Status1 Reg: 0x%02X\r\n", status1);
     HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
 
@@ -184,13 +291,290 @@ void MFRC522_Debug(void) {
         sprintf(debug_buf, "ERROR: No communication with MFRC522!\r\n");
         sprintf(debug_buf + strlen(debug_buf), "Check connections:\r\n");
         sprintf(debug_buf + strlen(debug_buf), "- VCC: 3.3V (NOT 5V!)\r\n");
-        sprintf(debug_buf + strlen(debug_buf), "- SDA: PE4\r\n");
+        sprintf(debug_buf + strlen(debug_buf), "- SDA: %s\r\n", readers[r].csName);
         sprintf(debug_buf + strlen(debug_buf), "- SCK: PE2\r\n");
         sprintf(debug_buf + strlen(debug_buf), "- MISO: PE5\r\n");
         sprintf(debug_buf + strlen(debug_buf), "- MOSI: PE6\r\n");
         HAL_UART_Transmit(&huart1, (const uint8_t*)debug_buf, strlen(debug_buf), 1000);
     }
 }
+
+// Switch the scale between 10 SPS and 80 SPS while running. The chips need
+// a few conversions to settle at the new rate and the filters start over.
+void SetScaleRate(uint8_t rate) {
+    char buf[64];
+
+    if (!HX711_multi_set_rate(&scale, rate)) {
+        return;
+    }
+    HX711_schedule_restart(&scale_schedule, SCALE_RATE_SETTLE);
+    for (int c = 0; c < SCALE_CELLS; c++) {
+        WeightFilter_reset(&cell_filter[c]);
+    }
+    sprintf(buf, "Scale rate: %d SPS\r\n", scale.rate);
+    HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+}
+
+// Stepping on and off, from the fast estimate against the empty scale
+void DetectStep(bool new_weight) {
+    char buf[64];
+
+    if (!occupied && new_weight) {
+        empty_weight = weight;
+        empty_known = true;
+    }
+    if (!empty_known) {
+        return;
+    }
+    if (!occupied && fast_weight - empty_weight > SCALE_STEP_GRAMS) {
+        occupied = true;
+        sprintf(buf, "Step on | Fast weight: %d\r\n", fast_weight);
+        HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+    } else if (occupied && fast_weight - empty_weight < SCALE_STEP_GRAMS / 2) {
+        occupied = false;
+        sprintf(buf, "Step off | Fast weight: %d\r\n", fast_weight);
+        HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+    }
+}
+
+void SendScaleReply(uint8_t op, Calibration_Status status) {
+    uint8_t data[FRAME_SCALE_REPLY_SIZE];
+
+    // Protocol: AA 06 OP STATUS POINTS WEIGHT[4] 55
+    data[0] = 0xAA;
+    data[1] = FRAME_TYPE_SCALE_REPLY;
+    data[2] = op;
+    data[3] = status;
+    data[4] = calibration.points;
+    data[5] = (weight >> 24) & 0xFF;
+    data[6] = (weight >> 16) & 0xFF;
+    data[7] = (weight >> 8) & 0xFF;
+    data[8] = weight & 0xFF;
+    data[9] = 0x55;
+    HAL_UART_Transmit(&huart1, data, FRAME_SCALE_REPLY_SIZE, 1000);
+}
+
+// Tare offsets into the HX711 driver. The 80 SPS filters work on raw
+// counts, so they carry on across a change.
+void ApplyCalibration(void) {
+    for (int c = 0; c < SCALE_CELLS; c++) {
+        HX711_multi_set_offset(&scale, c, calibration.offset[c]);
+    }
+}
+
+// Let the zero tracker follow drift of the empty scale. A correction is
+// spread over the cells; only their sum matters for the weight.
+void TrackZero(int32_t net) {
+    char buf[96];
+    int32_t grams;
+    bool limited = zero_tracker.limited;
+    int32_t counts = ZeroTracker_add(&zero_tracker, weight, net, !occupied, HAL_GetTick(), &grams);
+
+    if (counts) {
+        calibration.offset[0] += counts - counts / SCALE_CELLS * SCALE_CELLS;
+        for (int c = 0; c < SCALE_CELLS; c++) {
+            calibration.offset[c] += counts / SCALE_CELLS;
+        }
+        ApplyCalibration();
+        weight -= grams;
+        sprintf(buf, "Zero tracking: %+ld g (%+ld counts), %+ld g since tare\r\n",
+                (long)grams, (long)counts, (long)zero_tracker.total);
+        HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+    } else if (zero_tracker.limited && !limited) {
+        sprintf(buf, "Zero tracking stopped at %+ld g since tare, tare the scale\r\n", (long)zero_tracker.total);
+        HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+    }
+}
+
+// A calibration command from the ESP32. Tare and calibration points are
+// measured over the next CAL_CAPTURE_SAMPLES weight values and answered
+// by CaptureCalibration(); the rest are answered right away.
+void HandleScaleCommand(const EspLink_Frame* frame) {
+    char buf[80];
+    uint8_t op = frame->data[0];
+    int32_t value = ((int32_t)frame->data[1] << 24) | ((int32_t)frame->data[2] << 16) |
+                    ((int32_t)frame->data[3] << 8) | frame->data[4];
+    Calibration_Status status = CAL_OK;
+
+    sprintf(buf, "Scale command %d, value %ld\r\n", op, (long)value);
+    HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+
+    if (cal_op != SCALE_OP_STATUS && op != SCALE_OP_STATUS) {
+        SendScaleReply(op, CAL_BUSY);
+        return;
+    }
+    switch (op) {
+    case SCALE_OP_STATUS:
+        break;
+    case SCALE_OP_POINT:
+        if (value <= 0) {
+            status = CAL_BAD_ARG;
+            break;
+        }
+        /* fall through */
+    case SCALE_OP_TARE:
+        cal_op = op;
+        cal_grams = value;
+        cal_samples = 0;
+        memset(cal_sum, 0, sizeof(cal_sum));
+        return;
+    case SCALE_OP_CLEAR:
+        Calibration_clear_points(&calibration);
+        break;
+    case SCALE_OP_SAVE:
+        status = CalibrationStore_save(&calibration);
+        break;
+    default:
+        status = CAL_BAD_ARG;
+        break;
+    }
+    SendScaleReply(op, status);
+}
+
+// Collect one new weight value for a pending tare or calibration point
+void CaptureCalibration(void) {
+    char buf[80];
+    Calibration_Status status = CAL_OK;
+
+    if (cal_op == SCALE_OP_STATUS) {
+        return;
+    }
+    if (cal_samples == 0 || weight < cal_min) cal_min = weight;
+    if (cal_samples == 0 || weight > cal_max) cal_max = weight;
+    for (int c = 0; c < SCALE_CELLS; c++) {
+        cal_sum[c] += cell_net[c];
+    }
+    if (++cal_samples < CAL_CAPTURE_SAMPLES) {
+        return;
+    }
+
+    if (cal_max - cal_min > CAL_STABLE_GRAMS) {
+        status = CAL_UNSTABLE;
+    } else if (cal_op == SCALE_OP_TARE) {
+        for (int c = 0; c < SCALE_CELLS; c++) {
+            calibration.offset[c] += cal_sum[c] / CAL_CAPTURE_SAMPLES;
+        }
+        ApplyCalibration();
+        ZeroTracker_tared(&zero_tracker);
+        weight = 0;
+    } else {
+        int32_t counts = 0;
+        for (int c = 0; c < SCALE_CELLS; c++) {
+            counts += cal_sum[c] / CAL_CAPTURE_SAMPLES;
+        }
+        status = Calibration_add_point(&calibration, counts, cal_grams);
+        if (status == CAL_OK) {
+            weight = Calibration_to_grams(&calibration, counts);
+        }
+    }
+    sprintf(buf, "Calibration %s: status %d, %d points\r\n",
+            cal_op == SCALE_OP_TARE ? "tare" : "point", status, calibration.points);
+    HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+    SendScaleReply(cal_op, status);
+    cal_op = SCALE_OP_STATUS;
+}
+
+void SendAllowlistState(void) {
+    uint8_t data[FRAME_ALLOWLIST_STATE_SIZE];
+
+    // Protocol: AA 07 COUNT[2] CHECKSUM[4] 55
+    data[0] = 0xAA;
+    data[1] = FRAME_TYPE_ALLOWLIST_STATE;
+    data[2] = (allowlist.count >> 8) & 0xFF;
+    data[3] = allowlist.count & 0xFF;
+    data[4] = (allowlist.checksum >> 24) & 0xFF;
+    data[5] = (allowlist.checksum >> 16) & 0xFF;
+    data[6] = (allowlist.checksum >> 8) & 0xFF;
+    data[7] = allowlist.checksum & 0xFF;
+    data[8] = 0x55;
+    HAL_UART_Transmit(&huart1, data, FRAME_ALLOWLIST_STATE_SIZE, 1000);
+    allowlist_tick = HAL_GetTick();
+}
+
+// A change to the valid card list from the ESP32
+void HandleAllowlistFrame(const EspLink_Frame* frame) {
+    char buf[80];
+    const uint8_t* uid = &frame->data[1];
+
+    switch (frame->data[0]) {
+    case ALLOWLIST_OP_ADD:
+        CardAllowlist_add(&allowlist, uid);
+        break;
+    case ALLOWLIST_OP_REMOVE:
+        CardAllowlist_remove(&allowlist, uid);
+        break;
+    case ALLOWLIST_OP_CLEAR:
+        CardAllowlist_clear(&allowlist);
+        allowlist.synced = false;
+        break;
+    case ALLOWLIST_OP_END: {
+        uint32_t expected = ((uint32_t)uid[0] << 24) | ((uint32_t)uid[1] << 16) | ((uint32_t)uid[2] << 8) | uid[3];
+        allowlist.synced = expected == allowlist.count;
+        sprintf(buf, "Allowlist synced: %d of %lu cards%s\r\n", allowlist.count, (unsigned long)expected,
+                allowlist.synced ? "" : " - MISMATCH");
+        HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+        SendAllowlistState();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+    if (huart == esp_link.huart) {
+        EspLink_rx_complete(&esp_link);
+    }
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+    if (huart == esp_link.huart) {
+        EspLink_rx_error(&esp_link);
+    }
+}
+
+// Advance the card check of one reader. Each call only does a few short SPI
+// transfers, so while a reader waits for a card to answer the loop moves on
+// to the next one instead of waiting.
+void ServiceReader(uint8_t r) {
+    Reader* reader = &readers[r];
+    uint8_t CardID[5];
+    char buf[200];
+
+    TM_MFRC522_Status_t status = TM_MFRC522_CheckStep(&reader->dev, CardID);
+    if (status == MI_BUSY) {
+        return;
+    }
+    reader->status = status;
+    if (status != MI_OK) {
+        return;
+    }
+
+    // The same card stays in the field for a while; send it once per READER_REPEAT_MS
+    uint32_t now = HAL_GetTick();
+    if (memcmp(CardID, reader->lastId, 4) == 0 && now - reader->lastSentTick < READER_REPEAT_MS) {
+        return;
+    }
+    memcpy(reader->lastId, CardID, sizeof(reader->lastId));
+    reader->lastSentTick = now;
+
+    // Accept or reject right away from the local allowlist: green LED for a
+    // valid card, red for any other. Until the first full list has arrived
+    // only the ESP32 knows, and every card gets green as before.
+    bool accepted = !allowlist.synced || CardAllowlist_contains(&allowlist, CardID);
+    HAL_GPIO_WritePin(GPIOG, accepted ? GPIO_PIN_13 : GPIO_PIN_14, GPIO_PIN_SET);
+    led_off_tick = now + LED_ON_MS;
+
+    // All readers share the one scale for now; the latest sample is used
+    int card_weight = weight;
+    // Format and send card ID + weight with debug info
+    sprintf(buf, "*** CARD DETECTED (reader %d) ***\r\nID: %02X%02X%02X%02X%02X\r\nRaw: %ld | Weight: %d g | %s\r\n==================\r\n",
+            r, CardID[0], CardID[1], CardID[2], CardID[3], CardID[4], raw_value, card_weight,
+            !allowlist.synced ? "Allowlist not synced" : accepted ? "ACCEPTED" : "REJECTED");
+    HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+
+    SendCardDataToESP32(r, CardID, card_weight);
+}
 /* USER CODE END 0 */
 
 /**
@@ -227,7 +611,7 @@ int main(void)
   MX_USART2_UART_Init();
   /* USER CODE BEGIN 2 */
   // Declare buffer here
-  char buf[200];
+  char buf[256];
 
   // Send initialization message
   sprintf(buf, "=== System Diagnostic ===\r\n");
@@ -236,30 +620,51 @@ int main(void)
   // Test SPI connection first
   Test_SPI_Connection();
 
-  // Initialize MFRC522
-  TM_MFRC522_Init();
+  // Initialize the MFRC522 readers
+  for (int r = 0; r < READER_COUNT; r++) {
+      TM_MFRC522_Init(&readers[r].dev, &hspi4, readers[r].csPort, readers[r].csPin);
 
-  // Debug MFRC522
-  MFRC522_Debug();
+      // Debug MFRC522
+      MFRC522_Debug(r);
+  }
 
-  // Initialize HX711
-  HX711_begin(&hx, GPIOD, GPIO_PIN_0, GPIOD, GPIO_PIN_1, 128);
+  // Initialize HX711s, all cells clocked together by PD0
+  HX711_multi_begin(&scale, GPIOD, GPIO_PIN_0, GPIOD, scale_dout_pins, SCALE_CELLS, 128);
+  HX711_multi_set_rate_pin(&scale, GPIOD, GPIO_PIN_7);
+  for (int c = 0; c < SCALE_CELLS; c++) {
+      WeightFilter_begin(&cell_filter[c], &scale_filter_config);
+  }
 
   // Test HX711 connection BEFORE configuration
   Test_HX711_Connection();
 
-  // Configure HX711
-  HX711_set_scale(&hx, 2); // Set scale to 2 for testing
-  sprintf(buf, "HX711 scale set to 2 for testing\r\n");
+  // Calibration from flash; until the scale is calibrated over the link
+  // the old fixed conversion applies
+  if (CalibrationStore_load(&calibration) && calibration.cells == SCALE_CELLS) {
+      sprintf(buf, "Calibration loaded: record %lu, %d points\r\n", (unsigned long)calibration.sequence, calibration.points);
+  } else {
+      Calibration_default(&calibration, SCALE_CELLS);
+      sprintf(buf, "No calibration in flash, using defaults\r\n");
+  }
   HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+  ApplyCalibration();
+  ZeroTracker_begin(&zero_tracker, &zero_config);
 
-  // Don't tare yet - let's see raw values first
-  // HX711_tare(&hx, 10);
+  HX711_schedule_begin(&scale_schedule, &scale, scale_slots, sizeof(scale_slots) / sizeof(scale_slots[0]), SCALE_SETTLE);
+
+  // Commands from the ESP32 arrive on the same UART
+  CardAllowlist_begin(&allowlist);
+  EspLink_begin(&esp_link, &huart1);
 
   sprintf(buf, "=== Initialization Complete ===\r\n");
   HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
 
   HAL_Delay(2000);
+
+  // The allowlist starts empty; reporting that makes the ESP32 send the
+  // full list. Only now, so the main loop is there to drain the receive
+  // ring while it arrives.
+  SendAllowlistState();
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -267,63 +672,98 @@ int main(void)
   while (1)
   {
     /* USER CODE END WHILE */
-    uint8_t CardID[5];
-    uint8_t status;
-    int weight = 0;
-    long raw_value = 0;
-
-    // Clear CardID array
-    memset(CardID, 0, sizeof(CardID));
-
-    // Always try to read weight first
-    if (HX711_is_ready(&hx)) {
-        raw_value = HX711_read(&hx);
-        weight = HX711_get_units(&hx, 1); // Single reading for speed
+    // Keep the latest weight; the schedule only reads when every cell has
+    // a sample waiting so the readers are never held up. One readout
+    // covers all cells, the weight is the sum of their filtered values.
+    // The calibration turns the summed net counts into grams.
+    if (HX711_schedule_poll(&scale_schedule) == 0) {
+        int32_t net = 0;
+        int32_t fast_net = 0;
+        bool new_weight = true;
+        raw_value = 0;
+        for (int c = 0; c < SCALE_CELLS; c++) {
+            cell_raw[c] = scale_schedule.last[0][c];
+            raw_value += cell_raw[c];
+            if (scale.rate == 80) {
+                // The cell filters run in step, so they all finish together
+                new_weight = WeightFilter_add(&cell_filter[c], cell_raw[c]);
+                fast_net += cell_filter[c].fast - scale.OFFSET[c];
+                cell_net[c] = cell_filter[c].slow - scale.OFFSET[c];
+            } else {
+                cell_net[c] = (int32_t)HX711_schedule_value(&scale_schedule, 0, c) - scale.OFFSET[c];
+            }
+            net += cell_net[c];
+        }
+        if (new_weight) {
+            weight = Calibration_to_grams(&calibration, net);
+            if (cal_op != SCALE_OP_STATUS) {
+                CaptureCalibration();
+            } else {
+                TrackZero(net);
+            }
+        }
+        fast_weight = scale.rate == 80 ? Calibration_to_grams(&calibration, fast_net) : weight;
+        DetectStep(new_weight);
     }
 
-    // Check for RFID card
-    status = TM_MFRC522_Check(CardID);
-
-    if (status == MI_OK) {
-        // Card detected successfully
-        if (HX711_is_ready(&hx)) {
-            raw_value = HX711_read(&hx);
-            weight = HX711_get_units(&hx, 3); // More readings for accuracy
-
+    // Commands from the ESP32
+    EspLink_Frame link_frame;
+    while (EspLink_poll(&esp_link, &link_frame)) {
+        if (link_frame.type == ESP_LINK_TYPE_SCALE) {
+            HandleScaleCommand(&link_frame);
+        } else if (link_frame.type == ESP_LINK_TYPE_VALID_CARD) {
+            HandleAllowlistFrame(&link_frame);
         }
-        weight = weight/ 100 -5114 + 2557;
-        // Format and send card ID + weight with debug info
-        sprintf(buf, "*** CARD DETECTED ***\r\nID: %02X%02X%02X%02X%02X\r\nRaw: %ld | Weight: %d g\r\n==================\r\n",
-                CardID[0], CardID[1], CardID[2], CardID[3], CardID[4], raw_value, weight);
-
-        HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
-
+    }
 
-        SendCardDataToESP32(CardID, weight);
+    // User button: switch between 10 and 80 SPS
+    GPIO_PinState button = HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_0);
+    if (button != button_last && HAL_GetTick() - button_tick >= BUTTON_DEBOUNCE_MS) {
+        button_last = button;
+        button_tick = HAL_GetTick();
+        if (button == GPIO_PIN_SET) {
+            SetScaleRate(scale.rate == 80 ? 10 : 80);
+        }
+    }
 
-        // Turn on LED to indicate card read
-        HAL_GPIO_WritePin(GPIOG, GPIO_PIN_13, GPIO_PIN_SET);
-        HAL_Delay(500);
-        HAL_GPIO_WritePin(GPIOG, GPIO_PIN_13, GPIO_PIN_RESET);
+    // Interleave the readers: one pass gives each of them a step
+    for (int r = 0; r < READER_COUNT; r++) {
+        ServiceReader(r);
+    }
 
-        // Reset counter
-        no_card_counter = 0;
+    uint32_t now = HAL_GetTick();
+    if (led_off_tick && (int32_t)(now - led_off_tick) >= 0) {
+        HAL_GPIO_WritePin(GPIOG, GPIO_PIN_13 | GPIO_PIN_14, GPIO_PIN_RESET);
+        led_off_tick = 0;
+    }
 
-        // Wait to avoid multiple reads
-        HAL_Delay(500);
+    // Let the ESP32 check our copy of the allowlist now and then
+    if (now - allowlist_tick >= ALLOWLIST_REPORT_MS) {
+        SendAllowlistState();
+    }
 
-    } else {
-        // No card detected - only show occasionally
-        no_card_counter++;
-
-        if (no_card_counter >= 10) { // Show every 10th cycle (5 seconds)
-            sprintf(buf, "Waiting for card... | Raw: %ld | Weight: %d g | MFRC522 Status: 0x%02X\r\n", raw_value, weight, status);
-            HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
-            HAL_UART_Transmit(&huart2, 'hello', 5, 1000);
-            no_card_counter = 0;
+    // No card news - only show occasionally
+    if (now - status_tick >= STATUS_INTERVAL_MS) {
+        status_tick = now;
+        int n = sprintf(buf, "Waiting for card... | Raw: %ld | Weight: %d g | Fast: %d | Zero: %+ld g | %d SPS | Allowlist: %d%s | MFRC522 Status:",
+                        raw_value, weight, fast_weight, (long)zero_tracker.total, scale.rate,
+                        allowlist.count, allowlist.synced ? "" : " (not synced)");
+        for (int r = 0; r < READER_COUNT; r++) {
+            n += sprintf(buf + n, " 0x%02X", readers[r].status);
         }
-
-        HAL_Delay(500);
+#if SCALE_CHANNEL_B
+        n += sprintf(buf + n, " | Channel B: %ld", (long)HX711_schedule_value(&scale_schedule, 1, 0));
+#endif
+        if (SCALE_CELLS > 1) {
+            // Per-cell readings show an uneven or failing corner
+            n += sprintf(buf + n, " | Cells:");
+            for (int c = 0; c < SCALE_CELLS; c++) {
+                n += sprintf(buf + n, " %ld%s", cell_raw[c], (scale.saturated & (1 << c)) ? "!" : "");
+            }
+        }
+        sprintf(buf + n, "\r\n");
+        HAL_UART_Transmit(&huart1, (const uint8_t*)buf, strlen(buf), 1000);
+        HAL_UART_Transmit(&huart2, (const uint8_t*)"hello", 5, 1000);
     }
 
     /* USER CODE BEGIN 3 */
@@ -550,7 +990,43 @@ static void MX_GPIO_Init(void)
   HAL_GPIO_Init(GPIOG, &GPIO_InitStruct);
 
   /* USER CODE BEGIN MX_GPIO_Init_2 */
+  /*Configure GPIO pin : PD7, RATE of the HX711s, low = 10 SPS */
+  HAL_GPIO_WritePin(GPIOD, GPIO_PIN_7, GPIO_PIN_RESET);
+  GPIO_InitStruct.Pin = GPIO_PIN_7;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
 
+  /*Configure GPIO pin : PA0, user button (high when pressed) */
+  GPIO_InitStruct.Pin = GPIO_PIN_0;
+  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+  /*Configure GPIO pins : DOUT of the load cells, like PD1 */
+  for (int c = 0; c < SCALE_CELLS; c++) {
+    GPIO_InitStruct.Pin = scale_dout_pins[c];
+    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
+  }
+
+  /*Configure GPIO pin : PG14, red LED for a rejected card */
+  HAL_GPIO_WritePin(GPIOG, GPIO_PIN_14, GPIO_PIN_RESET);
+  GPIO_InitStruct.Pin = GPIO_PIN_14;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOG, &GPIO_InitStruct);
+
+  /*Configure GPIO pin : PE3, CS of the second MFRC522 */
+  HAL_GPIO_WritePin(GPIOE, GPIO_PIN_3, GPIO_PIN_SET);
+  GPIO_InitStruct.Pin = GPIO_PIN_3;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(GPIOE, &GPIO_InitStruct);
   /* USER CODE END MX_GPIO_Init_2 */
 }
 
@@ -19,43 +19,127 @@
  * |----------------------------------------------------------------------
  */
 #include "tm_stm32f4_mfrc522.h"
-
-extern SPI_HandleTypeDef hspi4;
-
-void TM_MFRC522_Init(void) {
-	TM_MFRC522_InitPins();
+#include <string.h>
+
+/* TM_MFRC522_CheckStep() states */
+#define MFRC522_STEP_IDLE				0
+#define MFRC522_STEP_REQUEST			1
+#define MFRC522_STEP_ANTICOLL			2
+#define MFRC522_STEP_HALT				3
+
+void TM_MFRC522_Init(TM_MFRC522_t* dev, SPI_HandleTypeDef* hspi, GPIO_TypeDef* csPort, uint16_t csPin) {
+	dev->hspi = hspi;
+	dev->csPort = csPort;
+	dev->csPin = csPin;
+	dev->step = MFRC522_STEP_IDLE;
+	TM_MFRC522_InitPins(dev);
 	//TM_SPI_Init(MFRC522_SPI, MFRC522_SPI_PINSPACK);
 
-	TM_MFRC522_Reset();
+	TM_MFRC522_Reset(dev);
 
-	TM_MFRC522_WriteRegister(MFRC522_REG_T_MODE, 0x8D);
-	TM_MFRC522_WriteRegister(MFRC522_REG_T_PRESCALER, 0x3E);
-	TM_MFRC522_WriteRegister(MFRC522_REG_T_RELOAD_L, 30);           
-	TM_MFRC522_WriteRegister(MFRC522_REG_T_RELOAD_H, 0);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_T_MODE, 0x8D);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_T_PRESCALER, 0x3E);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_T_RELOAD_L, 30);           
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_T_RELOAD_H, 0);
 
 	/* 48dB gain */
-	TM_MFRC522_WriteRegister(MFRC522_REG_RF_CFG, 0x70);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_RF_CFG, 0x70);
 	
-	TM_MFRC522_WriteRegister(MFRC522_REG_TX_AUTO, 0x40);
-	TM_MFRC522_WriteRegister(MFRC522_REG_MODE, 0x3D);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_TX_AUTO, 0x40);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_MODE, 0x3D);
 
-	TM_MFRC522_AntennaOn();		//Open the antenna
+	TM_MFRC522_AntennaOn(dev);		//Open the antenna
 }
 
-TM_MFRC522_Status_t TM_MFRC522_Check(uint8_t* id) {
+TM_MFRC522_Status_t TM_MFRC522_Check(TM_MFRC522_t* dev, uint8_t* id) {
 	TM_MFRC522_Status_t status;
 	//Find cards, return card type
-	status = TM_MFRC522_Request(PICC_REQIDL, id);	
+	status = TM_MFRC522_Request(dev, PICC_REQIDL, id);	
 	if (status == MI_OK) {
 		//Card detected
 		//Anti-collision, return card serial number 4 bytes
-		status = TM_MFRC522_Anticoll(id);	
+		status = TM_MFRC522_Anticoll(dev, id);	
 	}
-	TM_MFRC522_Halt();			//Command card into hibernation 
+	TM_MFRC522_Halt(dev);			//Command card into hibernation 
 
 	return status;
 }
 
+static void TM_MFRC522_HaltStart(TM_MFRC522_t* dev) {
+	dev->buf[0] = PICC_HALT;
+	dev->buf[1] = 0;
+	TM_MFRC522_CalculateCRC(dev, dev->buf, 2, &dev->buf[2]);
+	TM_MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, dev->buf, 4);
+	dev->step = MFRC522_STEP_HALT;
+}
+
+TM_MFRC522_Status_t TM_MFRC522_CheckStep(TM_MFRC522_t* dev, uint8_t* id) {
+	TM_MFRC522_Status_t status;
+	uint16_t backBits;
+	uint8_t i;
+	uint8_t serNumCheck = 0;
+
+	switch (dev->step) {
+		case MFRC522_STEP_IDLE: {
+			//Find cards, as in TM_MFRC522_Request()
+			TM_MFRC522_WriteRegister(dev, MFRC522_REG_BIT_FRAMING, 0x07);
+			dev->buf[0] = PICC_REQIDL;
+			TM_MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, dev->buf, 1);
+			dev->step = MFRC522_STEP_REQUEST;
+			return MI_BUSY;
+		}
+		case MFRC522_STEP_REQUEST: {
+			status = TM_MFRC522_ToCardPoll(dev, dev->buf, &backBits);
+			if (status == MI_BUSY) {
+				return MI_BUSY;
+			}
+			if ((status != MI_OK) || (backBits != 0x10)) {
+				dev->result = MI_ERR;
+				TM_MFRC522_HaltStart(dev);
+				return MI_BUSY;
+			}
+			//Card detected, anti-collision as in TM_MFRC522_Anticoll()
+			TM_MFRC522_WriteRegister(dev, MFRC522_REG_BIT_FRAMING, 0x00);
+			dev->buf[0] = PICC_ANTICOLL;
+			dev->buf[1] = 0x20;
+			TM_MFRC522_ToCardStart(dev, PCD_TRANSCEIVE, dev->buf, 2);
+			dev->step = MFRC522_STEP_ANTICOLL;
+			return MI_BUSY;
+		}
+		case MFRC522_STEP_ANTICOLL: {
+			status = TM_MFRC522_ToCardPoll(dev, dev->buf, &backBits);
+			if (status == MI_BUSY) {
+				return MI_BUSY;
+			}
+			if (status == MI_OK) {
+				//Check card serial number
+				for (i = 0; i < 4; i++) {
+					serNumCheck ^= dev->buf[i];
+				}
+				if (serNumCheck != dev->buf[i]) {
+					status = MI_ERR;
+				}
+				memcpy(dev->id, dev->buf, 5);
+			}
+			dev->result = status;
+			//Command card into hibernation
+			TM_MFRC522_HaltStart(dev);
+			return MI_BUSY;
+		}
+		default: {
+			status = TM_MFRC522_ToCardPoll(dev, dev->buf, &backBits);
+			if (status == MI_BUSY) {
+				return MI_BUSY;
+			}
+			dev->step = MFRC522_STEP_IDLE;
+			if (dev->result == MI_OK) {
+				memcpy(id, dev->id, 5);
+			}
+			return dev->result;
+		}
+	}
+}
+
 TM_MFRC522_Status_t TM_MFRC522_Compare(uint8_t* CardID, uint8_t* CompareID) {
 	uint8_t i;
 	for (i = 0; i < 5; i++) {
@@ -66,7 +150,7 @@ TM_MFRC522_Status_t TM_MFRC522_Compare(uint8_t* CardID, uint8_t* CompareID) {
 	return MI_OK;
 }
 
-void TM_MFRC522_InitPins(void) {
+void TM_MFRC522_InitPins(TM_MFRC522_t* dev) {
 //	GPIO_InitTypeDef GPIO_InitStruct;
 	//Enable clock
 //	RCC_AHB1PeriphClockCmd(MFRC522_CS_RCC, ENABLE);
@@ -79,74 +163,72 @@ void TM_MFRC522_InitPins(void) {
 //	GPIO_InitStruct.GPIO_Pin = MFRC522_CS_PIN;
 //	GPIO_Init(MFRC522_CS_PORT, &GPIO_InitStruct);
 
-	MFRC522_CS_HIGH;
+	MFRC522_CS_HIGH(dev);
 }
 
-void TM_MFRC522_WriteRegister(uint8_t addr, uint8_t val) {
+void TM_MFRC522_WriteRegister(TM_MFRC522_t* dev, uint8_t addr, uint8_t val) {
 	//CS low
-	MFRC522_CS_LOW;
+	MFRC522_CS_LOW(dev);
 	//Send address
 	uint8_t buf = (addr << 1) & 0x7E;
-	HAL_StatusTypeDef ret = 0;
-	ret = HAL_SPI_Transmit(&hspi4, &buf, 1, 10);
-	while ((ret = HAL_SPI_GetState(&hspi4)) == HAL_SPI_STATE_BUSY);
+	HAL_SPI_Transmit(dev->hspi, &buf, 1, 10);
+	while (HAL_SPI_GetState(dev->hspi) == HAL_SPI_STATE_BUSY);
 	//Send data	
-	HAL_SPI_Transmit(&hspi4, &val, 1, 10);
-	while ((ret = HAL_SPI_GetState(&hspi4)) == HAL_SPI_STATE_BUSY);
+	HAL_SPI_Transmit(dev->hspi, &val, 1, 10);
+	while (HAL_SPI_GetState(dev->hspi) == HAL_SPI_STATE_BUSY);
 	//CS high
-	MFRC522_CS_HIGH;
+	MFRC522_CS_HIGH(dev);
 }
 
-uint8_t TM_MFRC522_ReadRegister(uint8_t addr) {
+uint8_t TM_MFRC522_ReadRegister(TM_MFRC522_t* dev, uint8_t addr) {
 	uint8_t val;
 	//CS low
-	MFRC522_CS_LOW;
+	MFRC522_CS_LOW(dev);
 
 	uint8_t buf = ((addr << 1) & 0x7E) | 0x80;
-	HAL_StatusTypeDef ret = 0;
-	ret = HAL_SPI_Transmit(&hspi4, &buf, 1, 10);
-	while ((ret = HAL_SPI_GetState(&hspi4)) == HAL_SPI_STATE_BUSY);
-	ret = HAL_SPI_Receive(&hspi4, &val, 1, 10);
-	while ((ret = HAL_SPI_GetState(&hspi4)) == HAL_SPI_STATE_BUSY);
+	HAL_SPI_Transmit(dev->hspi, &buf, 1, 10);
+	while (HAL_SPI_GetState(dev->hspi) == HAL_SPI_STATE_BUSY);
+	HAL_SPI_Receive(dev->hspi, &val, 1, 10);
+	while (HAL_SPI_GetState(dev->hspi) == HAL_SPI_STATE_BUSY);
 	//CS high
-	MFRC522_CS_HIGH;
+	MFRC522_CS_HIGH(dev);
 
 	return val;	
 }
 
-void TM_MFRC522_SetBitMask(uint8_t reg, uint8_t mask) {
-	TM_MFRC522_WriteRegister(reg, TM_MFRC522_ReadRegister(reg) | mask);
+void TM_MFRC522_SetBitMask(TM_MFRC522_t* dev, uint8_t reg, uint8_t mask) {
+	TM_MFRC522_WriteRegister(dev, reg, TM_MFRC522_ReadRegister(dev, reg) | mask);
 }
 
-void TM_MFRC522_ClearBitMask(uint8_t reg, uint8_t mask){
-	TM_MFRC522_WriteRegister(reg, TM_MFRC522_ReadRegister(reg) & (~mask));
+void TM_MFRC522_ClearBitMask(TM_MFRC522_t* dev, uint8_t reg, uint8_t mask) {
+	TM_MFRC522_WriteRegister(dev, reg, TM_MFRC522_ReadRegister(dev, reg) & (~mask));
 } 
 
-void TM_MFRC522_AntennaOn(void) {
+void TM_MFRC522_AntennaOn(TM_MFRC522_t* dev) {
 	uint8_t temp;
 
-	temp = TM_MFRC522_ReadRegister(MFRC522_REG_TX_CONTROL);
+	temp = TM_MFRC522_ReadRegister(dev, MFRC522_REG_TX_CONTROL);
 	if (!(temp & 0x03)) {
-		TM_MFRC522_SetBitMask(MFRC522_REG_TX_CONTROL, 0x03);
+		TM_MFRC522_SetBitMask(dev, MFRC522_REG_TX_CONTROL, 0x03);
 	}
 }
 
-void TM_MFRC522_AntennaOff(void) {
-	TM_MFRC522_ClearBitMask(MFRC522_REG_TX_CONTROL, 0x03);
+void TM_MFRC522_AntennaOff(TM_MFRC522_t* dev) {
+	TM_MFRC522_ClearBitMask(dev, MFRC522_REG_TX_CONTROL, 0x03);
 }
 
-void TM_MFRC522_Reset(void) {
-	TM_MFRC522_WriteRegister(MFRC522_REG_COMMAND, PCD_RESETPHASE);
+void TM_MFRC522_Reset(TM_MFRC522_t* dev) {
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_COMMAND, PCD_RESETPHASE);
 }
 
-TM_MFRC522_Status_t TM_MFRC522_Request(uint8_t reqMode, uint8_t* TagType) {
+TM_MFRC522_Status_t TM_MFRC522_Request(TM_MFRC522_t* dev, uint8_t reqMode, uint8_t* TagType) {
 	TM_MFRC522_Status_t status;  
 	uint16_t backBits;			//The received data bits
 
-	TM_MFRC522_WriteRegister(MFRC522_REG_BIT_FRAMING, 0x07);		//TxLastBists = BitFramingReg[2..0]	???
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_BIT_FRAMING, 0x07);		//TxLastBists = BitFramingReg[2..0]	???
 
 	TagType[0] = reqMode;
-	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, TagType, 1, TagType, &backBits);
+	status = TM_MFRC522_ToCard(dev, PCD_TRANSCEIVE, TagType, 1, TagType, &backBits);
 
 	if ((status != MI_OK) || (backBits != 0x10)) {    
 		status = MI_ERR;
@@ -155,13 +237,23 @@ TM_MFRC522_Status_t TM_MFRC522_Request(uint8_t reqMode, uint8_t* TagType) {
 	return status;
 }
 
-TM_MFRC522_Status_t TM_MFRC522_ToCard(uint8_t command, uint8_t* sendData, uint8_t sendLen, uint8_t* backData, uint16_t* backLen) {
-	TM_MFRC522_Status_t status = MI_ERR;
+TM_MFRC522_Status_t TM_MFRC522_ToCard(TM_MFRC522_t* dev, uint8_t command, uint8_t* sendData, uint8_t sendLen, uint8_t* backData, uint16_t* backLen) {
+	TM_MFRC522_Status_t status;
+
+	TM_MFRC522_ToCardStart(dev, command, sendData, sendLen);
+
+	//Waiting to receive data to complete
+	do {
+		status = TM_MFRC522_ToCardPoll(dev, backData, backLen);
+	} while (status == MI_BUSY);
+
+	return status;
+}
+
+void TM_MFRC522_ToCardStart(TM_MFRC522_t* dev, uint8_t command, uint8_t* sendData, uint8_t sendLen) {
 	uint8_t irqEn = 0x00;
 	uint8_t waitIRq = 0x00;
-	uint8_t lastBits;
-	uint8_t n;
-	uint16_t i;
+	uint8_t i;
 
 	switch (command) {
 		case PCD_AUTHENT: {
@@ -177,82 +269,93 @@ TM_MFRC522_Status_t TM_MFRC522_ToCard(uint8_t command, uint8_t* sendData, uint8_
 		default:
 			break;
 	}
+	dev->command = command;
+	dev->irqEn = irqEn;
+	dev->waitIRq = waitIRq;
 
-	TM_MFRC522_WriteRegister(MFRC522_REG_COMM_IE_N, irqEn | 0x80);
-	TM_MFRC522_ClearBitMask(MFRC522_REG_COMM_IRQ, 0x80);
-	TM_MFRC522_SetBitMask(MFRC522_REG_FIFO_LEVEL, 0x80);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_COMM_IE_N, irqEn | 0x80);
+	TM_MFRC522_ClearBitMask(dev, MFRC522_REG_COMM_IRQ, 0x80);
+	TM_MFRC522_SetBitMask(dev, MFRC522_REG_FIFO_LEVEL, 0x80);
 
-	TM_MFRC522_WriteRegister(MFRC522_REG_COMMAND, PCD_IDLE);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_COMMAND, PCD_IDLE);
 
 	//Writing data to the FIFO
 	for (i = 0; i < sendLen; i++) {   
-		TM_MFRC522_WriteRegister(MFRC522_REG_FIFO_DATA, sendData[i]);    
+		TM_MFRC522_WriteRegister(dev, MFRC522_REG_FIFO_DATA, sendData[i]);    
 	}
 
 	//Execute the command
-	TM_MFRC522_WriteRegister(MFRC522_REG_COMMAND, command);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_COMMAND, command);
 	if (command == PCD_TRANSCEIVE) {    
-		TM_MFRC522_SetBitMask(MFRC522_REG_BIT_FRAMING, 0x80);		//StartSend=1,transmission of data starts  
+		TM_MFRC522_SetBitMask(dev, MFRC522_REG_BIT_FRAMING, 0x80);		//StartSend=1,transmission of data starts  
 	}   
+	dev->startTick = HAL_GetTick();
+}
 
-	//Waiting to receive data to complete
-	i = 2000;	//i according to the clock frequency adjustment, the operator M1 card maximum waiting time 25ms???
-	do {
-		//CommIrqReg[7..0]
-		//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
-		n = TM_MFRC522_ReadRegister(MFRC522_REG_COMM_IRQ);
-		i--;
-	} while ((i!=0) && !(n&0x01) && !(n&waitIRq));
+TM_MFRC522_Status_t TM_MFRC522_ToCardPoll(TM_MFRC522_t* dev, uint8_t* backData, uint16_t* backLen) {
+	TM_MFRC522_Status_t status = MI_ERR;
+	uint8_t lastBits;
+	uint8_t n;
+	uint8_t i;
 
-	TM_MFRC522_ClearBitMask(MFRC522_REG_BIT_FRAMING, 0x80);			//StartSend=0
+	//CommIrqReg[7..0]
+	//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
+	n = TM_MFRC522_ReadRegister(dev, MFRC522_REG_COMM_IRQ);
+	if (!(n&0x01) && !(n&dev->waitIRq)) {
+		if (HAL_GetTick() - dev->startTick <= MFRC522_TIMEOUT_MS) {
+			return MI_BUSY;
+		}
+		TM_MFRC522_ClearBitMask(dev, MFRC522_REG_BIT_FRAMING, 0x80);	//StartSend=0
+		return MI_ERR;
+	}
 
-	if (i != 0)  {
-		if (!(TM_MFRC522_ReadRegister(MFRC522_REG_ERROR) & 0x1B)) {
-			status = MI_OK;
-			if (n & irqEn & 0x01) {   
-				status = MI_NOTAGERR;			
-			}
+	TM_MFRC522_ClearBitMask(dev, MFRC522_REG_BIT_FRAMING, 0x80);		//StartSend=0
 
-			if (command == PCD_TRANSCEIVE) {
-				n = TM_MFRC522_ReadRegister(MFRC522_REG_FIFO_LEVEL);
-				lastBits = TM_MFRC522_ReadRegister(MFRC522_REG_CONTROL) & 0x07;
-				if (lastBits) {   
-					*backLen = (n - 1) * 8 + lastBits;   
-				} else {   
-					*backLen = n * 8;   
-				}
+	if (!(TM_MFRC522_ReadRegister(dev, MFRC522_REG_ERROR) & 0x1B)) {
+		status = MI_OK;
+		if (n & dev->irqEn & 0x01) {   
+			status = MI_NOTAGERR;			
+		}
 
-				if (n == 0) {   
-					n = 1;    
-				}
-				if (n > MFRC522_MAX_LEN) {   
-					n = MFRC522_MAX_LEN;   
-				}
+		if (dev->command == PCD_TRANSCEIVE) {
+			n = TM_MFRC522_ReadRegister(dev, MFRC522_REG_FIFO_LEVEL);
+			lastBits = TM_MFRC522_ReadRegister(dev, MFRC522_REG_CONTROL) & 0x07;
+			if (lastBits) {   
+				*backLen = (n - 1) * 8 + lastBits;   
+			} else {   
+				*backLen = n * 8;   
+			}
 
-				//Reading the received data in FIFO
-				for (i = 0; i < n; i++) {   
-					backData[i] = TM_MFRC522_ReadRegister(MFRC522_REG_FIFO_DATA);    
-				}
+			if (n == 0) {   
+				n = 1;    
+			}
+			if (n > MFRC522_MAX_LEN) {   
+				n = MFRC522_MAX_LEN;   
+			}
+
+			//Reading the received data in FIFO
+			for (i = 0; i < n; i++) {   
+				backData[i] = TM_MFRC522_ReadRegister(dev, MFRC522_REG_FIFO_DATA);    
 			}
-		} else {   
-			status = MI_ERR;  
 		}
+	} else {   
+		status = MI_ERR;  
 	}
 
 	return status;
 }
 
-TM_MFRC522_Status_t TM_MFRC522_Anticoll(uint8_t* serNum) {
+TM_MFRC522_Status_t TM_MFRC522_Anticoll(TM_MFRC522_t* dev, uint8_t* serNum) {
 	TM_MFRC522_Status_t status;
 	uint8_t i;
 	uint8_t serNumCheck = 0;
 	uint16_t unLen;
 
-	TM_MFRC522_WriteRegister(MFRC522_REG_BIT_FRAMING, 0x00);		//TxLastBists = BitFramingReg[2..0]
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_BIT_FRAMING, 0x00);		//TxLastBists = BitFramingReg[2..0]
 
 	serNum[0] = PICC_ANTICOLL;
 	serNum[1] = 0x20;
-	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, serNum, 2, serNum, &unLen);
+	status = TM_MFRC522_ToCard(dev, PCD_TRANSCEIVE, serNum, 2, serNum, &unLen);
 
 	if (status == MI_OK) {
 		//Check card serial number
@@ -266,32 +369,32 @@ TM_MFRC522_Status_t TM_MFRC522_Anticoll(uint8_t* serNum) {
 	return status;
 } 
 
-void TM_MFRC522_CalculateCRC(uint8_t*  pIndata, uint8_t len, uint8_t* pOutData) {
+void TM_MFRC522_CalculateCRC(TM_MFRC522_t* dev, uint8_t*  pIndata, uint8_t len, uint8_t* pOutData) {
 	uint8_t i, n;
 
-	TM_MFRC522_ClearBitMask(MFRC522_REG_DIV_IRQ, 0x04);				//CRCIrq = 0
-	TM_MFRC522_SetBitMask(MFRC522_REG_FIFO_LEVEL, 0x80);			//Clear the FIFO pointer
+	TM_MFRC522_ClearBitMask(dev, MFRC522_REG_DIV_IRQ, 0x04);				//CRCIrq = 0
+	TM_MFRC522_SetBitMask(dev, MFRC522_REG_FIFO_LEVEL, 0x80);			//Clear the FIFO pointer
 	//Write_MFRC522(CommandReg, PCD_IDLE);
 
 	//Writing data to the FIFO	
 	for (i = 0; i < len; i++) {   
-		TM_MFRC522_WriteRegister(MFRC522_REG_FIFO_DATA, *(pIndata+i));   
+		TM_MFRC522_WriteRegister(dev, MFRC522_REG_FIFO_DATA, *(pIndata+i));   
 	}
-	TM_MFRC522_WriteRegister(MFRC522_REG_COMMAND, PCD_CALCCRC);
+	TM_MFRC522_WriteRegister(dev, MFRC522_REG_COMMAND, PCD_CALCCRC);
 
 	//Wait CRC calculation is complete
 	i = 0xFF;
 	do {
-		n = TM_MFRC522_ReadRegister(MFRC522_REG_DIV_IRQ);
+		n = TM_MFRC522_ReadRegister(dev, MFRC522_REG_DIV_IRQ);
 		i--;
 	} while ((i!=0) && !(n&0x04));			//CRCIrq = 1
 
 	//Read CRC calculation result
-	pOutData[0] = TM_MFRC522_ReadRegister(MFRC522_REG_CRC_RESULT_L);
-	pOutData[1] = TM_MFRC522_ReadRegister(MFRC522_REG_CRC_RESULT_M);
+	pOutData[0] = TM_MFRC522_ReadRegister(dev, MFRC522_REG_CRC_RESULT_L);
+	pOutData[1] = TM_MFRC522_ReadRegister(dev, MFRC522_REG_CRC_RESULT_M);
 }
 
-uint8_t TM_MFRC522_SelectTag(uint8_t* serNum) {
+uint8_t TM_MFRC522_SelectTag(TM_MFRC522_t* dev, uint8_t* serNum) {
 	uint8_t i;
 	TM_MFRC522_Status_t status;
 	uint8_t size;
@@ -303,8 +406,8 @@ uint8_t TM_MFRC522_SelectTag(uint8_t* serNum) {
 	for (i = 0; i < 5; i++) {
 		buffer[i+2] = *(serNum+i);
 	}
-	TM_MFRC522_CalculateCRC(buffer, 7, &buffer[7]);		//??
-	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, buffer, 9, buffer, &recvBits);
+	TM_MFRC522_CalculateCRC(dev, buffer, 7, &buffer[7]);		//??
+	status = TM_MFRC522_ToCard(dev, PCD_TRANSCEIVE, buffer, 9, buffer, &recvBits);
 
 	if ((status == MI_OK) && (recvBits == 0x18)) {   
 		size = buffer[0]; 
@@ -315,7 +418,7 @@ uint8_t TM_MFRC522_SelectTag(uint8_t* serNum) {
 	return size;
 }
 
-TM_MFRC522_Status_t TM_MFRC522_Auth(uint8_t authMode, uint8_t BlockAddr, uint8_t* Sectorkey, uint8_t* serNum) {
+TM_MFRC522_Status_t TM_MFRC522_Auth(TM_MFRC522_t* dev, uint8_t authMode, uint8_t BlockAddr, uint8_t* Sectorkey, uint8_t* serNum) {
 	TM_MFRC522_Status_t status;
 	uint16_t recvBits;
 	uint8_t i;
@@ -330,23 +433,23 @@ TM_MFRC522_Status_t TM_MFRC522_Auth(uint8_t authMode, uint8_t BlockAddr, uint8_t
 	for (i=0; i<4; i++) {    
 		buff[i+8] = *(serNum+i);   
 	}
-	status = TM_MFRC522_ToCard(PCD_AUTHENT, buff, 12, buff, &recvBits);
+	status = TM_MFRC522_ToCard(dev, PCD_AUTHENT, buff, 12, buff, &recvBits);
 
-	if ((status != MI_OK) || (!(TM_MFRC522_ReadRegister(MFRC522_REG_STATUS2) & 0x08))) {   
+	if ((status != MI_OK) || (!(TM_MFRC522_ReadRegister(dev, MFRC522_REG_STATUS2) & 0x08))) {   
 		status = MI_ERR;   
 	}
 
 	return status;
 }
 
-TM_MFRC522_Status_t TM_MFRC522_Read(uint8_t blockAddr, uint8_t* recvData) {
+TM_MFRC522_Status_t TM_MFRC522_Read(TM_MFRC522_t* dev, uint8_t blockAddr, uint8_t* recvData) {
 	TM_MFRC522_Status_t status;
 	uint16_t unLen;
 
 	recvData[0] = PICC_READ;
 	recvData[1] = blockAddr;
-	TM_MFRC522_CalculateCRC(recvData,2, &recvData[2]);
-	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, recvData, 4, recvData, &unLen);
+	TM_MFRC522_CalculateCRC(dev, recvData,2, &recvData[2]);
+	status = TM_MFRC522_ToCard(dev, PCD_TRANSCEIVE, recvData, 4, recvData, &unLen);
 
 	if ((status != MI_OK) || (unLen != 0x90)) {
 		status = MI_ERR;
@@ -355,7 +458,7 @@ TM_MFRC522_Status_t TM_MFRC522_Read(uint8_t blockAddr, uint8_t* recvData) {
 	return status;
 }
 
-TM_MFRC522_Status_t TM_MFRC522_Write(uint8_t blockAddr, uint8_t* writeData) {
+TM_MFRC522_Status_t TM_MFRC522_Write(TM_MFRC522_t* dev, uint8_t blockAddr, uint8_t* writeData) {
 	TM_MFRC522_Status_t status;
 	uint16_t recvBits;
 	uint8_t i;
@@ -363,8 +466,8 @@ TM_MFRC522_Status_t TM_MFRC522_Write(uint8_t blockAddr, uint8_t* writeData) {
 
 	buff[0] = PICC_WRITE;
 	buff[1] = blockAddr;
-	TM_MFRC522_CalculateCRC(buff, 2, &buff[2]);
-	status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff, &recvBits);
+	TM_MFRC522_CalculateCRC(dev, buff, 2, &buff[2]);
+	status = TM_MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, 4, buff, &recvBits);
 
 	if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)) {   
 		status = MI_ERR;   
@@ -375,8 +478,8 @@ TM_MFRC522_Status_t TM_MFRC522_Write(uint8_t blockAddr, uint8_t* writeData) {
 		for (i = 0; i < 16; i++) {    
 			buff[i] = *(writeData+i);   
 		}
-		TM_MFRC522_CalculateCRC(buff, 16, &buff[16]);
-		status = TM_MFRC522_ToCard(PCD_TRANSCEIVE, buff, 18, buff, &recvBits);
+		TM_MFRC522_CalculateCRC(dev, buff, 16, &buff[16]);
+		status = TM_MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, 18, buff, &recvBits);
 
 		if ((status != MI_OK) || (recvBits != 4) || ((buff[0] & 0x0F) != 0x0A)) {   
 			status = MI_ERR;   
@@ -386,14 +489,14 @@ TM_MFRC522_Status_t TM_MFRC522_Write(uint8_t blockAddr, uint8_t* writeData) {
 	return status;
 }
 
-void TM_MFRC522_Halt(void) {
+void TM_MFRC522_Halt(TM_MFRC522_t* dev) {
 	uint16_t unLen;
 	uint8_t buff[4]; 
 
 	buff[0] = PICC_HALT;
 	buff[1] = 0;
-	TM_MFRC522_CalculateCRC(buff, 2, &buff[2]);
+	TM_MFRC522_CalculateCRC(dev, buff, 2, &buff[2]);
 
-	TM_MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff, &unLen);
+	TM_MFRC522_ToCard(dev, PCD_TRANSCEIVE, buff, 4, buff, &unLen);
 }
 
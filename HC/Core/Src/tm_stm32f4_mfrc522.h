@@ -31,10 +31,16 @@
  * | along with this program.  If not, see <http://www.gnu.org/licenses/>.
  * |----------------------------------------------------------------------
  * 	
+ * Every reader is a TM_MFRC522_t handle with its own SPI bus and CS pin,
+ * so several readers can share SPI4 and differ only in SS(SDA).
+ * TM_MFRC522_CheckStep() runs a card check without waiting for the RF
+ * exchanges, so while one reader waits for a card to answer the others
+ * can use the bus.
+ *
  * MF RC522 Default pinout
  * 
  * 		MFRC522		STM32F429ZIT6	DESCRIPTION
- *		SS(SDA)		PE4				Chip select for SPI
+ *		SS(SDA)		PE4				Chip select for SPI (one pin per reader)
  *		SCK			PE2				Serial Clock for SPI
  *		MISO		PE5				Master In Slave Out for SPI
  *		MOSI		PE6				Master Out Slave In for SPI
@@ -49,15 +55,7 @@
 #include "stm32f4xx.h"
 #include "stm32f4xx_hal.h"
 
-#ifndef MFRC522_SPI
-#define MFRC522_SPI						SPI4
-#endif
-
-/* Default CS pin used */
-#ifndef MFRC522_CS_PIN
-#define MFRC522_CS_PORT					GPIOE
-#define MFRC522_CS_PIN					GPIO_PIN_4
-#endif
+#define MFRC522_MAX_LEN					16
 
 /**
  * Status enumeration
@@ -67,11 +65,36 @@
 typedef enum {
 	MI_OK = 0,
 	MI_NOTAGERR,
-	MI_ERR
+	MI_ERR,
+	MI_BUSY							/* Command still running, poll again */
 } TM_MFRC522_Status_t;
 
-#define MFRC522_CS_LOW					HAL_GPIO_WritePin(GPIOE, GPIO_PIN_4, GPIO_PIN_RESET)
-#define MFRC522_CS_HIGH					HAL_GPIO_WritePin(GPIOE, GPIO_PIN_4, GPIO_PIN_SET)
+/* Longest wait for a card to answer; the reader's own timer gives up after about 15 ms */
+#define MFRC522_TIMEOUT_MS				25
+
+/**
+ * Reader handle
+ *
+ * Set up with TM_MFRC522_Init(). The remaining fields belong to the driver.
+ */
+typedef struct {
+	SPI_HandleTypeDef* hspi;		/* SPI bus the reader is on */
+	GPIO_TypeDef* csPort;			/* Chip select, active low */
+	uint16_t csPin;
+	/* Command in progress, see TM_MFRC522_ToCardStart() */
+	uint8_t command;
+	uint8_t irqEn;
+	uint8_t waitIRq;
+	uint32_t startTick;
+	/* Card check in progress, see TM_MFRC522_CheckStep() */
+	uint8_t step;
+	TM_MFRC522_Status_t result;
+	uint8_t id[5];
+	uint8_t buf[MFRC522_MAX_LEN];
+} TM_MFRC522_t;
+
+#define MFRC522_CS_LOW(dev)				HAL_GPIO_WritePin((dev)->csPort, (dev)->csPin, GPIO_PIN_RESET)
+#define MFRC522_CS_HIGH(dev)			HAL_GPIO_WritePin((dev)->csPort, (dev)->csPin, GPIO_PIN_SET)
 
 /* MFRC522 Commands */
 #define PCD_IDLE						0x00   //NO action; Cancel the current command
@@ -169,8 +192,6 @@ typedef enum {
 //Dummy byte
 #define MFRC522_DUMMY					0x00
 
-#define MFRC522_MAX_LEN					16
-
 /**
  * Public functions
  */
@@ -179,8 +200,15 @@ typedef enum {
  *
  * Prepare MFRC522 to work with RFIDs
  *
+ * Parameters:
+ * 	- TM_MFRC522_t* dev:
+ * 		Reader handle to set up
+ * 	- SPI_HandleTypeDef* hspi:
+ * 		Initialized SPI bus the reader is on
+ * 	- GPIO_TypeDef* csPort, uint16_t csPin:
+ * 		Chip select of this reader, already configured as output
  */
-extern void TM_MFRC522_Init(void);
+extern void TM_MFRC522_Init(TM_MFRC522_t* dev, SPI_HandleTypeDef* hspi, GPIO_TypeDef* csPort, uint16_t csPin);
 
 /**
  * Check for RFID card existance
@@ -192,7 +220,19 @@ extern void TM_MFRC522_Init(void);
  *
  * Returns MI_OK if card is detected
  */
-extern TM_MFRC522_Status_t TM_MFRC522_Check(uint8_t* id);
+extern TM_MFRC522_Status_t TM_MFRC522_Check(TM_MFRC522_t* dev, uint8_t* id);
+
+/**
+ * Check for RFID card existance without blocking
+ *
+ * Same as TM_MFRC522_Check(), but returns MI_BUSY instead of waiting while
+ * the reader talks to the card. Call it again until it returns something
+ * else; the call after that starts a new check. Other readers on the same
+ * bus can be used in between, but not other functions on this reader.
+ *
+ * Returns MI_BUSY while running, then the same as TM_MFRC522_Check()
+ */
+extern TM_MFRC522_Status_t TM_MFRC522_CheckStep(TM_MFRC522_t* dev, uint8_t* id);
 
 /**
  * Compare 2 RFID ID's
@@ -211,23 +251,26 @@ extern TM_MFRC522_Status_t TM_MFRC522_Compare(uint8_t* CardID, uint8_t* CompareI
 /**
  * Private functions
  */
-extern void TM_MFRC522_InitPins(void);
-extern void TM_MFRC522_WriteRegister(uint8_t addr, uint8_t val);
-extern uint8_t TM_MFRC522_ReadRegister(uint8_t addr);
-extern void TM_MFRC522_SetBitMask(uint8_t reg, uint8_t mask);
-extern void TM_MFRC522_ClearBitMask(uint8_t reg, uint8_t mask);
-extern void TM_MFRC522_AntennaOn(void);
-extern void TM_MFRC522_AntennaOff(void);
-extern void TM_MFRC522_Reset(void);
-extern TM_MFRC522_Status_t TM_MFRC522_Request(uint8_t reqMode, uint8_t* TagType);
-extern TM_MFRC522_Status_t TM_MFRC522_ToCard(uint8_t command, uint8_t* sendData, uint8_t sendLen, uint8_t* backData, uint16_t* backLen);
-extern TM_MFRC522_Status_t TM_MFRC522_Anticoll(uint8_t* serNum);
-extern void TM_MFRC522_CalculateCRC(uint8_t* pIndata, uint8_t len, uint8_t* pOutData);
-extern uint8_t TM_MFRC522_SelectTag(uint8_t* serNum);
-extern TM_MFRC522_Status_t TM_MFRC522_Auth(uint8_t authMode, uint8_t BlockAddr, uint8_t* Sectorkey, uint8_t* serNum);
-extern TM_MFRC522_Status_t TM_MFRC522_Read(uint8_t blockAddr, uint8_t* recvData);
-extern TM_MFRC522_Status_t TM_MFRC522_Write(uint8_t blockAddr, uint8_t* writeData);
-extern void TM_MFRC522_Halt(void);
+extern void TM_MFRC522_InitPins(TM_MFRC522_t* dev);
+extern void TM_MFRC522_WriteRegister(TM_MFRC522_t* dev, uint8_t addr, uint8_t val);
+extern uint8_t TM_MFRC522_ReadRegister(TM_MFRC522_t* dev, uint8_t addr);
+extern void TM_MFRC522_SetBitMask(TM_MFRC522_t* dev, uint8_t reg, uint8_t mask);
+extern void TM_MFRC522_ClearBitMask(TM_MFRC522_t* dev, uint8_t reg, uint8_t mask);
+extern void TM_MFRC522_AntennaOn(TM_MFRC522_t* dev);
+extern void TM_MFRC522_AntennaOff(TM_MFRC522_t* dev);
+extern void TM_MFRC522_Reset(TM_MFRC522_t* dev);
+extern TM_MFRC522_Status_t TM_MFRC522_Request(TM_MFRC522_t* dev, uint8_t reqMode, uint8_t* TagType);
+extern TM_MFRC522_Status_t TM_MFRC522_ToCard(TM_MFRC522_t* dev, uint8_t command, uint8_t* sendData, uint8_t sendLen, uint8_t* backData, uint16_t* backLen);
+/* TM_MFRC522_ToCard() in two halves: start the command, then poll until it stops returning MI_BUSY */
+extern void TM_MFRC522_ToCardStart(TM_MFRC522_t* dev, uint8_t command, uint8_t* sendData, uint8_t sendLen);
+extern TM_MFRC522_Status_t TM_MFRC522_ToCardPoll(TM_MFRC522_t* dev, uint8_t* backData, uint16_t* backLen);
+extern TM_MFRC522_Status_t TM_MFRC522_Anticoll(TM_MFRC522_t* dev, uint8_t* serNum);
+extern void TM_MFRC522_CalculateCRC(TM_MFRC522_t* dev, uint8_t* pIndata, uint8_t len, uint8_t* pOutData);
+extern uint8_t TM_MFRC522_SelectTag(TM_MFRC522_t* dev, uint8_t* serNum);
+extern TM_MFRC522_Status_t TM_MFRC522_Auth(TM_MFRC522_t* dev, uint8_t authMode, uint8_t BlockAddr, uint8_t* Sectorkey, uint8_t* serNum);
+extern TM_MFRC522_Status_t TM_MFRC522_Read(TM_MFRC522_t* dev, uint8_t blockAddr, uint8_t* recvData);
+extern TM_MFRC522_Status_t TM_MFRC522_Write(TM_MFRC522_t* dev, uint8_t blockAddr, uint8_t* writeData);
+extern void TM_MFRC522_Halt(TM_MFRC522_t* dev);
 
 #endif
 
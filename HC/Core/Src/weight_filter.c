@@ -0,0 +1,77 @@
+/*
+ * weight_filter.c
+ */
+
+#include "weight_filter.h"
+
+void WeightFilter_begin(WeightFilter *wf, const WeightFilter_Config *config) {
+	wf->config = *config;
+	if (wf->config.order < 1) wf->config.order = 1;
+	if (wf->config.order > WEIGHT_FILTER_MAX_ORDER) wf->config.order = WEIGHT_FILTER_MAX_ORDER;
+	if (wf->config.decimation < 2) wf->config.decimation = 2;
+	if (wf->config.decimation > WEIGHT_FILTER_MAX_DECIMATION) wf->config.decimation = WEIGHT_FILTER_MAX_DECIMATION;
+	if (wf->config.window < 1) wf->config.window = 1;
+	if (wf->config.window > WEIGHT_FILTER_MAX_WINDOW) wf->config.window = WEIGHT_FILTER_MAX_WINDOW;
+	WeightFilter_reset(wf);
+}
+
+void WeightFilter_reset(WeightFilter *wf) {
+	for (uint8_t i = 0; i < WEIGHT_FILTER_MAX_ORDER; i++) {
+		wf->integrator[i] = 0;
+		wf->comb[i] = 0;
+	}
+	wf->phase = 0;
+	// The first `order` outputs still contain the zeros the combs started with
+	wf->warmup = wf->config.order;
+	wf->sum = 0;
+	wf->head = 0;
+	wf->filled = 0;
+	wf->fast = 0;
+	wf->slow = 0;
+	wf->slowValid = false;
+}
+
+bool WeightFilter_add(WeightFilter *wf, int32_t sample) {
+	uint8_t order = wf->config.order;
+
+	// Fast average over the last `window` samples
+	if (wf->filled == wf->config.window) {
+		wf->sum -= wf->ring[wf->head];
+	} else {
+		wf->filled++;
+	}
+	wf->ring[wf->head] = sample;
+	wf->sum += sample;
+	wf->head = (wf->head + 1) % wf->config.window;
+	wf->fast = (int32_t)(wf->sum / wf->filled);
+
+	// CIC: integrators at the input rate, unsigned so they wrap without
+	// overflow; combs with a delay of one at the output rate
+	uint64_t x = (uint64_t)(int64_t)sample;
+	for (uint8_t i = 0; i < order; i++) {
+		wf->integrator[i] += x;
+		x = wf->integrator[i];
+	}
+	if (++wf->phase < wf->config.decimation) {
+		return false;
+	}
+	wf->phase = 0;
+	for (uint8_t i = 0; i < order; i++) {
+		uint64_t y = x - wf->comb[i];
+		wf->comb[i] = x;
+		x = y;
+	}
+
+	// The DC gain is decimation^order
+	int64_t gain = 1;
+	for (uint8_t i = 0; i < order; i++) {
+		gain *= wf->config.decimation;
+	}
+	if (wf->warmup) {
+		wf->warmup--;
+		return false;
+	}
+	wf->slow = (int32_t)((int64_t)x / gain);
+	wf->slowValid = true;
+	return true;
+}
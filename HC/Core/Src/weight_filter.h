@@ -0,0 +1,64 @@
+/*
+ * weight_filter.h
+ *
+ * Decimating filter for HX711 samples at 80 SPS. Every sample updates a
+ * fast boxcar average that follows a load change within a few samples,
+ * for detecting step-on and step-off; a CIC decimator turns the same
+ * samples into a slow, low-noise value for recording. Plain C without HAL
+ * so the host simulator (Webcode/bench/hx711_sim.cpp) runs the same code.
+ */
+
+#ifndef WEIGHT_FILTER_H_
+#define WEIGHT_FILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WEIGHT_FILTER_MAX_ORDER      3
+#define WEIGHT_FILTER_MAX_DECIMATION 32
+#define WEIGHT_FILTER_MAX_WINDOW     16
+
+typedef struct {
+	uint8_t order;		// CIC stages, 1..3; more stages, less noise and slower settling
+	uint8_t decimation;	// samples per slow value, 2..32
+	uint8_t window;		// samples in the fast average, 1..16
+} WeightFilter_Config;
+
+typedef struct {
+	WeightFilter_Config config;
+
+	// CIC state; the integrators wrap around, which the combs undo
+	uint64_t integrator[WEIGHT_FILTER_MAX_ORDER];
+	uint64_t comb[WEIGHT_FILTER_MAX_ORDER];
+	uint8_t phase;
+	uint8_t warmup;		// slow values left until the combs hold real data
+
+	// Fast average
+	int32_t ring[WEIGHT_FILTER_MAX_WINDOW];
+	int64_t sum;
+	uint8_t head;
+	uint8_t filled;
+
+	int32_t fast;		// updated by every sample
+	int32_t slow;		// updated every `decimation` samples
+	bool slowValid;		// false until the first fully settled slow value
+} WeightFilter;
+
+// Set up with a configuration; out of range values are clamped
+void WeightFilter_begin(WeightFilter *wf, const WeightFilter_Config *config);
+
+// Forget all samples, e.g. after a rate or channel change
+void WeightFilter_reset(WeightFilter *wf);
+
+// Add one sample. Returns true when it completed a new slow value.
+bool WeightFilter_add(WeightFilter *wf, int32_t sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WEIGHT_FILTER_H_ */
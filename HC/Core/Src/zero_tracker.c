@@ -0,0 +1,98 @@
+/*
+ * zero_tracker.c
+ */
+
+#include "zero_tracker.h"
+#include <stdlib.h>
+
+void ZeroTracker_begin(ZeroTracker *zt, const ZeroTracker_Config *config) {
+	zt->config = *config;
+	if (zt->config.window < 2) zt->config.window = 2;
+	if (zt->config.window > ZERO_TRACKER_MAX_WINDOW) zt->config.window = ZERO_TRACKER_MAX_WINDOW;
+	if (zt->config.maxStep < 1) zt->config.maxStep = 1;
+	zt->head = 0;
+	zt->filled = 0;
+	zt->holding = false;
+	zt->holdSince = 0;
+	zt->zeroed = false;
+	zt->limited = false;
+	zt->total = 0;
+	zt->corrections = 0;
+}
+
+void ZeroTracker_tared(ZeroTracker *zt) {
+	// The window still holds values from before the tare
+	zt->filled = 0;
+	zt->holding = false;
+	zt->zeroed = true;
+	zt->limited = false;
+	zt->total = 0;
+}
+
+int32_t ZeroTracker_add(ZeroTracker *zt, int32_t weight, int32_t counts, bool empty, uint32_t nowMs, int32_t *grams) {
+	const ZeroTracker_Config *cfg = &zt->config;
+	int32_t min, max;
+	int64_t sumGrams = 0, sumCounts = 0;
+
+	*grams = 0;
+	if (!empty) {
+		zt->filled = 0;
+		zt->holding = false;
+		return 0;
+	}
+
+	zt->grams[zt->head] = weight;
+	zt->counts[zt->head] = counts;
+	zt->head = (zt->head + 1) % cfg->window;
+	if (zt->filled < cfg->window) zt->filled++;
+	if (zt->filled < cfg->window || zt->limited) {
+		return 0;
+	}
+
+	min = max = zt->grams[0];
+	for (uint8_t i = 0; i < cfg->window; i++) {
+		if (zt->grams[i] < min) min = zt->grams[i];
+		if (zt->grams[i] > max) max = zt->grams[i];
+		sumGrams += zt->grams[i];
+		sumCounts += zt->counts[i];
+	}
+	int32_t meanGrams = (int32_t)(sumGrams / cfg->window);
+	int32_t meanCounts = (int32_t)(sumCounts / cfg->window);
+
+	// Something on the scale or moving: start holding again later
+	if (max - min > cfg->stable || abs(meanGrams) > (zt->zeroed ? cfg->band : cfg->initialBand)) {
+		zt->holding = false;
+		return 0;
+	}
+	if (!zt->holding) {
+		zt->holding = true;
+		zt->holdSince = nowMs;
+		return 0;
+	}
+	if (nowMs - zt->holdSince < cfg->holdMs || meanGrams == 0) {
+		return 0;
+	}
+
+	int32_t step = meanGrams;
+	if (zt->zeroed) {
+		if (step > cfg->maxStep) step = cfg->maxStep;
+		if (step < -cfg->maxStep) step = -cfg->maxStep;
+		if (abs(zt->total + step) > cfg->maxTotal) {
+			zt->limited = true;
+			return 0;
+		}
+		zt->total += step;
+	}
+	zt->zeroed = true;
+	zt->corrections++;
+	zt->holdSince = nowMs;
+
+	// The same share of the mean in counts; the window moves with the tare
+	int32_t stepCounts = step == meanGrams ? meanCounts : (int32_t)((int64_t)meanCounts * step / meanGrams);
+	for (uint8_t i = 0; i < cfg->window; i++) {
+		zt->grams[i] -= step;
+		zt->counts[i] -= stepCounts;
+	}
+	*grams = step;
+	return stepCounts;
+}
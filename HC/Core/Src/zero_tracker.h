@@ -0,0 +1,69 @@
+/*
+ * zero_tracker.h
+ *
+ * Automatic zero tracking. Load cells drift with temperature and time, so
+ * an empty scale slowly stops reading zero. While the scale is empty and
+ * the weight holds still near zero, the tracker moves the tare towards the
+ * reading in small steps: at most maxStep grams per holdMs, and at most
+ * maxTotal grams in all since the last tare, after which it stops and a
+ * tare is needed. The first correction after boot may take up to
+ * initialBand at once, which zeroes the scale without a blocking tare.
+ * Works on the weight values the main loop already has, so it costs no
+ * extra samples. Plain C without HAL.
+ */
+
+#ifndef ZERO_TRACKER_H_
+#define ZERO_TRACKER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZERO_TRACKER_MAX_WINDOW 16
+
+typedef struct {
+	int32_t band;			// grams around zero that still count as empty
+	int32_t initialBand;	// the same for the first correction after boot
+	int32_t stable;			// largest spread of the window, grams
+	uint8_t window;			// weight values that must agree, 2..16
+	uint32_t holdMs;		// empty and stable this long per correction
+	int32_t maxStep;		// grams per correction
+	int32_t maxTotal;		// grams corrected since the last tare
+} ZeroTracker_Config;
+
+typedef struct {
+	ZeroTracker_Config config;
+
+	// The last `window` weight values, in grams and in net counts
+	int32_t grams[ZERO_TRACKER_MAX_WINDOW];
+	int32_t counts[ZERO_TRACKER_MAX_WINDOW];
+	uint8_t head;
+	uint8_t filled;
+	bool holding;			// empty and stable since holdSince
+	uint32_t holdSince;
+
+	bool zeroed;			// the initial correction has been made
+	bool limited;			// maxTotal reached, tracking stopped
+	int32_t total;			// grams corrected since the last tare
+	uint32_t corrections;
+} ZeroTracker;
+
+// Set up with a configuration; out of range values are clamped
+void ZeroTracker_begin(ZeroTracker *zt, const ZeroTracker_Config *config);
+
+// After a tare: the total starts over and no initial correction is made
+void ZeroTracker_tared(ZeroTracker *zt);
+
+// One new weight value, its net counts, and whether the scale is empty
+// (nobody stepped on). Returns the net counts to add to the tare, 0 for
+// none; *grams gets the same correction in grams.
+int32_t ZeroTracker_add(ZeroTracker *zt, int32_t weight, int32_t counts, bool empty, uint32_t nowMs, int32_t *grams);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZERO_TRACKER_H_ */
@@ -0,0 +1,102 @@
+/*
+ * bench.h
+ *
+ * Small benchmark harness for the native build. A benchmark is a function
+ * that runs its body state.iterations() times; the runner doubles the
+ * iteration count until one run takes at least the minimum time, then
+ * reports ns/op and heap allocations/op (counted by replacing the global
+ * operator new). Setup that should not be timed goes before
+ * state.startTimer().
+ *
+ *   BENCH(frame_parse) {
+ *       ...setup...
+ *       state.startTimer();
+ *       for (uint64_t i = 0; i < state.iterations(); i++) { ... }
+ *       state.setBytes(FRAME_CARD_SIZE);
+ *   }
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BENCH_MAX_COUNTERS 4
+
+class BenchState {
+public:
+    explicit BenchState(uint64_t iterations);
+
+    uint64_t iterations() const { return iters; }
+
+    // Restart the clock and the allocation count after setup
+    void startTimer();
+
+    // Bytes processed per iteration, reported as MB/s
+    void setBytes(uint64_t bytesPerIteration) { bytes = bytesPerIteration; }
+
+    // Extra per-benchmark figure, e.g. a compression ratio; printed as is
+    void counter(const char* name, double value);
+
+    // Used by the runner
+    uint64_t startNs;
+    uint64_t startAllocs;
+    uint64_t bytes;
+    const char* counterName[BENCH_MAX_COUNTERS];
+    double counterValue[BENCH_MAX_COUNTERS];
+    int counterCount;
+
+private:
+    uint64_t iters;
+};
+
+typedef void (*BenchFn)(BenchState& state);
+
+struct BenchRegistration {
+    BenchRegistration(const char* name, BenchFn fn);
+};
+
+#define BENCH(name) \
+    static void bench_##name(BenchState& state); \
+    static BenchRegistration benchRegistration_##name(#name, bench_##name); \
+    static void bench_##name(BenchState& state)
+
+// Heap allocations since start, from the operator new replacement
+uint64_t benchAllocCount();
+
+// Bytes currently held by operator new allocations
+int64_t benchHeapInUse();
+
+// Most bytes held since the last benchHeapPeakReset(), which starts the
+// peak at what is held now
+int64_t benchHeapPeak();
+void benchHeapPeakReset();
+
+uint64_t benchNowNs();
+
+// Keep a computed value alive so the optimizer cannot drop the work
+template <typename T>
+inline void benchKeep(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+// Deterministic pseudo-random numbers for test data
+uint32_t benchRandom();
+
+// "program ingest ...": emulated STM32 stations against the ingest path
+int ingestStress(int argc, char** argv);
+
+// "program http ...": loopback load test of the web routes
+int httpLoad(int argc, char** argv);
+
+// "program soak ...": heap use of the ingest and API paths over a long run
+int heapSoak(int argc, char** argv);
+
+// "program hx711 ...": settling time and noise of the STM32 weighing filters
+int hx711Sim(int argc, char** argv);
+
+// "program heap ...": peak heap of the streamed JSON lists against row count
+int heapHighWater(int argc, char** argv);
+
+#endif /* BENCH_H_ */
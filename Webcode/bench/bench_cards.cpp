@@ -0,0 +1,252 @@
+/*
+ * bench_cards.cpp
+ *
+ * Card table lookups and bulk import. The table is filled by replaying
+ * records, as at boot, so no flash traffic is counted for setup. Also the
+ * two ends of the allowlist sync: the ESP32's count and checksum over the
+ * table and the STM32's lookup in its copy (card_allowlist.c).
+ */
+
+#include "bench.h"
+#include "card_table.h"
+#include "card_transfer.h"
+#include "allowlist_sync.h"
+#include "card_allowlist.h"
+#include "api_sources.h"
+#include "json_check.h"
+#include "ram_flash_region.h"
+#include <stdio.h>
+
+#define LOOKUP_KEYS        1024
+#define IMPORT_ROWS        1000
+#define IMPORT_BATCH_CARDS 256
+#define IMPORT_BAD_ROWS    40      // more than CARD_IMPORT_MAX_ERRORS
+#define RESPONSE_SEGMENT   1436
+#define CARD_LOG_SECTORS   32      // size of the cardlog partition
+
+static CardJournal journal;
+static CardTable table(&journal);
+
+static void replayRecord(uint8_t type, const uint8_t* uid, const char* name) {
+    table.applyRecord(type, uid, name);
+}
+
+static bool liveState(const uint8_t* uid, char* name, size_t nameSize) {
+    return table.liveState(uid, name, nameSize);
+}
+
+static void makeUid(uint32_t n, uint8_t* uid) {
+    uid[0] = (uint8_t)(n >> 24);
+    uid[1] = (uint8_t)(n >> 16);
+    uid[2] = (uint8_t)(n >> 8);
+    uid[3] = (uint8_t)n;
+}
+
+static void fillTable() {
+    uint8_t uid[UID_SIZE];
+    char name[CARD_NAME_MAX + 1];
+    table.clear();
+    for (uint32_t i = 0; i < MAX_VALID_CARDS; i++) {
+        makeUid(0x10000000 + i * 7919, uid);
+        snprintf(name, sizeof(name), "Benh nhan %lu", (unsigned long)i);
+        table.applyRecord(CARD_REC_ADD, uid, name);
+    }
+}
+
+static void runLookup(BenchState& state, bool hit) {
+    static uint8_t keys[LOOKUP_KEYS][UID_SIZE];
+    fillTable();
+    for (int i = 0; i < LOOKUP_KEYS; i++) {
+        uint32_t n = benchRandom() % MAX_VALID_CARDS;
+        makeUid(hit ? 0x10000000 + n * 7919 : 0x20000000 + n, keys[i]);
+    }
+
+    uint32_t found = 0;
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        found += table.isValid(keys[i % LOOKUP_KEYS]);
+    }
+    benchKeep(found);
+    state.counter("cards", table.size());
+}
+
+BENCH(card_lookup_hit) {
+    runLookup(state, true);
+}
+
+BENCH(card_lookup_miss) {
+    runLookup(state, false);
+}
+
+// One op parses a whole 1000-row CSV upload, fed in 1436-byte pieces
+// like TCP segments
+BENCH(card_import_parse) {
+    static char csv[IMPORT_ROWS * 48];
+    static CardImportRow rows[IMPORT_ROWS];
+    size_t len = snprintf(csv, sizeof(csv), "uid,name\n");
+    for (uint32_t i = 0; i < IMPORT_ROWS; i++) {
+        len += snprintf(csv + len, sizeof(csv) - len, "%02X:%02X:%02X:%02X,Benh nhan %lu\n",
+                        0x10, (unsigned)(i >> 16) & 0xFF, (unsigned)(i >> 8) & 0xFF,
+                        (unsigned)i & 0xFF, (unsigned long)i);
+    }
+
+    uint32_t parsed = 0;
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        CardImportParser parser(rows, IMPORT_ROWS);
+        for (size_t off = 0; off < len; off += 1436) {
+            size_t n = len - off < 1436 ? len - off : 1436;
+            parser.feed((const uint8_t*)csv + off, n);
+        }
+        parser.finish();
+        parsed += parser.rowCount();
+    }
+    state.setBytes(len);
+    state.counter("rows", (double)parsed / state.iterations());
+}
+
+// One op imports 256 new cards into an empty journal in one batch
+BENCH(card_import_batch) {
+    static RamFlashRegion region(CARD_LOG_SECTORS);
+    uint8_t uid[UID_SIZE];
+    char name[CARD_NAME_MAX + 1];
+    uint64_t writes = 0;
+
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        region.format();
+        table.clear();
+        journal.begin(&region, replayRecord, liveState);
+        journal.beginBatch();
+        for (uint32_t c = 0; c < IMPORT_BATCH_CARDS; c++) {
+            makeUid(0x30000000 + c, uid);
+            snprintf(name, sizeof(name), "Benh nhan %lu", (unsigned long)c);
+            table.import(uid, name);
+        }
+        journal.commitBatch();
+        writes += region.writes;
+    }
+    state.counter("flash_writes", (double)writes / state.iterations());
+}
+
+// One op renders the response of an import with more failed rows than are
+// kept, through ChunkBuffer as sendChunked() sends it. The counters check
+// that the body is complete JSON even though it is longer than one chunk.
+BENCH(card_import_result) {
+    static CardImportRow rows[IMPORT_ROWS];
+    static char body[4096];
+    char line[48];
+    CardImportParser parser(rows, IMPORT_ROWS);
+    for (uint32_t i = 0; i < IMPORT_ROWS + IMPORT_BAD_ROWS; i++) {
+        int n = i % 26 == 25 ? snprintf(line, sizeof(line), "not a uid,Benh nhan %lu\n", (unsigned long)i)
+                             : snprintf(line, sizeof(line), "%02X:%02X:%02X:%02X,Benh nhan %lu\n", 0x40,
+                                        (unsigned)(i >> 16) & 0xFF, (unsigned)(i >> 8) & 0xFF,
+                                        (unsigned)i & 0xFF, (unsigned long)i);
+        parser.feed((const uint8_t*)line, n);
+    }
+    parser.finish();
+
+    // Every good row a new card
+    uint32_t counts[CARD_UNCHANGED + 1] = {parser.rowCount(), 0, 0};
+
+    size_t len = 0;
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        ChunkBuffer chunks(new CardImportResultSource(parser, counts));
+        uint8_t segment[RESPONSE_SEGMENT];
+        size_t n;
+        len = 0;
+        while ((n = chunks.fill(segment, sizeof(segment))) > 0) {
+            if (len + n <= sizeof(body)) memcpy(body + len, segment, n);
+            len += n;
+        }
+    }
+    state.setBytes(len);
+    state.counter("failed", parser.failedCount());
+    state.counter("body_bytes", len);
+    state.counter("valid_json", len <= sizeof(body) && jsonWellFormed(body, len));
+}
+
+// One op is the ESP32's side of an allowlist report: count and checksum
+// over a full table
+BENCH(allowlist_state) {
+    fillTable();
+    AllowlistState expected = {};
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        expected = allowlistState(table);
+        benchKeep(expected);
+    }
+    state.counter("cards", expected.count);
+}
+
+// The STM32's side of the delta frames, as HandleAllowlistFrame() applies
+// them; also counts the largest batch AllowlistSender wrote in one poll()
+class Stm32Allowlist : public Print {
+public:
+    size_t write(uint8_t c) override {
+        frame[len++] = c;
+        batchBytes++;
+        if (len < FRAME_VALID_CARD_SIZE) return 1;
+        len = 0;
+        const uint8_t* uid = &frame[3];
+        switch (frame[2]) {
+        case ALLOWLIST_OP_ADD:
+            CardAllowlist_add(&list, uid);
+            break;
+        case ALLOWLIST_OP_REMOVE:
+            CardAllowlist_remove(&list, uid);
+            break;
+        case ALLOWLIST_OP_CLEAR:
+            CardAllowlist_clear(&list);
+            list.synced = false;
+            break;
+        case ALLOWLIST_OP_END:
+            list.synced = (((uint32_t)uid[0] << 24) | ((uint32_t)uid[1] << 16) | ((uint32_t)uid[2] << 8) | uid[3]) == list.count;
+            break;
+        }
+        return 1;
+    }
+    using Print::write;
+
+    CardAllowlist list;
+    uint8_t frame[FRAME_VALID_CARD_SIZE];
+    size_t len = 0;
+    size_t batchBytes = 0;
+};
+
+// A card read on the STM32 against a full allowlist, half of them valid.
+// The list arrives through AllowlistSender; the counters check that both
+// sides agree on the checksum and that no batch overfills the STM32's ring.
+BENCH(allowlist_lookup) {
+    static Stm32Allowlist stm32;
+    static uint8_t keys[LOOKUP_KEYS][UID_SIZE];
+    fillTable();
+    CardAllowlist_begin(&stm32.list);
+    AllowlistSender sender;
+    sender.start();
+    uint32_t batches = 0;
+    size_t largestBatch = 0;
+    for (uint32_t ms = 0; sender.busy(); ms++) {
+        stm32.batchBytes = 0;
+        sender.poll(stm32, table, ms);
+        if (stm32.batchBytes) batches++;
+        if (stm32.batchBytes > largestBatch) largestBatch = stm32.batchBytes;
+    }
+    for (int i = 0; i < LOOKUP_KEYS; i++) {
+        uint32_t n = benchRandom() % MAX_VALID_CARDS;
+        makeUid(i & 1 ? 0x10000000 + n * 7919 : 0x20000000 + n, keys[i]);
+    }
+    AllowlistState expected = allowlistState(table);
+    const CardAllowlist& list = stm32.list;
+
+    uint32_t found = 0;
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        found += CardAllowlist_contains(&list, keys[i % LOOKUP_KEYS]);
+    }
+    benchKeep(found);
+    state.counter("checksum_match", list.synced && expected.count == list.count && expected.checksum == list.checksum);
+    state.counter("batches", batches);
+    state.counter("largest_batch_bytes", largestBatch);
+}
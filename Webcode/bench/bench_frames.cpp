@@ -0,0 +1,70 @@
+/*
+ * bench_frames.cpp
+ *
+ * UART frame parsing; one op is one 11-byte card frame.
+ */
+
+#include "bench.h"
+#include "frame_parser.h"
+#include <string.h>
+
+#define STREAM_FRAMES 1024
+
+static size_t putFrame(uint8_t* out, uint32_t n) {
+    out[0] = FRAME_START_BYTE;
+    out[1] = FRAME_TYPE_CARD_DETECTED;
+    out[2] = 0x10;
+    out[3] = 0x20;
+    out[4] = (uint8_t)(n >> 8);
+    out[5] = (uint8_t)n;
+    int32_t weight = 50000 + (int32_t)(n % 1000);
+    out[6] = (uint8_t)(weight >> 24);
+    out[7] = (uint8_t)(weight >> 16);
+    out[8] = (uint8_t)(weight >> 8);
+    out[9] = (uint8_t)weight;
+    out[10] = FRAME_END_BYTE;
+    return FRAME_CARD_SIZE;
+}
+
+// Clean stream, or one with a noise byte after every frame and every 16th
+// frame cut short so the parser has to resynchronise
+static size_t buildStream(uint8_t* out, bool noisy) {
+    size_t len = 0;
+    for (uint32_t n = 0; n < STREAM_FRAMES; n++) {
+        len += putFrame(out + len, n);
+        if (!noisy) continue;
+        if (n % 16 == 15) len -= 4;
+        out[len++] = 0x00;
+    }
+    return len;
+}
+
+static void runParser(BenchState& state, bool noisy) {
+    static uint8_t stream[STREAM_FRAMES * (FRAME_CARD_SIZE + 1)];
+    size_t len = buildStream(stream, noisy);
+    FrameParser parser;
+    CardFrame frame;
+    uint64_t cards = 0;
+    uint64_t fed = 0;
+    size_t pos = 0;
+
+    state.startTimer();
+    while (cards < state.iterations()) {
+        if (parser.feed(stream[pos], &frame) == FRAME_CARD) {
+            cards++;
+            benchKeep(frame);
+        }
+        fed++;
+        if (++pos == len) pos = 0;
+    }
+    state.setBytes(fed / state.iterations());
+    state.counter("bytes/frame", (double)fed / state.iterations());
+}
+
+BENCH(frame_parse) {
+    runParser(state, false);
+}
+
+BENCH(frame_parse_noisy) {
+    runParser(state, true);
+}
@@ -0,0 +1,169 @@
+/*
+ * bench_history.cpp
+ *
+ * Persistent history store on a RAM flash region the size of the
+ * "history" partition, and the compressed RAM cache in front of it.
+ */
+
+#include "bench.h"
+#include "history_store.h"
+#include "history_cache.h"
+#include "ram_flash_region.h"
+
+#define HISTORY_SECTORS    256     // size of the history partition
+#define HISTORY_FILL       20000
+#define HISTORY_CARDS      64
+#define READINGS_PER_VISIT 10      // readings while a patient stands on the scale
+
+static RamFlashRegion region(HISTORY_SECTORS);
+static HistoryStore store;
+
+static void cardUid(uint32_t card, uint8_t* uid) {
+    uid[0] = 0x10;
+    uid[1] = 0x20;
+    uid[2] = 0x30;
+    uid[3] = (uint8_t)card;
+}
+
+// Visits of random cards, READINGS_PER_VISIT readings one second apart,
+// about a minute between visits
+struct ReadingGenerator {
+    uint32_t n = 0;
+    uint32_t time = 1000;
+    uint32_t card = 0;
+    int32_t weight = 60000;
+
+    void next(uint8_t* uid, int32_t* w, uint32_t* t) {
+        if (n++ % READINGS_PER_VISIT == 0) {
+            card = benchRandom() % HISTORY_CARDS;
+            weight = 40000 + (int32_t)(card * 500);
+            time += 60;
+        } else {
+            time += 1;
+        }
+        cardUid(card, uid);
+        *w = weight + (int32_t)(benchRandom() % 21) - 10;
+        *t = time;
+    }
+};
+
+static void fillStore(uint32_t records) {
+    ReadingGenerator gen;
+    uint8_t uid[UID_SIZE];
+    int32_t weight;
+    uint32_t time;
+
+    region.format();
+    store.begin(&region);
+    for (uint32_t i = 0; i < records; i++) {
+        gen.next(uid, &weight, &time);
+        store.append(uid, weight, time, true);
+    }
+    store.flush();
+}
+
+// Steady state including segment erases once the ring has wrapped
+BENCH(history_append) {
+    ReadingGenerator gen;
+    uint8_t uid[UID_SIZE];
+    int32_t weight;
+    uint32_t time;
+
+    region.format();
+    store.begin(&region);
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        gen.next(uid, &weight, &time);
+        store.append(uid, weight, time, true);
+    }
+    state.setBytes(HISTORY_RECORD_SIZE);
+    state.counter("writes/1k", region.writes * 1000.0 / state.iterations());
+    state.counter("erases/1k", region.erases * 1000.0 / state.iterations());
+}
+
+BENCH(history_read) {
+    fillStore(HISTORY_FILL);
+    HistoryRecord rec;
+    uint32_t first = store.firstRecord();
+    uint32_t count = store.count();
+    uint32_t ok = 0;
+
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        ok += store.read(first + benchRandom() % count, &rec);
+    }
+    benchKeep(ok);
+}
+
+BENCH(history_seek_time) {
+    fillStore(HISTORY_FILL);
+    HistoryRecord first;
+    store.read(store.firstRecord(), &first);
+    uint32_t span = store.lastTimestamp() - first.timestamp;
+    uint32_t sum = 0;
+
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        sum += store.seekTime(first.timestamp + benchRandom() % span);
+    }
+    benchKeep(sum);
+}
+
+// One op walks one card's whole chain, newest first
+BENCH(history_card_walk) {
+    fillStore(HISTORY_FILL);
+    uint8_t uid[UID_SIZE];
+    HistoryRecord rec;
+    uint64_t visited = 0;
+
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        cardUid(benchRandom() % HISTORY_CARDS, uid);
+        for (uint32_t r = store.latestFor(uid); r != HISTORY_NO_RECORD; r = store.previousFor(r, rec)) {
+            if (!store.read(r, &rec)) break;
+            visited++;
+        }
+    }
+    state.counter("records/op", (double)visited / state.iterations());
+}
+
+BENCH(history_cache_append) {
+    static HistoryCache cache;
+    ReadingGenerator gen;
+    uint8_t uid[UID_SIZE];
+    int32_t weight;
+    uint32_t time;
+
+    cache.clear();
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        gen.next(uid, &weight, &time);
+        cache.append((uint32_t)i, uid, weight, time, true);
+    }
+    state.counter("bytes/sample", (double)cache.bytesUsed() / cache.count());
+    state.counter("samples", cache.count());
+}
+
+// One op decodes one block
+BENCH(history_cache_decode) {
+    static HistoryCache cache;
+    static HistorySample samples[HISTORY_BLOCK_MAX_SAMPLES];
+    ReadingGenerator gen;
+    uint8_t uid[UID_SIZE];
+    int32_t weight;
+    uint32_t time;
+
+    cache.clear();
+    for (uint32_t i = 0; i < HISTORY_FILL; i++) {
+        gen.next(uid, &weight, &time);
+        cache.append(i, uid, weight, time, true);
+    }
+
+    uint64_t decoded = 0;
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        decoded += cache.decodeBlock(i % cache.blockCount(), samples);
+    }
+    state.setBytes(HISTORY_BLOCK_SIZE);
+    state.counter("samples/op", (double)decoded / state.iterations());
+}
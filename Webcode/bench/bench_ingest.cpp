@@ -0,0 +1,47 @@
+/*
+ * bench_ingest.cpp
+ *
+ * Whole receive path, in process and unpaced: the ceiling the ingest
+ * code itself sets, before link speed and debug output. One op is one
+ * frame of emulator output.
+ */
+
+#include "bench.h"
+#include "stm32_emulator.h"
+#include "ingest_pipeline.h"
+
+#define INGEST_STATIONS 4
+#define INGEST_CARDS    32
+
+static void runIngest(BenchState& state, uint32_t debugPercent, uint32_t corruptPercent) {
+    EmulatorConfig config;
+    config.stations = INGEST_STATIONS;
+    config.cardsPerStation = INGEST_CARDS;
+    config.debugPercent = debugPercent;
+    config.corruptPercent = corruptPercent;
+    Stm32Emulator emulator(config);
+    IngestPipeline* pipeline = new IngestPipeline(INGEST_STATIONS, INGEST_CARDS);
+    EmulatorItem item;
+    CardFrame frame;
+    uint64_t bytes = 0;
+
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        emulator.next(&item);
+        for (size_t b = 0; b < item.len; b++) {
+            pipeline->feed(item.bytes[b], &frame, (uint32_t)(item.dueUs / 1000000));
+        }
+        bytes += item.len;
+    }
+    state.setBytes(bytes / state.iterations());
+    state.counter("stored", (double)pipeline->counters().framesReceived / state.iterations());
+    delete pipeline;
+}
+
+BENCH(ingest_pipeline) {
+    runIngest(state, 0, 0);
+}
+
+BENCH(ingest_pipeline_dirty) {
+    runIngest(state, 20, 5);
+}
@@ -0,0 +1,82 @@
+/*
+ * bench_json.cpp
+ *
+ * API row rendering. string_history_row builds the same row by String
+ * concatenation, the way the handlers did before JsonWriter, to show the
+ * allocations per row that the streaming writer avoids.
+ */
+
+#include "bench.h"
+#include "api_json.h"
+#include "json_writer.h"
+
+#define ROW_BUFFER_SIZE    128
+#define ROLLUP_BUFFER_SIZE 1024
+
+static const uint8_t ROW_UID[UID_SIZE] = {0xDE, 0xAD, 0xBE, 0xEF};
+
+BENCH(json_history_row) {
+    char buf[ROW_BUFFER_SIZE];
+    size_t bytes = 0;
+
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        BufferPrint out(buf, sizeof(buf));
+        printHistoryJson(out, (uint32_t)i, 1700000000 + (uint32_t)i, ROW_UID, 65432, true);
+        bytes = out.length();
+        benchKeep(buf);
+    }
+    state.setBytes(bytes);
+}
+
+static String uidString(const uint8_t* uid) {
+    String s;
+    for (int i = 0; i < UID_SIZE; i++) {
+        if (uid[i] < 0x10) s += "0";
+        String hex((unsigned long)uid[i], HEX);
+        hex.toUpperCase();
+        s += hex;
+        if (i < UID_SIZE - 1) s += ":";
+    }
+    return s;
+}
+
+BENCH(string_history_row) {
+    size_t bytes = 0;
+
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        String row = "{\"recNo\":";
+        row += String((unsigned long)i);
+        row += ",\"time\":";
+        row += String((unsigned long)(1700000000 + i));
+        row += ",\"uid\":\"";
+        row += uidString(ROW_UID);
+        row += "\",\"weight\":";
+        row += String(65432L);
+        row += ",\"valid\":true}";
+        bytes = row.length();
+        benchKeep(row);
+    }
+    state.setBytes(bytes);
+}
+
+BENCH(json_rollup) {
+    static WeightRollup rollup;
+    static char buf[ROLLUP_BUFFER_SIZE];
+    rollup.clear();
+    for (uint32_t i = 0; i < 200; i++) {
+        rollup.add(ROW_UID, 60000 + (int32_t)(i % 50) * 10, 1700000000 + i * 3000);
+    }
+    const PatientRollup* p = rollup.find(ROW_UID);
+    size_t bytes = 0;
+
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        BufferPrint out(buf, sizeof(buf));
+        printRollupJson(out, p);
+        bytes = out.length();
+        benchKeep(buf);
+    }
+    state.setBytes(bytes);
+}
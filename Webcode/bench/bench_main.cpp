@@ -0,0 +1,212 @@
+/*
+ * bench_main.cpp
+ *
+ * Usage: program [--min-ms N] [--list] [filter...]
+ *        program ingest [options]      (see ingest_stress.cpp)
+ *        program http [options]        (see http_load.cpp)
+ *        program soak [options]        (see soak.cpp)
+ *        program hx711 [options]       (see hx711_sim.cpp)
+ *        program heap [options]        (see heap_peak.cpp)
+ * Runs every benchmark whose name contains one of the filters (all of
+ * them without a filter).
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#define BENCH_MAX 64
+#define BENCH_DEFAULT_MIN_MS 200
+#define BENCH_MAX_ITERATIONS (1ULL << 32)
+
+struct BenchEntry {
+    const char* name;
+    BenchFn fn;
+};
+
+static BenchEntry benches[BENCH_MAX];
+static int benchCount = 0;
+static std::atomic<uint64_t> allocCount(0);
+static std::atomic<int64_t> heapInUse(0);
+static std::atomic<int64_t> heapPeak(0);
+
+// Count every heap allocation made through new, which is also what the
+// native String and Print::printf use, and the bytes held. Atomic because
+// the ingest and http runners allocate from several threads. The peak is
+// the most ever held since benchHeapPeakReset().
+void* operator new(size_t size) {
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    int64_t held = malloc_usable_size(p);
+    int64_t inUse = heapInUse.fetch_add(held, std::memory_order_relaxed) + held;
+    int64_t peak = heapPeak.load(std::memory_order_relaxed);
+    while (inUse > peak && !heapPeak.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {
+    }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    if (p) heapInUse.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+uint64_t benchAllocCount() {
+    return allocCount.load(std::memory_order_relaxed);
+}
+
+int64_t benchHeapInUse() {
+    return heapInUse.load(std::memory_order_relaxed);
+}
+
+int64_t benchHeapPeak() {
+    return heapPeak.load(std::memory_order_relaxed);
+}
+
+void benchHeapPeakReset() {
+    heapPeak.store(heapInUse.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+uint64_t benchNowNs() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+uint32_t benchRandom() {
+    // xorshift32
+    static uint32_t x = 2463534242UL;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+BenchState::BenchState(uint64_t n)
+    : startNs(benchNowNs()), startAllocs(benchAllocCount()), bytes(0), counterCount(0), iters(n) {
+}
+
+void BenchState::startTimer() {
+    startAllocs = benchAllocCount();
+    startNs = benchNowNs();
+}
+
+void BenchState::counter(const char* name, double value) {
+    for (int i = 0; i < counterCount; i++) {
+        if (strcmp(counterName[i], name) == 0) {
+            counterValue[i] = value;
+            return;
+        }
+    }
+    if (counterCount < BENCH_MAX_COUNTERS) {
+        counterName[counterCount] = name;
+        counterValue[counterCount++] = value;
+    }
+}
+
+BenchRegistration::BenchRegistration(const char* name, BenchFn fn) {
+    if (benchCount < BENCH_MAX) {
+        benches[benchCount].name = name;
+        benches[benchCount++].fn = fn;
+    }
+}
+
+static bool selected(const char* name, char** filters, int filterCount) {
+    if (!filterCount) return true;
+    for (int i = 0; i < filterCount; i++) {
+        if (strstr(name, filters[i])) return true;
+    }
+    return false;
+}
+
+static void runBench(const BenchEntry& bench, uint64_t minNs) {
+    uint64_t n = 1;
+    for (;;) {
+        BenchState state(n);
+        bench.fn(state);
+        uint64_t elapsed = benchNowNs() - state.startNs;
+        uint64_t allocs = benchAllocCount() - state.startAllocs;
+
+        if (elapsed < minNs && n < BENCH_MAX_ITERATIONS) {
+            // Aim a little past the target so the next run usually is the last
+            uint64_t next = elapsed ? (uint64_t)((double)n * minNs * 1.25 / elapsed) : n * 100;
+            if (next <= n) next = n * 2;
+            if (next > n * 100) next = n * 100;
+            n = next;
+            continue;
+        }
+
+        double nsPerOp = (double)elapsed / n;
+        printf("%-28s %12llu %12.1f ns/op %8.2f allocs/op", bench.name,
+               (unsigned long long)n, nsPerOp, (double)allocs / n);
+        if (state.bytes) {
+            printf(" %9.1f MB/s", state.bytes * 1000.0 / nsPerOp);
+        }
+        for (int i = 0; i < state.counterCount; i++) {
+            printf("  %s=%.4g", state.counterName[i], state.counterValue[i]);
+        }
+        printf("\n");
+        fflush(stdout);
+        return;
+    }
+}
+
+int main(int argc, char** argv) {
+    uint64_t minMs = BENCH_DEFAULT_MIN_MS;
+    char* filters[BENCH_MAX];
+    int filterCount = 0;
+
+    if (argc > 1 && strcmp(argv[1], "ingest") == 0) {
+        return ingestStress(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "http") == 0) {
+        return httpLoad(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "soak") == 0) {
+        return heapSoak(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "hx711") == 0) {
+        return hx711Sim(argc - 1, argv + 1);
+    }
+    if (argc > 1 && strcmp(argv[1], "heap") == 0) {
+        return heapHighWater(argc - 1, argv + 1);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+            minMs = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--list") == 0) {
+            for (int b = 0; b < benchCount; b++) printf("%s\n", benches[b].name);
+            return 0;
+        } else if (filterCount < BENCH_MAX) {
+            filters[filterCount++] = argv[i];
+        }
+    }
+
+    for (int b = 0; b < benchCount; b++) {
+        if (selected(benches[b].name, filters, filterCount)) {
+            runBench(benches[b], minMs * 1000000ULL);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * bench_rollup.cpp
+ *
+ * Per-patient summaries, updated once per reading.
+ */
+
+#include "bench.h"
+#include "weight_rollup.h"
+
+BENCH(rollup_add) {
+    static WeightRollup rollup;
+    uint8_t uid[UID_SIZE] = {0x10, 0x20, 0x30, 0x00};
+    uint32_t time = 1700000000;
+
+    rollup.clear();
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        uid[3] = (uint8_t)(benchRandom() % ROLLUP_MAX_PATIENTS);
+        time += 7;
+        rollup.add(uid, 50000 + (int32_t)(benchRandom() % 20000), time);
+    }
+    state.counter("patients", rollup.size());
+}
@@ -0,0 +1,208 @@
+/*
+ * heap_peak.cpp
+ *
+ * "program heap [options]": peak heap of the streamed JSON lists against
+ * row count. For each size the run builds a card table, a history log and
+ * a rollup table of that many rows (cards up to MAX_VALID_CARDS, patients
+ * up to ROLLUP_MAX_PATIENTS) and renders /cards, one /api/history page
+ * over the whole log (not capped at HISTORY_API_MAX_ROWS, so the row
+ * count is the only thing that changes) and /api/rollup. Each body goes
+ * through ChunkBuffer in one-segment pieces, held by a shared_ptr as
+ * sendChunked() does, and is checked to be well-formed JSON.
+ *
+ * The peak is the most heap held above what was in use before the
+ * request. A streamed list must stay at its source and buffer whatever
+ * the row count; the run fails if any list peaks higher at a later size
+ * than at the first one (the smallest, by default).
+ */
+
+#include "bench.h"
+#include "api_sources.h"
+#include "json_check.h"
+#include "ram_flash_region.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+
+#define HEAP_SEGMENT          1436     // TCP segment, as in the http runner
+#define HEAP_CARD_SECTORS     32       // cardlog partition
+#define HEAP_HISTORY_SECTORS  1024     // room for 200k records
+#define HEAP_MAX_SIZES        8
+#define HEAP_BODY_MAX         (32 * 1024 * 1024)
+
+enum HeapList {
+    HEAP_CARDS,
+    HEAP_HISTORY,
+    HEAP_ROLLUP,
+    HEAP_LISTS
+};
+
+static const char* const listNames[HEAP_LISTS] = {"/cards", "/api/history", "/api/rollup"};
+
+struct HeapOptions {
+    uint32_t sizes[HEAP_MAX_SIZES] = {10, 100, 1000, 10000};
+    int sizeCount = 4;
+};
+
+struct HeapResult {
+    uint32_t rows;
+    uint64_t bodyBytes;
+    int64_t peak;
+    uint64_t allocs;
+    bool valid;
+};
+
+// Body copied into a buffer allocated up front, so checking it costs no
+// heap during the request
+static char* body;
+
+static CardTable* replayTable;
+
+static void replayCard(uint8_t type, const uint8_t* uid, const char* name) {
+    replayTable->applyRecord(type, uid, name);
+}
+
+static bool liveCard(const uint8_t* uid, char* name, size_t nameSize) {
+    return replayTable->liveState(uid, name, nameSize);
+}
+
+static void fixtureUid(uint32_t n, uint8_t* uid) {
+    uid[0] = 0x6A;
+    uid[1] = (uint8_t)(n >> 16);
+    uid[2] = (uint8_t)(n >> 8);
+    uid[3] = (uint8_t)n;
+}
+
+// One request: the source is created inside the measurement, as the
+// handlers create theirs
+template <typename MakeSource>
+static HeapResult render(MakeSource makeSource, uint32_t rows) {
+    HeapResult result = {rows, 0, 0, 0, false};
+    int64_t before = benchHeapInUse();
+    uint64_t allocs = benchAllocCount();
+    benchHeapPeakReset();
+    {
+        std::shared_ptr<ChunkBuffer> chunks = std::make_shared<ChunkBuffer>(makeSource());
+        uint8_t segment[HEAP_SEGMENT];
+        size_t n;
+        while ((n = chunks->fill(segment, sizeof(segment))) > 0) {
+            if (result.bodyBytes + n <= HEAP_BODY_MAX) memcpy(body + result.bodyBytes, segment, n);
+            result.bodyBytes += n;
+        }
+    }
+    result.peak = benchHeapPeak() - before;
+    result.allocs = benchAllocCount() - allocs;
+    result.valid = result.bodyBytes <= HEAP_BODY_MAX && jsonWellFormed(body, result.bodyBytes);
+    return result;
+}
+
+// One fixture of the given size and its three lists
+static void runSize(uint32_t size, HeapResult* results) {
+    RamFlashRegion cardRegion(HEAP_CARD_SECTORS);
+    RamFlashRegion historyRegion(HEAP_HISTORY_SECTORS);
+    CardJournal journal;
+    std::unique_ptr<CardTable> table(new CardTable(&journal));
+    std::unique_ptr<HistoryCache> cache(new HistoryCache());
+    std::unique_ptr<WeightRollup> rollup(new WeightRollup());
+    HistoryStore store;
+    uint8_t uid[UID_SIZE];
+
+    uint32_t cards = size < MAX_VALID_CARDS ? size : MAX_VALID_CARDS;
+    uint32_t patients = size < ROLLUP_MAX_PATIENTS ? size : ROLLUP_MAX_PATIENTS;
+    replayTable = table.get();
+    journal.begin(&cardRegion, replayCard, liveCard);
+    journal.beginBatch();
+    for (uint32_t c = 0; c < cards; c++) {
+        fixtureUid(c, uid);
+        table->add(uid);
+    }
+    journal.commitBatch();
+
+    // Readings spread over the patients, as the ingest path stores them
+    store.begin(&historyRegion);
+    for (uint32_t r = 0; r < size; r++) {
+        fixtureUid(r % patients, uid);
+        int32_t weight = 40000 + (int32_t)(benchRandom() % 40000);
+        uint32_t timestamp = 1700000000 + r * 60;
+        uint32_t recNo = store.endRecord();
+        if (store.append(uid, weight, timestamp, true)) {
+            cache->append(recNo, uid, weight, timestamp, true);
+        }
+        rollup->add(uid, weight, timestamp);
+    }
+
+    uint32_t start;
+    historyPageStart(store, nullptr, nullptr, 0, 0xFFFFFFFFUL, &start);
+    results[HEAP_CARDS] = render([&] { return new CardListSource(*table); }, cards);
+    results[HEAP_HISTORY] = render([&] {
+        return new HistorySource(store, *cache, nullptr, start, 0, 0xFFFFFFFFUL, (int)size);
+    }, store.count());
+    results[HEAP_ROLLUP] = render([&] { return new RollupListSource(*rollup); }, rollup->size());
+    replayTable = nullptr;
+}
+
+static bool parseSizes(const char* text, HeapOptions* opt) {
+    opt->sizeCount = 0;
+    while (*text && opt->sizeCount < HEAP_MAX_SIZES) {
+        char* end;
+        opt->sizes[opt->sizeCount++] = strtoul(text, &end, 10);
+        if (end == text) return false;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return opt->sizeCount > 0;
+}
+
+static bool parseOptions(int argc, char** argv, HeapOptions* opt) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            if (!parseSizes(argv[++i], opt)) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: program heap [--sizes N,N,...]\n");
+}
+
+int heapHighWater(int argc, char** argv) {
+    HeapOptions opt;
+    if (!parseOptions(argc, argv, &opt)) {
+        usage();
+        return 2;
+    }
+
+    body = (char*)malloc(HEAP_BODY_MAX);
+    if (!body) return 1;
+
+    HeapResult results[HEAP_MAX_SIZES][HEAP_LISTS];
+    printf("%-14s %8s %12s %12s %10s  %s\n", "list", "rows", "body bytes", "peak heap", "allocs", "json");
+    for (int s = 0; s < opt.sizeCount; s++) {
+        runSize(opt.sizes[s], results[s]);
+        for (int l = 0; l < HEAP_LISTS; l++) {
+            const HeapResult& r = results[s][l];
+            printf("%-14s %8lu %12llu %12lld %10llu  %s\n", listNames[l], (unsigned long)r.rows,
+                   (unsigned long long)r.bodyBytes, (long long)r.peak, (unsigned long long)r.allocs,
+                   r.valid ? "ok" : "INVALID");
+        }
+    }
+    free(body);
+
+    bool ok = true;
+    for (int l = 0; l < HEAP_LISTS; l++) {
+        for (int s = 0; s < opt.sizeCount; s++) {
+            if (!results[s][l].valid) ok = false;
+            if (results[s][l].peak > results[0][l].peak) {
+                printf("FAIL %s: peak heap %lld bytes at %lu rows, %lld at %lu\n", listNames[l],
+                       (long long)results[s][l].peak, (unsigned long)results[s][l].rows,
+                       (long long)results[0][l].peak, (unsigned long)results[0][l].rows);
+                ok = false;
+            }
+        }
+    }
+    printf("%s\n", ok ? "peak heap does not grow with the row count" : "FAILED");
+    return ok ? 0 : 1;
+}
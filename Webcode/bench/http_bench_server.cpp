@@ -0,0 +1,423 @@
+/*
+ * http_bench_server.cpp
+ */
+
+#include "http_bench_server.h"
+#include "card_transfer.h"
+#include "web_assets.h"
+#include "bench.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HTTP_BENCH_READ_SIZE 4096
+#define HTTP_BENCH_POLL_MS   10
+
+HttpBenchServer* HttpBenchServer::active = nullptr;
+
+// /data body, as main.cpp's PrintFnSource(printLatestReadingJson)
+class ReadingSource : public ResponseSource {
+public:
+    ReadingSource(const CardReading& reading, uint32_t historyCount)
+        : reading(reading), historyCount(historyCount) {}
+
+    bool next(Print& out) override {
+        printReadingJson(out, reading, historyCount);
+        return false;
+    }
+
+private:
+    const CardReading& reading;
+    uint32_t historyCount;
+};
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Value of name in a query string or form body, percent-decoded
+static bool formArg(const std::string& form, const char* name, std::string* value) {
+    size_t nameLen = strlen(name);
+    size_t pos = 0;
+    while (pos <= form.size()) {
+        size_t end = form.find('&', pos);
+        if (end == std::string::npos) end = form.size();
+        if (end - pos > nameLen && form.compare(pos, nameLen, name) == 0 && form[pos + nameLen] == '=') {
+            value->clear();
+            for (size_t i = pos + nameLen + 1; i < end; i++) {
+                char c = form[i];
+                if (c == '+') {
+                    c = ' ';
+                } else if (c == '%' && i + 2 < end && hexDigit(form[i + 1]) >= 0 && hexDigit(form[i + 2]) >= 0) {
+                    c = (char)(hexDigit(form[i + 1]) << 4 | hexDigit(form[i + 2]));
+                    i += 2;
+                }
+                *value += c;
+            }
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+static const char* statusText(int code) {
+    switch (code) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    default: return "Not Found";
+    }
+}
+
+static void appendHeader(std::string& out, int code, const char* contentType) {
+    char line[160];
+    snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nConnection: keep-alive\r\n",
+             code, statusText(code), contentType);
+    out += line;
+}
+
+static void appendLength(std::string& out, size_t length) {
+    char line[48];
+    snprintf(line, sizeof(line), "Content-Length: %lu\r\n\r\n", (unsigned long)length);
+    out += line;
+}
+
+HttpBenchServer::HttpBenchServer(uint32_t cards, uint32_t historyRecords)
+    : listenFd(-1), stopping(false),
+      cardRegion(HTTP_BENCH_CARD_SECTORS), historyRegion(HTTP_BENCH_HISTORY_SECTORS), latest(), queried(0) {
+    table = new CardTable(&journal);
+    cache = new HistoryCache();
+    active = this;
+
+    uint8_t uid[UID_SIZE];
+    journal.begin(&cardRegion, replayCard, liveCard);
+    journal.beginBatch();
+    for (uint32_t c = 0; c < cards; c++) {
+        cardUid(c, uid);
+        table->add(uid);
+    }
+    journal.commitBatch();
+
+    store.begin(&historyRegion);
+    for (uint32_t r = 0; r < historyRecords; r++) {
+        uint32_t card = r;
+        if (cards > 1) {
+            card = r % HTTP_BENCH_QUERY_SHARE == 0 ? 0 : 1 + r % (cards - 1);
+        } else if (cards) {
+            card = 0;
+        }
+        if (card == 0) queried++;
+        cardUid(card, uid);
+        int32_t weight = 40000 + (int32_t)(benchRandom() % 40000);
+        uint32_t timestamp = 1000000 + r;
+        bool isValid = table->isValid(uid);
+        uint32_t recNo = store.endRecord();
+        if (store.append(uid, weight, timestamp, isValid)) {
+            cache->append(recNo, uid, weight, timestamp, isValid);
+        }
+        latest.card = cardKey(uid);
+        latest.isValid = isValid;
+        latest.weight = weight;
+        latest.timestamp = timestamp;
+        latest.hasData = true;
+    }
+}
+
+HttpBenchServer::~HttpBenchServer() {
+    for (Connection& conn : conns) close(conn.fd);
+    if (listenFd >= 0) close(listenFd);
+    if (active == this) active = nullptr;
+    delete cache;
+    delete table;
+}
+
+void HttpBenchServer::cardUid(uint32_t card, uint8_t* uid) {
+    uid[0] = 0x5A;
+    uid[1] = 0x00;
+    uid[2] = card >> 8;
+    uid[3] = card;
+}
+
+void HttpBenchServer::replayCard(uint8_t type, const uint8_t* uid, const char* name) {
+    active->table->applyRecord(type, uid, name);
+}
+
+bool HttpBenchServer::liveCard(const uint8_t* uid, char* name, size_t nameSize) {
+    return active->table->liveState(uid, name, nameSize);
+}
+
+uint16_t HttpBenchServer::listenLoopback() {
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listenFd < 0) return 0;
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 64) != 0 ||
+        getsockname(listenFd, (struct sockaddr*)&addr, &len) != 0) {
+        close(listenFd);
+        listenFd = -1;
+        return 0;
+    }
+    return ntohs(addr.sin_port);
+}
+
+void HttpBenchServer::run() {
+    std::vector<struct pollfd> fds;
+    while (!stopping.load()) {
+        fds.clear();
+        fds.push_back({listenFd, POLLIN, 0});
+        for (const Connection& conn : conns) {
+            short events = conn.sent < conn.out.size() ? POLLOUT : POLLIN;
+            fds.push_back({conn.fd, events, 0});
+        }
+        int ready = poll(fds.data(), fds.size(), HTTP_BENCH_POLL_MS);
+
+        // Background upkeep as in loop()
+        journal.maintain();
+        store.maintain(millis());
+        if (ready <= 0) continue;
+
+        // Connections first: fds[i + 1] belongs to conns[i]
+        for (size_t i = conns.size(); i-- > 0;) {
+            short revents = fds[i + 1].revents;
+            if (revents && !service(conns[i], revents)) {
+                close(conns[i].fd);
+                conns.erase(conns.begin() + i);
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                conns.push_back({fd, std::string(), std::string(), 0});
+            }
+        }
+    }
+}
+
+// Read what arrived, answer every complete request, send what fits.
+// Returns false once the connection is closed or unusable.
+bool HttpBenchServer::service(Connection& conn, short revents) {
+    if (revents & (POLLERR | POLLNVAL)) return false;
+
+    if (revents & (POLLIN | POLLHUP)) {
+        char buf[HTTP_BENCH_READ_SIZE];
+        for (;;) {
+            ssize_t n = read(conn.fd, buf, sizeof(buf));
+            if (n > 0) {
+                conn.in.append(buf, n);
+                continue;
+            }
+            if (n == 0) return false;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno != EINTR) return false;
+        }
+    }
+
+    for (;;) {
+        size_t headerEnd = conn.in.find("\r\n\r\n");
+        if (headerEnd == std::string::npos) {
+            if (conn.in.size() > HTTP_BENCH_MAX_REQUEST) return false;
+            break;
+        }
+        size_t lineEnd = conn.in.find("\r\n");
+        size_t sp1 = conn.in.find(' ');
+        size_t sp2 = conn.in.find(' ', sp1 + 1);
+        if (sp1 == std::string::npos || sp2 == std::string::npos || sp2 > lineEnd) return false;
+
+        size_t contentLength = 0;
+        std::string ifNoneMatch;
+        for (size_t pos = lineEnd + 2; pos < headerEnd;) {
+            size_t end = conn.in.find("\r\n", pos);
+            const char* line = conn.in.c_str() + pos;
+            if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                contentLength = strtoul(line + 15, nullptr, 10);
+            } else if (strncasecmp(line, "If-None-Match:", 14) == 0) {
+                size_t v = pos + 14;
+                while (v < end && conn.in[v] == ' ') v++;
+                ifNoneMatch = conn.in.substr(v, end - v);
+            }
+            pos = end + 2;
+        }
+        if (contentLength > HTTP_BENCH_MAX_REQUEST) return false;
+        size_t total = headerEnd + 4 + contentLength;
+        if (conn.in.size() < total) break;
+
+        handle(conn, conn.in.substr(0, sp1), conn.in.substr(sp1 + 1, sp2 - sp1 - 1), ifNoneMatch,
+               conn.in.substr(headerEnd + 4, contentLength));
+        conn.in.erase(0, total);
+    }
+
+    while (conn.sent < conn.out.size()) {
+        ssize_t n = write(conn.fd, conn.out.data() + conn.sent, conn.out.size() - conn.sent);
+        if (n > 0) {
+            conn.sent += n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return false;
+        }
+    }
+    if (conn.sent == conn.out.size()) {
+        conn.out.clear();
+        conn.sent = 0;
+    }
+    return true;
+}
+
+void HttpBenchServer::handle(Connection& conn, const std::string& method, const std::string& target,
+                             const std::string& ifNoneMatch, const std::string& body) {
+    size_t q = target.find('?');
+    std::string path = target.substr(0, q);
+    std::string query = q == std::string::npos ? std::string() : target.substr(q + 1);
+
+    if (method == "GET") {
+        if (path == "/data") {
+            sendChunked(conn, "application/json", new ReadingSource(latest, store.count()));
+        } else if (path == "/cards") {
+            sendChunked(conn, "application/json", new CardListSource(*table));
+        } else if (path == "/api/history") {
+            handleHistory(conn, query);
+        } else {
+            handleStatic(conn, path.c_str(), ifNoneMatch);
+        }
+    } else if (method == "POST" && path == "/add_card") {
+        handleCardChange(conn, body, true);
+    } else if (method == "POST" && path == "/remove_card") {
+        handleCardChange(conn, body, false);
+    } else {
+        sendText(conn, 404, "text/plain", "Not found");
+    }
+}
+
+// As handleStaticAsset()
+void HttpBenchServer::handleStatic(Connection& conn, const char* path, const std::string& ifNoneMatch) {
+    const WebAsset* asset = findWebAsset(path);
+    if (!asset) {
+        sendText(conn, 404, "text/plain", "Not found");
+        return;
+    }
+    const char* cacheControl = asset->immutable ? "public, max-age=31536000, immutable" : "no-cache";
+    bool notModified = ifNoneMatch == asset->etag;
+    appendHeader(conn.out, notModified ? 304 : 200, asset->contentType);
+    if (!notModified) conn.out += "Content-Encoding: gzip\r\n";
+    conn.out += "ETag: ";
+    conn.out += asset->etag;
+    conn.out += "\r\nCache-Control: ";
+    conn.out += cacheControl;
+    conn.out += "\r\n";
+    if (notModified) {
+        appendLength(conn.out, 0);
+        return;
+    }
+    appendLength(conn.out, asset->length);
+    conn.out.append((const char*)asset->data, asset->length);
+}
+
+// As handleHistoryApi()
+void HttpBenchServer::handleHistory(Connection& conn, const std::string& query) {
+    std::string arg;
+    bool filtered = formArg(query, "uid", &arg);
+    uint8_t filterUid[UID_SIZE];
+    if (filtered && !parseUid(arg.c_str(), arg.size(), filterUid)) {
+        sendText(conn, 400, "application/json", "{\"error\":\"invalid uid\"}");
+        return;
+    }
+    uint32_t since = 0;
+    uint32_t until = 0xFFFFFFFFUL;
+    if (formArg(query, "since", &arg)) since = strtoul(arg.c_str(), nullptr, 10);
+    if (formArg(query, "until", &arg)) until = strtoul(arg.c_str(), nullptr, 10);
+    bool resume = formArg(query, "cursor", &arg);
+    uint32_t cursor = 0;
+    if (resume) {
+        char* end;
+        cursor = strtoul(arg.c_str(), &end, 16);
+        if (arg.size() != HISTORY_CURSOR_SIZE - 1 || *end != '\0' || cursor == HISTORY_NO_RECORD) {
+            sendText(conn, 400, "application/json", "{\"error\":\"invalid cursor\"}");
+            return;
+        }
+    }
+    int limit = HTTP_BENCH_PAGE_ROWS;
+    if (formArg(query, "limit", &arg)) {
+        limit = atoi(arg.c_str());
+        if (limit < 1) limit = 1;
+        if (limit > HTTP_BENCH_MAX_ROWS) limit = HTTP_BENCH_MAX_ROWS;
+    }
+
+    uint32_t start;
+    if (!historyPageStart(store, filtered ? filterUid : nullptr, resume ? &cursor : nullptr,
+                          since, until, &start)) {
+        sendText(conn, 400, "application/json", "{\"error\":\"invalid cursor\"}");
+        return;
+    }
+    sendChunked(conn, "application/json",
+                new HistorySource(store, *cache, filtered ? filterUid : nullptr, start, since, until, limit));
+}
+
+// As handleAddCard() / handleRemoveCard(), without the SSE notification
+void HttpBenchServer::handleCardChange(Connection& conn, const std::string& body, bool add) {
+    std::string arg;
+    if (!formArg(body, "uid", &arg)) {
+        sendText(conn, 400, "text/plain", "Missing UID parameter");
+        return;
+    }
+    const char* html;
+    uint8_t uid[UID_SIZE];
+    if (!parseUid(arg.c_str(), arg.size(), uid)) {
+        html = "<meta charset='UTF-8'><script>alert('Định dạng UID không hợp lệ!'); window.location.href='/manage';</script>";
+    } else if (add) {
+        html = table->add(uid)
+            ? "<meta charset='UTF-8'><script>alert('Đã thêm thẻ thành công!'); window.location.href='/manage';</script>"
+            : "<meta charset='UTF-8'><script>alert('Thêm thẻ thất bại!'); window.location.href='/manage';</script>";
+    } else {
+        html = table->remove(uid)
+            ? "<meta charset='UTF-8'><script>alert('Đã xóa thẻ thành công!'); window.location.href='/manage';</script>"
+            : "<meta charset='UTF-8'><script>alert('Xóa thẻ thất bại!'); window.location.href='/manage';</script>";
+    }
+    sendText(conn, 200, "text/html; charset=UTF-8", html);
+}
+
+void HttpBenchServer::sendText(Connection& conn, int code, const char* contentType, const char* text) {
+    size_t len = strlen(text);
+    appendHeader(conn.out, code, contentType);
+    appendLength(conn.out, len);
+    conn.out.append(text, len);
+}
+
+// As sendChunked() in chunked_response.cpp: one HTTP chunk per segment
+void HttpBenchServer::sendChunked(Connection& conn, const char* contentType, ResponseSource* src) {
+    appendHeader(conn.out, 200, contentType);
+    conn.out += "Transfer-Encoding: chunked\r\n\r\n";
+
+    ChunkBuffer body(src);
+    uint8_t segment[HTTP_BENCH_SEGMENT];
+    size_t n;
+    while ((n = body.fill(segment, sizeof(segment))) > 0) {
+        char size[20];
+        snprintf(size, sizeof(size), "%lx\r\n", (unsigned long)n);
+        conn.out += size;
+        conn.out.append((const char*)segment, n);
+        conn.out += "\r\n";
+    }
+    conn.out += "0\r\n\r\n";
+}
@@ -0,0 +1,90 @@
+/*
+ * http_bench_server.h
+ *
+ * Host stand-in for the firmware's web server: the routes of main.cpp
+ * served from the same stores, assets and response sources on a loopback
+ * socket. One thread runs every connection from a poll() loop, as the
+ * AsyncTCP task does; streamed bodies go out as HTTP chunks of one TCP
+ * segment each, the window AsyncWebServer fills per send. Handlers are
+ * copies of main.cpp's (same responses, same store calls); the ESP32 TCP
+ * stack and Wi-Fi are not modelled.
+ */
+
+#ifndef HTTP_BENCH_SERVER_H_
+#define HTTP_BENCH_SERVER_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "card_table.h"
+#include "history_store.h"
+#include "history_cache.h"
+#include "api_json.h"
+#include "api_sources.h"
+#include "ram_flash_region.h"
+
+#define HTTP_BENCH_SEGMENT         1436   // TCP MSS of the ESP32 over Wi-Fi
+#define HTTP_BENCH_CARD_SECTORS    32     // cardlog partition, 128 KB
+#define HTTP_BENCH_HISTORY_SECTORS 256    // history partition, 1 MB
+#define HTTP_BENCH_MAX_REQUEST     4096
+#define HTTP_BENCH_PAGE_ROWS       50     // as HISTORY_PAGE_ROWS in main.cpp
+#define HTTP_BENCH_MAX_ROWS        500    // as HISTORY_API_MAX_ROWS
+#define HTTP_BENCH_QUERY_SHARE     16     // 1 in N readings is card 0's
+
+class HttpBenchServer {
+public:
+    // Registers cards 0 .. cards - 1 (UID 5A:00:hi:lo) and stores
+    // historyRecords readings spread over them, one second apart. Card 0,
+    // the one /api/history?uid= asks for, is a patient weighed often: it
+    // gets every HTTP_BENCH_QUERY_SHARE-th reading, the others take turns.
+    HttpBenchServer(uint32_t cards, uint32_t historyRecords);
+    ~HttpBenchServer();
+
+    // Listen on 127.0.0.1 at an ephemeral port; returns it, 0 on failure
+    uint16_t listenLoopback();
+
+    // Serve until stop() is called from another thread
+    void run();
+    void stop() { stopping.store(true); }
+
+    static void cardUid(uint32_t card, uint8_t* uid);
+
+    // Readings of card 0 in the history
+    uint32_t queriedCardRecords() const { return queried; }
+
+private:
+    struct Connection {
+        int fd;
+        std::string in;
+        std::string out;
+        size_t sent;
+    };
+
+    bool service(Connection& conn, short revents);
+    void handle(Connection& conn, const std::string& method, const std::string& target,
+                const std::string& ifNoneMatch, const std::string& body);
+    void handleStatic(Connection& conn, const char* path, const std::string& ifNoneMatch);
+    void handleHistory(Connection& conn, const std::string& query);
+    void handleCardChange(Connection& conn, const std::string& body, bool add);
+    void sendText(Connection& conn, int code, const char* contentType, const char* text);
+    void sendChunked(Connection& conn, const char* contentType, ResponseSource* src);
+
+    static void replayCard(uint8_t type, const uint8_t* uid, const char* name);
+    static bool liveCard(const uint8_t* uid, char* name, size_t nameSize);
+    static HttpBenchServer* active;
+
+    int listenFd;
+    std::atomic<bool> stopping;
+    std::vector<Connection> conns;
+    RamFlashRegion cardRegion;
+    RamFlashRegion historyRegion;
+    CardJournal journal;
+    CardTable* table;
+    HistoryStore store;
+    HistoryCache* cache;
+    CardReading latest;
+    uint32_t queried;
+};
+
+#endif /* HTTP_BENCH_SERVER_H_ */
@@ -0,0 +1,363 @@
+/*
+ * http_load.cpp
+ *
+ * "program http [options]": keep-alive clients load each web route of
+ * HttpBenchServer in turn, for every fixture size, and the run reports
+ * requests/s, latency percentiles and bytes per response:
+ *
+ *   /, /manage, /weight_history   page loads (gzipped assets)
+ *   / (304)                       revalidation with If-None-Match
+ *   /data                         latest reading
+ *   /cards                        card list for /manage
+ *   /api/history                  first page of /weight_history
+ *   /api/history?uid=             one card's page, walked on its chain
+ *   /add_card, /remove_card       run together: each client adds its own
+ *                                 card, then removes it again
+ *
+ * A fixture size sets the number of history records and of registered
+ * cards; cards stop short of MAX_VALID_CARDS by one per client so the
+ * adds still fit. The ?uid= card has one reading in HTTP_BENCH_QUERY_SHARE,
+ * and the fixture line reports how many that is.
+ */
+
+#include "bench.h"
+#include "http_bench_server.h"
+#include "web_assets.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define LOAD_MAX_SIZES   8
+#define LOAD_MAX_FILTERS 8
+#define LOAD_READ_SIZE   16384
+
+enum LoadKind {
+    LOAD_GET,
+    LOAD_REVALIDATE,
+    LOAD_ADD,
+    LOAD_REMOVE
+};
+
+struct LoadRoute {
+    const char* name;
+    LoadKind kind;
+    const char* target;
+};
+
+static const LoadRoute loadRoutes[] = {
+    {"/", LOAD_GET, "/"},
+    {"/ (304)", LOAD_REVALIDATE, "/"},
+    {"/manage", LOAD_GET, "/manage"},
+    {"/weight_history", LOAD_GET, "/weight_history"},
+    {"/data", LOAD_GET, "/data"},
+    {"/cards", LOAD_GET, "/cards"},
+    {"/api/history", LOAD_GET, "/api/history?limit=50"},
+    {"/api/history?uid=", LOAD_GET, "/api/history?limit=50&uid=5A%3A00%3A00%3A00"},
+    {"/add_card", LOAD_ADD, "/add_card"},
+    {"/remove_card", LOAD_REMOVE, "/remove_card"},
+};
+#define LOAD_ROUTE_COUNT (sizeof(loadRoutes) / sizeof(loadRoutes[0]))
+
+struct LoadOptions {
+    uint32_t clients = 10;
+    uint32_t seconds = 2;
+    uint32_t sizes[LOAD_MAX_SIZES] = {50, 1000, 10000};
+    int sizeCount = 3;
+    const char* filters[LOAD_MAX_FILTERS];
+    int filterCount = 0;
+};
+
+// Per client and route of a phase
+struct RouteStats {
+    std::vector<uint32_t> latencyUs;
+    uint64_t bodyBytes = 0;
+    uint64_t wireBytes = 0;
+    uint64_t errors = 0;
+};
+
+// Blocking keep-alive connection reading one response at a time
+class LoadClient {
+public:
+    LoadClient() : fd(-1), pos(0) {}
+    ~LoadClient() {
+        if (fd >= 0) close(fd);
+    }
+
+    bool connectTo(uint16_t port) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return false;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        return connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+
+    bool send(const std::string& request) {
+        size_t done = 0;
+        while (done < request.size()) {
+            ssize_t n = write(fd, request.data() + done, request.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += n;
+        }
+        return true;
+    }
+
+    // Read one response; body is the decoded body
+    bool receive(int* status, std::string* body, uint64_t* wireBytes) {
+        size_t headerEnd;
+        while ((headerEnd = buf.find("\r\n\r\n", pos)) == std::string::npos) {
+            if (!more()) return false;
+        }
+        size_t start = pos;
+        *status = atoi(buf.c_str() + pos + 9);
+        long length = -1;
+        bool chunked = false;
+        for (size_t line = buf.find("\r\n", pos) + 2; line < headerEnd; line = buf.find("\r\n", line) + 2) {
+            const char* h = buf.c_str() + line;
+            if (strncasecmp(h, "Content-Length:", 15) == 0) length = atol(h + 15);
+            if (strncasecmp(h, "Transfer-Encoding: chunked", 26) == 0) chunked = true;
+        }
+        pos = headerEnd + 4;
+        body->clear();
+
+        if (chunked) {
+            for (;;) {
+                size_t lineEnd;
+                while ((lineEnd = buf.find("\r\n", pos)) == std::string::npos) {
+                    if (!more()) return false;
+                }
+                size_t size = strtoul(buf.c_str() + pos, nullptr, 16);
+                pos = lineEnd + 2;
+                if (!need(size + 2)) return false;
+                body->append(buf, pos, size);
+                pos += size + 2;
+                if (!size) break;
+            }
+        } else if (length > 0) {
+            if (!need(length)) return false;
+            body->append(buf, pos, length);
+            pos += length;
+        }
+        *wireBytes = pos - start;
+        buf.erase(0, pos);
+        pos = 0;
+        return true;
+    }
+
+private:
+    bool more() {
+        char chunk[LOAD_READ_SIZE];
+        for (;;) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buf.append(chunk, n);
+            return true;
+        }
+    }
+
+    bool need(size_t n) {
+        while (buf.size() - pos < n) {
+            if (!more()) return false;
+        }
+        return true;
+    }
+
+    int fd;
+    std::string buf;
+    size_t pos;
+};
+
+static std::string buildRequest(const LoadRoute& route, uint32_t client) {
+    std::string req;
+    if (route.kind == LOAD_ADD || route.kind == LOAD_REMOVE) {
+        // Each client has a card of its own outside the fixture's range
+        char body[32];
+        snprintf(body, sizeof(body), "uid=5B%%3A00%%3A%02X%%3A%02X", (client >> 8) & 0xFF, client & 0xFF);
+        char length[48];
+        snprintf(length, sizeof(length), "Content-Length: %u\r\n\r\n", (unsigned)strlen(body));
+        req = std::string("POST ") + route.target + " HTTP/1.1\r\nHost: bench\r\n"
+              "Content-Type: application/x-www-form-urlencoded\r\n" + length + body;
+        return req;
+    }
+    req = std::string("GET ") + route.target + " HTTP/1.1\r\nHost: bench\r\nAccept-Encoding: gzip\r\n";
+    if (route.kind == LOAD_REVALIDATE) {
+        const WebAsset* asset = findWebAsset(route.target);
+        if (asset) req += std::string("If-None-Match: ") + asset->etag + "\r\n";
+    }
+    return req + "\r\n";
+}
+
+// One client of a phase: cycle through the phase's routes until the deadline
+static void runClient(uint16_t port, uint32_t client, const LoadRoute* const* routes, int routeCount,
+                      uint64_t deadlineNs, RouteStats* stats) {
+    LoadClient conn;
+    if (!conn.connectTo(port)) {
+        stats[0].errors++;
+        return;
+    }
+    std::string requests[2];
+    for (int r = 0; r < routeCount; r++) {
+        requests[r] = buildRequest(*routes[r], client);
+        stats[r].latencyUs.reserve(1 << 16);
+    }
+
+    std::string body;
+    for (int r = 0; benchNowNs() < deadlineNs; r = (r + 1) % routeCount) {
+        uint64_t start = benchNowNs();
+        int status = 0;
+        uint64_t wire = 0;
+        if (!conn.send(requests[r]) || !conn.receive(&status, &body, &wire)) {
+            stats[r].errors++;
+            return;
+        }
+        stats[r].latencyUs.push_back((uint32_t)((benchNowNs() - start) / 1000));
+        stats[r].bodyBytes += body.size();
+        stats[r].wireBytes += wire;
+
+        bool ok = routes[r]->kind == LOAD_REVALIDATE ? status == 304 : status == 200;
+        if (routes[r]->kind == LOAD_ADD || routes[r]->kind == LOAD_REMOVE) {
+            ok = ok && body.find("thành công") != std::string::npos;
+        }
+        if (!ok) stats[r].errors++;
+    }
+}
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t i = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+static bool selected(const LoadRoute& route, const LoadOptions& opt) {
+    if (!opt.filterCount) return true;
+    for (int i = 0; i < opt.filterCount; i++) {
+        if (strstr(route.name, opt.filters[i])) return true;
+    }
+    return false;
+}
+
+static void runPhase(uint16_t port, const LoadOptions& opt, const LoadRoute* const* routes, int routeCount) {
+    std::vector<RouteStats> stats(opt.clients * 2);
+    std::vector<std::thread> threads;
+    uint64_t start = benchNowNs();
+    uint64_t deadline = start + opt.seconds * 1000000000ULL;
+    for (uint32_t c = 0; c < opt.clients; c++) {
+        threads.emplace_back(runClient, port, c, routes, routeCount, deadline, &stats[c * 2]);
+    }
+    for (std::thread& t : threads) t.join();
+    double elapsed = (benchNowNs() - start) / 1e9;
+
+    for (int r = 0; r < routeCount; r++) {
+        std::vector<uint32_t> latency;
+        uint64_t body = 0, wire = 0, errors = 0;
+        for (uint32_t c = 0; c < opt.clients; c++) {
+            const RouteStats& s = stats[c * 2 + r];
+            latency.insert(latency.end(), s.latencyUs.begin(), s.latencyUs.end());
+            body += s.bodyBytes;
+            wire += s.wireBytes;
+            errors += s.errors;
+        }
+        std::sort(latency.begin(), latency.end());
+        size_t n = latency.size();
+        printf("%-20s %9lu %10.0f %8u %8u %10.0f %10.0f %7llu\n", routes[r]->name, (unsigned long)n,
+               n / elapsed, percentile(latency, 50), percentile(latency, 99),
+               n ? (double)body / n : 0.0, n ? (double)wire / n : 0.0, (unsigned long long)errors);
+        fflush(stdout);
+    }
+}
+
+static bool parseSizes(const char* text, LoadOptions* opt) {
+    opt->sizeCount = 0;
+    while (*text && opt->sizeCount < LOAD_MAX_SIZES) {
+        char* end;
+        opt->sizes[opt->sizeCount++] = strtoul(text, &end, 10);
+        if (end == text) return false;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return opt->sizeCount > 0;
+}
+
+static bool parseOptions(int argc, char** argv, LoadOptions* opt) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            if (opt->filterCount < LOAD_MAX_FILTERS) opt->filters[opt->filterCount++] = arg;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        if (strcmp(arg, "--clients") == 0) opt->clients = strtoul(value, nullptr, 10);
+        else if (strcmp(arg, "--seconds") == 0) opt->seconds = strtoul(value, nullptr, 10);
+        else if (strcmp(arg, "--sizes") == 0) {
+            if (!parseSizes(value, opt)) return false;
+        } else return false;
+    }
+    if (opt->clients < 1) opt->clients = 1;
+    if (opt->clients > MAX_VALID_CARDS / 2) opt->clients = MAX_VALID_CARDS / 2;
+    if (opt->seconds < 1) opt->seconds = 1;
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: program http [--clients N] [--seconds N] [--sizes N,N,...] [route...]\n"
+            "  runs the routes whose names contain one of the given strings (all by default)\n");
+}
+
+int httpLoad(int argc, char** argv) {
+    LoadOptions opt;
+    if (!parseOptions(argc, argv, &opt)) {
+        usage();
+        return 2;
+    }
+
+    for (int s = 0; s < opt.sizeCount; s++) {
+        uint32_t records = opt.sizes[s];
+        uint32_t cards = std::min<uint32_t>(records, MAX_VALID_CARDS - opt.clients);
+        HttpBenchServer server(cards, records);
+        uint16_t port = server.listenLoopback();
+        if (!port) {
+            fprintf(stderr, "cannot listen on 127.0.0.1: %s\n", strerror(errno));
+            return 1;
+        }
+        std::thread serverThread(&HttpBenchServer::run, &server);
+
+        printf("fixture    %lu cards, %lu history records (%lu of the ?uid= card), %lu clients, %lu s per route\n",
+               (unsigned long)cards, (unsigned long)records, (unsigned long)server.queriedCardRecords(),
+               (unsigned long)opt.clients, (unsigned long)opt.seconds);
+        printf("%-20s %9s %10s %8s %8s %10s %10s %7s\n", "route", "requests", "req/s",
+               "p50 us", "p99 us", "body B", "wire B", "errors");
+        for (size_t r = 0; r < LOAD_ROUTE_COUNT; r++) {
+            const LoadRoute* phase[2] = {&loadRoutes[r], nullptr};
+            int count = 1;
+            if (loadRoutes[r].kind == LOAD_REMOVE) continue;
+            if (loadRoutes[r].kind == LOAD_ADD) {
+                phase[count++] = &loadRoutes[r + 1];
+                if (!selected(*phase[0], opt) && !selected(*phase[1], opt)) continue;
+            } else if (!selected(*phase[0], opt)) {
+                continue;
+            }
+            runPhase(port, opt, phase, count);
+        }
+        printf("\n");
+
+        server.stop();
+        serverThread.join();
+    }
+    return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * hx711_sim.cpp
+ *
+ * "program hx711 [options]": settling time against noise floor of the
+ * STM32's weighing filters. In each trial a simulated load cell sees
+ * someone step on (a first-order rise to --step-g with time constant
+ * --tau-ms) and stay; a model HX711 samples it at 10 or 80 SPS with the
+ * datasheet's noise (about 50 nV and 90 nV rms at gain 128, given here in
+ * counts) and, optionally, body sway. Every configuration runs on the same
+ * trials: the smoothed 10 SPS stream of HX711_Schedule, and at 80 SPS the
+ * fast average and the CIC decimator of weight_filter.c, built from the
+ * STM32 sources. For each one it reports the output rate, the time to
+ * half the step (how soon step-on can be detected), the time until the
+ * output stays within --band-g of the load, and the rms error once
+ * settled.
+ */
+
+#include "bench.h"
+#include "weight_filter.h"
+#include "calibration.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#define SIM_BEFORE_MS    1000    // empty scale before the step
+#define SIM_AFTER_MS     6000    // loaded scale after it
+#define SIM_STEADY_MS    4000    // noise is measured from here after the step
+#define SIM_SWAY_HZ      1.2
+
+struct SimOptions {
+    uint32_t trials = 20;
+    double stepG = 60000;
+    double tauMs = 100;
+    double countsPerGram = 20;
+    double noise10 = 21;         // counts rms at 10 SPS
+    double noise80 = 38;         // counts rms at 80 SPS
+    double swayG = 0;            // rms of body sway while loaded
+    double bandG = 50;
+    uint32_t seed = 1;
+};
+
+enum SimFilterKind {
+    SIM_EMA,                     // HX711_Schedule stream
+    SIM_FAST,                    // WeightFilter fast average
+    SIM_CIC                      // WeightFilter slow value
+};
+
+struct SimSetup {
+    const char* name;
+    uint32_t sps;
+    SimFilterKind kind;
+    float alpha;
+    WeightFilter_Config filter;
+};
+
+static const SimSetup setups[] = {
+    {"10sps raw", 10, SIM_EMA, 1.0f, {}},
+    {"10sps ema 0.5", 10, SIM_EMA, 0.5f, {}},
+    {"10sps ema 0.25", 10, SIM_EMA, 0.25f, {}},
+    {"80sps fast w4", 80, SIM_FAST, 0, {3, 8, 4}},
+    {"80sps fast w8", 80, SIM_FAST, 0, {3, 8, 8}},
+    {"80sps cic n1 r8", 80, SIM_CIC, 0, {1, 8, 4}},
+    {"80sps cic n2 r8", 80, SIM_CIC, 0, {2, 8, 4}},
+    {"80sps cic n3 r8", 80, SIM_CIC, 0, {3, 8, 4}},
+    {"80sps cic n3 r16", 80, SIM_CIC, 0, {3, 16, 4}},
+    {"80sps cic n3 r32", 80, SIM_CIC, 0, {3, 32, 4}},
+};
+
+struct SimOutput {
+    double ms;
+    double grams;
+};
+
+// Gaussian noise from a seeded xorshift, so every setup sees the same trials
+class SimNoise {
+public:
+    explicit SimNoise(uint64_t seed) : x(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+
+    double uniform() {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return ((x >> 11) + 0.5) / 9007199254740992.0;
+    }
+
+    double gauss() {
+        return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+    }
+
+private:
+    uint64_t x;
+};
+
+// The load in grams at a time, step at stepMs
+static double loadAt(const SimOptions& opt, double ms, double stepMs, double swayPhase) {
+    if (ms < stepMs) return 0;
+    double rise = 1 - exp(-(ms - stepMs) / opt.tauMs);
+    double sway = opt.swayG * M_SQRT2 * sin(2 * M_PI * SIM_SWAY_HZ * ms / 1000 + swayPhase);
+    return (opt.stepG + sway) * rise;
+}
+
+// One trial of one setup: the filter outputs over time
+static void runTrial(const SimOptions& opt, const SimSetup& setup, uint32_t trial, std::vector<SimOutput>* out) {
+    SimNoise noise(opt.seed * 1000003ULL + trial);
+    double period = 1000.0 / setup.sps;
+    // The step lands anywhere within a sample period
+    double stepMs = SIM_BEFORE_MS + noise.uniform() * period;
+    double swayPhase = noise.uniform() * 2 * M_PI;
+    double rms = setup.sps == 80 ? opt.noise80 : opt.noise10;
+
+    WeightFilter wf;
+    WeightFilter_begin(&wf, &setup.filter);
+    float ema = 0;
+    bool first = true;
+
+    out->clear();
+    for (double ms = period; ms < SIM_BEFORE_MS + SIM_AFTER_MS; ms += period) {
+        // A conversion averages its period; its middle stands in for that
+        double grams = loadAt(opt, ms - period / 2, stepMs, swayPhase);
+        int32_t counts = (int32_t)lround(grams * opt.countsPerGram + rms * noise.gauss());
+
+        switch (setup.kind) {
+        case SIM_EMA:
+            ema = first ? counts : ema + setup.alpha * (counts - ema);
+            first = false;
+            out->push_back({ms - stepMs, ema / opt.countsPerGram});
+            break;
+        case SIM_FAST:
+            WeightFilter_add(&wf, counts);
+            out->push_back({ms - stepMs, wf.fast / opt.countsPerGram});
+            break;
+        case SIM_CIC:
+            if (WeightFilter_add(&wf, counts)) {
+                out->push_back({ms - stepMs, wf.slow / opt.countsPerGram});
+            }
+            break;
+        }
+    }
+}
+
+static double percentile(std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+static void simulate(const SimOptions& opt, const SimSetup& setup) {
+    std::vector<SimOutput> out;
+    std::vector<double> half, settle;
+    double squares = 0;
+    uint64_t steady = 0;
+    uint32_t unsettled = 0;
+
+    for (uint32_t trial = 0; trial < opt.trials; trial++) {
+        runTrial(opt, setup, trial, &out);
+
+        double halfMs = -1;
+        size_t lastOut = 0;
+        bool outside = false;
+        for (size_t i = 0; i < out.size(); i++) {
+            const SimOutput& o = out[i];
+            if (o.ms < 0) continue;
+            if (halfMs < 0 && o.grams >= opt.stepG / 2) halfMs = o.ms;
+            if (fabs(o.grams - opt.stepG) > opt.bandG) {
+                lastOut = i;
+                outside = true;
+            }
+            if (o.ms >= SIM_STEADY_MS) {
+                double e = o.grams - opt.stepG;
+                squares += e * e;
+                steady++;
+            }
+        }
+        if (halfMs >= 0) half.push_back(halfMs);
+        if (outside && lastOut + 1 < out.size()) {
+            settle.push_back(out[lastOut + 1].ms);
+        } else if (outside) {
+            unsettled++;
+        }
+    }
+
+    double rate = setup.kind == SIM_CIC ? (double)setup.sps / setup.filter.decimation : setup.sps;
+    double noiseRms = steady ? sqrt(squares / steady) : 0;
+    printf("%-18s %5.1f Hz  t50 %5.0f ms  settle p50 %5.0f ms  max %5.0f ms  noise %7.2f g rms",
+           setup.name, rate, percentile(half, 0.5), percentile(settle, 0.5), percentile(settle, 1.0), noiseRms);
+    if (unsettled) printf("  (%u of %u trials never settled)", unsettled, opt.trials);
+    printf("\n");
+}
+
+static bool parseOptions(int argc, char** argv, SimOptions* opt, const char** filter) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (arg[0] != '-') {
+            *filter = arg;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        double v = strtod(argv[++i], nullptr);
+        if (strcmp(arg, "--trials") == 0) opt->trials = (uint32_t)v;
+        else if (strcmp(arg, "--step-g") == 0) opt->stepG = v;
+        else if (strcmp(arg, "--tau-ms") == 0) opt->tauMs = v;
+        else if (strcmp(arg, "--counts-per-g") == 0) opt->countsPerGram = v;
+        else if (strcmp(arg, "--noise-10") == 0) opt->noise10 = v;
+        else if (strcmp(arg, "--noise-80") == 0) opt->noise80 = v;
+        else if (strcmp(arg, "--sway-g") == 0) opt->swayG = v;
+        else if (strcmp(arg, "--band-g") == 0) opt->bandG = v;
+        else if (strcmp(arg, "--seed") == 0) opt->seed = (uint32_t)v;
+        else return false;
+    }
+    if (opt->trials < 1) opt->trials = 1;
+    if (opt->tauMs <= 0) opt->tauMs = 1;
+    if (opt->countsPerGram <= 0) opt->countsPerGram = 1;
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: program hx711 [--trials N] [--step-g G] [--tau-ms MS] [--counts-per-g N]\n"
+            "                     [--noise-10 COUNTS] [--noise-80 COUNTS] [--sway-g G] [--band-g G]\n"
+            "                     [--seed N] [setup]\n"
+            "  runs the filter setups whose names contain the given string (all by default)\n");
+}
+
+int hx711Sim(int argc, char** argv) {
+    SimOptions opt;
+    const char* filter = nullptr;
+    if (!parseOptions(argc, argv, &opt, &filter)) {
+        usage();
+        return 2;
+    }
+
+    printf("step %.0f g, tau %.0f ms, %.0f counts/g, noise %.0f/%.0f counts rms at 10/80 SPS, sway %.0f g, band %.0f g, %u trials\n",
+           opt.stepG, opt.tauMs, opt.countsPerGram, opt.noise10, opt.noise80, opt.swayG, opt.bandG, opt.trials);
+    for (const SimSetup& setup : setups) {
+        if (!filter || strstr(setup.name, filter)) simulate(opt, setup);
+    }
+    return 0;
+}
+
+// Per-sample cost of the 80 SPS filter; the STM32 runs it once per cell
+BENCH(weight_filter_add) {
+    WeightFilter_Config config = {3, 8, 4};
+    WeightFilter wf;
+    WeightFilter_begin(&wf, &config);
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        WeightFilter_add(&wf, (int32_t)(benchRandom() & 0xFFFFF));
+    }
+    benchKeep(wf.slow);
+}
+
+// Net counts to grams with a four-point calibration, once per weight value
+BENCH(calibration_to_grams) {
+    Calibration cal;
+    Calibration_default(&cal, 1);
+    Calibration_add_point(&cal, 400000, 20000);
+    Calibration_add_point(&cal, 800000, 40500);
+    Calibration_add_point(&cal, 1200000, 60800);
+    int32_t total = 0;
+    state.startTimer();
+    for (uint64_t i = 0; i < state.iterations(); i++) {
+        total += Calibration_to_grams(&cal, (int32_t)(benchRandom() & 0x1FFFFF));
+    }
+    benchKeep(total);
+}
@@ -0,0 +1,59 @@
+/*
+ * ingest_pipeline.cpp
+ */
+
+#include "ingest_pipeline.h"
+#include "stm32_emulator.h"
+
+IngestPipeline* IngestPipeline::active = nullptr;
+
+IngestPipeline::IngestPipeline(uint32_t stations, uint32_t validCards)
+    : count(), cardRegion(INGEST_CARD_SECTORS), region(INGEST_HISTORY_SECTORS) {
+    // Large tables live on the heap, as they would be globals on the device
+    table = new CardTable(&journal);
+    cache = new HistoryCache();
+    rollup = new WeightRollup();
+    ingest = new CardIngest(*table, store, *cache, *rollup, count);
+
+    // The registered cards are loaded straight into the table; the journal
+    // only records later changes made through cards()
+    active = this;
+    journal.begin(&cardRegion, replayCard, liveCard);
+    uint8_t uid[UID_SIZE];
+    for (uint32_t s = 0; s < stations; s++) {
+        for (uint32_t c = 0; c < validCards; c++) {
+            Stm32Emulator::cardUid(s, c, uid);
+            table->applyRecord(CARD_REC_ADD, uid, "");
+        }
+    }
+    store.begin(&region);
+}
+
+IngestPipeline::~IngestPipeline() {
+    if (active == this) active = nullptr;
+    delete ingest;
+    delete rollup;
+    delete cache;
+    delete table;
+}
+
+void IngestPipeline::replayCard(uint8_t type, const uint8_t* uid, const char* name) {
+    active->table->applyRecord(type, uid, name);
+}
+
+bool IngestPipeline::liveCard(const uint8_t* uid, char* name, size_t nameSize) {
+    return active->table->liveState(uid, name, nameSize);
+}
+
+// processSTM32Message() and processCardDetected() for one byte
+bool IngestPipeline::feed(uint8_t byte, CardFrame* frame, uint32_t deviceTime) {
+    if (ingest->feed(byte, frame) != FRAME_CARD) return false;
+    ingest->storeCard(*frame, deviceTime);
+    return true;
+}
+
+void IngestPipeline::idle(uint32_t nowMs) {
+    ingest->expire(nowMs);
+    journal.maintain();
+    store.maintain(nowMs);
+}
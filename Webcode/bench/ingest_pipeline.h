@@ -0,0 +1,60 @@
+/*
+ * ingest_pipeline.h
+ *
+ * The firmware's receive path on the host: the tables loop() owns and the
+ * CardIngest it runs over them, which checks the card lookup and stores
+ * each reading in the history store, history cache and rollups. With a
+ * log attached it prints the same debug lines as the firmware, so a log
+ * Print that models the debug UART shows what that output costs; the SSE
+ * push is not modelled.
+ */
+
+#ifndef INGEST_PIPELINE_H_
+#define INGEST_PIPELINE_H_
+
+#include <Arduino.h>
+#include "card_ingest.h"
+#include "ram_flash_region.h"
+
+#define INGEST_HISTORY_SECTORS 256   // size of the history partition
+#define INGEST_CARD_SECTORS    32    // size of the cardlog partition
+
+class IngestPipeline {
+public:
+    // Cards 0 .. validCards - 1 of every station are registered
+    IngestPipeline(uint32_t stations, uint32_t validCards);
+    ~IngestPipeline();
+
+    void setLog(Print* log) { ingest->setLog(log); }
+
+    // Feed one received byte. Returns true and fills frame when it
+    // completed a card frame, which has then been stored.
+    bool feed(uint8_t byte, CardFrame* frame, uint32_t deviceTime);
+
+    // The rest of a loop() pass: frame timeout and background upkeep, as
+    // after processSTM32Message()
+    void idle(uint32_t nowMs);
+
+    const IngestCounters& counters() const { return count; }
+    HistoryStore& history() { return store; }
+    const HistoryCache& historyCache() const { return *cache; }
+    CardTable& cards() { return *table; }
+    const WeightRollup& rollups() const { return *rollup; }
+
+private:
+    static void replayCard(uint8_t type, const uint8_t* uid, const char* name);
+    static bool liveCard(const uint8_t* uid, char* name, size_t nameSize);
+    static IngestPipeline* active;
+
+    IngestCounters count;
+    RamFlashRegion cardRegion;
+    CardJournal journal;
+    CardTable* table;
+    RamFlashRegion region;
+    HistoryStore store;
+    HistoryCache* cache;
+    WeightRollup* rollup;
+    CardIngest* ingest;
+};
+
+#endif /* INGEST_PIPELINE_H_ */
@@ -0,0 +1,379 @@
+/*
+ * ingest_stress.cpp
+ *
+ * "program ingest [options]": emulated STM32 stations send frames over a
+ * paced link to the ingest pipeline, run the way loop() runs it (drain
+ * the RX buffer, upkeep, delay), and the run reports sustained frames per
+ * second, drop rate and send-to-stored latency percentiles.
+ *
+ * The link is either an in-process ring the size of the ESP32 UART RX
+ * buffer, where bytes that do not fit are lost like a UART overrun, or
+ * (--pty) a pseudo-terminal, which adds kernel buffering and syscalls.
+ * The firmware's per-byte debug output goes to a model of the debug UART
+ * that blocks like the ESP32 one once its FIFO is full.
+ */
+
+#include "bench.h"
+#include "stm32_emulator.h"
+#include "ingest_pipeline.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SEND_STAMP_SLOTS   65536      // power of two, frames in flight
+#define DEBUG_UART_FIFO    128        // ESP32 UART TX FIFO, bytes
+#define DRAIN_IDLE_MS      200        // stop once the link is quiet this long
+#define RX_CHUNK           256
+
+struct StressOptions {
+    EmulatorConfig emulator;
+    uint32_t seconds = 5;
+    uint32_t validCards = 32;
+    uint32_t baud = 115200;           // STM32 link, 0 = unpaced
+    uint32_t rxBuffer = 256;          // HardwareSerial default
+    uint32_t logBaud = 115200;        // debug UART, 0 = no debug output
+    uint32_t loopDelayUs = 1000;      // delay(1) at the end of loop()
+    bool pty = false;
+};
+
+static void sleepUntil(uint64_t ns) {
+    for (;;) {
+        uint64_t now = benchNowNs();
+        if (now >= ns) return;
+        // Sleep most of the way, spin the rest for accuracy
+        if (ns - now > 200000) {
+            struct timespec ts;
+            uint64_t d = ns - now - 100000;
+            ts.tv_sec = d / 1000000000ULL;
+            ts.tv_nsec = d % 1000000000ULL;
+            nanosleep(&ts, nullptr);
+        }
+    }
+}
+
+class ByteLink {
+public:
+    virtual ~ByteLink() {}
+    // Returns the bytes accepted; the rest are lost
+    virtual size_t send(const uint8_t* data, size_t len) = 0;
+    virtual size_t receive(uint8_t* data, size_t max) = 0;
+    virtual const char* describe() const = 0;
+};
+
+// Single-producer single-consumer ring standing in for the UART RX buffer
+class RingLink : public ByteLink {
+public:
+    explicit RingLink(size_t capacity) : buf(capacity + 1), head(0), tail(0) {}
+
+    size_t send(const uint8_t* data, size_t len) override {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        size_t n = 0;
+        while (n < len) {
+            size_t next = (h + 1) % buf.size();
+            if (next == t) break;
+            buf[h] = data[n++];
+            h = next;
+        }
+        head.store(h, std::memory_order_release);
+        return n;
+    }
+
+    size_t receive(uint8_t* data, size_t max) override {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        size_t n = 0;
+        while (n < max && t != h) {
+            data[n++] = buf[t];
+            t = (t + 1) % buf.size();
+        }
+        tail.store(t, std::memory_order_release);
+        return n;
+    }
+
+    const char* describe() const override { return "in-process ring"; }
+
+private:
+    std::vector<uint8_t> buf;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+};
+
+// Pseudo-terminal in raw mode; a full master side counts as an overrun
+class PtyLink : public ByteLink {
+public:
+    PtyLink() : master(-1), slave(-1) {}
+
+    ~PtyLink() override {
+        if (slave >= 0) close(slave);
+        if (master >= 0) close(master);
+    }
+
+    bool open() {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) return false;
+        slave = ::open(ptsname(master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (slave < 0) return false;
+
+        struct termios tio;
+        tcgetattr(slave, &tio);
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+        fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+
+    size_t send(const uint8_t* data, size_t len) override {
+        ssize_t n = write(master, data, len);
+        return n > 0 ? (size_t)n : 0;
+    }
+
+    size_t receive(uint8_t* data, size_t max) override {
+        ssize_t n = read(slave, data, max);
+        return n > 0 ? (size_t)n : 0;
+    }
+
+    const char* describe() const override { return "pty"; }
+
+private:
+    int master;
+    int slave;
+};
+
+// Debug UART: printing blocks once more than a FIFO's worth is queued
+class DebugUartModel : public Print {
+public:
+    explicit DebugUartModel(uint32_t baud) : byteNs(baud ? 10000000000ULL / baud : 0), busyUntil(0), total(0) {}
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+
+    size_t write(const uint8_t*, size_t len) override {
+        total += len;
+        uint64_t now = benchNowNs();
+        if (busyUntil < now) busyUntil = now;
+        busyUntil += len * byteNs;
+        uint64_t fifoNs = DEBUG_UART_FIFO * byteNs;
+        if (busyUntil > now + fifoNs) sleepUntil(busyUntil - fifoNs);
+        return len;
+    }
+    using Print::write;
+
+    uint64_t bytes() const { return total; }
+
+private:
+    uint64_t byteNs;
+    uint64_t busyUntil;
+    uint64_t total;
+};
+
+struct SenderStats {
+    uint64_t framesIntact = 0;
+    uint64_t framesCorrupt = 0;
+    uint64_t debugLines = 0;
+    uint64_t bytes = 0;
+    uint64_t overrunBytes = 0;
+    uint64_t lostIntact = 0;          // intact frames that lost bytes to an overrun
+};
+
+static std::atomic<uint64_t> sendStamp[SEND_STAMP_SLOTS];
+static std::atomic<uint32_t> framesStamped(0);
+
+// Paces emulator output onto the link at the configured baud rate. An
+// item is handed over when its last byte would have arrived.
+static void runSender(const StressOptions& opt, ByteLink* link, uint64_t startNs,
+                      std::atomic<bool>* done, SenderStats* stats) {
+    Stm32Emulator emulator(opt.emulator);
+    EmulatorItem item;
+    uint64_t byteNs = opt.baud ? 10000000000ULL / opt.baud : 0;
+    uint64_t endNs = startNs + opt.seconds * 1000000000ULL;
+    uint64_t linkFree = startNs;
+
+    for (;;) {
+        emulator.next(&item);
+        uint64_t due = startNs + item.dueUs * 1000;
+        if (due >= endNs) break;
+        if (linkFree < due) linkFree = due;
+        linkFree += item.len * byteNs;
+        sleepUntil(linkFree);
+
+        if (item.kind == ITEM_FRAME) {
+            sendStamp[item.seq % SEND_STAMP_SLOTS].store(benchNowNs(), std::memory_order_relaxed);
+            framesStamped.store(item.seq + 1, std::memory_order_release);
+        }
+        size_t sent = link->send(item.bytes, item.len);
+        stats->bytes += item.len;
+        stats->overrunBytes += item.len - sent;
+
+        if (item.kind == ITEM_FRAME) {
+            stats->framesIntact++;
+            if (sent < item.len) stats->lostIntact++;
+        } else if (item.kind == ITEM_CORRUPT_FRAME) {
+            stats->framesCorrupt++;
+        } else {
+            stats->debugLines++;
+        }
+    }
+    done->store(true);
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t i = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+static bool parseOptions(int argc, char** argv, StressOptions* opt) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--pty") == 0) {
+            opt->pty = true;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        uint32_t v = strtoul(argv[++i], nullptr, 10);
+        if (strcmp(arg, "--stations") == 0) opt->emulator.stations = v;
+        else if (strcmp(arg, "--fps") == 0) opt->emulator.framesPerSecond = v;
+        else if (strcmp(arg, "--cards") == 0) opt->emulator.cardsPerStation = v;
+        else if (strcmp(arg, "--valid") == 0) opt->validCards = v;
+        else if (strcmp(arg, "--debug") == 0) opt->emulator.debugPercent = v;
+        else if (strcmp(arg, "--corrupt") == 0) opt->emulator.corruptPercent = v;
+        else if (strcmp(arg, "--burst") == 0) opt->emulator.burstFrames = v;
+        else if (strcmp(arg, "--seed") == 0) opt->emulator.seed = v;
+        else if (strcmp(arg, "--seconds") == 0) opt->seconds = v;
+        else if (strcmp(arg, "--baud") == 0) opt->baud = v;
+        else if (strcmp(arg, "--rx-buffer") == 0) opt->rxBuffer = v;
+        else if (strcmp(arg, "--log-baud") == 0) opt->logBaud = v;
+        else if (strcmp(arg, "--loop-delay-us") == 0) opt->loopDelayUs = v;
+        else return false;
+    }
+    if (opt->emulator.stations > EMULATOR_MAX_STATIONS) opt->emulator.stations = EMULATOR_MAX_STATIONS;
+    if (opt->rxBuffer < 1) opt->rxBuffer = 1;
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: program ingest [--stations N] [--fps N] [--seconds N] [--cards N] [--valid N]\n"
+            "                      [--debug PCT] [--corrupt PCT] [--burst N] [--seed N]\n"
+            "                      [--baud N] [--rx-buffer BYTES] [--log-baud N] [--loop-delay-us N] [--pty]\n"
+            "  --baud 0 sends as fast as the receiver drains; --log-baud 0 turns debug output off\n");
+}
+
+int ingestStress(int argc, char** argv) {
+    StressOptions opt;
+    if (!parseOptions(argc, argv, &opt)) {
+        usage();
+        return 2;
+    }
+
+    RingLink ring(opt.rxBuffer);
+    PtyLink pty;
+    ByteLink* link = &ring;
+    if (opt.pty) {
+        if (!pty.open()) {
+            fprintf(stderr, "cannot open a pty: %s\n", strerror(errno));
+            return 1;
+        }
+        link = &pty;
+    }
+
+    IngestPipeline pipeline(opt.emulator.stations, opt.validCards);
+    DebugUartModel debugUart(opt.logBaud);
+    if (opt.logBaud) pipeline.setLog(&debugUart);
+
+    std::vector<uint64_t> latencies;
+    std::vector<uint8_t> seen;
+    uint64_t spurious = 0;
+    uint64_t duplicates = 0;
+    uint8_t buf[RX_CHUNK];
+    CardFrame frame;
+
+    SenderStats sender;
+    std::atomic<bool> done(false);
+    uint64_t startNs = benchNowNs();
+    std::thread thread(runSender, std::cref(opt), link, startNs, &done, &sender);
+
+    // loop(): drain the RX buffer, upkeep, delay(1)
+    uint64_t lastRxNs = startNs;
+    for (;;) {
+        size_t n;
+        bool any = false;
+        while ((n = link->receive(buf, sizeof(buf))) > 0) {
+            if (!any && opt.logBaud) debugUart.println("Data available on UART!");
+            any = true;
+            uint32_t deviceTime = (uint32_t)((benchNowNs() - startNs) / 1000000000ULL);
+            for (size_t i = 0; i < n; i++) {
+                if (!pipeline.feed(buf[i], &frame, deviceTime)) continue;
+                uint32_t seq = (uint32_t)frame.weight;
+                bool known = seq < framesStamped.load(std::memory_order_acquire) && frame.uid[0] == 0x5A;
+                uint64_t sent = known ? sendStamp[seq % SEND_STAMP_SLOTS].load(std::memory_order_relaxed) : 0;
+                if (!sent) {
+                    spurious++;
+                    continue;
+                }
+                if (seq >= seen.size()) seen.resize(seq + 1024, 0);
+                if (seen[seq]) {
+                    duplicates++;
+                    continue;
+                }
+                seen[seq] = 1;
+                latencies.push_back(benchNowNs() - sent);
+            }
+        }
+        uint64_t now = benchNowNs();
+        if (any) lastRxNs = now;
+        pipeline.idle((uint32_t)((now - startNs) / 1000000));
+
+        if (done.load() && now - lastRxNs > DRAIN_IDLE_MS * 1000000ULL) break;
+        if (opt.loopDelayUs) sleepUntil(benchNowNs() + opt.loopDelayUs * 1000ULL);
+    }
+    thread.join();
+    double elapsed = (double)(lastRxNs - startNs) / 1e9;
+
+    const IngestCounters& c = pipeline.counters();
+    uint64_t received = latencies.size();
+    std::sort(latencies.begin(), latencies.end());
+
+    printf("link       %s, %lu-byte RX buffer, %lu baud, debug log %lu baud, loop delay %lu us\n",
+           link->describe(), (unsigned long)opt.rxBuffer, (unsigned long)opt.baud,
+           (unsigned long)opt.logBaud, (unsigned long)opt.loopDelayUs);
+    printf("stations   %lu x %lu fps for %lu s, debug %lu%%, corrupt %lu%%, burst %lu\n",
+           (unsigned long)opt.emulator.stations, (unsigned long)opt.emulator.framesPerSecond,
+           (unsigned long)opt.seconds, (unsigned long)opt.emulator.debugPercent,
+           (unsigned long)opt.emulator.corruptPercent, (unsigned long)opt.emulator.burstFrames);
+    printf("sent       %llu frames (%llu corrupt), %llu debug lines, %llu bytes, %.1f fps scheduled\n",
+           (unsigned long long)(sender.framesIntact + sender.framesCorrupt),
+           (unsigned long long)sender.framesCorrupt, (unsigned long long)sender.debugLines,
+           (unsigned long long)sender.bytes, sender.framesIntact / (double)opt.seconds);
+    printf("received   %llu frames, %.1f fps sustained\n",
+           (unsigned long long)received, elapsed > 0 ? received / elapsed : 0.0);
+    printf("dropped    %llu of %llu intact frames (%.2f%%), %llu hit by overrun, %llu overrun bytes\n",
+           (unsigned long long)(sender.framesIntact - received), (unsigned long long)sender.framesIntact,
+           sender.framesIntact ? 100.0 * (sender.framesIntact - received) / sender.framesIntact : 0.0,
+           (unsigned long long)sender.lostIntact, (unsigned long long)sender.overrunBytes);
+    printf("rejected   bad_end=%llu unknown_type=%llu overflow=%llu timeout=%llu noise_bytes=%llu"
+           " spurious=%llu duplicate=%llu\n",
+           (unsigned long long)c.framesRejected[FRAME_REJECT_BAD_END],
+           (unsigned long long)c.framesRejected[FRAME_REJECT_UNKNOWN_TYPE],
+           (unsigned long long)c.framesRejected[FRAME_REJECT_OVERFLOW],
+           (unsigned long long)c.framesRejected[FRAME_REJECT_TIMEOUT],
+           (unsigned long long)c.uartNoiseBytes, (unsigned long long)spurious,
+           (unsigned long long)duplicates);
+    printf("latency us p50=%.0f p90=%.0f p99=%.0f p99.9=%.0f max=%.0f\n",
+           percentile(latencies, 50) / 1e3, percentile(latencies, 90) / 1e3,
+           percentile(latencies, 99) / 1e3, percentile(latencies, 99.9) / 1e3,
+           latencies.empty() ? 0.0 : latencies.back() / 1e3);
+    printf("debug log  %llu bytes (%.1f per received byte)\n",
+           (unsigned long long)debugUart.bytes(),
+           c.uartBytes ? (double)debugUart.bytes() / c.uartBytes : 0.0);
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * json_check.cpp
+ */
+
+#include "json_check.h"
+#include <string.h>
+
+#define JSON_CHECK_MAX_DEPTH 32
+
+struct JsonCursor {
+    const char* p;
+    const char* end;
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    }
+
+    bool take(char c) {
+        skipSpace();
+        if (p < end && *p == c) {
+            p++;
+            return true;
+        }
+        return false;
+    }
+};
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool parseValue(JsonCursor& c, int depth);
+
+static bool parseString(JsonCursor& c) {
+    if (!c.take('"')) return false;
+    while (c.p < c.end) {
+        char ch = *c.p++;
+        if (ch == '"') return true;
+        if ((unsigned char)ch < 0x20) return false;
+        if (ch == '\\') {
+            if (c.p >= c.end) return false;
+            char e = *c.p++;
+            if (e == 'u') {
+                for (int i = 0; i < 4; i++) {
+                    if (c.p >= c.end || !strchr("0123456789abcdefABCDEF", *c.p)) return false;
+                    c.p++;
+                }
+            } else if (!strchr("\"\\/bfnrt", e)) {
+                return false;
+            }
+        }
+    }
+    return false;
+}
+
+static bool parseNumber(JsonCursor& c) {
+    if (c.p < c.end && *c.p == '-') c.p++;
+    if (c.p >= c.end || !isDigit(*c.p)) return false;
+    if (*c.p == '0') {
+        c.p++;
+    } else {
+        while (c.p < c.end && isDigit(*c.p)) c.p++;
+    }
+    if (c.p < c.end && *c.p == '.') {
+        c.p++;
+        if (c.p >= c.end || !isDigit(*c.p)) return false;
+        while (c.p < c.end && isDigit(*c.p)) c.p++;
+    }
+    if (c.p < c.end && (*c.p == 'e' || *c.p == 'E')) {
+        c.p++;
+        if (c.p < c.end && (*c.p == '+' || *c.p == '-')) c.p++;
+        if (c.p >= c.end || !isDigit(*c.p)) return false;
+        while (c.p < c.end && isDigit(*c.p)) c.p++;
+    }
+    return true;
+}
+
+static bool parseWord(JsonCursor& c, const char* word) {
+    size_t n = strlen(word);
+    if ((size_t)(c.end - c.p) < n || memcmp(c.p, word, n) != 0) return false;
+    c.p += n;
+    return true;
+}
+
+static bool parseValue(JsonCursor& c, int depth) {
+    if (depth > JSON_CHECK_MAX_DEPTH) return false;
+    c.skipSpace();
+    if (c.p >= c.end) return false;
+    switch (*c.p) {
+    case '{':
+        c.p++;
+        if (c.take('}')) return true;
+        do {
+            c.skipSpace();
+            if (!parseString(c) || !c.take(':') || !parseValue(c, depth + 1)) return false;
+        } while (c.take(','));
+        return c.take('}');
+    case '[':
+        c.p++;
+        if (c.take(']')) return true;
+        do {
+            if (!parseValue(c, depth + 1)) return false;
+        } while (c.take(','));
+        return c.take(']');
+    case '"':
+        return parseString(c);
+    case 't':
+        return parseWord(c, "true");
+    case 'f':
+        return parseWord(c, "false");
+    case 'n':
+        return parseWord(c, "null");
+    default:
+        return parseNumber(c);
+    }
+}
+
+bool jsonWellFormed(const char* text, size_t len) {
+    JsonCursor c = {text, text + len};
+    if (!parseValue(c, 0)) return false;
+    c.skipSpace();
+    return c.p == c.end;
+}
@@ -0,0 +1,16 @@
+/*
+ * json_check.h
+ *
+ * Syntax check of a rendered JSON body, for benchmarks that also verify
+ * what a streamed source produced. Accepts exactly one value with nothing
+ * but whitespace after it; does not decode anything.
+ */
+
+#ifndef JSON_CHECK_H_
+#define JSON_CHECK_H_
+
+#include <stddef.h>
+
+bool jsonWellFormed(const char* text, size_t len);
+
+#endif /* JSON_CHECK_H_ */
@@ -0,0 +1,228 @@
+/*
+ * soak.cpp
+ *
+ * "program soak [options]": heap use of the ingest and API paths over a
+ * long run. Emulated stations feed the ingest pipeline as fast as the host
+ * goes (device time follows the emulator, so a minute covers days of
+ * readings and several turns of the history ring), and once per device
+ * second the run serves what the dashboard asks for: /data, /cards, the
+ * first /api/history page with and without ?uid=, /api/rollup?uid= and an
+ * add/remove of a card. Responses go through ChunkBuffer in one-segment
+ * pieces as sendChunked() sends them.
+ *
+ * After the first report window the ingest path must not allocate at all,
+ * and each request may only allocate its source object, so heap in use
+ * has to return to the same figure at every report. The run fails
+ * otherwise. On the device the matching figure is
+ * hc_heap_largest_block_bytes on /metrics.
+ */
+
+#include "bench.h"
+#include "stm32_emulator.h"
+#include "ingest_pipeline.h"
+#include "api_json.h"
+#include "api_sources.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOAK_SEGMENT     1436     // TCP segment, as in the http runner
+#define SOAK_PAGE_ROWS   50       // /weight_history page size
+
+struct SoakOptions {
+    EmulatorConfig emulator;
+    uint32_t seconds = 60;
+    uint32_t reportSeconds = 10;
+    uint32_t validCards = 32;
+};
+
+// Counts and drops response bytes
+class NullPrint : public Print {
+public:
+    size_t write(uint8_t) override {
+        bytes++;
+        return 1;
+    }
+    size_t write(const uint8_t*, size_t n) override {
+        bytes += n;
+        return n;
+    }
+    using Print::write;
+
+    uint64_t bytes = 0;
+};
+
+// Drain a response the way the chunked transport does
+static uint64_t serve(ResponseSource* src) {
+    ChunkBuffer body(src);
+    uint8_t segment[SOAK_SEGMENT];
+    uint64_t total = 0;
+    size_t n;
+    while ((n = body.fill(segment, sizeof(segment))) > 0) total += n;
+    return total;
+}
+
+// Responses printed straight into the send buffer, as sendEvent() does
+class ReadingSource : public ResponseSource {
+public:
+    ReadingSource(const CardReading& reading, uint32_t count) : reading(reading), count(count) {}
+
+    bool next(Print& out) override {
+        printReadingJson(out, reading, count);
+        return false;
+    }
+
+private:
+    const CardReading& reading;
+    uint32_t count;
+};
+
+class RollupSource : public ResponseSource {
+public:
+    explicit RollupSource(const PatientRollup* p) : p(p) {}
+
+    bool next(Print& out) override {
+        if (p) printRollupJson(out, p);
+        return false;
+    }
+
+private:
+    const PatientRollup* p;
+};
+
+// One dashboard's worth of requests; returns the number made
+static uint32_t serveDashboard(IngestPipeline& pipeline, const CardReading& latest, uint32_t tick,
+                               uint64_t* bytes) {
+    HistoryStore& store = pipeline.history();
+    uint8_t cardUid[CARD_UID_MAX];
+    cardKeyUid(latest.card, cardUid);
+    uint32_t start;
+
+    *bytes += serve(new ReadingSource(latest, store.count()));
+    *bytes += serve(new CardListSource(pipeline.cards()));
+    historyPageStart(store, nullptr, nullptr, 0, 0xFFFFFFFFUL, &start);
+    *bytes += serve(new HistorySource(store, pipeline.historyCache(), nullptr, start, 0, 0xFFFFFFFFUL,
+                                      SOAK_PAGE_ROWS));
+    historyPageStart(store, cardUid, nullptr, 0, 0xFFFFFFFFUL, &start);
+    *bytes += serve(new HistorySource(store, pipeline.historyCache(), cardUid, start, 0, 0xFFFFFFFFUL,
+                                      SOAK_PAGE_ROWS));
+    *bytes += serve(new RollupSource(pipeline.rollups().find(cardUid)));
+
+    // A card added and removed again through the journal
+    uint8_t uid[UID_SIZE] = {0x5B, 0x00, 0x00, (uint8_t)(tick & 0x0F)};
+    pipeline.cards().add(uid);
+    pipeline.cards().remove(uid);
+    return 5;
+}
+
+static bool parseOptions(int argc, char** argv, SoakOptions* opt) {
+    opt->emulator.stations = 4;
+    opt->emulator.framesPerSecond = 50;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (i + 1 >= argc) return false;
+        uint32_t v = strtoul(argv[++i], nullptr, 10);
+        if (strcmp(arg, "--stations") == 0) opt->emulator.stations = v;
+        else if (strcmp(arg, "--fps") == 0) opt->emulator.framesPerSecond = v;
+        else if (strcmp(arg, "--cards") == 0) opt->emulator.cardsPerStation = v;
+        else if (strcmp(arg, "--valid") == 0) opt->validCards = v;
+        else if (strcmp(arg, "--corrupt") == 0) opt->emulator.corruptPercent = v;
+        else if (strcmp(arg, "--seed") == 0) opt->emulator.seed = v;
+        else if (strcmp(arg, "--seconds") == 0) opt->seconds = v;
+        else if (strcmp(arg, "--report") == 0) opt->reportSeconds = v;
+        else return false;
+    }
+    if (opt->emulator.stations < 1) opt->emulator.stations = 1;
+    if (opt->emulator.stations > EMULATOR_MAX_STATIONS) opt->emulator.stations = EMULATOR_MAX_STATIONS;
+    if (opt->emulator.framesPerSecond < 1) opt->emulator.framesPerSecond = 1;
+    if (opt->reportSeconds < 1) opt->reportSeconds = 1;
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: program soak [--seconds N] [--report N] [--stations N] [--fps N] [--cards N]\n"
+            "                    [--valid N] [--corrupt PCT] [--seed N]\n");
+}
+
+int heapSoak(int argc, char** argv) {
+    SoakOptions opt;
+    if (!parseOptions(argc, argv, &opt)) {
+        usage();
+        return 2;
+    }
+
+    Stm32Emulator emulator(opt.emulator);
+    IngestPipeline pipeline(opt.emulator.stations, opt.validCards);
+    CardReading latest = {};
+    EmulatorItem item;
+    CardFrame frame;
+
+    uint64_t ingestAllocs = 0;
+    uint64_t apiAllocs = 0;
+    uint64_t requests = 0;
+    uint64_t responseBytes = 0;
+    uint32_t lastTick = 0;
+    int64_t baseline = 0;
+    bool failed = false;
+
+    printf("stations   %lu x %lu fps, %lu valid cards each, %lu s\n",
+           (unsigned long)opt.emulator.stations, (unsigned long)opt.emulator.framesPerSecond,
+           (unsigned long)opt.validCards, (unsigned long)opt.seconds);
+
+    uint64_t startNs = benchNowNs();
+    uint64_t nextReportNs = startNs + opt.reportSeconds * 1000000000ULL;
+    for (uint32_t window = 0; window * opt.reportSeconds < opt.seconds;) {
+        emulator.next(&item);
+        uint32_t nowMs = (uint32_t)(item.dueUs / 1000);
+        uint32_t deviceTime = (uint32_t)(item.dueUs / 1000000);
+
+        uint64_t before = benchAllocCount();
+        for (size_t i = 0; i < item.len; i++) {
+            if (pipeline.feed(item.bytes[i], &frame, deviceTime)) {
+                latest.card = cardKey(frame.uid);
+                latest.weight = frame.weight;
+                latest.timestamp = deviceTime;
+                latest.isValid = pipeline.cards().isValid(frame.uid);
+                latest.hasData = true;
+            }
+        }
+        pipeline.idle(nowMs);
+        ingestAllocs += benchAllocCount() - before;
+
+        if (deviceTime != lastTick && latest.hasData) {
+            lastTick = deviceTime;
+            before = benchAllocCount();
+            requests += serveDashboard(pipeline, latest, deviceTime, &responseBytes);
+            apiAllocs += benchAllocCount() - before;
+        }
+
+        if (benchNowNs() < nextReportNs) continue;
+        nextReportNs += opt.reportSeconds * 1000000000ULL;
+        window++;
+
+        int64_t heap = benchHeapInUse();
+        const char* verdict = "warm-up";
+        if (window == 1) {
+            baseline = heap;
+        } else {
+            bool ok = ingestAllocs == 0 && apiAllocs <= requests && heap == baseline;
+            verdict = ok ? "ok" : "FAIL";
+            failed |= !ok;
+        }
+        printf("t=%4lus  device %7lus  frames %9llu  records %6lu  ingest allocs %llu  "
+               "api allocs/request %.2f  heap %lld B  %s\n",
+               (unsigned long)(window * opt.reportSeconds), (unsigned long)deviceTime,
+               (unsigned long long)pipeline.counters().framesReceived, (unsigned long)pipeline.history().count(),
+               (unsigned long long)ingestAllocs, requests ? (double)apiAllocs / requests : 0.0,
+               (long long)heap, verdict);
+        fflush(stdout);
+        ingestAllocs = 0;
+        apiAllocs = 0;
+        requests = 0;
+    }
+    printf("served     %.1f KB per dashboard refresh on average\n",
+           lastTick ? responseBytes / 1024.0 / lastTick : 0.0);
+    printf("%s\n", failed ? "FAIL: heap use is not steady" : "PASS: no steady-state heap growth");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * stm32_emulator.cpp
+ */
+
+#include "stm32_emulator.h"
+#include "frame_parser.h"
+#include <stdio.h>
+
+Stm32Emulator::Stm32Emulator(const EmulatorConfig& c) : config(c), seq(0), rng(c.seed ? c.seed : 1) {
+    if (config.stations < 1) config.stations = 1;
+    if (config.stations > EMULATOR_MAX_STATIONS) config.stations = EMULATOR_MAX_STATIONS;
+    if (config.framesPerSecond < 1) config.framesPerSecond = 1;
+    if (config.cardsPerStation < 1) config.cardsPerStation = 1;
+
+    // Spread the first frames over one interval so stations do not start in step
+    for (uint32_t s = 0; s < config.stations; s++) {
+        stations[s].nextUs = random() % (1000000 / config.framesPerSecond);
+        stations[s].nextBurstUs = 1000000;
+        stations[s].burstLeft = 0;
+        stations[s].debugSent = false;
+    }
+}
+
+void Stm32Emulator::cardUid(uint32_t station, uint32_t card, uint8_t* uid) {
+    uid[0] = 0x5A;
+    uid[1] = (uint8_t)station;
+    uid[2] = (uint8_t)(card >> 8);
+    uid[3] = (uint8_t)card;
+}
+
+uint32_t Stm32Emulator::random() {
+    // xorshift32
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+uint64_t Stm32Emulator::interval() {
+    uint64_t mean = 1000000 / config.framesPerSecond;
+    return mean * 3 / 4 + random() % (mean / 2 + 1);
+}
+
+void Stm32Emulator::next(EmulatorItem* out) {
+    // Station due first; a running burst is due immediately
+    uint32_t s = 0;
+    uint64_t due = UINT64_MAX;
+    for (uint32_t i = 0; i < config.stations; i++) {
+        Station& st = stations[i];
+        uint64_t t = st.burstLeft ? st.nextBurstUs : st.nextUs;
+        if (config.burstFrames && !st.burstLeft && st.nextBurstUs < t) t = st.nextBurstUs;
+        if (t < due) {
+            due = t;
+            s = i;
+        }
+    }
+
+    Station& st = stations[s];
+    out->dueUs = due;
+    if (config.burstFrames && !st.burstLeft && st.nextBurstUs == due) {
+        st.burstLeft = config.burstFrames;
+    }
+
+    if (!st.debugSent && random() % 100 < config.debugPercent) {
+        makeDebugText(s, out);
+        st.debugSent = true;
+        return;
+    }
+
+    makeFrame(s, out);
+    st.debugSent = false;
+    if (st.burstLeft) {
+        if (--st.burstLeft == 0) st.nextBurstUs += 1000000;
+    } else {
+        st.nextUs += interval();
+    }
+}
+
+void Stm32Emulator::makeFrame(uint32_t station, EmulatorItem* out) {
+    uint8_t* f = out->bytes;
+    bool corrupt = random() % 100 < config.corruptPercent;
+    uint32_t weight = corrupt ? EMULATOR_CORRUPT_WEIGHT : seq;
+
+    f[0] = FRAME_START_BYTE;
+    f[1] = FRAME_TYPE_CARD_DETECTED;
+    cardUid(station, random() % config.cardsPerStation, &f[2]);
+    f[6] = (uint8_t)(weight >> 24);
+    f[7] = (uint8_t)(weight >> 16);
+    f[8] = (uint8_t)(weight >> 8);
+    f[9] = (uint8_t)weight;
+    f[10] = FRAME_END_BYTE;
+    out->len = FRAME_CARD_SIZE;
+
+    if (!corrupt) {
+        out->kind = ITEM_FRAME;
+        out->seq = seq++;
+        return;
+    }
+
+    out->kind = ITEM_CORRUPT_FRAME;
+    switch (random() % 4) {
+    case 0:
+        f[10] ^= 0x01;                        // bad end byte
+        break;
+    case 1:
+        out->len -= 1 + random() % 6;          // cut short
+        break;
+    case 2:
+        f[1] = 0x02;                          // unknown type
+        break;
+    default:
+        f[0] ^= 0x01;                         // start byte lost
+        break;
+    }
+}
+
+void Stm32Emulator::makeDebugText(uint32_t station, EmulatorItem* out) {
+    int n;
+    if (random() % 2) {
+        n = snprintf((char*)out->bytes, EMULATOR_ITEM_MAX, "[ST%lu] HX711 raw=%lu tare=%lu\r\n",
+                     (unsigned long)station, (unsigned long)(random() % 8388608),
+                     (unsigned long)(random() % 100000));
+    } else {
+        n = snprintf((char*)out->bytes, EMULATOR_ITEM_MAX, "[ST%lu] RC522 poll ok, irq=0x%02lx\r\n",
+                     (unsigned long)station, (unsigned long)(random() & 0x7F));
+    }
+    out->len = n < EMULATOR_ITEM_MAX ? n : EMULATOR_ITEM_MAX - 1;
+    out->kind = ITEM_DEBUG_TEXT;
+}
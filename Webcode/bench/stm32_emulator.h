@@ -0,0 +1,79 @@
+/*
+ * stm32_emulator.h
+ *
+ * Synthetic STM32 stations for the ingest stress test. Each station sends
+ * v1 card frames (AA 01 UID[4] WEIGHT[4] 55) at an average rate with
+ * +-25% jitter, and optionally debug text lines, damaged frames and a
+ * burst of back-to-back frames once a second. Intact frames carry a
+ * sequence number in the weight field so the receiver can match them to
+ * their send time. The emulator only produces items with due times;
+ * pacing them onto a link is up to the caller.
+ */
+
+#ifndef STM32_EMULATOR_H_
+#define STM32_EMULATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+#define EMULATOR_MAX_STATIONS  16
+#define EMULATOR_ITEM_MAX      64
+#define EMULATOR_CORRUPT_WEIGHT 0x7FFFFFFF   // weight field of damaged frames
+
+enum EmulatorItemKind {
+    ITEM_FRAME,
+    ITEM_CORRUPT_FRAME,
+    ITEM_DEBUG_TEXT
+};
+
+struct EmulatorItem {
+    uint8_t bytes[EMULATOR_ITEM_MAX];
+    size_t len;
+    EmulatorItemKind kind;
+    uint32_t seq;             // ITEM_FRAME only
+    uint64_t dueUs;           // from the start of the run
+};
+
+struct EmulatorConfig {
+    uint32_t stations = 1;
+    uint32_t framesPerSecond = 20;    // per station
+    uint32_t cardsPerStation = 32;
+    uint32_t debugPercent = 0;        // chance of a debug line before a frame
+    uint32_t corruptPercent = 0;      // chance a frame is damaged
+    uint32_t burstFrames = 0;         // extra frames once a second, 0 = none
+    uint32_t seed = 1;
+};
+
+class Stm32Emulator {
+public:
+    explicit Stm32Emulator(const EmulatorConfig& config);
+
+    // Next item of the station that is due first
+    void next(EmulatorItem* out);
+
+    // Frames handed out so far, intact ones numbered 0 .. framesSent() - 1
+    uint32_t framesSent() const { return seq; }
+
+    static void cardUid(uint32_t station, uint32_t card, uint8_t* uid);
+
+private:
+    struct Station {
+        uint64_t nextUs;
+        uint64_t nextBurstUs;
+        uint32_t burstLeft;
+        bool debugSent;       // debug line for the pending frame already out
+    };
+
+    uint32_t random();
+    uint64_t interval();
+    void makeFrame(uint32_t station, EmulatorItem* out);
+    void makeDebugText(uint32_t station, EmulatorItem* out);
+
+    EmulatorConfig config;
+    Station stations[EMULATOR_MAX_STATIONS];
+    uint32_t seq;
+    uint32_t rng;
+};
+
+#endif /* STM32_EMULATOR_H_ */
@@ -0,0 +1,69 @@
+/*
+ * allowlist_sync.h
+ *
+ * Keeps the STM32's copy of the valid cards (HC/Core/Src/card_allowlist.c)
+ * in step with the card table, so the STM32 can accept or reject a card
+ * without asking. Every add and remove goes out as one delta frame:
+ *   AA 02 OP UID[4] 55
+ * The STM32 reports its count and checksum at boot, after a full list
+ * and every 30 s; when they differ from the table's (an STM32 reset, a
+ * lost frame, a bulk import) the whole list is sent again: CLEAR, one ADD
+ * per active card and END with the card count in the UID field. The full
+ * list goes out in paced batches from loop(), see AllowlistSender.
+ */
+
+#ifndef ALLOWLIST_SYNC_H_
+#define ALLOWLIST_SYNC_H_
+
+#include <Arduino.h>
+#include "frame_parser.h"
+#include "card_table.h"
+
+#define ALLOWLIST_OP_ADD    1
+#define ALLOWLIST_OP_REMOVE 2
+#define ALLOWLIST_OP_CLEAR  3
+#define ALLOWLIST_OP_END    4
+
+// The STM32 only drains its 256-byte receive ring between other work, and
+// its main loop can stall for tens of milliseconds on blocking debug
+// output. 8 frames (64 bytes) every 25 ms is about a fifth of the UART
+// rate and leaves the ring room for a 100 ms stall; 1024 cards take 3.2 s.
+#define ALLOWLIST_BATCH_FRAMES 8
+#define ALLOWLIST_BATCH_MS     25
+
+// Checksum term of one card, the murmur3 finalizer of the UID read as a
+// big-endian integer; the checksum is the XOR over the cards, so it does
+// not depend on their order
+uint32_t allowlistMix(const uint8_t* uid);
+
+// Count and checksum the STM32 should report for the active cards
+AllowlistState allowlistState(const CardTable& table);
+
+// One delta frame
+void sendAllowlistDelta(Print& out, uint8_t op, const uint8_t* uid);
+
+// The whole list, a batch of frames per ALLOWLIST_BATCH_MS. Walks the table
+// by index like CardListSource, so the caller must hold the state lock
+// around each poll(), not across the transfer.
+class AllowlistSender {
+public:
+    // Send the list from the start; a transfer under way starts over
+    void start();
+    bool busy() const { return step != STEP_IDLE; }
+
+    // Send the next batch if it is due. True when the END frame went out;
+    // sent() is then the number of cards in the list.
+    bool poll(Print& out, const CardTable& table, uint32_t nowMs);
+    uint32_t sent() const { return count; }
+
+private:
+    enum Step { STEP_IDLE, STEP_CLEAR, STEP_CARDS };
+
+    Step step = STEP_IDLE;
+    int pos = 0;
+    uint32_t count = 0;
+    uint32_t batchMs = 0;
+    bool first = false;       // the first batch goes out right away
+};
+
+#endif /* ALLOWLIST_SYNC_H_ */
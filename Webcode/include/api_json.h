@@ -0,0 +1,35 @@
+/*
+ * api_json.h
+ *
+ * JSON renderers for the API rows and the latest reading, shared by the
+ * handlers in main.cpp, the response sources and the native benchmarks.
+ */
+
+#ifndef API_JSON_H_
+#define API_JSON_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "card_key.h"
+#include "weight_rollup.h"
+
+// Latest received data from STM32
+struct CardReading {
+    CardKey card;
+    uint8_t reader;
+    bool isValid;
+    int32_t weight; // Đổi thành int32_t
+    unsigned long timestamp;
+    bool hasData;
+};
+
+// {"lastCard":..,"reader":..,"weight":..,"valid":..,"timestamp":..,"historyCount":..}
+void printReadingJson(Print& out, const CardReading& reading, uint32_t historyCount);
+
+// {"recNo":..,"time":..,"uid":"..","weight":..,"valid":..}
+void printHistoryJson(Print& out, uint32_t recNo, uint32_t timestamp, const uint8_t* uid, int32_t weight, bool isValidCard);
+
+// Summary of one card with its daily buckets, oldest day first
+void printRollupJson(Print& out, const PatientRollup* p);
+
+#endif /* API_JSON_H_ */
@@ -0,0 +1,124 @@
+/*
+ * api_sources.h
+ *
+ * Streamed bodies of the card list, card import, history and rollup API.
+ * They take the stores they read as arguments, so the same sources serve
+ * main.cpp's handlers and the native benchmarks.
+ */
+
+#ifndef API_SOURCES_H_
+#define API_SOURCES_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "response_source.h"
+#include "card_table.h"
+#include "card_transfer.h"
+#include "history_store.h"
+#include "history_cache.h"
+#include "weight_rollup.h"
+
+#define HISTORY_CURSOR_SIZE 9      // 8 hex digits + NUL
+
+// Active cards, walked by index so cards added between chunks are picked up
+class CardListSource : public JsonArraySource {
+public:
+    explicit CardListSource(const CardTable& table) : table(table) {}
+
+protected:
+    bool advance() override;
+    void printItem(Print& out) override;
+
+private:
+    const CardTable& table;
+    int pos = 0;
+    int current = 0;
+};
+
+// Result of a card import as {"rows":...,"failed":...,"errors":[...]}, one
+// kept error per chunk. Counts and errors are copied out of the upload job,
+// which is freed before the body is sent.
+class CardImportResultSource : public JsonArraySource {
+public:
+    CardImportResultSource(const CardImportParser& parser, const uint32_t* counts);
+
+    bool next(Print& out) override;
+
+protected:
+    bool advance() override;
+    void printItem(Print& out) override;
+
+private:
+    uint32_t counts[CARD_UNCHANGED + 1];
+    uint32_t failed;
+    uint32_t errorCount;
+    CardImportError errors[CARD_IMPORT_MAX_ERRORS];
+    uint32_t pos = 0;
+    uint32_t current = 0;
+    bool opened = false;
+};
+
+// One page of history rows, newest first, as {"records":[...],"cursor":...}.
+// The walk position is the next record number, so records appended or cache
+// blocks dropped between chunks are harmless; it is also what goes into the
+// continuation cursor.
+class HistorySource : public JsonArraySource {
+public:
+    // start is the newest record to visit (HISTORY_NO_RECORD for an empty
+    // page); with a uid it must be one of that card's records
+    HistorySource(HistoryStore& store, const HistoryCache& cache, const uint8_t* uid,
+                  uint32_t start, uint32_t since, uint32_t until, int limit);
+
+    bool next(Print& out) override;
+
+protected:
+    bool advance() override;
+    void printItem(Print& out) override;
+
+private:
+    uint32_t firstInRange() const;
+    bool hasMore();
+    bool loadUnfiltered(uint32_t r);
+    void setCurrent(uint32_t r, const HistoryRecord& rec);
+
+    HistoryStore& store;
+    const HistoryCache& cache;
+    bool filtered;
+    uint8_t filterUid[UID_SIZE];
+    uint32_t since;
+    uint32_t until;
+    uint32_t stop = 0;        // unfiltered: oldest record in the time range
+    int left;
+    uint32_t nextRec;
+    bool opened = false;
+    HistorySample current;
+    HistorySample samples[HISTORY_BLOCK_MAX_SAMPLES];
+    uint32_t decoded = 0;
+};
+
+// Every patient summary of the rollup table
+class RollupListSource : public JsonArraySource {
+public:
+    explicit RollupListSource(const WeightRollup& rollup) : rollup(rollup) {}
+
+protected:
+    bool advance() override;
+    void printItem(Print& out) override;
+
+private:
+    const WeightRollup& rollup;
+    uint32_t pos = 0;
+    uint32_t current = 0;
+};
+
+// Newest record of a history page (HISTORY_NO_RECORD for an empty one):
+// the cursor record when resuming, else the newest record of the card or
+// the newest at or before until. Returns false for a cursor that does not
+// belong to the listing; a cursor rotated out of the log ends it.
+bool historyPageStart(HistoryStore& store, const uint8_t* uid, const uint32_t* cursor,
+                      uint32_t since, uint32_t until, uint32_t* start);
+
+// Cursors are opaque to clients; inside they are the next record number
+void formatHistoryCursor(uint32_t recNo, char* out);
+
+#endif /* API_SOURCES_H_ */
@@ -0,0 +1,92 @@
+/*
+ * card_ingest.h
+ *
+ * Receive path for the STM32 link: feeds UART bytes through the frame
+ * parser, counts what was dropped, keeps the last calibration reply,
+ * checks the STM32's allowlist report and stores each card reading in the
+ * history log, its RAM cache and the patient rollups. A card whose rollup
+ * was evicted gets it back from the log before the reading is added, so
+ * its all-time figures never restart. The firmware's loop() and the
+ * native ingest benchmarks both run it, so what the benchmarks measure is
+ * the code that ships.
+ */
+
+#ifndef CARD_INGEST_H_
+#define CARD_INGEST_H_
+
+#include <Arduino.h>
+#include "frame_parser.h"
+#include "card_table.h"
+#include "history_store.h"
+#include "history_cache.h"
+#include "weight_rollup.h"
+#include "allowlist_sync.h"
+
+// Why a frame from the STM32 was dropped
+enum FrameReject {
+    FRAME_REJECT_BAD_END,         // 11 bytes without the 0x55 end byte
+    FRAME_REJECT_UNKNOWN_TYPE,
+    FRAME_REJECT_OVERFLOW,
+    FRAME_REJECT_TIMEOUT,         // incomplete frame for more than 1 s
+    FRAME_REJECT_COUNT
+};
+
+struct IngestCounters {
+    uint32_t uartBytes;
+    uint32_t uartNoiseBytes;      // dropped while waiting for a start byte
+    uint32_t framesReceived;
+    uint32_t framesRejected[FRAME_REJECT_COUNT];
+    uint32_t rollupEvictions;     // WeightRollup::evictions()
+    uint32_t rollupRestores;      // rollups rebuilt from the history log
+};
+
+class CardIngest {
+public:
+    CardIngest(CardTable& cards, HistoryStore& store, HistoryCache& cache, WeightRollup& rollup,
+               IngestCounters& counters)
+        : cards(cards), store(store), cache(cache), rollup(rollup), count(counters) {}
+
+    // Debug lines for every byte and frame; nullptr for none
+    void setLog(Print* log) { this->log = log; }
+
+    // Restarted when the STM32 reports a different allowlist
+    void setAllowlistSender(AllowlistSender* sender) { this->sender = sender; }
+
+    // Feed one received byte. On FRAME_CARD the caller stores the frame
+    // with storeCard(), so it can time that part on its own.
+    FrameEvent feed(uint8_t byte, CardFrame* frame);
+
+    // Drop a frame left incomplete for FRAME_TIMEOUT_MS
+    void expire(uint32_t nowMs);
+
+    // Store a card reading taken at time (device seconds) in the history
+    // and, for a valid card, its rollup. Returns whether the card is valid.
+    bool storeCard(const CardFrame& frame, uint32_t time);
+
+    // Summary of a card rebuilt from its records in the history log;
+    // false if the log has no readings of it as a valid card
+    bool restoreRollup(const uint8_t* uid, PatientRollup* p);
+
+    // Rebuild the rollup table at boot, with the cards weighed last
+    void loadRollups();
+
+    // The last calibration reply and its millis(); 0 = none yet
+    const ScaleReply& scaleReply() const { return reply; }
+    unsigned long scaleReplyTime() const { return replyTime; }
+
+private:
+    void addRecord(const uint8_t* uid, int32_t weight, uint32_t time, bool isValid);
+
+    CardTable& cards;
+    HistoryStore& store;
+    HistoryCache& cache;
+    WeightRollup& rollup;
+    IngestCounters& count;
+    FrameParser parser;
+    Print* log = nullptr;
+    AllowlistSender* sender = nullptr;
+    ScaleReply reply = {};
+    unsigned long replyTime = 0;
+};
+
+#endif /* CARD_INGEST_H_ */
@@ -0,0 +1,90 @@
+/*
+ * card_journal.h
+ *
+ * Append-only journal of valid-card changes kept in the "cardlog" flash
+ * partition. Each add/remove/rename is one small CRC-framed record appended
+ * to the current head sector, so changing a card no longer rewrites the
+ * whole table. Sectors are used as a ring ordered by sequence number; the
+ * oldest one is compacted (live cards re-appended, sector erased) in the
+ * background from loop() so erases are spread over the whole partition.
+ *
+ * At boot begin() replays every valid record in sequence order through the
+ * replay callback to rebuild the in-memory card table.
+ */
+
+#ifndef CARD_JOURNAL_H_
+#define CARD_JOURNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "flash_region.h"
+
+// Record types
+#define CARD_REC_ADD       0x01  // uid + name, card becomes active
+#define CARD_REC_REMOVE    0x02  // uid, card becomes inactive
+#define CARD_REC_RENAME    0x03  // uid + name, name of a known card changes
+
+#define CARD_JOURNAL_MAX_SECTORS      64
+#define CARD_JOURNAL_RESERVE_SECTORS  2   // keep this many erased for compaction
+
+// Called for every record during replay, in the order they were written
+typedef void (*CardReplayFn)(uint8_t type, const uint8_t* uid, const char* name);
+
+// Used by compaction: fill name and return true if the card is currently
+// active, return false if it is removed or unknown (its records are dropped)
+typedef bool (*CardLiveStateFn)(const uint8_t* uid, char* name, size_t nameSize);
+
+class CardJournal {
+public:
+    CardJournal();
+
+    // Mount the journal on a region and replay it. Sectors with a damaged
+    // header are erased; a damaged record ends replay of its sector.
+    bool begin(FlashRegion* region, CardReplayFn replay, CardLiveStateFn liveState);
+
+    // Append one record. name may be nullptr for CARD_REC_REMOVE.
+    bool append(uint8_t type, const uint8_t* uid, const char* name = nullptr);
+
+    // Batched appends: records appended between beginBatch() and
+    // commitBatch() are collected in RAM and written with one flash write
+    // per sector they land in. A power cut during the commit leaves a
+    // prefix of the batch, which replays like separate appends would.
+    void beginBatch();
+    bool commitBatch();
+
+    // Background compaction: reclaims at most one sector per call while the
+    // number of erased sectors is below CARD_JOURNAL_RESERVE_SECTORS.
+    void maintain();
+
+    bool isEmpty() const { return usedSectors == 0; }
+    uint32_t getFreeSectors() const { return sectorCount - usedSectors; }
+    uint32_t getSectorCount() const { return sectorCount; }
+
+private:
+    bool appendRecord(uint8_t type, const uint8_t* uid, const char* name, bool allowReclaim);
+    bool openSector();
+    bool reclaimOldest();
+    int oldestSector() const;
+    uint32_t replaySector(uint32_t sector);
+    bool flushBatch();
+
+    FlashRegion* region;
+    CardReplayFn replayFn;
+    CardLiveStateFn liveStateFn;
+
+    uint32_t sectorSeq[CARD_JOURNAL_MAX_SECTORS]; // 0 = erased
+    uint32_t sectorCount;
+    uint32_t usedSectors;
+    uint32_t nextSeq;
+    int head;              // sector being appended to, -1 if none
+    uint32_t headOffset;   // next write offset inside head
+
+    bool batching;
+    bool batchFailed;
+    uint32_t batchOffset;  // head offset of batch[0]
+    uint32_t batchLen;
+    uint8_t batch[FLASH_SECTOR_SIZE];
+};
+
+#endif /* CARD_JOURNAL_H_ */
@@ -0,0 +1,46 @@
+/*
+ * card_key.h
+ *
+ * Cards are identified in RAM by a 64-bit integer key instead of a byte
+ * array: the UID bytes big-endian in the low 56 bits and the UID length in
+ * the top byte. Any UID up to 7 bytes (ISO 14443 double size) fits, UIDs
+ * of different lengths never share a key, and comparing two cards is one
+ * integer compare. The wire frame, the history log and the card journal
+ * keep their UID_SIZE byte fields.
+ */
+
+#ifndef CARD_KEY_H_
+#define CARD_KEY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+#define CARD_UID_MAX 7        // longest UID a key holds
+
+typedef uint64_t CardKey;
+
+#define CARD_KEY_NONE 0       // no UID has length 0
+
+inline CardKey cardKey(const uint8_t* uid, size_t len = UID_SIZE) {
+    CardKey key = (CardKey)len << 56;
+    for (size_t i = 0; i < len; i++) {
+        key |= (CardKey)uid[i] << (8 * (len - 1 - i));
+    }
+    return key;
+}
+
+inline size_t cardKeyLength(CardKey key) {
+    return (size_t)(key >> 56);
+}
+
+// UID bytes of key into uid (at least CARD_UID_MAX bytes); returns the length
+inline size_t cardKeyUid(CardKey key, uint8_t* uid) {
+    size_t len = cardKeyLength(key);
+    for (size_t i = 0; i < len; i++) {
+        uid[i] = (uint8_t)(key >> (8 * (len - 1 - i)));
+    }
+    return len;
+}
+
+#endif /* CARD_KEY_H_ */
@@ -0,0 +1,85 @@
+/*
+ * card_table.h
+ *
+ * In-memory table of registered cards, backed by the card journal. A
+ * change is appended to the journal first and applied to the table only
+ * when that succeeds; at boot the journal replays into the table through
+ * applyRecord(). Entries are never deleted: a removed card stays in the
+ * table as inactive, so its name comes back when it is added again.
+ *
+ * The table is kept as parallel arrays: the card keys (card_key.h) are
+ * contiguous so a lookup scans 8 bytes per card, the active flags are a
+ * bitset, and names live NUL-terminated in one pool addressed by offset.
+ * The pool is compacted when a name no longer fits; a change that would
+ * need more than CARD_NAME_POOL bytes of names is refused.
+ */
+
+#ifndef CARD_TABLE_H_
+#define CARD_TABLE_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "card_key.h"
+#include "card_journal.h"
+
+// Outcome of one bulk-imported card
+enum CardImportResult {
+    CARD_ADDED,
+    CARD_UPDATED,
+    CARD_UNCHANGED,
+    CARD_TABLE_FULL,
+    CARD_WRITE_FAILED
+};
+
+class CardTable {
+public:
+    explicit CardTable(CardJournal* journal);
+
+    void clear();
+
+    // Index of a card (active or not), or -1
+    int find(CardKey key) const;
+    int find(const uint8_t* uid) const { return find(cardKey(uid)); }
+    bool isValid(CardKey key) const;
+    bool isValid(const uint8_t* uid) const { return isValid(cardKey(uid)); }
+
+    // Journalled changes; false if the card is unknown (remove/rename),
+    // the table or name pool is full or the journal write fails
+    bool add(const uint8_t* uid);
+    bool remove(const uint8_t* uid);
+    bool rename(const uint8_t* uid, const char* name);
+
+    // Add a card or update its name, for bulk import
+    CardImportResult import(const uint8_t* uid, const char* name);
+
+    // Journal callbacks: replay one record without writing, and report
+    // the current state of a card for compaction
+    void applyRecord(uint8_t type, const uint8_t* uid, const char* name);
+    bool liveState(const uint8_t* uid, char* name, size_t nameSize) const;
+
+    // Entries 0 .. size() - 1, including inactive ones
+    int size() const { return used; }
+    CardKey key(int i) const { return keys[i]; }
+    bool isActive(int i) const { return activeBits[i >> 5] & (1UL << (i & 31)); }
+    const char* name(int i) const { return nameLen[i] ? namePool + nameOffset[i] : ""; }
+    int activeCount() const;
+
+private:
+    int insert(CardKey key);
+    void setActive(int i, bool active);
+    bool nameFits(int i, const char* name) const;
+    void setName(int i, const char* name);
+    void compactNames();
+
+    CardJournal* journal;
+    CardKey keys[MAX_VALID_CARDS];
+    uint32_t activeBits[(MAX_VALID_CARDS + 31) / 32];
+    uint16_t nameOffset[MAX_VALID_CARDS];
+    uint8_t nameLen[MAX_VALID_CARDS];         // 0 = no name
+    char namePool[CARD_NAME_POOL];
+    uint16_t poolEnd;                         // first free byte
+    uint16_t poolLive;                        // bytes held by current names
+    uint16_t used;
+};
+
+#endif /* CARD_TABLE_H_ */
@@ -0,0 +1,91 @@
+/*
+ * card_transfer.h
+ *
+ * Card lists for bulk import and export. Two formats:
+ *   CSV:     one "XX:XX:XX:XX,name" line per card. On import a header line
+ *            starting with "uid", blank lines and a missing name are fine;
+ *            everything after the first comma is the name.
+ *   binary:  "HCC1", then per card uid[UID_SIZE], name length (1 byte),
+ *            name bytes (not terminated)
+ * CardImportParser takes an upload in pieces of any size, detects the
+ * format from the first bytes and collects the usable rows; every row it
+ * cannot use is counted and the first CARD_IMPORT_MAX_ERRORS are kept with
+ * their row number (CSV line or binary record, from 1).
+ */
+
+#ifndef CARD_TRANSFER_H_
+#define CARD_TRANSFER_H_
+
+#include <Arduino.h>
+#include "config.h"
+
+#define CARD_BINARY_MAGIC       "HCC1"
+#define CARD_BINARY_MAGIC_SIZE  4
+#define CARD_CSV_LINE_MAX       96
+#define CARD_IMPORT_MAX_ERRORS  32
+#define CARD_IMPORT_CARRY_SIZE  (UID_SIZE + 1 + 255)   // longest binary record
+#define CARD_IMPORT_MIN_ROW     (UID_SIZE + 1)         // shortest row of either format
+
+struct CardImportRow {
+    uint8_t uid[UID_SIZE];
+    char name[CARD_NAME_MAX + 1];
+    uint16_t row;
+};
+
+struct CardImportError {
+    uint16_t row;
+    const char* reason;       // static string
+};
+
+// Copy a card name keeping printable text without markup/quote characters,
+// trimmed and cut to CARD_NAME_MAX bytes without splitting a UTF-8
+// sequence. out must hold CARD_NAME_MAX + 1 bytes. Returns the length.
+size_t cleanCardName(const char* in, size_t len, char* out);
+
+// "XX:XX:XX:XX", either case
+bool parseUid(const char* text, size_t len, uint8_t* uid);
+
+// One card of an export
+void printCardCsv(Print& out, const uint8_t* uid, const char* name);
+void printCardBinary(Print& out, const uint8_t* uid, const char* name);
+
+class CardImportParser {
+public:
+    CardImportParser(CardImportRow* rows, uint32_t maxRows);
+
+    void feed(const uint8_t* data, size_t len);
+    void finish();            // end of the upload
+
+    bool isBinary() const { return format == FORMAT_BINARY; }
+    uint32_t rowCount() const { return count; }
+    const CardImportRow& row(uint32_t i) const { return rows[i]; }
+
+    // Failed rows; the caller adds the ones it cannot apply
+    void addError(uint16_t row, const char* reason);
+    uint32_t failedCount() const { return failed; }
+    uint32_t errorCount() const { return errorsKept; }
+    const CardImportError& error(uint32_t i) const { return errors[i]; }
+
+private:
+    enum Format { FORMAT_UNKNOWN, FORMAT_CSV, FORMAT_BINARY };
+
+    void endCsvLine();
+    void endBinaryRecord();
+    void addRow(uint16_t row, const uint8_t* uid, const char* name, size_t nameLen);
+
+    CardImportRow* rows;
+    uint32_t maxRows;
+    uint32_t count;
+
+    Format format;
+    uint16_t rowNo;           // row being read
+    bool overlong;            // CSV line longer than CARD_CSV_LINE_MAX
+    size_t carryLen;
+    uint8_t carry[CARD_IMPORT_CARRY_SIZE];
+
+    CardImportError errors[CARD_IMPORT_MAX_ERRORS];
+    uint32_t errorsKept;
+    uint32_t failed;
+};
+
+#endif /* CARD_TRANSFER_H_ */
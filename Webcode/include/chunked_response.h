@@ -0,0 +1,24 @@
+/*
+ * chunked_response.h
+ *
+ * Streamed responses for the async web server. The body is produced by a
+ * ResponseSource (response_source.h) one piece at a time, each time the
+ * connection can take more data, and sent with chunked transfer encoding.
+ * No work happens while the client is slow to read.
+ *
+ * Sources run on the AsyncTCP task between loop() iterations; next() is
+ * called with the StateLock held, and a source must cope with the data
+ * changing between calls (keep a cursor, re-check bounds).
+ */
+
+#ifndef CHUNKED_RESPONSE_H_
+#define CHUNKED_RESPONSE_H_
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "response_source.h"
+
+// Send src as a chunked response; the response owns src
+void sendChunked(AsyncWebServerRequest* request, const char* contentType, ResponseSource* src);
+
+#endif /* CHUNKED_RESPONSE_H_ */
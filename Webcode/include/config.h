@@ -0,0 +1,15 @@
+/*
+ * config.h
+ *
+ * Limits shared between main.cpp and the storage modules.
+ */
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#define UID_SIZE           4
+#define MAX_VALID_CARDS    1024
+#define CARD_NAME_MAX      31    // bytes, without terminator
+#define CARD_NAME_POOL     16384 // bytes for all card names, 16 per card on average
+
+#endif /* CONFIG_H_ */
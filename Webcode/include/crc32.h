@@ -0,0 +1,28 @@
+/*
+ * crc32.h
+ *
+ * CRC-32 (IEEE 802.3, reflected 0xEDB88320) used to frame records
+ * written to flash.
+ */
+
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRC32_INIT 0xFFFFFFFFUL
+
+// Feed len bytes into a running CRC. Start with CRC32_INIT and pass the
+// result through crc32Final() once all data has been fed.
+uint32_t crc32Update(uint32_t crc, const void* data, size_t len);
+
+static inline uint32_t crc32Final(uint32_t crc) {
+    return crc ^ 0xFFFFFFFFUL;
+}
+
+static inline uint32_t crc32(const void* data, size_t len) {
+    return crc32Final(crc32Update(CRC32_INIT, data, len));
+}
+
+#endif /* CRC32_H_ */
@@ -0,0 +1,47 @@
+/*
+ * flash_region.h
+ *
+ * Minimal raw-flash interface for the log-structured stores. Offsets are
+ * relative to the start of the region. NOR semantics: write() can only
+ * clear bits, so a range must be erased (all 0xFF) before it is rewritten.
+ */
+
+#ifndef FLASH_REGION_H_
+#define FLASH_REGION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLASH_SECTOR_SIZE  4096
+#define FLASH_PAGE_SIZE    256
+
+class FlashRegion {
+public:
+    virtual ~FlashRegion() {}
+
+    virtual uint32_t size() const = 0;
+    virtual bool read(uint32_t offset, void* dst, size_t len) = 0;
+    virtual bool write(uint32_t offset, const void* src, size_t len) = 0;
+    virtual bool eraseSector(uint32_t sector) = 0;
+
+    uint32_t sectorCount() const { return size() / FLASH_SECTOR_SIZE; }
+};
+
+// Region backed by a data partition from partitions.csv
+class PartitionFlashRegion : public FlashRegion {
+public:
+    PartitionFlashRegion() : partition(nullptr) {}
+
+    // Look up the partition by label. Returns false if it is not in the table.
+    bool begin(const char* label);
+
+    uint32_t size() const override;
+    bool read(uint32_t offset, void* dst, size_t len) override;
+    bool write(uint32_t offset, const void* src, size_t len) override;
+    bool eraseSector(uint32_t sector) override;
+
+private:
+    const void* partition; // esp_partition_t, kept opaque to avoid the IDF header here
+};
+
+#endif /* FLASH_REGION_H_ */
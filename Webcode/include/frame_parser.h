@@ -0,0 +1,126 @@
+/*
+ * frame_parser.h
+ *
+ * Byte-at-a-time parser for the frames the STM32 sends over UART:
+ *   AA 01 UID[4] WEIGHT[4, big-endian] 55
+ *   AA 04 READER UID[4] WEIGHT[4, big-endian] 55
+ *   AA 06 OP STATUS POINTS WEIGHT[4, big-endian] 55
+ *   AA 07 COUNT[2] CHECKSUM[4] 55
+ * The second form comes from a controller with several RFID readers and
+ * names the reader (weighing station); the first is reader 0. The third
+ * answers a scale calibration command (AA 05 OP VALUE[4] 55, built by
+ * buildScaleCommand()); the fourth reports the STM32's copy of the valid
+ * cards (see allowlist_sync.h).
+ * Bytes outside a frame are skipped as noise, frames of other types are
+ * dropped after their type byte, and expire() drops a frame that stays
+ * incomplete for FRAME_TIMEOUT_MS. The parser only reports what happened;
+ * logging and counting are up to the caller.
+ */
+
+#ifndef FRAME_PARSER_H_
+#define FRAME_PARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+#define FRAME_START_BYTE          0xAA
+#define FRAME_END_BYTE            0x55
+#define FRAME_TYPE_CARD_DETECTED  0x01  // STM32 -> ESP32: card detected with weight
+#define FRAME_TYPE_VALID_CARD     0x02  // ESP32 -> STM32: valid card list change
+#define FRAME_TYPE_READER_CARD    0x04  // STM32 -> ESP32: same, with the reader ID
+#define FRAME_TYPE_SCALE_COMMAND  0x05  // ESP32 -> STM32: calibration command
+#define FRAME_TYPE_SCALE_REPLY    0x06  // STM32 -> ESP32: its result
+#define FRAME_TYPE_ALLOWLIST_STATE 0x07 // STM32 -> ESP32: count and checksum of its valid cards
+#define FRAME_CARD_SIZE           11
+#define FRAME_READER_CARD_SIZE    12
+#define FRAME_SCALE_COMMAND_SIZE  8
+#define FRAME_SCALE_REPLY_SIZE    10
+#define FRAME_VALID_CARD_SIZE     8
+#define FRAME_ALLOWLIST_STATE_SIZE 9
+#define FRAME_BUFFER_SIZE         256
+#define FRAME_TIMEOUT_MS          1000
+
+// Result of feeding one byte
+enum FrameEvent {
+    FRAME_PENDING,            // byte stored, frame not complete yet
+    FRAME_NOISE,              // byte skipped while waiting for a start byte
+    FRAME_STARTED,            // start byte found
+    FRAME_CARD,               // complete card frame, see CardFrame
+    FRAME_SCALE_REPLY,        // calibration reply, see scaleReply()
+    FRAME_ALLOWLIST_STATE,    // STM32 allowlist report, see allowlistState()
+    FRAME_BAD_END,            // full frame without the end byte, dropped
+    FRAME_UNKNOWN_TYPE,       // dropped after the type byte
+    FRAME_OVERFLOW            // buffer full, dropped
+};
+
+struct CardFrame {
+    uint8_t reader;           // 0 for FRAME_TYPE_CARD_DETECTED
+    uint8_t uid[UID_SIZE];
+    int32_t weight;
+};
+
+// Calibration commands; the STM32 keeps its calibration in flash only
+// after SCALE_OP_SAVE
+enum ScaleOp {
+    SCALE_OP_STATUS = 0,      // just report
+    SCALE_OP_TARE = 1,        // the current load becomes zero
+    SCALE_OP_POINT = 2,       // the current load weighs VALUE grams
+    SCALE_OP_CLEAR = 3,       // drop the calibration points, keep the tare
+    SCALE_OP_SAVE = 4         // write tare and points to flash
+};
+
+// STATUS byte of the reply
+enum ScaleStatus {
+    SCALE_OK = 0,
+    SCALE_BUSY,               // a tare or point is still being measured
+    SCALE_BAD_ARG,            // unknown op, or a point out of order with the others
+    SCALE_FULL,               // no room for another point
+    SCALE_UNSTABLE,           // the load moved while it was measured
+    SCALE_FLASH_ERROR
+};
+
+struct ScaleReply {
+    uint8_t op;
+    uint8_t status;
+    uint8_t points;           // calibration points, the zero point included
+    int32_t weight;           // grams after the command
+};
+
+struct AllowlistState {
+    uint16_t count;
+    uint32_t checksum;        // XOR of allowlistMix() over the cards
+};
+
+// Write the command frame into out (FRAME_SCALE_COMMAND_SIZE bytes)
+void buildScaleCommand(uint8_t op, int32_t value, uint8_t* out);
+
+class FrameParser {
+public:
+    FrameParser();
+
+    // Feed one received byte; frame is filled on FRAME_CARD
+    FrameEvent feed(uint8_t byte, CardFrame* frame);
+
+    // Call after each batch of bytes. Drops a frame that has been pending
+    // for more than FRAME_TIMEOUT_MS and returns true if it did.
+    bool expire(uint32_t nowMs);
+
+    // Bytes of the frame in progress
+    size_t pending() const { return len; }
+
+    // The reply of the last FRAME_SCALE_REPLY
+    const ScaleReply& scaleReply() const { return reply; }
+
+    // The report of the last FRAME_ALLOWLIST_STATE
+    const AllowlistState& allowlistState() const { return allowlist; }
+
+private:
+    ScaleReply reply;
+    AllowlistState allowlist;
+    uint8_t buf[FRAME_BUFFER_SIZE];
+    size_t len;
+    uint32_t pendingSince;    // ms, 0 = not yet seen by expire()
+};
+
+#endif /* FRAME_PARSER_H_ */
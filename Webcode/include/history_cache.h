@@ -0,0 +1,112 @@
+/*
+ * history_cache.h
+ *
+ * Compressed in-RAM copy of the most recent weight history, so the history
+ * page does not need flash reads for the newest records.
+ *
+ * Samples are packed into fixed 256-byte blocks. Each block starts with a
+ * header (first record number, first/last timestamp, sample count) and can
+ * be decoded on its own. Each sample starts with a varint tag whose bit 0
+ * is the valid-card flag:
+ *   repeat of the previous UID:  tag = dt << 2 | 2 | valid,
+ *                                varint zigzag(weight - previous weight)
+ *   any other sample:            tag = uidId << 2 | valid,
+ *                                varint zigzag(dt), varint zigzag(weight)
+ * where dt is the timestamp delta to the previous sample (the block header
+ * for the first one). The readings of a patient standing on the scale thus
+ * cost about 2 bytes each instead of a 16-byte record. UIDs are interned
+ * into a small table; an id is reused only once no live block refers to it.
+ */
+
+#ifndef HISTORY_CACHE_H_
+#define HISTORY_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+#define HISTORY_BLOCK_SIZE         256
+#define HISTORY_BLOCK_HEADER_SIZE  16
+#define HISTORY_BLOCK_PAYLOAD      (HISTORY_BLOCK_SIZE - HISTORY_BLOCK_HEADER_SIZE)
+#define HISTORY_BLOCK_MAX_SAMPLES  (HISTORY_BLOCK_PAYLOAD / 2)
+#define HISTORY_CACHE_BLOCKS       32     // 8 KB of RAM
+#define HISTORY_CACHE_MAX_UIDS     256
+
+struct HistorySample {
+    uint32_t recNo;           // record number in HistoryStore
+    uint32_t timestamp;
+    uint8_t uid[UID_SIZE];
+    int32_t weight;
+    bool isValidCard;
+};
+
+struct HistoryBlock {
+    uint32_t firstRecNo;
+    uint32_t firstTimestamp;
+    uint32_t lastTimestamp;
+    uint16_t count;
+    uint16_t used;            // payload bytes
+    uint8_t payload[HISTORY_BLOCK_PAYLOAD];
+};
+
+// Varint helpers, also used by the block decoder
+size_t varintEncode(uint32_t value, uint8_t* out);
+size_t varintDecode(const uint8_t* in, size_t avail, uint32_t* value);
+
+static inline uint32_t zigzagEncode(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t zigzagDecode(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+class HistoryCache {
+public:
+    HistoryCache();
+
+    void clear();
+
+    // Add the sample stored under recNo. Record numbers must increase;
+    // a gap starts a new block.
+    void append(uint32_t recNo, const uint8_t* uid, int32_t weight,
+                uint32_t timestamp, bool isValidCard);
+
+    // Blocks are numbered 0 (oldest) .. blockCount() - 1 (newest)
+    uint32_t blockCount() const { return blocksUsed; }
+
+    // Decode one block, oldest sample first. out must hold
+    // HISTORY_BLOCK_MAX_SAMPLES entries. Returns the number of samples.
+    uint32_t decodeBlock(uint32_t i, HistorySample* out) const;
+
+    // Block holding recNo, or -1 if it is not cached
+    int findBlock(uint32_t recNo) const;
+
+    uint32_t count() const;
+    uint32_t firstRecord() const;
+    uint32_t bytesUsed() const;
+
+private:
+    HistoryBlock* blockAt(uint32_t i) { return &blocks[(firstBlock + i) % HISTORY_CACHE_BLOCKS]; }
+    const HistoryBlock* blockAt(uint32_t i) const { return &blocks[(firstBlock + i) % HISTORY_CACHE_BLOCKS]; }
+    void openBlock(uint32_t recNo, uint32_t timestamp);
+    void dropOldestBlock();
+    int internUid(const uint8_t* uid);
+    size_t encodeSample(int id, int32_t weight, uint32_t timestamp, bool isValidCard, uint8_t* out) const;
+
+    HistoryBlock blocks[HISTORY_CACHE_BLOCKS];
+    uint32_t firstBlock;
+    uint32_t blocksUsed;
+    uint32_t blockSerial;       // serial of the newest block
+
+    uint8_t uids[HISTORY_CACHE_MAX_UIDS][UID_SIZE];
+    uint32_t uidLastBlock[HISTORY_CACHE_MAX_UIDS];  // serial of the last block using the id
+    uint32_t uidCount;
+
+    // Encoder state of the newest block
+    int prevUid;
+    uint32_t prevTimestamp;
+    int32_t prevWeight;
+};
+
+#endif /* HISTORY_CACHE_H_ */
@@ -0,0 +1,126 @@
+/*
+ * history_store.h
+ *
+ * Persistent weight history: fixed 16-byte records appended to the
+ * "history" flash partition. The partition is a ring of one-sector
+ * segments; segment seq N always lives in sector (N - 1) % segmentCount,
+ * so a record number maps straight to a flash address. When the ring is
+ * full the oldest segment is erased and reused.
+ *
+ * Appends are collected in a page-sized RAM batch and written with one
+ * flash write when the batch is full, the segment ends, flush() is called
+ * or the batch has waited HISTORY_FLUSH_INTERVAL_MS.
+ *
+ * Per-card lookups use a secondary index: every record stores the distance
+ * back to the previous record of the same UID, and a RAM head table maps
+ * each UID to its newest record. Walking one card's history therefore
+ * touches only that card's records. The head table is rebuilt with one
+ * sequential scan of the log in begin(). When it is full, new UIDs are
+ * stored unchained (HISTORY_FLAG_UNCHAINED) and their lookups scan the log
+ * back from the record in hand instead; the table is only rebuilt again
+ * once a segment has rotated out and may have freed slots.
+ */
+
+#ifndef HISTORY_STORE_H_
+#define HISTORY_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "flash_region.h"
+
+#define HISTORY_FLAG_VALID_CARD       0x01
+#define HISTORY_FLAG_UNCHAINED        0x02  // no slot when written: prevDelta unknown
+
+#define HISTORY_RECORD_SIZE           16
+#define HISTORY_SEGMENT_HEADER_SIZE   16
+#define HISTORY_RECORDS_PER_SEGMENT   ((FLASH_SECTOR_SIZE - HISTORY_SEGMENT_HEADER_SIZE) / HISTORY_RECORD_SIZE)
+#define HISTORY_BATCH_RECORDS         (FLASH_PAGE_SIZE / HISTORY_RECORD_SIZE)
+#define HISTORY_MAX_SEGMENTS          256
+#define HISTORY_FLUSH_INTERVAL_MS     30000
+#define HISTORY_INDEX_SLOTS           2048  // power of two, distinct UIDs in the log
+#define HISTORY_NO_RECORD             0xFFFFFFFFUL
+
+// On-flash record
+struct HistoryRecord {
+    uint32_t timestamp;       // device time, seconds
+    uint8_t uid[UID_SIZE];
+    int32_t weight;
+    uint16_t prevDelta;       // recNo distance to the previous record of this UID, 0 = none
+    uint8_t flags;            // HISTORY_FLAG_*
+    uint8_t check;            // low byte of crc32 over the first 15 bytes
+};
+
+class HistoryStore {
+public:
+    HistoryStore();
+
+    // Mount the store and find the head segment. Segments whose header does
+    // not match their ring position are ignored and reused later.
+    bool begin(FlashRegion* region);
+
+    bool append(const uint8_t* uid, int32_t weight, uint32_t timestamp, bool isValidCard);
+
+    // Read one record by record number; false for numbers outside
+    // [firstRecord(), endRecord()) or records that fail their check byte
+    bool read(uint32_t recNo, HistoryRecord* out);
+
+    // Newest record of a card, or HISTORY_NO_RECORD
+    uint32_t latestFor(const uint8_t* uid);
+
+    // Record before recNo for the same card (rec is the record at recNo),
+    // or HISTORY_NO_RECORD at the end of the chain. An unchained record
+    // costs a backward scan to the card's previous record.
+    uint32_t previousFor(uint32_t recNo, const HistoryRecord& rec);
+
+    // First record with timestamp >= t, or endRecord() if there is none.
+    // Binary search over the log, which is in device-time order; costs
+    // about log2(count()) record reads.
+    uint32_t seekTime(uint32_t t);
+
+    // Write the pending batch to flash
+    bool flush();
+
+    // Call from loop(): flushes an aged batch and erases the next segment
+    // ahead of time so a rotation does not stall ingest
+    void maintain(uint32_t nowMs);
+
+    uint32_t firstRecord() const;
+    uint32_t endRecord() const;
+    uint32_t count() const { return endRecord() - firstRecord(); }
+    uint32_t lastTimestamp() const { return lastTime; }
+    uint32_t capacity() const { return segmentCount * HISTORY_RECORDS_PER_SEGMENT; }
+
+private:
+    struct IndexSlot {
+        uint8_t uid[UID_SIZE];
+        uint32_t last;        // newest recNo, HISTORY_NO_RECORD = empty slot
+    };
+
+    IndexSlot* findSlot(const uint8_t* uid, bool insert);
+    void rebuildIndex();
+    uint32_t scanBack(const uint8_t* uid, uint32_t before);
+    bool openSegment(uint32_t seq);
+    bool readFlash(uint32_t recNo, HistoryRecord* out);
+    uint32_t sectorOf(uint32_t seq) const { return (seq - 1) % segmentCount; }
+    uint32_t offsetOf(uint32_t recNo) const;
+
+    FlashRegion* region;
+    uint32_t segmentCount;
+    uint32_t firstSeq;        // oldest live segment, 0 if the store is empty
+    uint32_t headSeq;         // segment being appended to, 0 if none
+    uint32_t headCount;       // records in the head segment, including pending
+    bool nextErased;          // sector for headSeq + 1 is already erased
+    uint32_t lastTime;
+
+    IndexSlot index[HISTORY_INDEX_SLOTS];
+    uint32_t indexUsed;
+    bool indexOverflow;       // some UIDs are not indexed, lookups fall back to a scan
+    uint32_t indexFirst;      // firstRecord() at the last rebuild
+
+    HistoryRecord pending[HISTORY_BATCH_RECORDS];
+    uint32_t pendingCount;
+    uint32_t pendingSince;    // ms, 0 = not yet seen by maintain()
+};
+
+#endif /* HISTORY_STORE_H_ */
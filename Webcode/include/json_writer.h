@@ -0,0 +1,88 @@
+/*
+ * json_writer.h
+ *
+ * Streaming JSON writer for the API endpoints. Output goes straight to a
+ * Print (the chunked response buffer or a BufferPrint over a caller's
+ * array); numbers, UIDs and escaped strings are formatted on the stack,
+ * so writing a document never touches the heap. Commas between members
+ * and elements are inserted automatically.
+ *
+ *   JsonWriter json(out);
+ *   json.beginObject().key("uid").uid(card.uid).key("weight").value(w).endObject();
+ */
+
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+#include <Arduino.h>
+#include "config.h"
+#include "card_key.h"
+
+#define JSON_MAX_DEPTH 16
+
+class JsonWriter {
+public:
+    explicit JsonWriter(Print& out);
+
+    JsonWriter& beginObject();
+    JsonWriter& endObject();
+    JsonWriter& beginArray();
+    JsonWriter& endArray();
+
+    // Member name; must be followed by a value or begin*()
+    JsonWriter& key(const char* name);
+
+    JsonWriter& value(const char* s);   // escaped string, nullptr = null
+    JsonWriter& value(int v) { return value((long)v); }
+    JsonWriter& value(unsigned int v) { return value((unsigned long)v); }
+    JsonWriter& value(long v);
+    JsonWriter& value(unsigned long v);
+    JsonWriter& value(float v, uint8_t decimals);
+    JsonWriter& value(bool v);
+    JsonWriter& null();
+
+    // UID as the string "XX:XX:XX:XX"
+    JsonWriter& uid(const uint8_t* uid);
+    JsonWriter& uid(CardKey key);       // as many "XX" as the key's UID has
+
+    // Text written verbatim as a value, e.g. a pre-rendered fragment
+    JsonWriter& raw(const char* json);
+
+private:
+    void separator();
+    void open(char c);
+    void close(char c);
+    void writeUnsigned(unsigned long v);
+
+    Print& out;
+    uint32_t hasItems;    // bit n set = level n already has a member/element
+    uint8_t depth;
+    bool afterKey;
+};
+
+// Print into a fixed caller-owned buffer, always NUL-terminated. Output
+// that does not fit is dropped and reported by overflowed().
+class BufferPrint : public Print {
+public:
+    BufferPrint(char* buf, size_t size);
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* data, size_t len) override;
+    using Print::write;
+
+    const char* c_str() const { return buf; }
+    size_t length() const { return len; }
+    bool overflowed() const { return overflow; }
+
+private:
+    char* buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+};
+
+// Format uid as "XX:XX:XX:XX" into out (at least UID_STRING_SIZE bytes)
+#define UID_STRING_SIZE (UID_SIZE * 3)
+void formatUid(const uint8_t* uid, char* out);
+
+#endif /* JSON_WRITER_H_ */
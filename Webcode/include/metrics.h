@@ -0,0 +1,66 @@
+/*
+ * metrics.h
+ *
+ * Runtime counters and latency histograms, served in the Prometheus text
+ * format on /metrics. Updating a metric is a few integer operations and no
+ * locking, so the instrumentation stays on in production:
+ *   - ingest counters and card processing time are written by loop() with
+ *     the StateLock held, and read by MetricsSource, which also holds it
+ *   - route histograms are written and read on the AsyncTCP task only
+ * Heap and stack gauges are sampled when /metrics is read.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <Arduino.h>
+#include "chunked_response.h"
+#include "card_ingest.h"
+
+#define METRICS_BUCKETS     12    // finite histogram buckets, see metrics.cpp
+#define METRICS_MAX_ROUTES  24
+
+struct LatencyHistogram {
+    uint32_t buckets[METRICS_BUCKETS + 1];  // per bucket, last one is +Inf
+    uint32_t count;
+    uint64_t sumUs;
+
+    void observe(uint32_t us);
+};
+
+struct RouteMetrics {
+    const char* path;
+    LatencyHistogram duration;    // handler time, without the streamed body
+};
+
+struct Metrics {
+    IngestCounters ingest;        // kept by CardIngest
+    LatencyHistogram cardProcess; // processCardDetected()
+
+    RouteMetrics routes[METRICS_MAX_ROUTES];
+    uint32_t routeCount;
+};
+
+extern Metrics metrics;
+
+// Histogram for a route, registered once from setup(); nullptr when the
+// table is full
+RouteMetrics* metricsRoute(const char* path);
+
+// Remember the calling task as the loop task; call from setup()
+void metricsSetLoopTask();
+
+// /metrics body, a few lines per piece
+class MetricsSource : public ResponseSource {
+public:
+    bool next(Print& out) override;
+
+private:
+    bool printHistogramLine(Print& out);
+
+    uint8_t section = 0;
+    uint32_t histogram = 0;       // 0 = card processing, then the routes
+    uint32_t line = 0;            // bucket index, then sum/count
+};
+
+#endif /* METRICS_H_ */
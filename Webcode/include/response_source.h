@@ -0,0 +1,71 @@
+/*
+ * response_source.h
+ *
+ * Response bodies produced one piece at a time. A ResponseSource prints
+ * at most RESPONSE_CHUNK_SIZE bytes per next() call; ChunkBuffer carries
+ * those pieces into whatever send window the transport offers, so a
+ * response needs one buffer no matter how many rows it has. Nothing here
+ * depends on the web server; chunked_response.h connects it to
+ * AsyncWebServer.
+ */
+
+#ifndef RESPONSE_SOURCE_H_
+#define RESPONSE_SOURCE_H_
+
+#include <Arduino.h>
+
+#define RESPONSE_CHUNK_SIZE 1024  // largest piece a source may print at once
+
+class ResponseSource {
+public:
+    virtual ~ResponseSource() {}
+
+    // Print the next piece of the body. Returns false once the body is
+    // complete (the piece printed by that call is still sent).
+    virtual bool next(Print& out) = 0;
+};
+
+// JSON array built from items: advance() moves to the next item (false at
+// the end) and printItem() prints the current one
+class JsonArraySource : public ResponseSource {
+public:
+    bool next(Print& out) override;
+
+protected:
+    virtual bool advance() = 0;
+    virtual void printItem(Print& out) = 0;
+
+private:
+    uint8_t state = 0;    // 0 = before '[', 1 = in items, 2 = done
+};
+
+// Carry buffer between a source and the transport's send window. Owns src.
+class ChunkBuffer : public Print {
+public:
+    explicit ChunkBuffer(ResponseSource* src);
+    ~ChunkBuffer() override;
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* data, size_t n) override;
+    using Print::write;
+
+    // Copy up to maxLen bytes of body into out; 0 once the body is complete
+    size_t fill(uint8_t* out, size_t maxLen);
+
+protected:
+    // Have the source print its next piece; false after the last one.
+    // Overridden to run the source under a lock.
+    virtual bool produce();
+
+private:
+    ChunkBuffer(const ChunkBuffer&) = delete;
+    ChunkBuffer& operator=(const ChunkBuffer&) = delete;
+
+    ResponseSource* src;
+    uint8_t buf[RESPONSE_CHUNK_SIZE];
+    size_t len;
+    size_t pos;
+    bool done;
+};
+
+#endif /* RESPONSE_SOURCE_H_ */
@@ -0,0 +1,24 @@
+/*
+ * state_lock.h
+ *
+ * Web handlers run on the AsyncTCP task while loop() ingests readings, so
+ * the card table, history store/cache and rollups are guarded by one
+ * recursive mutex. Hold a StateLock (scoped) around every access.
+ */
+
+#ifndef STATE_LOCK_H_
+#define STATE_LOCK_H_
+
+// Create the mutex; call once from setup() before the web server starts
+void stateLockInit();
+
+class StateLock {
+public:
+    StateLock();
+    ~StateLock();
+
+    StateLock(const StateLock&) = delete;
+    StateLock& operator=(const StateLock&) = delete;
+};
+
+#endif /* STATE_LOCK_H_ */
@@ -0,0 +1,32 @@
+/*
+ * web_assets.h
+ *
+ * Static pages, stylesheet and scripts, gzipped at build time by
+ * tools/embed_web.py from the files in web/ and stored in flash.
+ */
+
+#ifndef WEB_ASSETS_H_
+#define WEB_ASSETS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+
+struct WebAsset {
+    const char* path;         // URL path
+    const char* contentType;
+    const uint8_t* data;      // gzip data
+    uint32_t length;
+    const char* etag;         // quoted strong ETag
+    bool immutable;           // referenced by a versioned URL, cache for a year
+};
+
+extern const WebAsset webAssets[];
+extern const size_t webAssetCount;
+
+const WebAsset* findWebAsset(const char* path);
+
+#endif /* WEB_ASSETS_H_ */
@@ -0,0 +1,114 @@
+/*
+ * weight_rollup.h
+ *
+ * Per-patient weight summaries kept up to date at ingest, so dashboards do
+ * not have to scan the raw history. For every card the table holds:
+ *   - all-time count, min, max, last weight and a running mean/variance
+ *     (Welford's method, no stored samples needed)
+ *   - one bucket per day for the last ROLLUP_DAYS days
+ *     (count, min, max, mean)
+ *   - the last ROLLUP_TREND_SAMPLES weigh-ins (a burst of readings counts
+ *     once), used for a least-squares trend slope in grams per day
+ * Days are device-time days (timestamp / 86400), like the history log.
+ *
+ * The table is RAM only and holds the ROLLUP_MAX_PATIENTS cards weighed
+ * most recently; a full entry per registered card would not fit in RAM.
+ * When it is full the card that was weighed longest ago is evicted. The
+ * history log keeps every reading, so an evicted card is rebuilt from its
+ * records (RollupRestore) when it is weighed or asked for again, and at
+ * boot for the cards weighed last.
+ */
+
+#ifndef WEIGHT_ROLLUP_H_
+#define WEIGHT_ROLLUP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+#define ROLLUP_MAX_PATIENTS    128
+#define ROLLUP_DAYS            7
+#define ROLLUP_TREND_SAMPLES   8
+#define ROLLUP_SESSION_SECONDS 600     // readings closer than this are one weigh-in
+#define ROLLUP_SECONDS_PER_DAY 86400UL
+
+struct RollupDay {
+    uint16_t day;             // timestamp / ROLLUP_SECONDS_PER_DAY, low 16 bits
+    uint16_t count;           // 0 = unused bucket
+    int32_t min;
+    int32_t max;
+    float mean;
+};
+
+struct PatientRollup {
+    uint8_t uid[UID_SIZE];
+    uint32_t count;           // 0 = free entry
+    int32_t min;
+    int32_t max;
+    int32_t last;
+    uint32_t lastTime;
+    float mean;               // Welford running mean
+    float m2;                 // Welford sum of squared deviations
+
+    RollupDay days[ROLLUP_DAYS];                // ring indexed by day % ROLLUP_DAYS
+    uint32_t trendTime[ROLLUP_TREND_SAMPLES];   // ring of the last readings
+    int32_t trendWeight[ROLLUP_TREND_SAMPLES];
+    uint8_t trendNext;
+    uint8_t trendCount;
+};
+
+class WeightRollup {
+public:
+    WeightRollup();
+
+    void clear();
+
+    // Fold one reading into the card's summary. Timestamps are device
+    // time in seconds and are expected to be non-decreasing per card.
+    void add(const uint8_t* uid, int32_t weight, uint32_t timestamp);
+
+    // Summary of a card, or nullptr if it has none in the table
+    const PatientRollup* find(const uint8_t* uid) const;
+
+    // Put a rebuilt summary in the table, replacing the card's entry
+    void insert(const PatientRollup& p);
+
+    // Entries 0 .. capacity() - 1; free entries have count == 0
+    const PatientRollup* entry(uint32_t i) const { return &table[i]; }
+    uint32_t capacity() const { return ROLLUP_MAX_PATIENTS; }
+    uint32_t size() const { return used; }
+
+    // Entries replaced to make room for another card since clear()
+    uint32_t evictions() const { return evicted; }
+
+    // Derived values
+    static float stddev(const PatientRollup* p);
+    static float trendPerDay(const PatientRollup* p);
+
+private:
+    PatientRollup* findOrInsert(const uint8_t* uid);
+
+    PatientRollup table[ROLLUP_MAX_PATIENTS];
+    uint32_t used;
+    uint32_t evicted;
+};
+
+// Builds the summary add() would have built from a card's readings, from
+// the same readings newest first, as they come off the history log's
+// per-card chain
+class RollupRestore {
+public:
+    RollupRestore(PatientRollup* p, const uint8_t* uid);
+
+    // Fold a reading older than every one folded so far
+    void addOlder(int32_t weight, uint32_t timestamp);
+
+    // Put the trend window in add()'s order; call after the last reading
+    void finish();
+
+private:
+    PatientRollup* p;
+    uint32_t newerTime;       // timestamp of the previous reading folded
+};
+
+#endif /* WEIGHT_ROLLUP_H_ */
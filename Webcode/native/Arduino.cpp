@@ -0,0 +1,154 @@
+/*
+ * Arduino.cpp
+ */
+
+#include "Arduino.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <chrono>
+#include <thread>
+
+#define PRINTF_STACK_SIZE 64
+
+static std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+uint32_t millis() {
+    auto elapsed = std::chrono::steady_clock::now() - bootTime;
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+uint32_t micros() {
+    auto elapsed = std::chrono::steady_clock::now() - bootTime;
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t len = strlen(src);
+    if (size) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+#endif
+
+static const char* integerFormat(bool isSigned, unsigned char base) {
+    if (base == HEX) return "%lx";
+    return isSigned ? "%ld" : "%lu";
+}
+
+String::String(int value, unsigned char base) : String((long)value, base) {
+}
+
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {
+}
+
+String::String(long value, unsigned char base) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), integerFormat(true, base), value);
+    str = buf;
+}
+
+String::String(unsigned long value, unsigned char base) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), integerFormat(false, base), value);
+    str = buf;
+}
+
+String::String(double value, unsigned char decimals) {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+    str = buf;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+    size_t pos = str.find(c, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const char* s, unsigned int from) const {
+    size_t pos = str.find(s, from);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    if (from > to) {
+        unsigned int t = from;
+        from = to;
+        to = t;
+    }
+    if (from >= str.size()) return String();
+    return String(str.substr(from, to - from).c_str());
+}
+
+void String::trim() {
+    size_t start = str.find_first_not_of(" \t\r\n\f\v");
+    if (start == std::string::npos) {
+        str.clear();
+        return;
+    }
+    size_t end = str.find_last_not_of(" \t\r\n\f\v");
+    str = str.substr(start, end - start + 1);
+}
+
+void String::toUpperCase() {
+    for (char& c : str) c = toupper((unsigned char)c);
+}
+
+void String::toLowerCase() {
+    for (char& c : str) c = tolower((unsigned char)c);
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        if (!write(*buffer++)) break;
+        n++;
+    }
+    return n;
+}
+
+size_t Print::print(long v, int base) {
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), integerFormat(true, base), v);
+    return write(buf, n);
+}
+
+size_t Print::print(unsigned long v, int base) {
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), integerFormat(false, base), v);
+    return write(buf, n);
+}
+
+size_t Print::print(double v, int decimals) {
+    char buf[48];
+    int n = snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+    return write(buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+// Same strategy as the ESP32 core: a stack buffer, heap only when it is short
+size_t Print::printf(const char* format, ...) {
+    char stackBuf[PRINTF_STACK_SIZE];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(stackBuf, sizeof(stackBuf), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    if (len < (int)sizeof(stackBuf)) {
+        return write(stackBuf, len);
+    }
+
+    char* heapBuf = new char[len + 1];
+    va_start(args, format);
+    vsnprintf(heapBuf, len + 1, format, args);
+    va_end(args);
+    size_t n = write(heapBuf, len);
+    delete[] heapBuf;
+    return n;
+}
@@ -0,0 +1,130 @@
+/*
+ * Arduino.h
+ *
+ * Host stand-in for the parts of the Arduino core that the portable
+ * modules use (String, Print, millis/micros), so they build in the
+ * PlatformIO "native" environment. Behaviour follows the ESP32 core where
+ * it matters for measurements: Print::printf() formats into a 64-byte
+ * stack buffer and only allocates for longer output.
+ */
+
+#ifndef NATIVE_ARDUINO_H_
+#define NATIVE_ARDUINO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#define DEC 10
+#define HEX 16
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+
+// glibc gained strlcpy in 2.38; newlib and the BSDs always had it
+#if defined(__GLIBC__) && (__GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38))
+size_t strlcpy(char* dst, const char* src, size_t size);
+#endif
+
+class String {
+public:
+    String() {}
+    String(const char* s) : str(s ? s : "") {}
+    String(const String& s) = default;
+    explicit String(char c) : str(1, c) {}
+    explicit String(int value, unsigned char base = DEC);
+    explicit String(unsigned int value, unsigned char base = DEC);
+    explicit String(long value, unsigned char base = DEC);
+    explicit String(unsigned long value, unsigned char base = DEC);
+    explicit String(double value, unsigned char decimals = 2);
+
+    String& operator=(const String& s) = default;
+    String& operator=(const char* s) { str = s ? s : ""; return *this; }
+
+    unsigned int length() const { return str.size(); }
+    bool isEmpty() const { return str.empty(); }
+    const char* c_str() const { return str.c_str(); }
+    bool reserve(unsigned int size) { str.reserve(size); return true; }
+
+    bool concat(const String& s) { str += s.str; return true; }
+    bool concat(const char* s) { if (s) str += s; return true; }
+    bool concat(const char* s, unsigned int len) { str.append(s, len); return true; }
+    bool concat(char c) { str += c; return true; }
+    bool concat(int v) { return concat(String(v)); }
+    bool concat(unsigned int v) { return concat(String(v)); }
+    bool concat(long v) { return concat(String(v)); }
+    bool concat(unsigned long v) { return concat(String(v)); }
+    bool concat(double v) { return concat(String(v)); }
+
+    template <typename T>
+    String& operator+=(T v) { concat(v); return *this; }
+
+    bool operator==(const String& s) const { return str == s.str; }
+    bool operator==(const char* s) const { return str == (s ? s : ""); }
+    bool operator!=(const String& s) const { return !(*this == s); }
+    bool operator!=(const char* s) const { return !(*this == s); }
+    bool operator<(const String& s) const { return str < s.str; }
+
+    char charAt(unsigned int i) const { return i < str.size() ? str[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const char* s, unsigned int from = 0) const;
+    String substring(unsigned int from) const { return substring(from, length()); }
+    String substring(unsigned int from, unsigned int to) const;
+    bool startsWith(const char* prefix) const { return str.compare(0, strlen(prefix), prefix) == 0; }
+    void trim();
+    void toUpperCase();
+    void toLowerCase();
+    long toInt() const { return atol(str.c_str()); }
+
+private:
+    std::string str;
+};
+
+template <typename T>
+String operator+(const String& a, T b) {
+    String s(a);
+    s += b;
+    return s;
+}
+
+inline String operator+(const char* a, const String& b) {
+    String s(a);
+    s += b;
+    return s;
+}
+
+class Print {
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* s) { return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v, int base = DEC) { return print((long)v, base); }
+    size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(long v, int base = DEC);
+    size_t print(unsigned long v, int base = DEC);
+    size_t print(double v, int decimals = 2);
+
+    template <typename T>
+    size_t println(T v) { return print(v) + println(); }
+    size_t println() { return write("\r\n"); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+#endif /* NATIVE_ARDUINO_H_ */
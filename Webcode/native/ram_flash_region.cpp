@@ -0,0 +1,52 @@
+/*
+ * ram_flash_region.cpp
+ */
+
+#include "ram_flash_region.h"
+#include <stdlib.h>
+#include <string.h>
+
+RamFlashRegion::RamFlashRegion(uint32_t sectors)
+    : writes(0), erases(0), bytesWritten(0), bytes(sectors * FLASH_SECTOR_SIZE) {
+    data = (uint8_t*)malloc(bytes);
+    memset(data, 0xFF, bytes);
+}
+
+RamFlashRegion::~RamFlashRegion() {
+    free(data);
+}
+
+bool RamFlashRegion::read(uint32_t offset, void* dst, size_t len) {
+    if (offset > bytes || len > bytes - offset) return false;
+    memcpy(dst, data + offset, len);
+    return true;
+}
+
+bool RamFlashRegion::write(uint32_t offset, const void* src, size_t len) {
+    if (offset > bytes || len > bytes - offset) return false;
+    const uint8_t* in = (const uint8_t*)src;
+    for (size_t i = 0; i < len; i++) {
+        data[offset + i] &= in[i];
+    }
+    writes++;
+    bytesWritten += len;
+    return true;
+}
+
+bool RamFlashRegion::eraseSector(uint32_t sector) {
+    if (sector >= sectorCount()) return false;
+    memset(data + sector * FLASH_SECTOR_SIZE, 0xFF, FLASH_SECTOR_SIZE);
+    erases++;
+    return true;
+}
+
+void RamFlashRegion::format() {
+    memset(data, 0xFF, bytes);
+    resetCounters();
+}
+
+void RamFlashRegion::resetCounters() {
+    writes = 0;
+    erases = 0;
+    bytesWritten = 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * ram_flash_region.h
+ *
+ * FlashRegion kept in host memory for the native build. It behaves like
+ * NOR flash: erased bytes read 0xFF and write() can only clear bits, so a
+ * store that forgets to erase before rewriting sees the same corruption
+ * it would on the device. Operation counters let benchmarks report flash
+ * traffic alongside time.
+ */
+
+#ifndef RAM_FLASH_REGION_H_
+#define RAM_FLASH_REGION_H_
+
+#include "flash_region.h"
+
+class RamFlashRegion : public FlashRegion {
+public:
+    explicit RamFlashRegion(uint32_t sectors);
+    ~RamFlashRegion() override;
+
+    uint32_t size() const override { return bytes; }
+    bool read(uint32_t offset, void* dst, size_t len) override;
+    bool write(uint32_t offset, const void* src, size_t len) override;
+    bool eraseSector(uint32_t sector) override;
+
+    // Erase everything and zero the counters
+    void format();
+    void resetCounters();
+
+    uint32_t writes;
+    uint32_t erases;
+    uint64_t bytesWritten;
+
+private:
+    RamFlashRegion(const RamFlashRegion&) = delete;
+    RamFlashRegion& operator=(const RamFlashRegion&) = delete;
+
+    uint8_t* data;
+    uint32_t bytes;
+};
+
+#endif /* RAM_FLASH_REGION_H_ */
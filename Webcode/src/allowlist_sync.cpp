@@ -0,0 +1,78 @@
+/*
+ * allowlist_sync.cpp
+ */
+
+#include "allowlist_sync.h"
+
+uint32_t allowlistMix(const uint8_t* uid) {
+    uint32_t h = ((uint32_t)uid[0] << 24) | ((uint32_t)uid[1] << 16) | ((uint32_t)uid[2] << 8) | uid[3];
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+// Only 4-byte UIDs fit the delta frame, and only those reach the STM32
+static bool sentToStm32(const CardTable& table, int i, uint8_t* uid) {
+    return table.isActive(i) && cardKeyUid(table.key(i), uid) == UID_SIZE;
+}
+
+AllowlistState allowlistState(const CardTable& table) {
+    AllowlistState state = {};
+    uint8_t uid[CARD_UID_MAX];
+    for (int i = 0; i < table.size(); i++) {
+        if (sentToStm32(table, i, uid)) {
+            state.count++;
+            state.checksum ^= allowlistMix(uid);
+        }
+    }
+    return state;
+}
+
+void sendAllowlistDelta(Print& out, uint8_t op, const uint8_t* uid) {
+    uint8_t frame[FRAME_VALID_CARD_SIZE];
+    frame[0] = FRAME_START_BYTE;
+    frame[1] = FRAME_TYPE_VALID_CARD;
+    frame[2] = op;
+    memcpy(&frame[3], uid, UID_SIZE);
+    frame[7] = FRAME_END_BYTE;
+    out.write(frame, sizeof(frame));
+}
+
+void AllowlistSender::start() {
+    step = STEP_CLEAR;
+    pos = 0;
+    count = 0;
+    first = true;
+}
+
+bool AllowlistSender::poll(Print& out, const CardTable& table, uint32_t nowMs) {
+    if (step == STEP_IDLE || (!first && nowMs - batchMs < ALLOWLIST_BATCH_MS)) return false;
+    first = false;
+    batchMs = nowMs;
+
+    uint8_t uid[CARD_UID_MAX] = {};
+    int frames = 0;
+    if (step == STEP_CLEAR) {
+        sendAllowlistDelta(out, ALLOWLIST_OP_CLEAR, uid);
+        step = STEP_CARDS;
+        frames++;
+    }
+    while (frames < ALLOWLIST_BATCH_FRAMES && pos < table.size()) {
+        if (sentToStm32(table, pos++, uid)) {
+            sendAllowlistDelta(out, ALLOWLIST_OP_ADD, uid);
+            count++;
+            frames++;
+        }
+    }
+    if (frames == ALLOWLIST_BATCH_FRAMES) return false;
+
+    uint8_t end[UID_SIZE] = {
+        (uint8_t)(count >> 24), (uint8_t)(count >> 16), (uint8_t)(count >> 8), (uint8_t)count
+    };
+    sendAllowlistDelta(out, ALLOWLIST_OP_END, end);
+    step = STEP_IDLE;
+    return true;
+}
@@ -0,0 +1,68 @@
+/*
+ * api_json.cpp
+ */
+
+#include "api_json.h"
+#include "json_writer.h"
+
+void printReadingJson(Print& out, const CardReading& reading, uint32_t historyCount) {
+    JsonWriter json(out);
+    json.beginObject();
+    if (reading.hasData) {
+        json.key("lastCard").uid(reading.card);
+        json.key("reader").value(reading.reader);
+        json.key("weight").value(reading.weight);
+        json.key("valid").value(reading.isValid);
+        json.key("timestamp").value(reading.timestamp);
+    } else {
+        json.key("lastCard").value("None");
+        json.key("weight").value(0);
+        json.key("valid").value(false);
+        json.key("timestamp").value(0);
+    }
+    json.key("historyCount").value(historyCount);
+    json.endObject();
+}
+
+void printHistoryJson(Print& out, uint32_t recNo, uint32_t timestamp, const uint8_t* uid, int32_t weight, bool isValidCard) {
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("recNo").value(recNo);
+    json.key("time").value(timestamp);
+    json.key("uid").uid(uid);
+    json.key("weight").value(weight);
+    json.key("valid").value(isValidCard);
+    json.endObject();
+}
+
+void printRollupJson(Print& out, const PatientRollup* p) {
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("uid").uid(p->uid);
+    json.key("count").value(p->count);
+    json.key("min").value(p->min);
+    json.key("max").value(p->max);
+    json.key("mean").value(p->mean, 1);
+    json.key("stddev").value(WeightRollup::stddev(p), 1);
+    json.key("last").value(p->last);
+    json.key("lastTime").value(p->lastTime);
+    json.key("trendPerDay").value(WeightRollup::trendPerDay(p), 1);
+
+    // Daily buckets of the last ROLLUP_DAYS days, oldest first
+    json.key("days").beginArray();
+    uint16_t today = (uint16_t)(p->lastTime / ROLLUP_SECONDS_PER_DAY);
+    for (int ago = ROLLUP_DAYS - 1; ago >= 0; ago--) {
+        uint16_t day = today - ago;
+        const RollupDay* d = &p->days[day % ROLLUP_DAYS];
+        if (!d->count || d->day != day) continue;
+        json.beginObject();
+        json.key("day").value(d->day);
+        json.key("count").value(d->count);
+        json.key("min").value(d->min);
+        json.key("max").value(d->max);
+        json.key("mean").value(d->mean, 1);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+}
@@ -0,0 +1,208 @@
+/*
+ * api_sources.cpp
+ */
+
+#include "api_sources.h"
+#include "api_json.h"
+#include "json_writer.h"
+#include <stdio.h>
+#include <string.h>
+
+bool CardListSource::advance() {
+    while (pos < table.size()) {
+        current = pos++;
+        if (table.isActive(current)) return true;
+    }
+    return false;
+}
+
+void CardListSource::printItem(Print& out) {
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("uid").uid(table.key(current));
+    json.key("name").value(table.name(current));
+    json.key("active").value(true);
+    json.endObject();
+}
+
+CardImportResultSource::CardImportResultSource(const CardImportParser& parser, const uint32_t* c) {
+    memcpy(counts, c, sizeof(counts));
+    failed = parser.failedCount();
+    errorCount = parser.errorCount();
+    for (uint32_t i = 0; i < errorCount; i++) {
+        errors[i] = parser.error(i);
+    }
+}
+
+bool CardImportResultSource::next(Print& out) {
+    if (!opened) {
+        JsonWriter json(out);
+        json.beginObject();
+        json.key("rows").value(counts[CARD_ADDED] + counts[CARD_UPDATED] + counts[CARD_UNCHANGED] + failed);
+        json.key("added").value(counts[CARD_ADDED]);
+        json.key("updated").value(counts[CARD_UPDATED]);
+        json.key("unchanged").value(counts[CARD_UNCHANGED]);
+        json.key("failed").value(failed);
+        out.print(",\"errors\":");
+        opened = true;
+    }
+    if (JsonArraySource::next(out)) return true;
+    out.print("}");
+    return false;
+}
+
+bool CardImportResultSource::advance() {
+    if (pos == errorCount) return false;
+    current = pos++;
+    return true;
+}
+
+void CardImportResultSource::printItem(Print& out) {
+    const CardImportError& e = errors[current];
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("row").value(e.row);
+    json.key("error").value(e.reason);
+    json.endObject();
+}
+
+HistorySource::HistorySource(HistoryStore& s, const HistoryCache& c, const uint8_t* uid,
+                             uint32_t start, uint32_t since, uint32_t until, int limit)
+    : store(s), cache(c), filtered(uid != nullptr), since(since), until(until), left(limit), nextRec(start) {
+    if (filtered) {
+        memcpy(filterUid, uid, UID_SIZE);
+    } else {
+        stop = since ? store.seekTime(since) : 0;
+    }
+}
+
+bool HistorySource::next(Print& out) {
+    if (!opened) {
+        out.print("{\"records\":");
+        opened = true;
+    }
+    if (JsonArraySource::next(out)) return true;
+
+    out.print(",\"cursor\":");
+    JsonWriter json(out);
+    if (hasMore()) {
+        char cursor[HISTORY_CURSOR_SIZE];
+        formatHistoryCursor(nextRec, cursor);
+        json.value(cursor);
+    } else {
+        json.null();
+    }
+    out.print("}");
+    return false;
+}
+
+bool HistorySource::advance() {
+    while (left > 0 && nextRec != HISTORY_NO_RECORD) {
+        uint32_t r = nextRec;
+        if (filtered) {
+            // The chain is in time order: stop below since, skip above until
+            HistoryRecord rec;
+            if (!store.read(r, &rec) || rec.timestamp < since) {
+                nextRec = HISTORY_NO_RECORD;
+                return false;
+            }
+            nextRec = store.previousFor(r, rec);
+            if (rec.timestamp > until) continue;
+            setCurrent(r, rec);
+        } else {
+            uint32_t first = firstInRange();
+            if (r < first) {
+                nextRec = HISTORY_NO_RECORD;
+                return false;
+            }
+            nextRec = r > first ? r - 1 : HISTORY_NO_RECORD;
+            if (!loadUnfiltered(r)) continue;
+        }
+        left--;
+        return true;
+    }
+    return false;
+}
+
+void HistorySource::printItem(Print& out) {
+    printHistoryJson(out, current.recNo, current.timestamp, current.uid, current.weight, current.isValidCard);
+}
+
+// Unfiltered: oldest record still in the log and the time range
+uint32_t HistorySource::firstInRange() const {
+    uint32_t first = store.firstRecord();
+    return stop > first ? stop : first;
+}
+
+// Whether the page stopped at the limit with matching rows left
+bool HistorySource::hasMore() {
+    if (nextRec == HISTORY_NO_RECORD) return false;
+    if (!filtered) return nextRec >= firstInRange();
+    HistoryRecord rec;
+    return store.read(nextRec, &rec) && rec.timestamp >= since;
+}
+
+// Newest rows come from the compressed RAM cache, older ones from flash
+bool HistorySource::loadUnfiltered(uint32_t r) {
+    if (!decoded || r < samples[0].recNo || r - samples[0].recNo >= decoded) {
+        int b = cache.findBlock(r);
+        decoded = b >= 0 ? cache.decodeBlock(b, samples) : 0;
+    }
+    if (decoded && r >= samples[0].recNo && r - samples[0].recNo < decoded) {
+        current = samples[r - samples[0].recNo];
+        return true;
+    }
+    HistoryRecord rec;
+    if (!store.read(r, &rec)) return false;
+    setCurrent(r, rec);
+    return true;
+}
+
+void HistorySource::setCurrent(uint32_t r, const HistoryRecord& rec) {
+    current.recNo = r;
+    current.timestamp = rec.timestamp;
+    memcpy(current.uid, rec.uid, UID_SIZE);
+    current.weight = rec.weight;
+    current.isValidCard = rec.flags & HISTORY_FLAG_VALID_CARD;
+}
+
+bool RollupListSource::advance() {
+    while (pos < rollup.capacity()) {
+        current = pos++;
+        if (rollup.entry(current)->count) return true;
+    }
+    return false;
+}
+
+void RollupListSource::printItem(Print& out) {
+    printRollupJson(out, rollup.entry(current));
+}
+
+bool historyPageStart(HistoryStore& store, const uint8_t* uid, const uint32_t* cursor,
+                      uint32_t since, uint32_t until, uint32_t* start) {
+    *start = HISTORY_NO_RECORD;
+    if (cursor) {
+        if (*cursor >= store.endRecord()) return false;
+        if (*cursor >= store.firstRecord()) {
+            HistoryRecord rec;
+            if (uid && store.read(*cursor, &rec) && memcmp(rec.uid, uid, UID_SIZE) != 0) {
+                return false;
+            }
+            *start = *cursor;
+        }
+    } else if (uid) {
+        *start = store.latestFor(uid);
+    } else if (until == 0xFFFFFFFFUL) {
+        *start = store.count() ? store.endRecord() - 1 : HISTORY_NO_RECORD;
+    } else {
+        // Seek past the last record at or before until
+        uint32_t end = store.seekTime(until + 1);
+        *start = end > store.firstRecord() ? end - 1 : HISTORY_NO_RECORD;
+    }
+    if (since > until) *start = HISTORY_NO_RECORD;
+    return true;
+}
+
+void formatHistoryCursor(uint32_t recNo, char* out) {
+    snprintf(out, HISTORY_CURSOR_SIZE, "%08lx", (unsigned long)recNo);
+}
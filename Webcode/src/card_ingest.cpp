@@ -0,0 +1,143 @@
+/*
+ * card_ingest.cpp
+ */
+
+#include "card_ingest.h"
+#include "json_writer.h"
+
+FrameEvent CardIngest::feed(uint8_t byte, CardFrame* frame) {
+    count.uartBytes++;
+
+    // Debug raw bytes
+    if (log) log->printf("RX[%d]: 0x%02X\n", (int)parser.pending(), byte);
+
+    FrameEvent event = parser.feed(byte, frame);
+    switch (event) {
+    case FRAME_NOISE:
+        count.uartNoiseBytes++;
+        if (log) log->printf("Waiting for start byte, got: 0x%02X\n", byte);
+        break;
+    case FRAME_STARTED:
+        if (log) log->println("Start byte found!");
+        break;
+    case FRAME_CARD:
+        count.framesReceived++;
+        if (log) {
+            log->printf("Complete message received, reader: %d\n", frame->reader);
+            log->printf("Received - Reader: %d, UID: %02X:%02X:%02X:%02X, Weight: %ld\n", frame->reader,
+                        frame->uid[0], frame->uid[1], frame->uid[2], frame->uid[3], (long)frame->weight);
+        }
+        break;
+    case FRAME_SCALE_REPLY:
+        count.framesReceived++;
+        reply = parser.scaleReply();
+        replyTime = millis();
+        if (log) {
+            log->printf("Scale reply - op: %d, status: %d, points: %d, weight: %ld\n", reply.op,
+                        reply.status, reply.points, (long)reply.weight);
+        }
+        break;
+    case FRAME_ALLOWLIST_STATE: {
+        count.framesReceived++;
+        const AllowlistState& stm32State = parser.allowlistState();
+        AllowlistState state = allowlistState(cards);
+        if (stm32State.count != state.count || stm32State.checksum != state.checksum) {
+            if (log) {
+                log->printf("STM32 allowlist out of date (%u cards, expected %u), sending it\n",
+                            stm32State.count, state.count);
+            }
+            if (sender) sender->start();
+        }
+        break;
+    }
+    case FRAME_BAD_END:
+        count.framesRejected[FRAME_REJECT_BAD_END]++;
+        if (log) log->printf("Invalid end byte: 0x%02X, expected: 0x%02X\n", byte, FRAME_END_BYTE);
+        break;
+    case FRAME_UNKNOWN_TYPE:
+        count.framesRejected[FRAME_REJECT_UNKNOWN_TYPE]++;
+        if (log) log->printf("Ignoring message type: 0x%02X\n", byte);
+        break;
+    case FRAME_OVERFLOW:
+        count.framesRejected[FRAME_REJECT_OVERFLOW]++;
+        if (log) log->println("Buffer overflow, resetting");
+        break;
+    case FRAME_PENDING:
+        break;
+    }
+    return event;
+}
+
+void CardIngest::expire(uint32_t nowMs) {
+    size_t stuck = parser.pending();
+    if (parser.expire(nowMs)) {
+        count.framesRejected[FRAME_REJECT_TIMEOUT]++;
+        if (log) log->printf("Buffer timeout, resetting. Had %d bytes\n", (int)stuck);
+    }
+}
+
+bool CardIngest::storeCard(const CardFrame& frame, uint32_t time) {
+    bool isValid = cards.isValid(frame.uid);
+
+    // An evicted card's rollup comes back from the log before the new
+    // record is in it
+    if (isValid && !rollup.find(frame.uid)) {
+        PatientRollup p;
+        if (restoreRollup(frame.uid, &p)) rollup.insert(p);
+    }
+
+    addRecord(frame.uid, frame.weight, time, isValid);
+
+    // Per-patient summaries are updated here so /api/rollup never scans history
+    if (isValid) {
+        rollup.add(frame.uid, frame.weight, time);
+        count.rollupEvictions = rollup.evictions();
+    }
+
+    if (log) {
+        char uidStr[UID_STRING_SIZE];
+        formatUid(frame.uid, uidStr);
+        log->printf("Card Detected: %s, Weight: %ld, Valid: %s\n",
+                    uidStr, (long)frame.weight, isValid ? "YES" : "NO");
+    }
+    return isValid;
+}
+
+// Ingest point for the persistent history
+void CardIngest::addRecord(const uint8_t* uid, int32_t weight, uint32_t time, bool isValid) {
+    uint32_t recNo = store.endRecord();
+    if (!store.append(uid, weight, time, isValid)) {
+        if (log) log->println("Failed to store weight record");
+        return;
+    }
+    cache.append(recNo, uid, weight, time, isValid);
+}
+
+// Walks the card's chain, newest record first
+bool CardIngest::restoreRollup(const uint8_t* uid, PatientRollup* p) {
+    RollupRestore restore(p, uid);
+    HistoryRecord rec;
+    for (uint32_t r = store.latestFor(uid); r != HISTORY_NO_RECORD; r = store.previousFor(r, rec)) {
+        if (!store.read(r, &rec)) break;
+        if (rec.flags & HISTORY_FLAG_VALID_CARD) restore.addOlder(rec.weight, rec.timestamp);
+    }
+    restore.finish();
+    if (!p->count) return false;
+    count.rollupRestores++;
+    return true;
+}
+
+// Newest records first until the table is full: the same cards an
+// in-order replay would leave in it, without the evictions on the way
+void CardIngest::loadRollups() {
+    rollup.clear();
+    HistoryRecord rec;
+    PatientRollup p;
+    uint32_t first = store.firstRecord();
+    for (uint32_t r = store.endRecord(); r > first && rollup.size() < rollup.capacity(); r--) {
+        if (!store.read(r - 1, &rec) || !(rec.flags & HISTORY_FLAG_VALID_CARD) || rollup.find(rec.uid)) continue;
+        if (restoreRollup(rec.uid, &p)) rollup.insert(p);
+    }
+    count.rollupEvictions = 0;
+    count.rollupRestores = 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * card_journal.cpp
+ *
+ * Sector layout:
+ *   [SectorHeader 16 B][record][record]...[0xFF erased tail]
+ * Record layout (4-byte aligned):
+ *   marker 0xA5 | type | payload length | 0x00 | uid[UID_SIZE] name... | pad 0xFF | crc32
+ * The CRC covers everything before it, so a record torn by a power cut is
+ * detected and replay of that sector stops there.
+ */
+
+#include "card_journal.h"
+#include "crc32.h"
+#include <string.h>
+
+#define JOURNAL_MAGIC        0x314A4348UL  // "HCJ1"
+#define RECORD_MARKER        0xA5
+#define RECORD_HEADER_SIZE   4
+#define RECORD_MAX_PAYLOAD   (UID_SIZE + CARD_NAME_MAX)
+#define RECORD_MIN_SIZE      (RECORD_HEADER_SIZE + ((UID_SIZE + 3) & ~3) + 4)
+#define RECORD_MAX_SIZE      (RECORD_HEADER_SIZE + ((RECORD_MAX_PAYLOAD + 3) & ~3) + 4)
+
+struct SectorHeader {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t crc;      // crc32 of magic + seq
+    uint32_t reserved;
+};
+
+struct JournalRecord {
+    uint8_t type;
+    uint8_t uid[UID_SIZE];
+    char name[CARD_NAME_MAX + 1];
+};
+
+static uint32_t recordSize(uint8_t payloadLen) {
+    return RECORD_HEADER_SIZE + ((payloadLen + 3) & ~3) + 4;
+}
+
+// Read the record at offset inside a sector. Returns its size in bytes,
+// 0 at the end of the written area, or -1 if the record is damaged.
+static int readRecord(FlashRegion* region, uint32_t sector, uint32_t offset, JournalRecord* rec) {
+    uint8_t buf[RECORD_MAX_SIZE];
+    uint32_t base = sector * FLASH_SECTOR_SIZE;
+
+    if (offset + RECORD_MIN_SIZE > FLASH_SECTOR_SIZE) return 0;
+    if (!region->read(base + offset, buf, RECORD_HEADER_SIZE)) return -1;
+    if (buf[0] == 0xFF) return 0;
+    if (buf[0] != RECORD_MARKER || buf[2] < UID_SIZE || buf[2] > RECORD_MAX_PAYLOAD) return -1;
+
+    uint32_t size = recordSize(buf[2]);
+    if (offset + size > FLASH_SECTOR_SIZE) return -1;
+    if (!region->read(base + offset + RECORD_HEADER_SIZE, buf + RECORD_HEADER_SIZE,
+                      size - RECORD_HEADER_SIZE)) return -1;
+
+    uint32_t storedCrc;
+    memcpy(&storedCrc, buf + size - 4, 4);
+    if (crc32(buf, size - 4) != storedCrc) return -1;
+
+    uint8_t nameLen = buf[2] - UID_SIZE;
+    rec->type = buf[1];
+    memcpy(rec->uid, buf + RECORD_HEADER_SIZE, UID_SIZE);
+    memcpy(rec->name, buf + RECORD_HEADER_SIZE + UID_SIZE, nameLen);
+    rec->name[nameLen] = '\0';
+    return (int)size;
+}
+
+static bool sectorIsErased(FlashRegion* region, uint32_t sector) {
+    uint32_t chunk[16];
+    for (uint32_t off = 0; off < FLASH_SECTOR_SIZE; off += sizeof(chunk)) {
+        if (!region->read(sector * FLASH_SECTOR_SIZE + off, chunk, sizeof(chunk))) return false;
+        for (size_t i = 0; i < 16; i++) {
+            if (chunk[i] != 0xFFFFFFFFUL) return false;
+        }
+    }
+    return true;
+}
+
+CardJournal::CardJournal()
+    : region(nullptr), replayFn(nullptr), liveStateFn(nullptr),
+      sectorCount(0), usedSectors(0), nextSeq(1), head(-1), headOffset(0),
+      batching(false), batchFailed(false), batchOffset(0), batchLen(0) {
+    memset(sectorSeq, 0, sizeof(sectorSeq));
+}
+
+bool CardJournal::begin(FlashRegion* r, CardReplayFn replay, CardLiveStateFn liveState) {
+    region = r;
+    replayFn = replay;
+    liveStateFn = liveState;
+    sectorCount = region->sectorCount();
+    if (sectorCount > CARD_JOURNAL_MAX_SECTORS) sectorCount = CARD_JOURNAL_MAX_SECTORS;
+    if (sectorCount <= CARD_JOURNAL_RESERVE_SECTORS) return false;
+
+    usedSectors = 0;
+    nextSeq = 1;
+    head = -1;
+    headOffset = 0;
+
+    // Pass 1: classify sectors
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        SectorHeader hdr;
+        sectorSeq[s] = 0;
+        if (region->read(s * FLASH_SECTOR_SIZE, &hdr, sizeof(hdr)) &&
+            hdr.magic == JOURNAL_MAGIC && hdr.seq != 0 &&
+            hdr.crc == crc32(&hdr, 8)) {
+            sectorSeq[s] = hdr.seq;
+            usedSectors++;
+            if (hdr.seq >= nextSeq) nextSeq = hdr.seq + 1;
+        } else if (!sectorIsErased(region, s)) {
+            // Torn header or interrupted erase
+            region->eraseSector(s);
+        }
+    }
+
+    // Pass 2: replay in sequence order
+    uint32_t lastSeq = 0;
+    for (uint32_t n = 0; n < usedSectors; n++) {
+        int next = -1;
+        for (uint32_t s = 0; s < sectorCount; s++) {
+            if (sectorSeq[s] > lastSeq && (next < 0 || sectorSeq[s] < sectorSeq[next])) {
+                next = (int)s;
+            }
+        }
+        if (next < 0) break;
+        lastSeq = sectorSeq[next];
+        head = next;
+        headOffset = replaySector(next);
+    }
+    return true;
+}
+
+// Deliver every record of a sector and return the offset where the next
+// record can be written. A damaged record seals the sector.
+uint32_t CardJournal::replaySector(uint32_t sector) {
+    JournalRecord rec;
+    uint32_t offset = sizeof(SectorHeader);
+    for (;;) {
+        int size = readRecord(region, sector, offset, &rec);
+        if (size == 0) return offset;
+        if (size < 0) return FLASH_SECTOR_SIZE;
+        if (replayFn) replayFn(rec.type, rec.uid, rec.name);
+        offset += size;
+    }
+}
+
+bool CardJournal::append(uint8_t type, const uint8_t* uid, const char* name) {
+    return appendRecord(type, uid, name, true);
+}
+
+bool CardJournal::appendRecord(uint8_t type, const uint8_t* uid, const char* name, bool allowReclaim) {
+    if (!region) return false;
+
+    size_t nameLen = name ? strlen(name) : 0;
+    if (nameLen > CARD_NAME_MAX) nameLen = CARD_NAME_MAX;
+    uint8_t payloadLen = UID_SIZE + nameLen;
+    uint32_t size = recordSize(payloadLen);
+
+    if (head < 0 || headOffset + size > FLASH_SECTOR_SIZE) {
+        // A pending batch belongs to the current head
+        if (!flushBatch()) return false;
+
+        // Foreground compaction only happens if maintain() has fallen behind
+        while (allowReclaim && getFreeSectors() < 2 && usedSectors > 1) {
+            if (!reclaimOldest()) break;
+        }
+        if (!openSector()) return false;
+    }
+
+    uint8_t buf[RECORD_MAX_SIZE];
+    memset(buf, 0xFF, size);
+    buf[0] = RECORD_MARKER;
+    buf[1] = type;
+    buf[2] = payloadLen;
+    buf[3] = 0x00;
+    memcpy(buf + RECORD_HEADER_SIZE, uid, UID_SIZE);
+    if (nameLen) memcpy(buf + RECORD_HEADER_SIZE + UID_SIZE, name, nameLen);
+    uint32_t crc = crc32(buf, size - 4);
+    memcpy(buf + size - 4, &crc, 4);
+
+    uint32_t offset = headOffset;
+    headOffset += size;  // never rewrite a range even if the write fails
+    if (batching) {
+        if (!batchLen) batchOffset = offset;
+        memcpy(batch + batchLen, buf, size);
+        batchLen += size;
+        return true;
+    }
+    return region->write(head * FLASH_SECTOR_SIZE + offset, buf, size);
+}
+
+void CardJournal::beginBatch() {
+    batching = true;
+    batchFailed = false;
+    batchLen = 0;
+}
+
+bool CardJournal::commitBatch() {
+    bool ok = flushBatch() && !batchFailed;
+    batching = false;
+    batchFailed = false;
+    return ok;
+}
+
+// Write the records collected so far; they are contiguous in the head sector
+bool CardJournal::flushBatch() {
+    if (!batchLen) return true;
+    bool ok = region->write(head * FLASH_SECTOR_SIZE + batchOffset, batch, batchLen);
+    batchLen = 0;
+    if (!ok) batchFailed = true;
+    return ok;
+}
+
+bool CardJournal::openSector() {
+    if (usedSectors >= sectorCount) return false;
+
+    // Walk the ring from the current head so erases rotate over all sectors
+    uint32_t start = head < 0 ? 0 : (uint32_t)head + 1;
+    for (uint32_t i = 0; i < sectorCount; i++) {
+        uint32_t s = (start + i) % sectorCount;
+        if (sectorSeq[s] != 0) continue;
+
+        SectorHeader hdr;
+        hdr.magic = JOURNAL_MAGIC;
+        hdr.seq = nextSeq;
+        hdr.crc = crc32(&hdr, 8);
+        hdr.reserved = 0xFFFFFFFFUL;
+        if (!region->write(s * FLASH_SECTOR_SIZE, &hdr, sizeof(hdr))) return false;
+
+        sectorSeq[s] = nextSeq++;
+        usedSectors++;
+        head = (int)s;
+        headOffset = sizeof(SectorHeader);
+        return true;
+    }
+    return false;
+}
+
+int CardJournal::oldestSector() const {
+    int oldest = -1;
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        if (sectorSeq[s] != 0 && (oldest < 0 || sectorSeq[s] < sectorSeq[oldest])) {
+            oldest = (int)s;
+        }
+    }
+    return oldest;
+}
+
+// Re-append the current state of every active card mentioned in the oldest
+// sector, then erase it. Removed cards are simply dropped, and so are cards
+// that have an add or remove record in a newer sector: their state does not
+// depend on the old records. Without that check a sector full of live cards
+// would be copied as a whole and compaction would never gain space.
+bool CardJournal::reclaimOldest() {
+    static uint8_t handled[FLASH_SECTOR_SIZE / RECORD_MIN_SIZE][UID_SIZE];
+    static bool superseded[FLASH_SECTOR_SIZE / RECORD_MIN_SIZE];
+    int sector = oldestSector();
+    if (sector < 0 || sector == head || !liveStateFn) return false;
+
+    // Cards mentioned in the sector
+    uint32_t handledCount = 0;
+    uint32_t offset = sizeof(SectorHeader);
+    JournalRecord rec;
+    for (;;) {
+        int size = readRecord(region, sector, offset, &rec);
+        if (size <= 0) break;
+        offset += size;
+
+        bool seen = false;
+        for (uint32_t i = 0; i < handledCount && !seen; i++) {
+            seen = memcmp(handled[i], rec.uid, UID_SIZE) == 0;
+        }
+        if (seen) continue;
+        superseded[handledCount] = false;
+        memcpy(handled[handledCount++], rec.uid, UID_SIZE);
+    }
+
+    // One pass over the newer sectors
+    for (uint32_t s = 0; s < sectorCount; s++) {
+        if (sectorSeq[s] <= sectorSeq[sector]) continue;
+        offset = sizeof(SectorHeader);
+        for (;;) {
+            int size = readRecord(region, s, offset, &rec);
+            if (size <= 0) break;
+            offset += size;
+            if (rec.type != CARD_REC_ADD && rec.type != CARD_REC_REMOVE) continue;
+            for (uint32_t i = 0; i < handledCount; i++) {
+                if (memcmp(handled[i], rec.uid, UID_SIZE) == 0) {
+                    superseded[i] = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < handledCount; i++) {
+        char name[CARD_NAME_MAX + 1];
+        if (!superseded[i] && liveStateFn(handled[i], name, sizeof(name))) {
+            if (!appendRecord(CARD_REC_ADD, handled[i], name, false)) return false;
+        }
+    }
+
+    // The re-appended records must be on flash before the old ones go
+    if (!flushBatch()) return false;
+    if (!region->eraseSector(sector)) return false;
+    sectorSeq[sector] = 0;
+    usedSectors--;
+    return true;
+}
+
+void CardJournal::maintain() {
+    if (getFreeSectors() < CARD_JOURNAL_RESERVE_SECTORS && usedSectors > 1) {
+        reclaimOldest();
+    }
+}
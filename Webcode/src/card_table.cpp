@@ -0,0 +1,196 @@
+/*
+ * card_table.cpp
+ */
+
+#include "card_table.h"
+#include <string.h>
+
+CardTable::CardTable(CardJournal* j) : journal(j) {
+    clear();
+}
+
+void CardTable::clear() {
+    memset(activeBits, 0, sizeof(activeBits));
+    poolEnd = 0;
+    poolLive = 0;
+    used = 0;
+}
+
+int CardTable::find(CardKey key) const {
+    for (int i = 0; i < used; i++) {
+        if (keys[i] == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool CardTable::isValid(CardKey key) const {
+    int i = find(key);
+    return i >= 0 && isActive(i);
+}
+
+// New inactive entry without a name, -1 if the table is full
+int CardTable::insert(CardKey key) {
+    if (used >= MAX_VALID_CARDS) return -1;
+    int i = used++;
+    keys[i] = key;
+    setActive(i, false);
+    nameLen[i] = 0;
+    return i;
+}
+
+void CardTable::setActive(int i, bool active) {
+    uint32_t bit = 1UL << (i & 31);
+    if (active) {
+        activeBits[i >> 5] |= bit;
+    } else {
+        activeBits[i >> 5] &= ~bit;
+    }
+}
+
+static size_t nameLength(const char* name) {
+    return strnlen(name, CARD_NAME_MAX);
+}
+
+// Whether entry i (-1 for a new one) can take name, compacting if needed
+bool CardTable::nameFits(int i, const char* name) const {
+    size_t len = nameLength(name);
+    size_t held = i >= 0 && nameLen[i] ? nameLen[i] + 1 : 0;
+    return len == 0 || poolLive - held + len + 1 <= CARD_NAME_POOL;
+}
+
+// A name no longer than the old one is written over it; a longer one goes
+// to the end of the pool, compacting first when the end is reached
+void CardTable::setName(int i, const char* name) {
+    size_t len = nameLength(name);
+    if (nameLen[i]) poolLive -= nameLen[i] + 1;
+    if (len > nameLen[i]) {
+        nameLen[i] = 0;
+        if (poolEnd + len + 1 > CARD_NAME_POOL) compactNames();
+        if (poolEnd + len + 1 > CARD_NAME_POOL) return;  // callers check nameFits()
+        nameOffset[i] = poolEnd;
+        poolEnd += len + 1;
+    }
+    nameLen[i] = len;
+    if (!len) return;
+    memcpy(namePool + nameOffset[i], name, len);
+    namePool[nameOffset[i] + len] = '\0';
+    poolLive += len + 1;
+}
+
+// Slide the names down in pool order over the gaps left by renames. Runs
+// only when the pool end is reached, so the quadratic search is fine.
+void CardTable::compactNames() {
+    uint32_t from = 0;
+    uint16_t end = 0;
+    for (;;) {
+        int next = -1;
+        for (int i = 0; i < used; i++) {
+            if (nameLen[i] && nameOffset[i] >= from && (next < 0 || nameOffset[i] < nameOffset[next])) {
+                next = i;
+            }
+        }
+        if (next < 0) break;
+        from = nameOffset[next] + 1;
+        memmove(namePool + end, namePool + nameOffset[next], nameLen[next] + 1);
+        nameOffset[next] = end;
+        end += nameLen[next] + 1;
+    }
+    poolEnd = end;
+}
+
+bool CardTable::add(const uint8_t* uid) {
+    CardKey k = cardKey(uid);
+    int i = find(k);
+    if (i >= 0 && isActive(i)) {
+        return true;
+    }
+    if (i < 0 && used >= MAX_VALID_CARDS) {
+        return false;
+    }
+
+    // Re-adding keeps the old name
+    if (!journal->append(CARD_REC_ADD, uid, i >= 0 ? name(i) : "")) {
+        return false;
+    }
+    if (i < 0) i = insert(k);
+    setActive(i, true);
+    return true;
+}
+
+bool CardTable::remove(const uint8_t* uid) {
+    int i = find(uid);
+    if (i < 0) {
+        return false;
+    }
+    if (isActive(i) && !journal->append(CARD_REC_REMOVE, uid)) {
+        return false;
+    }
+    setActive(i, false);
+    return true;
+}
+
+bool CardTable::rename(const uint8_t* uid, const char* name) {
+    int i = find(uid);
+    if (i < 0 || !nameFits(i, name)) {
+        return false;
+    }
+    if (!journal->append(CARD_REC_RENAME, uid, name)) {
+        return false;
+    }
+    setName(i, name);
+    return true;
+}
+
+CardImportResult CardTable::import(const uint8_t* uid, const char* name) {
+    CardKey k = cardKey(uid);
+    int i = find(k);
+    if (i >= 0 && isActive(i) && strcmp(this->name(i), name) == 0) {
+        return CARD_UNCHANGED;
+    }
+    if ((i < 0 && used >= MAX_VALID_CARDS) || !nameFits(i, name)) {
+        return CARD_TABLE_FULL;
+    }
+    if (!journal->append(CARD_REC_ADD, uid, name)) {
+        return CARD_WRITE_FAILED;
+    }
+
+    bool added = i < 0 || !isActive(i);
+    if (i < 0) i = insert(k);
+    setActive(i, true);
+    setName(i, name);
+    return added ? CARD_ADDED : CARD_UPDATED;
+}
+
+void CardTable::applyRecord(uint8_t type, const uint8_t* uid, const char* name) {
+    CardKey k = cardKey(uid);
+    int i = find(k);
+
+    if (type == CARD_REC_ADD) {
+        if (i < 0 && (i = insert(k)) < 0) return;
+        setActive(i, true);
+        setName(i, name);
+    } else if (type == CARD_REC_REMOVE) {
+        if (i >= 0) setActive(i, false);
+    } else if (type == CARD_REC_RENAME) {
+        if (i >= 0) setName(i, name);
+    }
+}
+
+bool CardTable::liveState(const uint8_t* uid, char* name, size_t nameSize) const {
+    int i = find(uid);
+    if (i < 0 || !isActive(i)) {
+        return false;
+    }
+    strlcpy(name, this->name(i), nameSize);
+    return true;
+}
+
+int CardTable::activeCount() const {
+    int count = 0;
+    for (int w = 0; w < (used + 31) / 32; w++) {
+        count += __builtin_popcount(activeBits[w]);
+    }
+    return count;
+}
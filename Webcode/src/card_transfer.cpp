@@ -0,0 +1,201 @@
+/*
+ * card_transfer.cpp
+ */
+
+#include "card_transfer.h"
+#include "json_writer.h"
+#include <string.h>
+#include <strings.h>
+
+static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+size_t cleanCardName(const char* in, size_t len, char* out) {
+    while (len && isBlank(*in)) {
+        in++;
+        len--;
+    }
+    while (len && isBlank(in[len - 1])) len--;
+
+    size_t n = 0;
+    for (size_t i = 0; i < len && n < CARD_NAME_MAX; i++) {
+        uint8_t c = in[i];
+        if (c < 0x20 || c == 0x7F || strchr("\"'<>&\\", c) != NULL) continue;
+        out[n++] = (char)c;
+    }
+
+    // Do not leave half of a UTF-8 sequence at the end
+    size_t lead = n;
+    while (lead > 0 && (out[lead - 1] & 0xC0) == 0x80) lead--;
+    if (lead > 0 && (uint8_t)out[lead - 1] >= 0xC0) {
+        uint8_t c = out[lead - 1];
+        size_t need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+        if (n - (lead - 1) < need) n = lead - 1;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+bool parseUid(const char* text, size_t len, uint8_t* uid) {
+    if (len != UID_SIZE * 3 - 1) return false;
+    for (int i = 0; i < UID_SIZE; i++) {
+        int hi = hexValue(text[i * 3]);
+        int lo = hexValue(text[i * 3 + 1]);
+        if (hi < 0 || lo < 0) return false;
+        if (i < UID_SIZE - 1 && text[i * 3 + 2] != ':') return false;
+        uid[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+void printCardCsv(Print& out, const uint8_t* uid, const char* name) {
+    char uidStr[UID_STRING_SIZE];
+    formatUid(uid, uidStr);
+    out.print(uidStr);
+    out.write(',');
+    out.print(name);
+    out.write('\n');
+}
+
+void printCardBinary(Print& out, const uint8_t* uid, const char* name) {
+    size_t len = strlen(name);
+    if (len > 255) len = 255;
+    out.write(uid, UID_SIZE);
+    out.write((uint8_t)len);
+    out.write((const uint8_t*)name, len);
+}
+
+CardImportParser::CardImportParser(CardImportRow* r, uint32_t max)
+    : rows(r), maxRows(max), count(0), format(FORMAT_UNKNOWN), rowNo(1),
+      overlong(false), carryLen(0), errorsKept(0), failed(0) {
+}
+
+void CardImportParser::feed(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = data[i];
+        switch (format) {
+        case FORMAT_UNKNOWN:
+            // The first bytes decide the format
+            carry[carryLen++] = c;
+            if (carryLen == CARD_BINARY_MAGIC_SIZE) {
+                if (memcmp(carry, CARD_BINARY_MAGIC, CARD_BINARY_MAGIC_SIZE) == 0) {
+                    format = FORMAT_BINARY;
+                    carryLen = 0;
+                } else {
+                    uint8_t head[CARD_BINARY_MAGIC_SIZE];
+                    memcpy(head, carry, sizeof(head));
+                    format = FORMAT_CSV;
+                    carryLen = 0;
+                    feed(head, sizeof(head));
+                }
+            }
+            break;
+
+        case FORMAT_CSV:
+            if (c == '\n') {
+                endCsvLine();
+            } else if (carryLen < CARD_CSV_LINE_MAX) {
+                carry[carryLen++] = c;
+            } else {
+                overlong = true;
+            }
+            break;
+
+        case FORMAT_BINARY:
+            carry[carryLen++] = c;
+            if (carryLen > UID_SIZE && carryLen == (size_t)UID_SIZE + 1 + carry[UID_SIZE]) {
+                endBinaryRecord();
+            }
+            break;
+        }
+    }
+}
+
+void CardImportParser::finish() {
+    if (format == FORMAT_UNKNOWN) {
+        // Shorter than the binary header, so it can only be CSV
+        uint8_t head[CARD_BINARY_MAGIC_SIZE];
+        size_t n = carryLen;
+        memcpy(head, carry, n);
+        format = FORMAT_CSV;
+        carryLen = 0;
+        feed(head, n);
+    }
+    if (format == FORMAT_CSV && (carryLen || overlong)) {
+        endCsvLine();
+    } else if (format == FORMAT_BINARY && carryLen) {
+        addError(rowNo, "truncated record");
+        carryLen = 0;
+    }
+}
+
+void CardImportParser::endCsvLine() {
+    const char* line = (const char*)carry;
+    size_t len = carryLen;
+    uint16_t lineNo = rowNo++;
+    carryLen = 0;
+
+    if (overlong) {
+        overlong = false;
+        addError(lineNo, "line too long");
+        return;
+    }
+
+    // Spreadsheets like to start the file with a UTF-8 byte order mark
+    if (lineNo == 1 && len >= 3 && memcmp(line, "\xEF\xBB\xBF", 3) == 0) {
+        line += 3;
+        len -= 3;
+    }
+    while (len && isBlank(*line)) {
+        line++;
+        len--;
+    }
+    while (len && isBlank(line[len - 1])) len--;
+    if (!len) return;
+
+    const char* comma = (const char*)memchr(line, ',', len);
+    size_t uidLen = comma ? (size_t)(comma - line) : len;
+    while (uidLen && isBlank(line[uidLen - 1])) uidLen--;
+    if (uidLen == 3 && strncasecmp(line, "uid", 3) == 0) return;  // header
+
+    uint8_t uid[UID_SIZE];
+    if (!parseUid(line, uidLen, uid)) {
+        addError(lineNo, "invalid uid");
+        return;
+    }
+    const char* name = comma ? comma + 1 : line + len;
+    addRow(lineNo, uid, name, line + len - name);
+}
+
+void CardImportParser::endBinaryRecord() {
+    addRow(rowNo++, carry, (const char*)carry + UID_SIZE + 1, carry[UID_SIZE]);
+    carryLen = 0;
+}
+
+void CardImportParser::addRow(uint16_t row, const uint8_t* uid, const char* name, size_t nameLen) {
+    if (count >= maxRows) {
+        addError(row, "too many cards");
+        return;
+    }
+    CardImportRow* r = &rows[count++];
+    memcpy(r->uid, uid, UID_SIZE);
+    cleanCardName(name, nameLen, r->name);
+    r->row = row;
+}
+
+void CardImportParser::addError(uint16_t row, const char* reason) {
+    failed++;
+    if (errorsKept < CARD_IMPORT_MAX_ERRORS) {
+        errors[errorsKept].row = row;
+        errors[errorsKept].reason = reason;
+        errorsKept++;
+    }
+}
@@ -0,0 +1,27 @@
+/*
+ * chunked_response.cpp
+ */
+
+#include "chunked_response.h"
+#include "state_lock.h"
+#include <memory>
+
+// Runs the source under the state lock, between loop() iterations
+class LockedChunkBuffer : public ChunkBuffer {
+public:
+    explicit LockedChunkBuffer(ResponseSource* src) : ChunkBuffer(src) {}
+
+protected:
+    bool produce() override {
+        StateLock lock;
+        return ChunkBuffer::produce();
+    }
+};
+
+void sendChunked(AsyncWebServerRequest* request, const char* contentType, ResponseSource* src) {
+    std::shared_ptr<ChunkBuffer> state = std::make_shared<LockedChunkBuffer>(src);
+    request->send(request->beginChunkedResponse(contentType,
+        [state](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
+            return state->fill(buffer, maxLen);
+        }));
+}
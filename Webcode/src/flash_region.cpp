@@ -0,0 +1,36 @@
+/*
+ * flash_region.cpp
+ *
+ * FlashRegion on top of the ESP-IDF partition API.
+ */
+
+#include "flash_region.h"
+#include <esp_partition.h>
+
+#define PART(p) ((const esp_partition_t*)(p))
+
+bool PartitionFlashRegion::begin(const char* label) {
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                         ESP_PARTITION_SUBTYPE_ANY, label);
+    return partition != nullptr;
+}
+
+uint32_t PartitionFlashRegion::size() const {
+    return partition ? PART(partition)->size : 0;
+}
+
+bool PartitionFlashRegion::read(uint32_t offset, void* dst, size_t len) {
+    if (!partition) return false;
+    return esp_partition_read(PART(partition), offset, dst, len) == ESP_OK;
+}
+
+bool PartitionFlashRegion::write(uint32_t offset, const void* src, size_t len) {
+    if (!partition) return false;
+    return esp_partition_write(PART(partition), offset, src, len) == ESP_OK;
+}
+
+bool PartitionFlashRegion::eraseSector(uint32_t sector) {
+    if (!partition) return false;
+    return esp_partition_erase_range(PART(partition), sector * FLASH_SECTOR_SIZE,
+                                     FLASH_SECTOR_SIZE) == ESP_OK;
+}
@@ -0,0 +1,96 @@
+/*
+ * frame_parser.cpp
+ */
+
+#include "frame_parser.h"
+#include <string.h>
+
+static int32_t readInt32(const uint8_t* p) {
+    return ((int32_t)p[0] << 24) | ((int32_t)p[1] << 16) | ((int32_t)p[2] << 8) | p[3];
+}
+
+// Whole frame size for a type the ESP32 receives, 0 for any other
+static size_t frameSize(uint8_t type) {
+    switch (type) {
+    case FRAME_TYPE_CARD_DETECTED:   return FRAME_CARD_SIZE;
+    case FRAME_TYPE_READER_CARD:     return FRAME_READER_CARD_SIZE;
+    case FRAME_TYPE_SCALE_REPLY:     return FRAME_SCALE_REPLY_SIZE;
+    case FRAME_TYPE_ALLOWLIST_STATE: return FRAME_ALLOWLIST_STATE_SIZE;
+    default:                         return 0;
+    }
+}
+
+void buildScaleCommand(uint8_t op, int32_t value, uint8_t* out) {
+    out[0] = FRAME_START_BYTE;
+    out[1] = FRAME_TYPE_SCALE_COMMAND;
+    out[2] = op;
+    out[3] = (uint8_t)(value >> 24);
+    out[4] = (uint8_t)(value >> 16);
+    out[5] = (uint8_t)(value >> 8);
+    out[6] = (uint8_t)value;
+    out[7] = FRAME_END_BYTE;
+}
+
+FrameParser::FrameParser() : reply(), allowlist(), len(0), pendingSince(0) {
+}
+
+FrameEvent FrameParser::feed(uint8_t byte, CardFrame* frame) {
+    if (len == 0) {
+        if (byte != FRAME_START_BYTE) return FRAME_NOISE;
+        buf[len++] = byte;
+        return FRAME_STARTED;
+    }
+
+    buf[len++] = byte;
+    FrameEvent event = FRAME_PENDING;
+    size_t size = frameSize(buf[1]);
+    if (size == 0) {
+        event = FRAME_UNKNOWN_TYPE;
+        len = 0;
+    } else if (len >= size) {
+        if (buf[size - 1] != FRAME_END_BYTE) {
+            event = FRAME_BAD_END;
+        } else if (buf[1] == FRAME_TYPE_SCALE_REPLY) {
+            reply.op = buf[2];
+            reply.status = buf[3];
+            reply.points = buf[4];
+            reply.weight = readInt32(&buf[5]);
+            event = FRAME_SCALE_REPLY;
+        } else if (buf[1] == FRAME_TYPE_ALLOWLIST_STATE) {
+            allowlist.count = (uint16_t)((buf[2] << 8) | buf[3]);
+            allowlist.checksum = (uint32_t)readInt32(&buf[4]);
+            event = FRAME_ALLOWLIST_STATE;
+        } else {
+            // UID and weight are the last 8 bytes before the end byte; the
+            // reader byte, if any, sits between them and the type
+            const uint8_t* uid = &buf[size - 1 - 4 - UID_SIZE];
+            const uint8_t* w = uid + UID_SIZE;
+            frame->reader = size == FRAME_READER_CARD_SIZE ? buf[2] : 0;
+            memcpy(frame->uid, uid, UID_SIZE);
+            frame->weight = readInt32(w);
+            event = FRAME_CARD;
+        }
+        len = 0;
+    }
+
+    if (len >= FRAME_BUFFER_SIZE) {
+        len = 0;
+        return FRAME_OVERFLOW;
+    }
+    return event;
+}
+
+bool FrameParser::expire(uint32_t nowMs) {
+    if (len == 0) {
+        pendingSince = 0;
+        return false;
+    }
+    if (pendingSince == 0) {
+        pendingSince = nowMs;
+    } else if (nowMs - pendingSince > FRAME_TIMEOUT_MS) {
+        len = 0;
+        pendingSince = 0;
+        return true;
+    }
+    return false;
+}
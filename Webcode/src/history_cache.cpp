@@ -0,0 +1,210 @@
+/*
+ * history_cache.cpp
+ */
+
+#include "history_cache.h"
+#include <string.h>
+
+#define SAMPLE_MAX_BYTES 15  // three varints of up to 5 bytes
+
+static_assert(sizeof(HistoryBlock) == HISTORY_BLOCK_SIZE, "HistoryBlock must stay 256 bytes");
+
+size_t varintEncode(uint32_t value, uint8_t* out) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+size_t varintDecode(const uint8_t* in, size_t avail, uint32_t* value) {
+    uint32_t result = 0;
+    for (size_t n = 0; n < avail && n < 5; n++) {
+        result |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;  // truncated
+}
+
+HistoryCache::HistoryCache() {
+    clear();
+}
+
+void HistoryCache::clear() {
+    firstBlock = 0;
+    blocksUsed = 0;
+    blockSerial = 0;
+    uidCount = 0;
+    prevUid = -1;
+    prevTimestamp = 0;
+    prevWeight = 0;
+}
+
+void HistoryCache::openBlock(uint32_t recNo, uint32_t timestamp) {
+    if (blocksUsed == HISTORY_CACHE_BLOCKS) {
+        dropOldestBlock();
+    }
+    HistoryBlock* b = blockAt(blocksUsed++);
+    b->firstRecNo = recNo;
+    b->firstTimestamp = timestamp;
+    b->lastTimestamp = timestamp;
+    b->count = 0;
+    b->used = 0;
+    blockSerial++;
+
+    prevUid = -1;
+    prevTimestamp = timestamp;
+    prevWeight = 0;
+}
+
+void HistoryCache::dropOldestBlock() {
+    firstBlock = (firstBlock + 1) % HISTORY_CACHE_BLOCKS;
+    blocksUsed--;
+}
+
+// Id for uid, reusing an id that no live block refers to when the table is
+// full. May drop old blocks (never the newest) to free one; -1 if impossible.
+int HistoryCache::internUid(const uint8_t* uid) {
+    for (uint32_t i = 0; i < uidCount; i++) {
+        if (memcmp(uids[i], uid, UID_SIZE) == 0) return (int)i;
+    }
+    if (uidCount < HISTORY_CACHE_MAX_UIDS) {
+        memcpy(uids[uidCount], uid, UID_SIZE);
+        return (int)uidCount++;
+    }
+    for (;;) {
+        uint32_t oldestSerial = blockSerial - blocksUsed + 1;
+        for (uint32_t i = 0; i < uidCount; i++) {
+            if (uidLastBlock[i] < oldestSerial) {
+                memcpy(uids[i], uid, UID_SIZE);
+                return (int)i;
+            }
+        }
+        if (blocksUsed <= 1) return -1;
+        dropOldestBlock();
+    }
+}
+
+void HistoryCache::append(uint32_t recNo, const uint8_t* uid, int32_t weight,
+                          uint32_t timestamp, bool isValidCard) {
+    int id = internUid(uid);
+    if (id < 0) {
+        clear();
+        id = internUid(uid);
+    }
+
+    HistoryBlock* b = blocksUsed ? blockAt(blocksUsed - 1) : nullptr;
+    if (!b || recNo != b->firstRecNo + b->count || b->count >= HISTORY_BLOCK_MAX_SAMPLES) {
+        openBlock(recNo, timestamp);
+        b = blockAt(blocksUsed - 1);
+    }
+
+    uint8_t sample[SAMPLE_MAX_BYTES];
+    size_t n = encodeSample(id, weight, timestamp, isValidCard, sample);
+    if (b->used + n > HISTORY_BLOCK_PAYLOAD) {
+        // Encoder state restarts with the block, so encode again
+        openBlock(recNo, timestamp);
+        b = blockAt(blocksUsed - 1);
+        n = encodeSample(id, weight, timestamp, isValidCard, sample);
+    }
+
+    memcpy(b->payload + b->used, sample, n);
+    b->used += n;
+    b->count++;
+    b->lastTimestamp = timestamp;
+    uidLastBlock[id] = blockSerial;
+    prevUid = id;
+    prevTimestamp = timestamp;
+    prevWeight = weight;
+}
+
+size_t HistoryCache::encodeSample(int id, int32_t weight, uint32_t timestamp,
+                                  bool isValidCard, uint8_t* out) const {
+    uint32_t dt = timestamp - prevTimestamp;
+    size_t n;
+    if (id == prevUid && dt < (1UL << 29)) {
+        n = varintEncode((dt << 2) | 2 | (isValidCard ? 1 : 0), out);
+        n += varintEncode(zigzagEncode(weight - prevWeight), out + n);
+    } else {
+        n = varintEncode(((uint32_t)id << 2) | (isValidCard ? 1 : 0), out);
+        n += varintEncode(zigzagEncode((int32_t)dt), out + n);
+        n += varintEncode(zigzagEncode(weight), out + n);
+    }
+    return n;
+}
+
+uint32_t HistoryCache::decodeBlock(uint32_t i, HistorySample* out) const {
+    if (i >= blocksUsed) return 0;
+    const HistoryBlock* b = blockAt(i);
+
+    int uid = -1;
+    uint32_t timestamp = b->firstTimestamp;
+    int32_t weight = 0;
+    size_t pos = 0;
+    uint32_t n = 0;
+
+    while (n < b->count) {
+        uint32_t tag, value;
+        size_t k;
+        if (!(k = varintDecode(b->payload + pos, b->used - pos, &tag))) break;
+        pos += k;
+
+        if (tag & 2) {
+            // Repeat of the previous UID
+            if (uid < 0) break;
+            timestamp += tag >> 2;
+        } else {
+            uid = (int)(tag >> 2);
+            if (uid >= (int)uidCount) break;
+            if (!(k = varintDecode(b->payload + pos, b->used - pos, &value))) break;
+            pos += k;
+            timestamp += (uint32_t)zigzagDecode(value);
+            weight = 0;
+        }
+        if (!(k = varintDecode(b->payload + pos, b->used - pos, &value))) break;
+        pos += k;
+        weight += zigzagDecode(value);
+
+        HistorySample* s = &out[n];
+        s->recNo = b->firstRecNo + n;
+        s->timestamp = timestamp;
+        memcpy(s->uid, uids[uid], UID_SIZE);
+        s->weight = weight;
+        s->isValidCard = tag & 1;
+        n++;
+    }
+    return n;
+}
+
+int HistoryCache::findBlock(uint32_t recNo) const {
+    for (int i = (int)blocksUsed - 1; i >= 0; i--) {
+        const HistoryBlock* b = blockAt(i);
+        if (recNo >= b->firstRecNo && recNo - b->firstRecNo < b->count) return i;
+    }
+    return -1;
+}
+
+uint32_t HistoryCache::count() const {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < blocksUsed; i++) {
+        total += blockAt(i)->count;
+    }
+    return total;
+}
+
+uint32_t HistoryCache::firstRecord() const {
+    return blocksUsed ? blockAt(0)->firstRecNo : 0;
+}
+
+uint32_t HistoryCache::bytesUsed() const {
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < blocksUsed; i++) {
+        total += HISTORY_BLOCK_HEADER_SIZE + blockAt(i)->used;
+    }
+    return total;
+}
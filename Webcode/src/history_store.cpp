@@ -0,0 +1,345 @@
+/*
+ * history_store.cpp
+ *
+ * Segment layout:
+ *   [SegmentHeader 16 B][record 0]...[record 254]
+ * Record number r lives in segment seq r / HISTORY_RECORDS_PER_SEGMENT + 1,
+ * slot r % HISTORY_RECORDS_PER_SEGMENT.
+ */
+
+#include "history_store.h"
+#include "crc32.h"
+#include <string.h>
+
+#define HISTORY_MAGIC 0x31484348UL  // "HCH1"
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t crc;      // crc32 of magic + seq
+    uint32_t reserved;
+};
+
+static_assert(sizeof(HistoryRecord) == HISTORY_RECORD_SIZE, "HistoryRecord must stay 16 bytes");
+static_assert(sizeof(SegmentHeader) == HISTORY_SEGMENT_HEADER_SIZE, "SegmentHeader must stay 16 bytes");
+
+static uint8_t recordCheck(const HistoryRecord* rec) {
+    return (uint8_t)crc32(rec, HISTORY_RECORD_SIZE - 1);
+}
+
+static bool recordIsErased(const HistoryRecord* rec) {
+    const uint32_t* w = (const uint32_t*)rec;
+    return (w[0] & w[1] & w[2] & w[3]) == 0xFFFFFFFFUL;
+}
+
+static uint32_t uidHash(const uint8_t* uid) {
+    uint32_t key;
+    memcpy(&key, uid, sizeof(key) < UID_SIZE ? sizeof(key) : UID_SIZE);
+    return (key * 2654435761UL) & (HISTORY_INDEX_SLOTS - 1);
+}
+
+HistoryStore::HistoryStore()
+    : region(nullptr), segmentCount(0), firstSeq(0), headSeq(0), headCount(0),
+      nextErased(false), lastTime(0), indexUsed(0), indexOverflow(false), indexFirst(0),
+      pendingCount(0), pendingSince(0) {
+}
+
+bool HistoryStore::begin(FlashRegion* r) {
+    region = r;
+    segmentCount = region->sectorCount();
+    if (segmentCount > HISTORY_MAX_SEGMENTS) segmentCount = HISTORY_MAX_SEGMENTS;
+    if (segmentCount < 2) return false;
+
+    firstSeq = 0;
+    headSeq = 0;
+    headCount = 0;
+    nextErased = false;
+    lastTime = 0;
+    pendingCount = 0;
+    pendingSince = 0;
+
+    // The newest valid segment is the head
+    for (uint32_t s = 0; s < segmentCount; s++) {
+        SegmentHeader hdr;
+        if (region->read(s * FLASH_SECTOR_SIZE, &hdr, sizeof(hdr)) &&
+            hdr.magic == HISTORY_MAGIC && hdr.seq != 0 &&
+            hdr.crc == crc32(&hdr, 8) && sectorOf(hdr.seq) == s &&
+            hdr.seq > headSeq) {
+            headSeq = hdr.seq;
+        }
+    }
+    if (headSeq == 0) {
+        rebuildIndex();
+        return true;
+    }
+
+    // Walk back while the preceding segments are intact
+    firstSeq = headSeq;
+    while (firstSeq > 1 && headSeq - (firstSeq - 1) < segmentCount) {
+        SegmentHeader hdr;
+        uint32_t seq = firstSeq - 1;
+        if (!region->read(sectorOf(seq) * FLASH_SECTOR_SIZE, &hdr, sizeof(hdr)) ||
+            hdr.magic != HISTORY_MAGIC || hdr.seq != seq || hdr.crc != crc32(&hdr, 8)) {
+            break;
+        }
+        firstSeq = seq;
+    }
+
+    // Count the records already in the head segment
+    uint32_t base = (headSeq - 1) * HISTORY_RECORDS_PER_SEGMENT;
+    while (headCount < HISTORY_RECORDS_PER_SEGMENT) {
+        HistoryRecord rec;
+        if (!region->read(offsetOf(base + headCount), &rec, sizeof(rec)) || recordIsErased(&rec)) {
+            break;
+        }
+        if (rec.check == recordCheck(&rec) && rec.timestamp > lastTime) {
+            lastTime = rec.timestamp;
+        }
+        headCount++;
+    }
+    if (lastTime == 0 && headSeq > firstSeq) {
+        // Head is empty; take the time from the end of the previous segment
+        HistoryRecord rec;
+        for (uint32_t r = base; r > base - HISTORY_RECORDS_PER_SEGMENT; r--) {
+            if (readFlash(r - 1, &rec)) {
+                lastTime = rec.timestamp;
+                break;
+            }
+        }
+    }
+
+    rebuildIndex();
+    return true;
+}
+
+// Open addressing with linear probing. Returns the slot holding uid, or the
+// empty slot where it would go when insert is set (nullptr if not found or
+// the table is at its load limit).
+HistoryStore::IndexSlot* HistoryStore::findSlot(const uint8_t* uid, bool insert) {
+    uint32_t i = uidHash(uid);
+    for (uint32_t n = 0; n < HISTORY_INDEX_SLOTS; n++) {
+        IndexSlot* slot = &index[i];
+        if (slot->last == HISTORY_NO_RECORD) {
+            if (!insert || indexUsed >= HISTORY_INDEX_SLOTS * 3 / 4) return nullptr;
+            memcpy(slot->uid, uid, UID_SIZE);
+            indexUsed++;
+            return slot;
+        }
+        if (memcmp(slot->uid, uid, UID_SIZE) == 0) return slot;
+        i = (i + 1) & (HISTORY_INDEX_SLOTS - 1);
+    }
+    return nullptr;
+}
+
+// One sequential pass over the log, read a page at a time. UIDs whose
+// records have all rotated out are dropped.
+void HistoryStore::rebuildIndex() {
+    for (uint32_t i = 0; i < HISTORY_INDEX_SLOTS; i++) {
+        index[i].last = HISTORY_NO_RECORD;
+    }
+    indexUsed = 0;
+    indexOverflow = false;
+    indexFirst = firstRecord();
+
+    HistoryRecord page[HISTORY_BATCH_RECORDS];
+    uint32_t end = endRecord() - pendingCount;
+    uint32_t r = firstRecord();
+    while (r < end) {
+        // Stay inside one segment per read
+        uint32_t segEnd = (r / HISTORY_RECORDS_PER_SEGMENT + 1) * HISTORY_RECORDS_PER_SEGMENT;
+        uint32_t n = end - r;
+        if (n > HISTORY_BATCH_RECORDS) n = HISTORY_BATCH_RECORDS;
+        if (n > segEnd - r) n = segEnd - r;
+        if (!region->read(offsetOf(r), page, n * HISTORY_RECORD_SIZE)) break;
+
+        for (uint32_t k = 0; k < n; k++) {
+            const HistoryRecord* rec = &page[k];
+            if (recordIsErased(rec) || rec->check != recordCheck(rec)) continue;
+            IndexSlot* slot = findSlot(rec->uid, true);
+            if (slot) {
+                slot->last = r + k;
+            } else {
+                indexOverflow = true;
+            }
+        }
+        r += n;
+    }
+    for (uint32_t k = 0; k < pendingCount; k++) {
+        IndexSlot* slot = findSlot(pending[k].uid, true);
+        if (slot) {
+            slot->last = end + k;
+        } else {
+            indexOverflow = true;
+        }
+    }
+}
+
+uint32_t HistoryStore::latestFor(const uint8_t* uid) {
+    IndexSlot* slot = findSlot(uid, false);
+    if (slot && slot->last >= firstRecord()) return slot->last;
+    if (slot || !indexOverflow) return HISTORY_NO_RECORD;
+
+    // Not indexed: fall back to a newest-first scan
+    return scanBack(uid, endRecord());
+}
+
+// Newest record of uid before record number before
+uint32_t HistoryStore::scanBack(const uint8_t* uid, uint32_t before) {
+    HistoryRecord rec;
+    for (uint32_t r = before; r > firstRecord(); r--) {
+        if (read(r - 1, &rec) && memcmp(rec.uid, uid, UID_SIZE) == 0) return r - 1;
+    }
+    return HISTORY_NO_RECORD;
+}
+
+uint32_t HistoryStore::previousFor(uint32_t recNo, const HistoryRecord& rec) {
+    if (rec.flags & HISTORY_FLAG_UNCHAINED) return scanBack(rec.uid, recNo);
+    if (rec.prevDelta == 0 || rec.prevDelta > recNo) return HISTORY_NO_RECORD;
+    uint32_t prev = recNo - rec.prevDelta;
+    return prev >= firstRecord() ? prev : HISTORY_NO_RECORD;
+}
+
+uint32_t HistoryStore::firstRecord() const {
+    return firstSeq ? (firstSeq - 1) * HISTORY_RECORDS_PER_SEGMENT : 0;
+}
+
+uint32_t HistoryStore::endRecord() const {
+    return headSeq ? (headSeq - 1) * HISTORY_RECORDS_PER_SEGMENT + headCount : 0;
+}
+
+uint32_t HistoryStore::offsetOf(uint32_t recNo) const {
+    uint32_t seq = recNo / HISTORY_RECORDS_PER_SEGMENT + 1;
+    uint32_t slot = recNo % HISTORY_RECORDS_PER_SEGMENT;
+    return sectorOf(seq) * FLASH_SECTOR_SIZE + HISTORY_SEGMENT_HEADER_SIZE + slot * HISTORY_RECORD_SIZE;
+}
+
+bool HistoryStore::openSegment(uint32_t seq) {
+    uint32_t sector = sectorOf(seq);
+
+    // Reusing the sector of the oldest segment drops it from the ring
+    if (firstSeq != 0 && sectorOf(firstSeq) == sector && firstSeq < seq) {
+        firstSeq++;
+    }
+    if (!(nextErased && seq == headSeq + 1)) {
+        if (!region->eraseSector(sector)) return false;
+    }
+    nextErased = false;
+
+    SegmentHeader hdr;
+    hdr.magic = HISTORY_MAGIC;
+    hdr.seq = seq;
+    hdr.crc = crc32(&hdr, 8);
+    hdr.reserved = 0xFFFFFFFFUL;
+    if (!region->write(sector * FLASH_SECTOR_SIZE, &hdr, sizeof(hdr))) return false;
+
+    headSeq = seq;
+    headCount = 0;
+    if (firstSeq == 0) firstSeq = seq;
+    return true;
+}
+
+bool HistoryStore::append(const uint8_t* uid, int32_t weight, uint32_t timestamp, bool isValidCard) {
+    if (!region) return false;
+
+    if (headSeq == 0 || headCount == HISTORY_RECORDS_PER_SEGMENT) {
+        if (!flush() || !openSegment(headSeq + 1)) return false;
+    }
+
+    uint32_t recNo = endRecord();
+    IndexSlot* slot = findSlot(uid, true);
+    if (!slot && firstRecord() != indexFirst) {
+        // Table full, but a segment rotated out since the last rebuild:
+        // purge UIDs that went with it and try once more
+        rebuildIndex();
+        slot = findSlot(uid, true);
+    }
+    if (!slot) indexOverflow = true;
+
+    HistoryRecord* rec = &pending[pendingCount++];
+    rec->timestamp = timestamp;
+    memcpy(rec->uid, uid, UID_SIZE);
+    rec->weight = weight;
+    rec->prevDelta = 0;
+    if (slot && slot->last != HISTORY_NO_RECORD && slot->last >= firstRecord() &&
+        recNo - slot->last <= 0xFFFF) {
+        rec->prevDelta = (uint16_t)(recNo - slot->last);
+    }
+    if (slot) slot->last = recNo;
+    rec->flags = (isValidCard ? HISTORY_FLAG_VALID_CARD : 0) | (slot ? 0 : HISTORY_FLAG_UNCHAINED);
+    rec->check = recordCheck(rec);
+    headCount++;
+    lastTime = timestamp;
+
+    if (pendingCount == HISTORY_BATCH_RECORDS || headCount == HISTORY_RECORDS_PER_SEGMENT) {
+        return flush();
+    }
+    return true;
+}
+
+bool HistoryStore::flush() {
+    if (pendingCount == 0) return true;
+
+    // Pending records are always contiguous and inside the head segment
+    uint32_t firstPending = endRecord() - pendingCount;
+    bool ok = region->write(offsetOf(firstPending), pending, pendingCount * HISTORY_RECORD_SIZE);
+    pendingCount = 0;
+    pendingSince = 0;
+    return ok;
+}
+
+void HistoryStore::maintain(uint32_t nowMs) {
+    if (pendingCount > 0) {
+        if (pendingSince == 0) {
+            pendingSince = nowMs ? nowMs : 1;
+        } else if (nowMs - pendingSince >= HISTORY_FLUSH_INTERVAL_MS) {
+            flush();
+        }
+    }
+
+    // Prepare the next segment once the head is in its last batch
+    if (headSeq != 0 && !nextErased &&
+        headCount + HISTORY_BATCH_RECORDS >= HISTORY_RECORDS_PER_SEGMENT) {
+        uint32_t next = headSeq + 1;
+        if (firstSeq != 0 && sectorOf(firstSeq) == sectorOf(next) && firstSeq < next) {
+            firstSeq++;
+        }
+        nextErased = region->eraseSector(sectorOf(next));
+    }
+}
+
+bool HistoryStore::readFlash(uint32_t recNo, HistoryRecord* out) {
+    return region->read(offsetOf(recNo), out, sizeof(*out)) &&
+           !recordIsErased(out) && out->check == recordCheck(out);
+}
+
+bool HistoryStore::read(uint32_t recNo, HistoryRecord* out) {
+    uint32_t end = endRecord();
+    if (recNo < firstRecord() || recNo >= end) return false;
+
+    if (recNo >= end - pendingCount) {
+        *out = pending[recNo - (end - pendingCount)];
+        return true;
+    }
+    return readFlash(recNo, out);
+}
+
+// Unreadable records are skipped towards newer ones; a run of them at the
+// boundary may be returned, readers skip those anyway
+uint32_t HistoryStore::seekTime(uint32_t t) {
+    uint32_t lo = firstRecord();
+    uint32_t hi = endRecord();
+    HistoryRecord rec;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t probe = mid;
+        while (probe < hi && !read(probe, &rec)) probe++;
+        if (probe == hi) {
+            hi = mid;
+        } else if (rec.timestamp < t) {
+            lo = probe + 1;
+        } else {
+            hi = probe;
+        }
+    }
+    return lo;
+}
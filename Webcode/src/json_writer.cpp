@@ -0,0 +1,201 @@
+/*
+ * json_writer.cpp
+ */
+
+#include "json_writer.h"
+#include <math.h>
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+JsonWriter::JsonWriter(Print& o) : out(o), hasItems(0), depth(0), afterKey(false) {
+}
+
+// Comma before every member/element except the first of its container
+void JsonWriter::separator() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    uint32_t bit = 1UL << depth;
+    if (hasItems & bit) out.write(',');
+    hasItems |= bit;
+}
+
+void JsonWriter::open(char c) {
+    separator();
+    out.write(c);
+    if (depth < JSON_MAX_DEPTH - 1) depth++;
+    hasItems &= ~(1UL << depth);
+}
+
+void JsonWriter::close(char c) {
+    out.write(c);
+    if (depth > 0) depth--;
+}
+
+JsonWriter& JsonWriter::beginObject() { open('{'); return *this; }
+JsonWriter& JsonWriter::endObject() { close('}'); return *this; }
+JsonWriter& JsonWriter::beginArray() { open('['); return *this; }
+JsonWriter& JsonWriter::endArray() { close(']'); return *this; }
+
+JsonWriter& JsonWriter::key(const char* name) {
+    value(name);
+    out.write(':');
+    afterKey = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* s) {
+    if (!s) return null();
+    separator();
+    out.write('"');
+    const char* run = s;
+    for (; *s; s++) {
+        uint8_t c = *s;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out.write((const uint8_t*)run, s - run);
+        run = s + 1;
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', (char)c};
+            out.write((const uint8_t*)esc, 2);
+        } else {
+            char esc[6] = {'\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0x0F]};
+            out.write((const uint8_t*)esc, 6);
+        }
+    }
+    out.write((const uint8_t*)run, s - run);
+    out.write('"');
+    return *this;
+}
+
+void JsonWriter::writeUnsigned(unsigned long v) {
+    char buf[12];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    out.write((const uint8_t*)p, buf + sizeof(buf) - p);
+}
+
+JsonWriter& JsonWriter::value(long v) {
+    separator();
+    if (v < 0) {
+        out.write('-');
+        writeUnsigned(0UL - (unsigned long)v);
+    } else {
+        writeUnsigned((unsigned long)v);
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(unsigned long v) {
+    separator();
+    writeUnsigned(v);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(float v, uint8_t decimals) {
+    if (isnan(v) || isinf(v)) return null();
+    if (decimals > 6) decimals = 6;
+    separator();
+    if (v < 0) {
+        out.write('-');
+        v = -v;
+    }
+    unsigned long scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+    double scaled = (double)v * scale + 0.5;
+    if (scaled >= 4294967295.0) {
+        writeUnsigned(0xFFFFFFFFUL / scale);  // out of range, clamp
+        return *this;
+    }
+    unsigned long fixed = (unsigned long)scaled;
+    writeUnsigned(fixed / scale);
+    if (decimals) {
+        char buf[8];
+        unsigned long frac = fixed % scale;
+        buf[0] = '.';
+        for (int i = decimals; i > 0; i--) {
+            buf[i] = '0' + frac % 10;
+            frac /= 10;
+        }
+        out.write((const uint8_t*)buf, decimals + 1);
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool v) {
+    separator();
+    if (v) out.write((const uint8_t*)"true", 4);
+    else out.write((const uint8_t*)"false", 5);
+    return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+    separator();
+    out.write((const uint8_t*)"null", 4);
+    return *this;
+}
+
+JsonWriter& JsonWriter::uid(const uint8_t* uid) {
+    char buf[UID_STRING_SIZE + 1];
+    separator();
+    formatUid(uid, buf + 1);
+    buf[0] = '"';
+    buf[UID_STRING_SIZE] = '"';
+    out.write((const uint8_t*)buf, UID_STRING_SIZE + 1);
+    return *this;
+}
+
+JsonWriter& JsonWriter::uid(CardKey key) {
+    uint8_t bytes[CARD_UID_MAX];
+    char buf[CARD_UID_MAX * 3 + 1];
+    size_t len = cardKeyUid(key, bytes);
+    size_t n = 0;
+    separator();
+    buf[n++] = '"';
+    for (size_t i = 0; i < len; i++) {
+        if (i) buf[n++] = ':';
+        buf[n++] = HEX_DIGITS[bytes[i] >> 4];
+        buf[n++] = HEX_DIGITS[bytes[i] & 0x0F];
+    }
+    buf[n++] = '"';
+    out.write((const uint8_t*)buf, n);
+    return *this;
+}
+
+JsonWriter& JsonWriter::raw(const char* json) {
+    separator();
+    out.print(json);
+    return *this;
+}
+
+void formatUid(const uint8_t* uid, char* out) {
+    for (int i = 0; i < UID_SIZE; i++) {
+        *out++ = HEX_DIGITS[uid[i] >> 4];
+        *out++ = HEX_DIGITS[uid[i] & 0x0F];
+        *out++ = i < UID_SIZE - 1 ? ':' : '\0';
+    }
+}
+
+BufferPrint::BufferPrint(char* b, size_t s) : buf(b), size(s), len(0), overflow(false) {
+    if (size) buf[0] = '\0';
+}
+
+size_t BufferPrint::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t BufferPrint::write(const uint8_t* data, size_t n) {
+    if (!size) return 0;
+    size_t room = size - 1 - len;
+    if (n > room) {
+        n = room;
+        overflow = true;
+    }
+    memcpy(buf + len, data, n);
+    len += n;
+    buf[len] = '\0';
+    return n;
+}
@@ -2,17 +2,35 @@
  * Healthcare RFID System - ESP32 Communication Module
  * 
  * CHỨC NĂNG CHÍNH:
- * - ESP32 CHỈ NHẬN dữ liệu từ STM32 (mã thẻ + cân nặng)
- * - Không gửi phản hồi về STM32
+ * - ESP32 nhận dữ liệu từ STM32 (mã thẻ + cân nặng)
+ * - Gửi về STM32 danh sách thẻ hợp lệ (allowlist) và lệnh hiệu chuẩn cân
  * - Lưu trữ và hiển thị dữ liệu qua web interface
  * - Quản lý danh sách thẻ hợp lệ
  */
 
 #include <WiFi.h>
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
 #include <HardwareSerial.h>
-#include <ArduinoJson.h>
 #include <EEPROM.h>
+#include <esp_timer.h>
+#include "config.h"
+#include "flash_region.h"
+#include "card_journal.h"
+#include "card_table.h"
+#include "history_store.h"
+#include "history_cache.h"
+#include "weight_rollup.h"
+#include "chunked_response.h"
+#include "api_sources.h"
+#include "web_assets.h"
+#include "state_lock.h"
+#include "json_writer.h"
+#include "api_json.h"
+#include "card_transfer.h"
+#include "metrics.h"
+#include "allowlist_sync.h"
+#include "card_ingest.h"
+#include <new>
 
 // WiFi Configuration
 const char* ap_ssid = "HealthcareRFID";
@@ -23,130 +41,147 @@ bool useStationMode = false;
 #define STM32_SERIAL_BAUD   115200
 #define DEBUG_SERIAL_BAUD   115200
 
-// Communication Protocol Constants
-#define MSG_START_BYTE      0xAA
-#define MSG_END_BYTE        0x55
+// Flash partitions (see partitions.csv)
+#define CARD_LOG_PARTITION "cardlog"
+#define HISTORY_PARTITION  "history"
 
-// Message types - Chỉ cần loại này
-#define MSG_TYPE_CARD_DETECTED      0x01  // STM32 -> ESP32: Card detected with weight
-
-// Legacy constants removed
-#define UID_SIZE           4
-#define MAX_VALID_CARDS    50
-#define UART_BUFFER_SIZE   256
-
-// EEPROM Storage
+// Old EEPROM layout, only read once to migrate into the card journal
 #define EEPROM_SIZE        512
 #define EEPROM_CARD_COUNT_ADDR  0
 #define EEPROM_CARDS_START_ADDR 4
+#define EEPROM_LEGACY_MAX_CARDS 50
 
 // Global Variables
-WebServer server(80);
+AsyncWebServer server(80);
+AsyncEventSource events("/events");  // live readings and card-list changes
 HardwareSerial stm32Serial(1);
+PartitionFlashRegion cardLogRegion;
+CardJournal cardJournal;
+PartitionFlashRegion historyRegion;
+HistoryStore historyStore;
+HistoryCache historyCache;
+WeightRollup weightRollup;
 
 // Valid Cards Database
-struct ValidCard {
-    uint8_t uid[UID_SIZE];
-    bool active;
-    String name; // Optional: card holder name
-};
-
-ValidCard validCards[MAX_VALID_CARDS];
-uint8_t validCardCount = 0;
+CardTable cardTable(&cardJournal);
 
 // Latest received data from STM32
-struct CardReading {
-    uint8_t uid[UID_SIZE];
-    bool isValid;
-    int32_t weight; // Đổi thành int32_t
-    unsigned long timestamp;
-    bool hasData;
-} latestReading = {0};
-
-// Weight History Storage
-#define MAX_WEIGHT_HISTORY 20
-struct WeightRecord {
-    uint8_t uid[UID_SIZE];
-    int32_t weight; // Đổi thành int32_t
-    unsigned long timestamp;
-    bool valid;
-    bool isValidCard;
-};
+CardReading latestReading = {};
+
+// Weight History Storage - records live in the history partition
+#define HISTORY_PAGE_ROWS  50     // default /api/history page size
+#define HISTORY_API_MAX_ROWS 500
+#define EVENT_JSON_SIZE    192     // largest SSE payload
+#define HISTORY_CACHE_PRELOAD 2048   // records decoded into the RAM cache at boot
 
-WeightRecord weightHistory[MAX_WEIGHT_HISTORY];
-uint8_t historyIndex = 0;
-uint8_t historyCount = 0;
+// Device time in seconds, continued from the last stored record so history
+// timestamps keep increasing across reboots
+uint32_t deviceTimeBase = 0;
 
-// Message buffer for STM32 communication
-uint8_t rxBuffer[UART_BUFFER_SIZE];
-uint8_t rxIndex = 0;
+// Full valid card list on its way to the STM32, advanced by loop()
+AllowlistSender allowlistSender;
+
+// Frames from the STM32 and the stores they update
+CardIngest cardIngest(cardTable, historyStore, historyCache, weightRollup, metrics.ingest);
 
 // Function prototypes - Updated
 void setupWiFi();
 void initValidCards();
-void saveValidCardsToEEPROM();
-void loadValidCardsFromEEPROM();
-bool addValidCard(uint8_t* uid);
-bool removeValidCard(uint8_t* uid);
-bool isCardValid(uint8_t* uid);
+void loadValidCards();
+bool importLegacyEEPROMCards();
+void applyCardJournalRecord(uint8_t type, const uint8_t* uid, const char* name);
+bool getLiveCardState(const uint8_t* uid, char* name, size_t nameSize);
 void processSTM32Message();
-void processCompleteMessage(uint8_t msgType);
-void processCardDetected(uint8_t* uid, int32_t weight);
-String uidToString(uint8_t* uid);
-void stringToUID(String uidStr, uint8_t* uid);
-bool isValidUID(String uidStr);
-void addWeightRecord(uint8_t* uid, int32_t weight, unsigned long timestamp, bool isValid);
-String getWeightHistoryForCard(uint8_t* uid);
-void sendHTMLResponse(String html);
-String formatUptime(unsigned long milliseconds);
+void processCardDetected(const CardFrame& frame);
+bool parseUidArg(AsyncWebServerRequest* request, const char* name, uint8_t* uid);
+void loadWeightHistory();
+uint32_t deviceTime();
+void sendHTMLResponse(AsyncWebServerRequest* request, const char* html);
+void printLatestReadingJson(Print& out);
+void printCardCountJson(Print& out);
+void printScaleJson(Print& out);
+void sendEvent(AsyncEventSourceClient* client, const char* name, void (*printJson)(Print&));
+void notifyCardsChanged();
+void sendAllowlistChange(uint8_t op, const uint8_t* uid);
 
 // Web Interface Functions
-String getMainPage();
-String getCardManagementPage();
-void handleRoot();
-void handleData();
-void handleCards();
-void handleCardManagementPage();
-void handleAddCard();
-void handleRemoveCard();
-void handleWeightHistory();
+void handleStaticAsset(AsyncWebServerRequest* request);
+void handleData(AsyncWebServerRequest* request);
+void handleCards(AsyncWebServerRequest* request);
+void handleAddCard(AsyncWebServerRequest* request);
+void handleRemoveCard(AsyncWebServerRequest* request);
+void handleRenameCard(AsyncWebServerRequest* request);
+void handleHistoryApi(AsyncWebServerRequest* request);
+void handleCardExport(AsyncWebServerRequest* request);
+void handleCardImport(AsyncWebServerRequest* request);
+void handleCardImportBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total);
+void handleRollup(AsyncWebServerRequest* request);
+void handleScale(AsyncWebServerRequest* request);
+void handleScaleCommand(AsyncWebServerRequest* request);
+void handleMetrics(AsyncWebServerRequest* request);
+void onRoute(const char* path, WebRequestMethod method, ArRequestHandlerFunction handler,
+             ArBodyHandlerFunction onBody = nullptr);
 
 void setup() {
     Serial.begin(DEBUG_SERIAL_BAUD);
     delay(1000);
     Serial.println("Healthcare RFID System - ESP32 Starting...");
     
-    // Initialize EEPROM
-    EEPROM.begin(EEPROM_SIZE);
-    
     // Initialize STM32 Serial communication - GPIO16(RX), GPIO17(TX)
     stm32Serial.begin(STM32_SERIAL_BAUD, SERIAL_8N1, 16, 17);
     // Set STM32 Serial to listen for incoming messages
     stm32Serial.setTimeout(100);
-    // Load valid cards from EEPROM
-    loadValidCardsFromEEPROM();
+    stateLockInit();
+    metricsSetLoopTask();
+    cardIngest.setLog(&Serial);
+    cardIngest.setAllowlistSender(&allowlistSender);
+
+    // Load valid cards from the card journal
+    loadValidCards();
+
+    // Mount the persistent weight history
+    loadWeightHistory();
     
     // Setup WiFi Access Point
     setupWiFi();
     
-    // Setup web server routes
-    server.on("/", handleRoot);
-    server.on("/data", HTTP_GET, handleData);
-    server.on("/cards", HTTP_GET, handleCards);
-    server.on("/manage", HTTP_GET, handleCardManagementPage);
-    server.on("/add_card", HTTP_POST, handleAddCard);
-    server.on("/remove_card", HTTP_POST, handleRemoveCard);
-    server.on("/weight_history", HTTP_GET, handleWeightHistory);
+    // Setup web server routes; pages, CSS and JS are gzipped assets in flash
+    for (size_t i = 0; i < webAssetCount; i++) {
+        onRoute(webAssets[i].path, HTTP_GET, handleStaticAsset);
+    }
+    onRoute("/data", HTTP_GET, handleData);
+    onRoute("/cards", HTTP_GET, handleCards);
+    onRoute("/add_card", HTTP_POST, handleAddCard);
+    onRoute("/remove_card", HTTP_POST, handleRemoveCard);
+    onRoute("/rename_card", HTTP_POST, handleRenameCard);
+    onRoute("/api/cards/export", HTTP_GET, handleCardExport);
+    onRoute("/api/cards/import", HTTP_POST, handleCardImport, handleCardImportBody);
+    onRoute("/api/history", HTTP_GET, handleHistoryApi);
+    onRoute("/api/rollup", HTTP_GET, handleRollup);
+    onRoute("/api/scale", HTTP_GET, handleScale);
+    onRoute("/api/scale/command", HTTP_POST, handleScaleCommand);
+    onRoute("/metrics", HTTP_GET, handleMetrics);
+
+    // Push channel: a new subscriber gets the current state right away
+    events.onConnect([](AsyncEventSourceClient* client) {
+        StateLock lock;
+        sendEvent(client, "reading", printLatestReadingJson);
+        sendEvent(client, "cards", printCardCountJson);
+    });
+    server.addHandler(&events);
     
     // Start web server
     server.begin();
     Serial.println("Web Server Started - Access: http://192.168.4.1");
+
+    // The STM32 may have booted first and asked for the list already
+    allowlistSender.start();
     
     Serial.println("System Ready for UART Communication");
 }
 
+// HTTP is served by AsyncWebServer on its own task; loop() only ingests
 void loop() {
-    server.handleClient();
     if (stm32Serial.available()) {
         Serial.println("Data available on UART!");
     } else {
@@ -156,7 +191,15 @@ void loop() {
             lastCheck = millis();
         }
     }
-    processSTM32Message();
+    {
+        StateLock lock;
+        processSTM32Message();
+        if (allowlistSender.poll(stm32Serial, cardTable, millis())) {
+            Serial.printf("Allowlist sent to STM32: %lu cards\n", (unsigned long)allowlistSender.sent());
+        }
+        cardJournal.maintain();
+        historyStore.maintain(millis());
+    }
     delay(1);
 }
 
@@ -170,570 +213,560 @@ void setupWiFi() {
 }
 
 void initValidCards() {
-    validCardCount = 0;
     uint8_t card1[] = {0x12, 0x34, 0x56, 0x78};
     uint8_t card2[] = {0xAB, 0xCD, 0xEF, 0x01};
-    addValidCard(card1);
-    addValidCard(card2);
-    saveValidCardsToEEPROM();
+    cardTable.add(card1);
+    cardTable.add(card2);
 }
 
-void saveValidCardsToEEPROM() {
-    EEPROM.write(EEPROM_CARD_COUNT_ADDR, validCardCount);
-    for (int i = 0; i < validCardCount; i++) {
-        int addr = EEPROM_CARDS_START_ADDR + (i * (UID_SIZE + 1));
-        for (int j = 0; j < UID_SIZE; j++) {
-            EEPROM.write(addr + j, validCards[i].uid[j]);
-        }
-        EEPROM.write(addr + UID_SIZE, validCards[i].active ? 1 : 0);
-    }
-    EEPROM.commit();
-}
+void loadValidCards() {
+    cardTable.clear();
 
-void loadValidCardsFromEEPROM() {
-    validCardCount = EEPROM.read(EEPROM_CARD_COUNT_ADDR);
-    
-    if (validCardCount > MAX_VALID_CARDS || validCardCount == 0 || validCardCount == 255) {
-        initValidCards();
+    if (!cardLogRegion.begin(CARD_LOG_PARTITION) ||
+        !cardJournal.begin(&cardLogRegion, applyCardJournalRecord, getLiveCardState)) {
+        Serial.println("Card journal unavailable - check partitions.csv");
         return;
     }
-    
-    for (int i = 0; i < validCardCount; i++) {
-        int addr = EEPROM_CARDS_START_ADDR + (i * (UID_SIZE + 1));
-        for (int j = 0; j < UID_SIZE; j++) {
-            validCards[i].uid[j] = EEPROM.read(addr + j);
+
+    if (cardJournal.isEmpty()) {
+        // First boot on the journal: carry over cards saved by older firmware
+        if (!importLegacyEEPROMCards()) {
+            initValidCards();
         }
-        validCards[i].active = EEPROM.read(addr + UID_SIZE) == 1;
     }
+    Serial.printf("Loaded %d cards, journal free sectors: %lu/%lu\n", cardTable.size(),
+                  (unsigned long)cardJournal.getFreeSectors(),
+                  (unsigned long)cardJournal.getSectorCount());
 }
 
-bool addValidCard(uint8_t* uid) {
-    if (validCardCount >= MAX_VALID_CARDS) {
-        return false;
-    }
-    
-    // Check if card already exists
-    for (int i = 0; i < validCardCount; i++) {
-        if (memcmp(validCards[i].uid, uid, UID_SIZE) == 0) {
-            validCards[i].active = true;
-            return true;
+bool importLegacyEEPROMCards() {
+    EEPROM.begin(EEPROM_SIZE);
+    uint8_t count = EEPROM.read(EEPROM_CARD_COUNT_ADDR);
+    bool imported = false;
+
+    if (count > 0 && count <= EEPROM_LEGACY_MAX_CARDS) {
+        for (int i = 0; i < count; i++) {
+            int addr = EEPROM_CARDS_START_ADDR + (i * (UID_SIZE + 1));
+            uint8_t uid[UID_SIZE];
+            for (int j = 0; j < UID_SIZE; j++) {
+                uid[j] = EEPROM.read(addr + j);
+            }
+            if (EEPROM.read(addr + UID_SIZE) == 1) {
+                imported |= cardTable.add(uid);
+            }
         }
     }
-    
-    // Add new card
-    memcpy(validCards[validCardCount].uid, uid, UID_SIZE);
-    validCards[validCardCount].active = true;
-    validCardCount++;
-    
-    saveValidCardsToEEPROM();
-    
-    return true;
+    EEPROM.end();
+    return imported;
 }
 
-bool removeValidCard(uint8_t* uid) {
-    for (int i = 0; i < validCardCount; i++) {
-        if (memcmp(validCards[i].uid, uid, UID_SIZE) == 0) {
-            validCards[i].active = false;
-            saveValidCardsToEEPROM();
-            return true;
-        }
-    }
-    return false;
+// Replay callback: rebuild the card table without writing to the journal
+void applyCardJournalRecord(uint8_t type, const uint8_t* uid, const char* name) {
+    cardTable.applyRecord(type, uid, name);
 }
 
-// Check if a card is in the valid cards database
-bool isCardValid(uint8_t* uid) {
-    for (int i = 0; i < validCardCount; i++) {
-        if (validCards[i].active && 
-            memcmp(validCards[i].uid, uid, UID_SIZE) == 0) {
-            return true;
-        }
-    }
-    return false;
+// Compaction callback: current state of a card
+bool getLiveCardState(const uint8_t* uid, char* name, size_t nameSize) {
+    return cardTable.liveState(uid, name, nameSize);
 }
 
 void processSTM32Message() {
-    while (stm32Serial.available() && rxIndex < UART_BUFFER_SIZE) {
-        uint8_t receivedByte = stm32Serial.read();
-        
-        // Debug raw bytes
-        Serial.printf("RX[%d]: 0x%02X\n", rxIndex, receivedByte);
-        
-        // Check for start byte
-        if (rxIndex == 0) {
-            if (receivedByte != MSG_START_BYTE) {
-                Serial.printf("Waiting for start byte, got: 0x%02X\n", receivedByte);
-                continue; // Wait for start byte
-            }
-            Serial.println("Start byte found!");
-            rxBuffer[rxIndex] = receivedByte;
-            rxIndex++;
-            continue;
-        }
-        
-        // Store received byte
-        rxBuffer[rxIndex] = receivedByte;
-        rxIndex++;
-        
-        // Check if we have message type (chỉ xử lý MSG_TYPE_CARD_DETECTED)
-        if (rxIndex >= 2) {
-            uint8_t msgType = rxBuffer[1];
-            
-            // Chỉ xử lý tin nhắn phát hiện thẻ
-            if (msgType == MSG_TYPE_CARD_DETECTED) {
-                // Cần 11 bytes: AA 01 UID[4] WEIGHT[4] 55
-                if (rxIndex >= 11) {
-                    if (rxBuffer[10] == MSG_END_BYTE) {
-                        // Message hoàn chỉnh - xử lý
-                        Serial.printf("Complete message received, type: 0x%02X, length: 11\n", msgType);
-                        processCompleteMessage(msgType);
-                    } else {
-                        Serial.printf("Invalid end byte: 0x%02X, expected: 0x%02X\n", rxBuffer[10], MSG_END_BYTE);
-                    }
-                    rxIndex = 0; // Reset buffer
-                }
-            } else {
-                // Bỏ qua các loại message khác
-                Serial.printf("Ignoring message type: 0x%02X\n", msgType);
-                rxIndex = 0;
-            }
-        }
-        
-        // Prevent buffer overflow
-        if (rxIndex >= UART_BUFFER_SIZE) {
-            Serial.println("Buffer overflow, resetting");
-            rxIndex = 0;
+    CardFrame frame;
+
+    while (stm32Serial.available()) {
+        if (cardIngest.feed(stm32Serial.read(), &frame) == FRAME_CARD) {
+            uint32_t start = micros();
+            processCardDetected(frame);
+            metrics.cardProcess.observe(micros() - start);
         }
     }
     
     // Reset buffer nếu stuck quá lâu
-    static unsigned long bufferStartTime = 0;
-    if (rxIndex > 0) {
-        if (bufferStartTime == 0) {
-            bufferStartTime = millis();
-        } else if (millis() - bufferStartTime > 1000) { // 1s timeout
-            Serial.printf("Buffer timeout, resetting. Had %d bytes\n", rxIndex);
-            rxIndex = 0;
-            bufferStartTime = 0;
-        }
-    } else {
-        bufferStartTime = 0;
-    }
+    cardIngest.expire(millis());
 }
 
-void processCompleteMessage(uint8_t msgType) {
-    if (msgType == MSG_TYPE_CARD_DETECTED) {
-        // Extract UID and weight from message: AA 01 UID[4] WEIGHT[4] 55
-        uint8_t uid[UID_SIZE];
-        int32_t weight;
+void processCardDetected(const CardFrame& frame) {
+    // History, cache and rollups; the card table decides validity
+    bool isValid = cardIngest.storeCard(frame, deviceTime());
 
-        // Sao chép UID
-        memcpy(uid, &rxBuffer[2], UID_SIZE);
+    // Update latest reading
+    latestReading.card = cardKey(frame.uid);
+    latestReading.reader = frame.reader;
+    latestReading.isValid = isValid;
+    latestReading.weight = frame.weight; // Lưu weight dưới dạng int32_t
+    latestReading.timestamp = millis();
+    latestReading.hasData = true;
 
-        // Đọc weight dưới dạng số nguyên big-endian
-        weight = ((int32_t)rxBuffer[6] << 24) | 
-                 ((int32_t)rxBuffer[7] << 16) | 
-                 ((int32_t)rxBuffer[8] << 8) | 
-                 rxBuffer[9];
+    // Push to every open dashboard
+    sendEvent(nullptr, "reading", printLatestReadingJson);
+}
 
-        // Debug dữ liệu nhận được
-        Serial.printf("Received - UID: %02X:%02X:%02X:%02X, Weight: %ld\n",
-                      uid[0], uid[1], uid[2], uid[3], weight);
+// Utility Functions
+// Decode an "XX:XX:XX:XX" request argument in place, without a String copy
+bool parseUidArg(AsyncWebServerRequest* request, const char* name, uint8_t* uid) {
+    const String& text = request->arg(name);
+    return parseUid(text.c_str(), text.length(), uid);
+}
 
-        processCardDetected(uid, weight);
-    } else {
-        Serial.printf("Ignoring message type: 0x%02X\n", msgType);
+void loadWeightHistory() {
+    if (!historyRegion.begin(HISTORY_PARTITION) || !historyStore.begin(&historyRegion)) {
+        Serial.println("History store unavailable - check partitions.csv");
+        return;
+    }
+    deviceTimeBase = historyStore.lastTimestamp() + 1;
+
+    // Patient rollups of the cards weighed last, from their chains
+    cardIngest.loadRollups();
+
+    // Warm the compressed cache with the newest records
+    HistoryRecord rec;
+    uint32_t end = historyStore.endRecord();
+    uint32_t cacheFrom = end - historyStore.firstRecord() > HISTORY_CACHE_PRELOAD ? end - HISTORY_CACHE_PRELOAD
+                                                                                 : historyStore.firstRecord();
+    for (uint32_t r = cacheFrom; r < end; r++) {
+        if (!historyStore.read(r, &rec)) continue;
+        historyCache.append(r, rec.uid, rec.weight, rec.timestamp, rec.flags & HISTORY_FLAG_VALID_CARD);
     }
+    Serial.printf("History: %lu records (capacity %lu), %lu patient rollups\n",
+                  (unsigned long)historyStore.count(), (unsigned long)historyStore.capacity(),
+                  (unsigned long)weightRollup.size());
 }
 
-void processCardDetected(uint8_t* uid, int32_t weight) {
-    // Check if card is in valid database
-    bool isValid = isCardValid(uid);
-    unsigned long currentTime = millis();
-
-    // Update latest reading
-    memcpy(latestReading.uid, uid, UID_SIZE);
-    latestReading.isValid = isValid;
-    latestReading.weight = weight; // Lưu weight dưới dạng int32_t
-    latestReading.timestamp = currentTime;
-    latestReading.hasData = true;
-
-    // Add to weight history
-    addWeightRecord(uid, weight, currentTime, isValid);
+// From the 64-bit microsecond timer: millis() wraps after 49.7 days and
+// would send timestamps back in time
+uint32_t deviceTime() {
+    return deviceTimeBase + (uint32_t)(esp_timer_get_time() / 1000000);
+}
 
-    // Log the detection
-    String uidStr = uidToString(uid);
-    Serial.printf("Card Detected: %s, Weight: %ld, Valid: %s\n", 
-                  uidStr.c_str(), weight, isValid ? "YES" : "NO");
+// Helper function to send HTML with UTF-8 charset. The messages are string
+// literals, so the response points at them instead of copying into a String.
+void sendHTMLResponse(AsyncWebServerRequest* request, const char* html) {
+    request->send(200, "text/html; charset=UTF-8", (const uint8_t*)html, strlen(html));
 }
 
-// Utility Functions
-String uidToString(uint8_t* uid) {
-    String result = "";
-    for (int i = 0; i < UID_SIZE; i++) {
-        if (uid[i] < 0x10) result += "0";
-        result += String(uid[i], HEX);
-        if (i < UID_SIZE - 1) result += ":";
-    }
-    result.toUpperCase();
-    return result;
-}
-
-void stringToUID(String uidStr, uint8_t* uid) {
-    int index = 0;
-    int start = 0;
-    for (int i = 0; i <= uidStr.length() && index < UID_SIZE; i++) {
-        if (i == uidStr.length() || uidStr.charAt(i) == ':') {
-            String byteStr = uidStr.substring(start, i);
-            uid[index] = (uint8_t)strtol(byteStr.c_str(), NULL, 16);
-            index++;
-            start = i + 1;
-        }
+// Serves a gzipped asset; the ETag lets the browser revalidate with a 304
+void handleStaticAsset(AsyncWebServerRequest* request) {
+    const WebAsset* asset = findWebAsset(request->url().c_str());
+    if (!asset) {
+        request->send(404, "text/plain", "Not found");
+        return;
+    }
+    const char* cacheControl = asset->immutable ? "public, max-age=31536000, immutable" : "no-cache";
+    if (request->hasHeader("If-None-Match") && request->getHeader("If-None-Match")->value() == asset->etag) {
+        AsyncWebServerResponse* response = request->beginResponse(304, asset->contentType, "");
+        response->addHeader("ETag", asset->etag);
+        response->addHeader("Cache-Control", cacheControl);
+        request->send(response);
+        return;
     }
+    AsyncWebServerResponse* response = request->beginResponse(200, asset->contentType, asset->data, asset->length);
+    response->addHeader("Content-Encoding", "gzip");
+    response->addHeader("ETag", asset->etag);
+    response->addHeader("Cache-Control", cacheControl);
+    request->send(response);
 }
 
-bool isValidUID(String uidStr) {
-    if (uidStr.length() != 11) return false; // Expected format: XX:XX:XX:XX
-    for (int i = 0; i < uidStr.length(); i++) {
-        char c = uidStr.charAt(i);
-        if (i % 3 == 2) {
-            if (c != ':') return false;
-        } else {
-            if (!isHexadecimalDigit(c)) return false;
-        }
-    }
-    return true;
+// Latest reading, shared by /data and the "reading" event
+void printLatestReadingJson(Print& out) {
+    printReadingJson(out, latestReading, historyStore.count());
 }
 
-void addWeightRecord(uint8_t* uid, int32_t weight, unsigned long timestamp, bool isValid) {
-    memcpy(weightHistory[historyIndex].uid, uid, UID_SIZE);
-    weightHistory[historyIndex].weight = weight; // Lưu weight dưới dạng int32_t
-    weightHistory[historyIndex].timestamp = timestamp;
-    weightHistory[historyIndex].valid = true;
-    weightHistory[historyIndex].isValidCard = isValid;
+void printCardCountJson(Print& out) {
+    JsonWriter json(out);
+    json.beginObject().key("count").value(cardTable.activeCount()).endObject();
+}
 
-    historyIndex = (historyIndex + 1) % MAX_WEIGHT_HISTORY;
-    if (historyCount < MAX_WEIGHT_HISTORY) {
-        historyCount++;
+// Last calibration reply, for /api/scale
+void printScaleJson(Print& out) {
+    JsonWriter json(out);
+    json.beginObject();
+    if (cardIngest.scaleReplyTime()) {
+        const ScaleReply& scaleReply = cardIngest.scaleReply();
+        json.key("op").value(scaleReply.op);
+        json.key("status").value(scaleReply.status);
+        json.key("points").value(scaleReply.points);
+        json.key("weight").value(scaleReply.weight);
+        json.key("age_ms").value((unsigned long)(millis() - cardIngest.scaleReplyTime()));
     }
+    json.endObject();
 }
 
-String getWeightHistoryForCard(uint8_t* uid) {
-    String history = "";
-    for (int i = 0; i < historyCount; i++) {
-        int index = (historyIndex - 1 - i + MAX_WEIGHT_HISTORY) % MAX_WEIGHT_HISTORY;
-        if (memcmp(weightHistory[index].uid, uid, UID_SIZE) == 0) {
-            history += String(weightHistory[index].weight) + " ";
-        }
+// Send one event to a client, or to every subscriber if client is nullptr.
+// The payload is rendered into a stack buffer.
+void sendEvent(AsyncEventSourceClient* client, const char* name, void (*printJson)(Print&)) {
+    char buf[EVENT_JSON_SIZE];
+    BufferPrint out(buf, sizeof(buf));
+    printJson(out);
+    if (client) {
+        client->send(buf, name, millis());
+    } else {
+        events.send(buf, name, millis());
     }
-    return history;
 }
 
-// Helper function to send HTML with UTF-8 charset
-void sendHTMLResponse(String html) {
-    server.sendHeader("Content-Type", "text/html; charset=UTF-8");
-    server.send(200, "text/html", html);
+// Tell subscribers to refresh their card list
+void notifyCardsChanged() {
+    sendEvent(nullptr, "cards", printCardCountJson);
 }
 
-// Helper function to format uptime from milliseconds
-String formatUptime(unsigned long milliseconds) {
-    unsigned long seconds = milliseconds / 1000;
-    unsigned long minutes = seconds / 60;
-    unsigned long hours = minutes / 60;
-    unsigned long days = hours / 24;
-    
-    seconds %= 60;
-    minutes %= 60;
-    hours %= 24;
-    
-    String result = "";
-    if (days > 0) {
-        result += String(days) + " ngày ";
+// One card added or removed. While the full list is still going out the
+// change may fall behind its position, so the list is started over instead.
+void sendAllowlistChange(uint8_t op, const uint8_t* uid) {
+    if (allowlistSender.busy()) {
+        allowlistSender.start();
+    } else {
+        sendAllowlistDelta(stm32Serial, op, uid);
     }
-    if (hours > 0 || days > 0) {
-        result += (hours < 10 ? "0" : "") + String(hours) + ":";
+}
+
+// Response body written by one print function, under the state lock
+class PrintFnSource : public ResponseSource {
+public:
+    explicit PrintFnSource(void (*fn)(Print&)) : printJson(fn) {}
+
+    bool next(Print& out) override {
+        printJson(out);
+        return false;
     }
-    result += (minutes < 10 ? "0" : "") + String(minutes) + ":";
-    result += (seconds < 10 ? "0" : "") + String(seconds);
-    
-    return result;
-}
-
-// Web Interface Implementation
-String getMainPage() {
-    String html = "<!DOCTYPE html><html><head>";
-    html += "<meta charset='UTF-8'>";
-    html += "<title>Healthcare RFID System</title>";
-    html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-    html += "<style>";
-    html += "* { margin: 0; padding: 0; box-sizing: border-box; }";
-    html += "body { font-family: 'Segoe UI', Arial, sans-serif; background: linear-gradient(135deg, #667eea 0%, #764ba2 100%); min-height: 100vh; }";
-    html += ".container { max-width: 1200px; margin: 0 auto; padding: 20px; }";
-    html += ".header { text-align: center; color: white; margin-bottom: 30px; }";
-    html += ".header h1 { font-size: 2.5rem; margin-bottom: 10px; text-shadow: 2px 2px 4px rgba(0,0,0,0.3); }";
-    html += ".header p { font-size: 1.1rem; opacity: 0.9; }";
-    html += ".dashboard { display: grid; grid-template-columns: repeat(auto-fit, minmax(300px, 1fr)); gap: 20px; margin-bottom: 30px; }";
-    html += ".card { background: white; border-radius: 15px; padding: 25px; box-shadow: 0 10px 30px rgba(0,0,0,0.2); transition: transform 0.3s ease; }";
-    html += ".card:hover { transform: translateY(-5px); }";
-    html += ".card-title { font-size: 1.3rem; color: #333; margin-bottom: 15px; display: flex; align-items: center; }";
-    html += ".card-title::before { content: ''; margin-right: 10px; font-size: 1.5rem; }";
-    html += ".status-display { font-size: 1.1rem; padding: 15px; background: #f8f9fa; border-radius: 8px; border-left: 4px solid #007bff; }";
-    html += ".actions { display: grid; grid-template-columns: repeat(auto-fit, minmax(200px, 1fr)); gap: 15px; }";
-    html += ".btn { padding: 15px 25px; border: none; border-radius: 8px; font-size: 1rem; font-weight: 600; cursor: pointer; transition: all 0.3s ease; text-decoration: none; display: inline-block; text-align: center; color: white; }";
-    html += ".btn-primary { background: linear-gradient(45deg, #007bff, #0056b3); }";
-    html += ".btn-success { background: linear-gradient(45deg, #28a745, #1e7e34); }";
-    html += ".btn-warning { background: linear-gradient(45deg, #ffc107, #e0a800); }";
-    html += ".btn:hover { transform: translateY(-2px); box-shadow: 0 5px 15px rgba(0,0,0,0.2); }";
-    html += ".stats { display: grid; grid-template-columns: repeat(auto-fit, minmax(150px, 1fr)); gap: 15px; margin-top: 15px; }";
-    html += ".stat-item { text-align: center; padding: 15px; background: #f8f9fa; border-radius: 8px; }";
-    html += ".stat-number { font-size: 2rem; font-weight: bold; color: #007bff; }";
-    html += ".stat-label { font-size: 0.9rem; color: #666; margin-top: 5px; }";
-    html += "@media (max-width: 768px) { .header h1 { font-size: 2rem; } .dashboard { grid-template-columns: 1fr; } }";
-    html += "</style>";
-    html += "<script>";
-    html += "function updateStatus() {";
-    html += "  fetch('/data').then(r => r.json()).then(d => {";
-    html += "    const status = document.getElementById('status');";
-    html += "    const cardCount = document.getElementById('cardCount');";
-    html += "    const historyCount = document.getElementById('historyCount');";
-    html += "    if (d.lastCard && d.lastCard !== 'None') {";
-    html += "      const uptime = formatUptime(d.timestamp);";
-    html += "      status.innerHTML = `<strong>Thẻ cuối:</strong> ${d.lastCard}<br><strong>Cân nặng:</strong> ${d.weight}g<br><strong>Hợp lệ:</strong> ${d.valid ? 'Có' : 'Không'}<br><strong>Thời gian:</strong> ${uptime}`;";
-    html += "      status.style.borderLeftColor = d.valid ? '#28a745' : '#dc3545';";
-    html += "    } else {";
-    html += "      status.innerHTML = '<strong>Trạng thái:</strong> Đang chờ quẹt thẻ...';";
-    html += "      status.style.borderLeftColor = '#007bff';";
-    html += "    }";
-    html += "  }).catch(e => {";
-    html += "    document.getElementById('status').innerHTML = '<strong>Lỗi:</strong> Không thể kết nối đến hệ thống';";
-    html += "  });";
-    html += "  fetch('/cards').then(r => r.json()).then(cards => {";
-    html += "    document.getElementById('cardCount').textContent = cards.length;";
-    html += "  });";
-    html += "}";
-    html += "function formatUptime(ms) {";
-    html += "  const seconds = Math.floor(ms / 1000);";
-    html += "  const minutes = Math.floor(seconds / 60);";
-    html += "  const hours = Math.floor(minutes / 60);";
-    html += "  const days = Math.floor(hours / 24);";
-    html += "  const s = seconds % 60;";
-    html += "  const m = minutes % 60;";
-    html += "  const h = hours % 24;";
-    html += "  let result = '';";
-    html += "  if (days > 0) result += days + ' ngày ';";
-    html += "  if (hours > 0 || days > 0) result += (h < 10 ? '0' : '') + h + ':';";
-    html += "  result += (m < 10 ? '0' : '') + m + ':';";
-    html += "  result += (s < 10 ? '0' : '') + s;";
-    html += "  return result;";
-    html += "}";
-    html += "setInterval(updateStatus, 1000);";
-    html += "window.onload = updateStatus;";
-    html += "</script></head><body>";
-    html += "<div class='container'>";
-    html += "<div class='header'>";
-    html += "<h1>🏥 Healthcare RFID System</h1>";
-    html += "<p>Hệ thống quản lý thẻ RFID và cân nặng y tế</p>";
-    html += "</div>";
-    html += "<div class='dashboard'>";
-    html += "<div class='card'>";
-    html += "<div class='card-title'>📊 Trạng thái hệ thống</div>";
-    html += "<div id='status' class='status-display'>Đang tải...</div>";
-    html += "<div class='stats'>";
-    html += "<div class='stat-item'><div id='cardCount' class='stat-number'>0</div><div class='stat-label'>Thẻ hợp lệ</div></div>";
-    html += "<div class='stat-item'><div id='historyCount' class='stat-number'>" + String(historyCount) + "</div><div class='stat-label'>Lịch sử</div></div>";
-    html += "</div></div>";
-    html += "<div class='card'>";
-    html += "<div class='card-title'>⚡ Thao tác</div>";
-    html += "<div class='actions'>";
-    html += "<a href='/manage' class='btn btn-primary'>🏷️ Quản lý thẻ</a>";
-    html += "<a href='/weight_history' class='btn btn-success'>📊 Lịch sử cân nặng</a>";
-    html += "</div></div></div></div></body></html>";
-    return html;
-}
-
-String getCardManagementPage() {
-    String html = "<!DOCTYPE html><html><head>";
-    html += "<meta charset='UTF-8'>";
-    html += "<title>Quản lý thẻ - Healthcare RFID</title>";
-    html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-    html += "<style>";
-    html += "* { margin: 0; padding: 0; box-sizing: border-box; }";
-    html += "body { font-family: 'Segoe UI', Arial, sans-serif; background: linear-gradient(135deg, #667eea 0%, #764ba2 100%); min-height: 100vh; }";
-    html += ".container { max-width: 800px; margin: 0 auto; padding: 20px; }";
-    html += ".header { text-align: center; color: white; margin-bottom: 30px; }";
-    html += ".card { background: white; border-radius: 15px; padding: 25px; margin-bottom: 20px; box-shadow: 0 10px 30px rgba(0,0,0,0.2); }";
-    html += ".card-title { font-size: 1.5rem; color: #333; margin-bottom: 20px; }";
-    html += ".form-group { margin-bottom: 20px; }";
-    html += ".form-label { display: block; margin-bottom: 8px; font-weight: 600; color: #333; }";
-    html += ".form-input { width: 100%; padding: 12px; border: 2px solid #e1e5e9; border-radius: 8px; font-size: 1rem; transition: border-color 0.3s; }";
-    html += ".form-input:focus { outline: none; border-color: #007bff; }";
-    html += ".btn { padding: 12px 24px; border: none; border-radius: 8px; font-size: 1rem; font-weight: 600; cursor: pointer; transition: all 0.3s; text-decoration: none; display: inline-block; }";
-    html += ".btn-primary { background: #007bff; color: white; }";
-    html += ".btn-danger { background: #dc3545; color: white; }";
-    html += ".btn-secondary { background: #6c757d; color: white; }";
-    html += ".btn:hover { transform: translateY(-2px); box-shadow: 0 5px 15px rgba(0,0,0,0.2); }";
-    html += ".table { width: 100%; border-collapse: collapse; margin-top: 20px; }";
-    html += ".table th, .table td { padding: 12px; text-align: left; border-bottom: 1px solid #dee2e6; }";
-    html += ".table th { background: #f8f9fa; font-weight: 600; }";
-    html += ".table tr:hover { background: #f8f9fa; }";
-    html += ".badge { padding: 4px 8px; border-radius: 4px; font-size: 0.8rem; font-weight: 600; }";
-    html += ".badge-success { background: #d4edda; color: #155724; }";
-    html += "</style></head><body>";
-    html += "<div class='container'>";
-    html += "<div class='header'><h1>🏷️ Quản lý thẻ RFID</h1></div>";
-    html += "<div class='card'>";
-    html += "<div class='card-title'>➕ Thêm thẻ mới</div>";
-    html += "<form method='POST' action='/add_card'>";
-    html += "<div class='form-group'>";
-    html += "<label class='form-label'>UID thẻ (định dạng: XX:XX:XX:XX)</label>";
-    html += "<input type='text' name='uid' class='form-input' pattern='[0-9A-Fa-f]{2}:[0-9A-Fa-f]{2}:[0-9A-Fa-f]{2}:[0-9A-Fa-f]{2}' placeholder='VD: 12:34:56:78' required>";
-    html += "</div>";
-    html += "<button type='submit' class='btn btn-primary'>➕ Thêm thẻ</button>";
-    html += "</form></div>";
-    html += "<div class='card'>";
-    html += "<div class='card-title'>Danh sách thẻ hợp lệ</div>";
-    html += "<table class='table'>";
-    html += "<thead><tr><th>UID</th><th>Trạng thái</th><th>Thao tác</th></tr></thead><tbody>";
-    
-    for (int i = 0; i < validCardCount; i++) {
-        if (validCards[i].active) {
-            html += "<tr><td><code>" + uidToString(validCards[i].uid) + "</code></td>";
-            html += "<td><span class='badge badge-success'>Hoạt động</span></td>";
-            html += "<td><form method='POST' action='/remove_card' style='display:inline;'>";
-            html += "<input type='hidden' name='uid' value='" + uidToString(validCards[i].uid) + "'>";
-            html += "<button type='submit' class='btn btn-danger' onclick='return confirm(\"Bạn có chắc muốn xóa thẻ này?\")'>Xóa</button></form></td></tr>";
-        }
+
+private:
+    void (*printJson)(Print&);
+};
+
+// Register a route; the handler's run time (including the wait for the
+// StateLock) goes to the route's histogram
+void onRoute(const char* path, WebRequestMethod method, ArRequestHandlerFunction handler,
+             ArBodyHandlerFunction onBody) {
+    RouteMetrics* route = metricsRoute(path);
+    ArRequestHandlerFunction timed = [route, handler](AsyncWebServerRequest* request) {
+        uint32_t start = micros();
+        handler(request);
+        if (route) route->duration.observe(micros() - start);
+    };
+    if (onBody) {
+        server.on(path, method, timed, nullptr, onBody);
+    } else {
+        server.on(path, method, timed);
     }
-    
-    html += "</tbody></table>";
-    html += "<div style='margin-top: 20px; text-align: center;'>";
-    html += "<a href='/' class='btn btn-secondary'>Về trang chủ</a>";
-    html += "</div></div></div></body></html>";
-    return html;
 }
 
-void handleRoot() {
-    sendHTMLResponse(getMainPage());
+void handleMetrics(AsyncWebServerRequest* request) {
+    sendChunked(request, "text/plain; version=0.0.4", new MetricsSource());
 }
 
-void handleData() {
-    String json = "{";
-    if (latestReading.hasData) {
-        json += "\"lastCard\":\"" + uidToString(latestReading.uid) + "\",";
-        json += "\"weight\":" + String(latestReading.weight) + ",";
-        json += "\"valid\":" + String(latestReading.isValid ? "true" : "false") + ",";
-        json += "\"timestamp\":" + String(latestReading.timestamp);
-    } else {
-        json += "\"lastCard\":\"None\",\"weight\":0,\"valid\":false,\"timestamp\":0";
-    }
-    json += "}";
-    server.send(200, "application/json", json);
+void handleData(AsyncWebServerRequest* request) {
+    sendChunked(request, "application/json", new PrintFnSource(printLatestReadingJson));
 }
 
-void handleCards() {
-    String json = "[";
-    for (int i = 0; i < validCardCount; i++) {
-        if (validCards[i].active) {
-            if (json != "[") json += ",";
-            json += "{\"uid\":\"" + uidToString(validCards[i].uid) + "\",\"active\":true}";
-        }
-    }
-    json += "]";
-    server.send(200, "application/json", json);
+void handleCards(AsyncWebServerRequest* request) {
+    sendChunked(request, "application/json", new CardListSource(cardTable));
 }
 
-void handleCardManagementPage() {
-    sendHTMLResponse(getCardManagementPage());
+void handleAddCard(AsyncWebServerRequest* request) {
+    StateLock lock;
+    if (request->hasArg("uid")) {
+        uint8_t uid[UID_SIZE];
+        if (parseUidArg(request, "uid", uid)) {
+            if (cardTable.add(uid)) {
+                sendAllowlistChange(ALLOWLIST_OP_ADD, uid);
+                notifyCardsChanged();
+                sendHTMLResponse(request, "<meta charset='UTF-8'><script>alert('Đã thêm thẻ thành công!'); window.location.href='/manage';</script>");
+            } else {
+                sendHTMLResponse(request, "<meta charset='UTF-8'><script>alert('Thêm thẻ thất bại!'); window.location.href='/manage';</script>");
+            }
+        } else {
+            sendHTMLResponse(request, "<meta charset='UTF-8'><script>alert('Định dạng UID không hợp lệ!'); window.location.href='/manage';</script>");
+        }
+    } else {
+        request->send(400, "text/plain", "Missing UID parameter");
+    }
 }
 
-void handleAddCard() {
-    if (server.hasArg("uid")) {
-        String uidStr = server.arg("uid");
-        if (isValidUID(uidStr)) {
-            uint8_t uid[UID_SIZE];
-            stringToUID(uidStr, uid);
-            if (addValidCard(uid)) {
-                sendHTMLResponse("<meta charset='UTF-8'><script>alert('Đã thêm thẻ thành công!'); window.location.href='/manage';</script>");
+void handleRemoveCard(AsyncWebServerRequest* request) {
+    StateLock lock;
+    if (request->hasArg("uid")) {
+        uint8_t uid[UID_SIZE];
+        if (parseUidArg(request, "uid", uid)) {
+            if (cardTable.remove(uid)) {
+                sendAllowlistChange(ALLOWLIST_OP_REMOVE, uid);
+                notifyCardsChanged();
+                sendHTMLResponse(request, "<meta charset='UTF-8'><script>alert('Đã xóa thẻ thành công!'); window.location.href='/manage';</script>");
             } else {
-                sendHTMLResponse("<meta charset='UTF-8'><script>alert('Thêm thẻ thất bại!'); window.location.href='/manage';</script>");
+                sendHTMLResponse(request, "<meta charset='UTF-8'><script>alert('Xóa thẻ thất bại!'); window.location.href='/manage';</script>");
             }
         } else {
-            sendHTMLResponse("<meta charset='UTF-8'><script>alert('Định dạng UID không hợp lệ!'); window.location.href='/manage';</script>");
+            sendHTMLResponse(request, "<meta charset='UTF-8'><script>alert('Định dạng UID không hợp lệ!'); window.location.href='/manage';</script>");
         }
     } else {
-        server.send(400, "text/plain", "Missing UID parameter");
+        request->send(400, "text/plain", "Missing UID parameter");
     }
 }
 
-void handleRemoveCard() {
-    if (server.hasArg("uid")) {
-        String uidStr = server.arg("uid");
-        if (isValidUID(uidStr)) {
-            uint8_t uid[UID_SIZE];
-            stringToUID(uidStr, uid);
-            if (removeValidCard(uid)) {
-                sendHTMLResponse("<meta charset='UTF-8'><script>alert('Đã xóa thẻ thành công!'); window.location.href='/manage';</script>");
+void handleRenameCard(AsyncWebServerRequest* request) {
+    StateLock lock;
+    if (request->hasArg("uid") && request->hasArg("name")) {
+        uint8_t uid[UID_SIZE];
+        if (parseUidArg(request, "uid", uid)) {
+            // Card names end up inside HTML and JSON: printable text only
+            char name[CARD_NAME_MAX + 1];
+            const String& nameArg = request->arg("name");
+            cleanCardName(nameArg.c_str(), nameArg.length(), name);
+            if (cardTable.rename(uid, name)) {
+                notifyCardsChanged();
+                sendHTMLResponse(request, "<meta charset='UTF-8'><script>alert('Đã đổi tên thẻ!'); window.location.href='/manage';</script>");
             } else {
-                sendHTMLResponse("<meta charset='UTF-8'><script>alert('Xóa thẻ thất bại!'); window.location.href='/manage';</script>");
+                sendHTMLResponse(request, "<meta charset='UTF-8'><script>alert('Đổi tên thẻ thất bại!'); window.location.href='/manage';</script>");
             }
         } else {
-            sendHTMLResponse("<meta charset='UTF-8'><script>alert('Định dạng UID không hợp lệ!'); window.location.href='/manage';</script>");
+            sendHTMLResponse(request, "<meta charset='UTF-8'><script>alert('Định dạng UID không hợp lệ!'); window.location.href='/manage';</script>");
         }
     } else {
-        server.send(400, "text/plain", "Missing UID parameter");
-    }
-}
-
-
-
-// Hàm handleWeightHistory
-void handleWeightHistory() {
-    String html = "<!DOCTYPE html><html><head>";
-    html += "<meta charset='UTF-8'>";
-    html += "<title>Lịch sử cân nặng - Healthcare RFID</title>";
-    html += "<meta name='viewport' content='width=device-width, initial-scale=1'>";
-    html += "<style>";
-    html += "* { margin: 0; padding: 0; box-sizing: border-box; }";
-    html += "body { font-family: 'Segoe UI', Arial, sans-serif; background: linear-gradient(135deg, #667eea 0%, #764ba2 100%); min-height: 100vh; }";
-    html += ".container { max-width: 1000px; margin: 0 auto; padding: 20px; }";
-    html += ".header { text-align: center; color: white; margin-bottom: 30px; }";
-    html += ".card { background: white; border-radius: 15px; padding: 25px; box-shadow: 0 10px 30px rgba(0,0,0,0.2); }";
-    html += ".card-title { font-size: 1.5rem; color: #333; margin-bottom: 20px; }";
-    html += ".table { width: 100%; border-collapse: collapse; margin-top: 20px; }";
-    html += ".table th, .table td { padding: 12px; text-align: left; border-bottom: 1px solid #dee2e6; }";
-    html += ".table th { background: #f8f9fa; font-weight: 600; }";
-    html += ".table tr:hover { background: #f8f9fa; }";
-    html += ".badge { padding: 4px 8px; border-radius: 4px; font-size: 0.8rem; font-weight: 600; }";
-    html += ".badge-success { background: #d4edda; color: #155724; }";
-    html += ".badge-danger { background: #f8d7da; color: #721c24; }";
-    html += ".btn { padding: 12px 24px; border: none; border-radius: 8px; font-size: 1rem; font-weight: 600; cursor: pointer; transition: all 0.3s; text-decoration: none; display: inline-block; background: #007bff; color: white; }";
-    html += ".btn:hover { transform: translateY(-2px); box-shadow: 0 5px 15px rgba(0,0,0,0.2); }";
-    html += "</style></head><body>";
-    html += "<div class='container'>";
-    html += "<div class='header'><h1>📊 Lịch sử cân nặng</h1></div>";
-    html += "<div class='card'>";
-    html += "<div class='card-title'>Dữ liệu cân nặng gần đây</div>";
-    html += "<table class='table'><tr><th>Thời gian</th><th>UID thẻ</th><th>Cân nặng</th><th>Hợp lệ</th></tr>";
-
-    for (int i = 0; i < historyCount; i++) {
-        int index = (historyIndex - 1 - i + MAX_WEIGHT_HISTORY) % MAX_WEIGHT_HISTORY;
-        if (weightHistory[index].valid) {
-            String timeStr = formatUptime(weightHistory[index].timestamp);
-
-            html += "<tr><td>" + timeStr + "</td>";
-            html += "<td><code>" + uidToString(weightHistory[index].uid) + "</code></td>";
-            html += "<td><strong>" + String(weightHistory[index].weight) + "</strong></td>";
-            if (weightHistory[index].isValidCard) {
-                html += "<td><span class='badge badge-success'>Hợp lệ</span></td></tr>";
+        request->send(400, "text/plain", "Missing UID or name parameter");
+    }
+}
+
+// Active cards as CSV (with a header line) or the binary list, one card
+// per piece
+class CardExportSource : public ResponseSource {
+public:
+    explicit CardExportSource(bool binary) : binary(binary) {}
+
+    bool next(Print& out) override {
+        if (!started) {
+            started = true;
+            if (binary) {
+                out.write((const uint8_t*)CARD_BINARY_MAGIC, CARD_BINARY_MAGIC_SIZE);
             } else {
-                html += "<td><span class='badge badge-danger'>Không hợp lệ</span></td></tr>";
+                out.print("uid,name\n");
             }
         }
+        while (pos < cardTable.size()) {
+            int i = pos++;
+            if (!cardTable.isActive(i)) continue;
+            uint8_t uid[CARD_UID_MAX];
+            cardKeyUid(cardTable.key(i), uid);
+            if (binary) {
+                printCardBinary(out, uid, cardTable.name(i));
+            } else {
+                printCardCsv(out, uid, cardTable.name(i));
+            }
+            return true;
+        }
+        return false;
+    }
+
+private:
+    bool binary;
+    bool started = false;
+    int pos = 0;
+};
+
+// GET /api/cards/export[?format=csv|bin]
+void handleCardExport(AsyncWebServerRequest* request) {
+    bool binary = request->hasArg("format") && request->arg("format") == "bin";
+    sendChunked(request, binary ? "application/octet-stream" : "text/csv",
+                new CardExportSource(binary));
+}
+
+// Upload being parsed. Kept in request->_tempObject, which the server
+// releases with free() together with the request. The rows follow the job
+// in the same block, as many as the body can hold, so a short upload does
+// not need a full table's worth of heap.
+struct CardImportJob {
+    CardImportParser parser;
+
+    explicit CardImportJob(uint32_t maxRows) : parser((CardImportRow*)(this + 1), maxRows) {}
+
+    static uint32_t maxRowsFor(size_t total) {
+        size_t rows = total / CARD_IMPORT_MIN_ROW + 1;
+        return rows < MAX_VALID_CARDS ? rows : MAX_VALID_CARDS;
+    }
+};
+
+void handleCardImportBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) {
+    if (index == 0 && !request->_tempObject) {
+        uint32_t maxRows = CardImportJob::maxRowsFor(total);
+        void* mem = malloc(sizeof(CardImportJob) + maxRows * sizeof(CardImportRow));
+        if (mem) request->_tempObject = new (mem) CardImportJob(maxRows);
+    }
+    CardImportJob* job = (CardImportJob*)request->_tempObject;
+    if (job) job->parser.feed(data, len);
+}
+
+// POST /api/cards/import - the body is a CSV or binary card list (see
+// card_transfer.h). Each row adds the card or updates its name; the whole
+// batch is written to the card journal in one commit.
+void handleCardImport(AsyncWebServerRequest* request) {
+    CardImportJob* job = (CardImportJob*)request->_tempObject;
+    if (!job) {
+        if (request->contentLength()) {
+            request->send(503, "application/json", "{\"error\":\"out of memory\"}");
+        } else {
+            request->send(400, "application/json", "{\"error\":\"empty body\"}");
+        }
+        return;
+    }
+    CardImportParser& parser = job->parser;
+    parser.finish();
+
+    uint32_t counts[CARD_UNCHANGED + 1] = {0};
+    StateLock lock;
+    cardJournal.beginBatch();
+    for (uint32_t i = 0; i < parser.rowCount(); i++) {
+        const CardImportRow& row = parser.row(i);
+        CardImportResult result = cardTable.import(row.uid, row.name);
+        if (result == CARD_TABLE_FULL) {
+            parser.addError(row.row, "card table full");
+        } else if (result == CARD_WRITE_FAILED) {
+            parser.addError(row.row, "write failed");
+        } else {
+            counts[result]++;
+        }
+    }
+    bool saved = cardJournal.commitBatch();
+    if (counts[CARD_ADDED] || counts[CARD_UPDATED]) {
+        allowlistSender.start();
+        notifyCardsChanged();
+    }
+    Serial.printf("Card import: %lu added, %lu updated, %lu failed%s\n",
+                  (unsigned long)counts[CARD_ADDED], (unsigned long)counts[CARD_UPDATED],
+                  (unsigned long)parser.failedCount(), saved ? "" : ", journal write failed");
+
+    if (!saved) {
+        // The table in RAM is ahead of flash until the next successful write
+        request->send(500, "application/json", "{\"error\":\"journal write failed\"}");
+        return;
+    }
+    sendChunked(request, "application/json", new CardImportResultSource(parser, counts));
+}
+
+// One summary, copied so it cannot change while it is sent
+class RollupSource : public ResponseSource {
+public:
+    explicit RollupSource(const PatientRollup& p) : rollup(p) {}
+
+    bool next(Print& out) override {
+        printRollupJson(out, &rollup);
+        return false;
+    }
+
+private:
+    PatientRollup rollup;
+};
+
+// GET /api/rollup[?uid=XX:XX:XX:XX] - per-patient summaries, weights in grams
+void handleRollup(AsyncWebServerRequest* request) {
+    if (request->hasArg("uid")) {
+        uint8_t uid[UID_SIZE];
+        if (!parseUidArg(request, "uid", uid)) {
+            request->send(400, "application/json", "{\"error\":\"invalid uid\"}");
+            return;
+        }
+        StateLock lock;
+        const PatientRollup* p = weightRollup.find(uid);
+        if (p) {
+            sendChunked(request, "application/json", new RollupSource(*p));
+            return;
+        }
+        // Not among the cards weighed last: rebuilt from the log, without
+        // taking a table entry from one of them
+        PatientRollup restored;
+        if (!cardIngest.restoreRollup(uid, &restored)) {
+            request->send(404, "application/json", "{\"error\":\"no readings\"}");
+            return;
+        }
+        sendChunked(request, "application/json", new RollupSource(restored));
+        return;
     }
+    sendChunked(request, "application/json", new RollupListSource(weightRollup));
+}
 
-    html += "</table><br>";
-    html += "<a href='/' class='btn'>🏠 Về trang chính</a>";
-    html += "</div></div></body></html>";
-    sendHTMLResponse(html);
+// GET /api/scale - the STM32's answer to the last calibration command
+void handleScale(AsyncWebServerRequest* request) {
+    sendChunked(request, "application/json", new PrintFnSource(printScaleJson));
 }
 
+// POST /api/scale/command?op=status|tare|point|clear|save[&grams=N] - send
+// a calibration command to the STM32. Tare and point take a couple of
+// seconds to measure; the reply then shows up on /api/scale.
+void handleScaleCommand(AsyncWebServerRequest* request) {
+    static const char* const opNames[] = {"status", "tare", "point", "clear", "save"};
+    const String& opArg = request->arg("op");
+    int op = -1;
+    for (size_t i = 0; i < sizeof(opNames) / sizeof(opNames[0]); i++) {
+        if (opArg == opNames[i]) op = i;
+    }
+    int32_t grams = request->hasArg("grams") ? request->arg("grams").toInt() : 0;
+    if (op < 0 || (op == SCALE_OP_POINT && grams <= 0)) {
+        request->send(400, "application/json", "{\"error\":\"invalid op or grams\"}");
+        return;
+    }
+
+    // Under the lock, so its bytes cannot land inside an allowlist frame
+    uint8_t frame[FRAME_SCALE_COMMAND_SIZE];
+    buildScaleCommand(op, grams, frame);
+    StateLock lock;
+    stm32Serial.write(frame, sizeof(frame));
+    request->send(202, "application/json", "{\"sent\":true}");
+}
+
+bool parseHistoryCursor(const String& text, uint32_t* recNo) {
+    if (text.length() != HISTORY_CURSOR_SIZE - 1) return false;
+    char* end;
+    *recNo = strtoul(text.c_str(), &end, 16);
+    return *end == '\0' && *recNo != HISTORY_NO_RECORD;
+}
+
+// Non-negative decimal query argument
+bool parseTimeArg(const String& text, uint32_t* value) {
+    if (text.length() == 0 || text[0] < '0' || text[0] > '9') return false;
+    char* end;
+    *value = strtoul(text.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+// GET /api/history[?uid=XX:XX:XX:XX][&since=T][&until=T][&limit=N][&cursor=C]
+// Newest records first, at most limit per page. since/until bound the
+// device time (seconds, inclusive). A page that stops at the limit carries
+// a cursor; repeating the query with &cursor= returns the next page.
+void handleHistoryApi(AsyncWebServerRequest* request) {
+    // Optional ?uid= filter walks only that card's records
+    bool filtered = request->hasArg("uid");
+    uint8_t filterUid[UID_SIZE];
+    if (filtered) {
+        if (!parseUidArg(request, "uid", filterUid)) {
+            request->send(400, "application/json", "{\"error\":\"invalid uid\"}");
+            return;
+        }
+    }
+    uint32_t since = 0;
+    uint32_t until = 0xFFFFFFFFUL;
+    if ((request->hasArg("since") && !parseTimeArg(request->arg("since"), &since)) ||
+        (request->hasArg("until") && !parseTimeArg(request->arg("until"), &until))) {
+        request->send(400, "application/json", "{\"error\":\"invalid time range\"}");
+        return;
+    }
+    bool resume = request->hasArg("cursor");
+    uint32_t cursor = 0;
+    if (resume && !parseHistoryCursor(request->arg("cursor"), &cursor)) {
+        request->send(400, "application/json", "{\"error\":\"invalid cursor\"}");
+        return;
+    }
+    int limit = HISTORY_PAGE_ROWS;
+    if (request->hasArg("limit")) {
+        limit = request->arg("limit").toInt();
+        if (limit < 1) limit = 1;
+        if (limit > HISTORY_API_MAX_ROWS) limit = HISTORY_API_MAX_ROWS;
+    }
+
+    StateLock lock;
+    uint32_t start;
+    if (!historyPageStart(historyStore, filtered ? filterUid : nullptr, resume ? &cursor : nullptr,
+                          since, until, &start)) {
+        request->send(400, "application/json", "{\"error\":\"invalid cursor\"}");
+        return;
+    }
+    sendChunked(request, "application/json",
+                new HistorySource(historyStore, historyCache, filtered ? filterUid : nullptr,
+                                  start, since, until, limit));
+}
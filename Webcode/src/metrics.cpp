@@ -0,0 +1,155 @@
+/*
+ * metrics.cpp
+ */
+
+#include "metrics.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdarg.h>
+
+#define HISTOGRAM_LINES_PER_PIECE 6
+#define METRICS_LINE_MAX          128
+
+Metrics metrics;
+
+static TaskHandle_t loopTask = nullptr;
+
+// Upper bucket bounds in microseconds, and the same in seconds for "le"
+static const uint32_t BUCKET_US[METRICS_BUCKETS] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+};
+static const char* const BUCKET_LE[METRICS_BUCKETS + 1] = {
+    "0.00005", "0.0001", "0.00025", "0.0005", "0.001", "0.0025",
+    "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "+Inf"
+};
+
+static const char* const REJECT_REASON[FRAME_REJECT_COUNT] = {
+    "bad_end", "unknown_type", "overflow", "timeout"
+};
+
+void LatencyHistogram::observe(uint32_t us) {
+    uint32_t i = 0;
+    while (i < METRICS_BUCKETS && us > BUCKET_US[i]) i++;
+    buckets[i]++;
+    count++;
+    sumUs += us;
+}
+
+RouteMetrics* metricsRoute(const char* path) {
+    if (metrics.routeCount >= METRICS_MAX_ROUTES) return nullptr;
+    RouteMetrics* route = &metrics.routes[metrics.routeCount++];
+    route->path = path;
+    return route;
+}
+
+void metricsSetLoopTask() {
+    loopTask = xTaskGetCurrentTaskHandle();
+}
+
+// Print::printf() allocates for lines over 64 bytes, so format on the stack
+static void printLine(Print& out, const char* format, ...) {
+    char buf[METRICS_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (n < 0) return;
+    if (n >= (int)sizeof(buf)) n = sizeof(buf) - 1;
+    out.write((const uint8_t*)buf, n);
+}
+
+static void printType(Print& out, const char* name, const char* type) {
+    printLine(out, "# TYPE %s %s\n", name, type);
+}
+
+static void printValue(Print& out, const char* name, unsigned long value) {
+    printLine(out, "%s %lu\n", name, value);
+}
+
+bool MetricsSource::next(Print& out) {
+    switch (section) {
+    case 0:
+        printType(out, "hc_uart_bytes_total", "counter");
+        printValue(out, "hc_uart_bytes_total", metrics.ingest.uartBytes);
+        printType(out, "hc_uart_noise_bytes_total", "counter");
+        printValue(out, "hc_uart_noise_bytes_total", metrics.ingest.uartNoiseBytes);
+        printType(out, "hc_frames_received_total", "counter");
+        printValue(out, "hc_frames_received_total", metrics.ingest.framesReceived);
+        printType(out, "hc_frames_rejected_total", "counter");
+        for (int i = 0; i < FRAME_REJECT_COUNT; i++) {
+            printLine(out, "hc_frames_rejected_total{reason=\"%s\"} %lu\n",
+                      REJECT_REASON[i], (unsigned long)metrics.ingest.framesRejected[i]);
+        }
+        printType(out, "hc_rollup_evictions_total", "counter");
+        printValue(out, "hc_rollup_evictions_total", metrics.ingest.rollupEvictions);
+        printType(out, "hc_rollup_restores_total", "counter");
+        printValue(out, "hc_rollup_restores_total", metrics.ingest.rollupRestores);
+        section++;
+        return true;
+
+    case 1:
+        // Sampled now; this runs on the AsyncTCP task
+        printType(out, "hc_heap_free_bytes", "gauge");
+        printValue(out, "hc_heap_free_bytes", ESP.getFreeHeap());
+        printType(out, "hc_heap_min_free_bytes", "gauge");
+        printValue(out, "hc_heap_min_free_bytes", ESP.getMinFreeHeap());
+        printType(out, "hc_heap_largest_block_bytes", "gauge");
+        printValue(out, "hc_heap_largest_block_bytes", ESP.getMaxAllocHeap());
+        printType(out, "hc_task_stack_min_free_bytes", "gauge");
+        if (loopTask) {
+            printLine(out, "hc_task_stack_min_free_bytes{task=\"loop\"} %lu\n",
+                      (unsigned long)uxTaskGetStackHighWaterMark(loopTask));
+        }
+        printLine(out, "hc_task_stack_min_free_bytes{task=\"async_tcp\"} %lu\n",
+                  (unsigned long)uxTaskGetStackHighWaterMark(nullptr));
+        section++;
+        return true;
+
+    default:
+        for (int n = 0; n < HISTOGRAM_LINES_PER_PIECE; n++) {
+            if (!printHistogramLine(out)) return false;
+        }
+        return true;
+    }
+}
+
+// One bucket line, or the sum and count lines, of the current histogram.
+// Returns false once every histogram is printed.
+bool MetricsSource::printHistogramLine(Print& out) {
+    if (histogram > metrics.routeCount) return false;
+
+    const LatencyHistogram* h;
+    const char* name;
+    char label[48];
+    if (histogram == 0) {
+        h = &metrics.cardProcess;
+        name = "hc_card_process_seconds";
+        label[0] = '\0';
+    } else {
+        h = &metrics.routes[histogram - 1].duration;
+        name = "hc_http_handler_seconds";
+        snprintf(label, sizeof(label), "route=\"%s\",", metrics.routes[histogram - 1].path);
+    }
+
+    if (line == 0 && histogram <= 1) printType(out, name, "histogram");
+    if (line <= METRICS_BUCKETS) {
+        // Prometheus buckets are cumulative
+        uint32_t total = 0;
+        for (uint32_t i = 0; i <= line; i++) total += h->buckets[i];
+        printLine(out, "%s_bucket{%sle=\"%s\"} %lu\n", name, label, BUCKET_LE[line], (unsigned long)total);
+        line++;
+        return true;
+    }
+
+    // Strip the trailing comma for the sum/count label set
+    size_t len = strlen(label);
+    if (len) label[len - 1] = '\0';
+    const char* open = len ? "{" : "";
+    const char* close = len ? "}" : "";
+    printLine(out, "%s_sum%s%s%s %lu.%06lu\n", name, open, label, close,
+              (unsigned long)(h->sumUs / 1000000), (unsigned long)(h->sumUs % 1000000));
+    printLine(out, "%s_count%s%s%s %lu\n", name, open, label, close, (unsigned long)h->count);
+    histogram++;
+    line = 0;
+    return histogram <= metrics.routeCount;
+}
@@ -0,0 +1,61 @@
+/*
+ * response_source.cpp
+ */
+
+#include "response_source.h"
+
+bool JsonArraySource::next(Print& out) {
+    if (state == 2) return false;
+    if (state == 0) out.print("[");
+    if (advance()) {
+        if (state == 1) out.print(",");
+        state = 1;
+        printItem(out);
+        return true;
+    }
+    out.print("]");
+    state = 2;
+    return false;
+}
+
+ChunkBuffer::ChunkBuffer(ResponseSource* s) : src(s), len(0), pos(0), done(false) {
+}
+
+ChunkBuffer::~ChunkBuffer() {
+    delete src;
+}
+
+size_t ChunkBuffer::write(uint8_t c) {
+    if (len == RESPONSE_CHUNK_SIZE) return 0;
+    buf[len++] = c;
+    return 1;
+}
+
+size_t ChunkBuffer::write(const uint8_t* data, size_t n) {
+    if (n > RESPONSE_CHUNK_SIZE - len) n = RESPONSE_CHUNK_SIZE - len;
+    memcpy(buf + len, data, n);
+    len += n;
+    return n;
+}
+
+bool ChunkBuffer::produce() {
+    return src->next(*this);
+}
+
+size_t ChunkBuffer::fill(uint8_t* out, size_t maxLen) {
+    size_t n = 0;
+    while (n < maxLen) {
+        if (pos == len) {
+            if (done) break;
+            len = pos = 0;
+            done = !produce();
+            continue;
+        }
+        size_t k = len - pos;
+        if (k > maxLen - n) k = maxLen - n;
+        memcpy(out + n, buf + pos, k);
+        pos += k;
+        n += k;
+    }
+    return n;
+}
@@ -0,0 +1,21 @@
+/*
+ * state_lock.cpp
+ */
+
+#include "state_lock.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static SemaphoreHandle_t stateMutex = nullptr;
+
+void stateLockInit() {
+    if (!stateMutex) stateMutex = xSemaphoreCreateRecursiveMutex();
+}
+
+StateLock::StateLock() {
+    xSemaphoreTakeRecursive(stateMutex, portMAX_DELAY);
+}
+
+StateLock::~StateLock() {
+    xSemaphoreGiveRecursive(stateMutex);
+}
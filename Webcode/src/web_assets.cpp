@@ -0,0 +1,15 @@
+/*
+ * web_assets.cpp
+ *
+ * Lookup for the generated asset table (src/web_assets_data.cpp).
+ */
+
+#include "web_assets.h"
+#include <string.h>
+
+const WebAsset* findWebAsset(const char* path) {
+    for (size_t i = 0; i < webAssetCount; i++) {
+        if (strcmp(webAssets[i].path, path) == 0) return &webAssets[i];
+    }
+    return nullptr;
+}
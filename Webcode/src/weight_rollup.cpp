@@ -0,0 +1,174 @@
+/*
+ * weight_rollup.cpp
+ */
+
+#include "weight_rollup.h"
+#include <math.h>
+#include <string.h>
+
+WeightRollup::WeightRollup() {
+    clear();
+}
+
+void WeightRollup::clear() {
+    memset(table, 0, sizeof(table));
+    used = 0;
+    evicted = 0;
+}
+
+const PatientRollup* WeightRollup::find(const uint8_t* uid) const {
+    for (uint32_t i = 0; i < ROLLUP_MAX_PATIENTS; i++) {
+        if (table[i].count && memcmp(table[i].uid, uid, UID_SIZE) == 0) return &table[i];
+    }
+    return nullptr;
+}
+
+// Entry for uid; a new card takes a free entry or the one weighed longest ago
+PatientRollup* WeightRollup::findOrInsert(const uint8_t* uid) {
+    PatientRollup* victim = nullptr;
+    for (uint32_t i = 0; i < ROLLUP_MAX_PATIENTS; i++) {
+        PatientRollup* p = &table[i];
+        if (!p->count) {
+            if (!victim || victim->count) victim = p;
+            continue;
+        }
+        if (memcmp(p->uid, uid, UID_SIZE) == 0) return p;
+        if (!victim || (victim->count && p->lastTime < victim->lastTime)) victim = p;
+    }
+
+    if (!victim->count) {
+        used++;
+    } else {
+        evicted++;
+    }
+    memset(victim, 0, sizeof(*victim));
+    memcpy(victim->uid, uid, UID_SIZE);
+    return victim;
+}
+
+void WeightRollup::insert(const PatientRollup& p) {
+    *findOrInsert(p.uid) = p;
+}
+
+void WeightRollup::add(const uint8_t* uid, int32_t weight, uint32_t timestamp) {
+    PatientRollup* p = findOrInsert(uid);
+
+    // All-time summary, Welford's running mean and variance
+    p->count++;
+    if (p->count == 1 || weight < p->min) p->min = weight;
+    if (p->count == 1 || weight > p->max) p->max = weight;
+    float delta = weight - p->mean;
+    p->mean += delta / p->count;
+    p->m2 += delta * (weight - p->mean);
+    p->last = weight;
+    p->lastTime = timestamp;
+
+    // Daily bucket; a bucket left over from an older day is restarted
+    uint16_t day = (uint16_t)(timestamp / ROLLUP_SECONDS_PER_DAY);
+    RollupDay* d = &p->days[day % ROLLUP_DAYS];
+    if (d->day != day || !d->count) {
+        d->day = day;
+        d->count = 0;
+        d->mean = 0;
+    }
+    if (d->count < 0xFFFF) d->count++;
+    if (d->count == 1 || weight < d->min) d->min = weight;
+    if (d->count == 1 || weight > d->max) d->max = weight;
+    d->mean += (weight - d->mean) / d->count;
+
+    // Trend window, one point per weigh-in: readings that follow the
+    // previous one within ROLLUP_SESSION_SECONDS replace its point
+    uint32_t prev = (p->trendNext + ROLLUP_TREND_SAMPLES - 1) % ROLLUP_TREND_SAMPLES;
+    if (p->trendCount && timestamp - p->trendTime[prev] < ROLLUP_SESSION_SECONDS) {
+        p->trendTime[prev] = timestamp;
+        p->trendWeight[prev] = weight;
+        return;
+    }
+    p->trendTime[p->trendNext] = timestamp;
+    p->trendWeight[p->trendNext] = weight;
+    p->trendNext = (p->trendNext + 1) % ROLLUP_TREND_SAMPLES;
+    if (p->trendCount < ROLLUP_TREND_SAMPLES) p->trendCount++;
+}
+
+RollupRestore::RollupRestore(PatientRollup* p, const uint8_t* uid) : p(p), newerTime(0) {
+    memset(p, 0, sizeof(*p));
+    memcpy(p->uid, uid, UID_SIZE);
+}
+
+void RollupRestore::addOlder(int32_t weight, uint32_t timestamp) {
+    // The all-time summary does not depend on the order; the newest
+    // reading is the last one
+    p->count++;
+    if (p->count == 1) {
+        p->last = weight;
+        p->lastTime = timestamp;
+    }
+    if (p->count == 1 || weight < p->min) p->min = weight;
+    if (p->count == 1 || weight > p->max) p->max = weight;
+    float delta = weight - p->mean;
+    p->mean += delta / p->count;
+    p->m2 += delta * (weight - p->mean);
+
+    // Only the days add() would still hold: each has its own bucket
+    uint16_t day = (uint16_t)(timestamp / ROLLUP_SECONDS_PER_DAY);
+    uint16_t lastDay = (uint16_t)(p->lastTime / ROLLUP_SECONDS_PER_DAY);
+    if ((uint16_t)(lastDay - day) < ROLLUP_DAYS) {
+        RollupDay* d = &p->days[day % ROLLUP_DAYS];
+        d->day = day;
+        if (d->count < 0xFFFF) d->count++;
+        if (d->count == 1 || weight < d->min) d->min = weight;
+        if (d->count == 1 || weight > d->max) d->max = weight;
+        d->mean += (weight - d->mean) / d->count;
+    }
+
+    // add() keeps the newest reading of each weigh-in, so a point starts
+    // wherever the gap to the newer reading is a session or more. Points
+    // are collected newest first and put in order by finish().
+    bool point = p->count == 1 || newerTime - timestamp >= ROLLUP_SESSION_SECONDS;
+    newerTime = timestamp;
+    if (point && p->trendCount < ROLLUP_TREND_SAMPLES) {
+        p->trendTime[p->trendCount] = timestamp;
+        p->trendWeight[p->trendCount] = weight;
+        p->trendCount++;
+    }
+}
+
+void RollupRestore::finish() {
+    uint32_t n = p->trendCount;
+    for (uint32_t i = 0; i < n / 2; i++) {
+        uint32_t j = n - 1 - i;
+        uint32_t t = p->trendTime[i];
+        p->trendTime[i] = p->trendTime[j];
+        p->trendTime[j] = t;
+        int32_t w = p->trendWeight[i];
+        p->trendWeight[i] = p->trendWeight[j];
+        p->trendWeight[j] = w;
+    }
+    p->trendNext = p->trendCount % ROLLUP_TREND_SAMPLES;
+}
+
+float WeightRollup::stddev(const PatientRollup* p) {
+    return p->count > 1 ? sqrtf(p->m2 / (p->count - 1)) : 0;
+}
+
+// Least-squares slope of the trend window in grams per day, 0 with fewer
+// than two weigh-ins
+float WeightRollup::trendPerDay(const PatientRollup* p) {
+    if (p->trendCount < 2) return 0;
+
+    // Times relative to the newest reading keep the sums small
+    uint32_t t0 = p->lastTime;
+    float sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (uint32_t i = 0; i < p->trendCount; i++) {
+        float x = -(float)(t0 - p->trendTime[i]) / ROLLUP_SECONDS_PER_DAY;
+        float y = (float)(p->trendWeight[i] - p->last);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    float n = p->trendCount;
+    float den = n * sxx - sx * sx;
+    if (den <= 1e-12f) return 0;
+    return (n * sxy - sx * sy) / den;
+}
@@ -0,0 +1,105 @@
+"""
+embed_web.py
+
+PlatformIO pre-build script: gzips the files in web/ and writes them to
+src/web_assets_data.cpp as PROGMEM arrays with a strong ETag each.
+
+In HTML files a {{name}} placeholder is replaced by a versioned URL
+(/name?v=<etag>) so stylesheets and scripts can be cached for a long time
+and are still refetched after a firmware update.
+
+Can also be run by hand: python tools/embed_web.py
+"""
+
+import gzip
+import os
+import zlib
+
+WEB_DIR = "web"
+OUTPUT = os.path.join("src", "web_assets_data.cpp")
+
+# Served path for each file; anything not listed is served under /<name>
+ROUTES = {
+    "index.html": "/",
+    "manage.html": "/manage",
+    "history.html": "/weight_history",
+}
+
+CONTENT_TYPES = {
+    ".html": "text/html; charset=UTF-8",
+    ".css": "text/css",
+    ".js": "application/javascript",
+}
+
+
+def compress(data):
+    # mtime=0 keeps the output, and so the ETag, stable between builds
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def etag_of(blob):
+    return "%08x" % (zlib.crc32(blob) & 0xFFFFFFFF)
+
+
+def c_array(name, blob):
+    lines = []
+    for i in range(0, len(blob), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in blob[i:i + 16]) + ",")
+    return "static const uint8_t %s[] PROGMEM = {\n%s\n};\n" % (name, "\n".join(lines))
+
+
+def generate(project_dir):
+    web_dir = os.path.join(project_dir, WEB_DIR)
+    names = sorted(os.listdir(web_dir))
+    # Static files first so the HTML can reference their ETags
+    names.sort(key=lambda n: n.endswith(".html"))
+
+    assets = []
+    versions = {}
+    for name in names:
+        ext = os.path.splitext(name)[1]
+        if ext not in CONTENT_TYPES:
+            continue
+        with open(os.path.join(web_dir, name), "rb") as f:
+            data = f.read()
+        is_html = ext == ".html"
+        if is_html:
+            text = data.decode("utf-8")
+            for dep, url in versions.items():
+                text = text.replace("{{%s}}" % dep, url)
+            data = text.encode("utf-8")
+        blob = compress(data)
+        tag = etag_of(blob)
+        path = ROUTES.get(name, "/" + name)
+        if not is_html:
+            versions[name] = "%s?v=%s" % (path, tag)
+        assets.append((name, path, CONTENT_TYPES[ext], blob, tag, not is_html, len(data)))
+
+    out = ["// Generated by tools/embed_web.py from web/ - do not edit\n",
+           "#include \"web_assets.h\"\n"]
+    for i, (name, path, ctype, blob, tag, immutable, raw) in enumerate(assets):
+        out.append("// %s: %d bytes, %d gzipped\n" % (name, raw, len(blob)))
+        out.append(c_array("asset%d" % i, blob))
+    out.append("\nconst WebAsset webAssets[] = {\n")
+    for i, (name, path, ctype, blob, tag, immutable, raw) in enumerate(assets):
+        out.append("    {\"%s\", \"%s\", asset%d, %d, \"\\\"%s\\\"\", %s},\n"
+                   % (path, ctype, i, len(blob), tag, "true" if immutable else "false"))
+    out.append("};\n\nconst size_t webAssetCount = sizeof(webAssets) / sizeof(webAssets[0]);\n")
+    text = "".join(out)
+
+    output = os.path.join(project_dir, OUTPUT)
+    old = None
+    if os.path.exists(output):
+        with open(output) as f:
+            old = f.read()
+    if text != old:
+        with open(output, "w") as f:
+            f.write(text)
+        print("embed_web: wrote %s (%d assets)" % (OUTPUT, len(assets)))
+
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    generate(env.subst("$PROJECT_DIR"))  # noqa: F821
+except NameError:
+    generate(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
@@ -0,0 +1,29 @@
+// Shared helpers for the pages served from PROGMEM
+
+// Duration in seconds as "[d ngày ][hh:]mm:ss"
+function formatUptime(seconds) {
+  seconds = Math.floor(seconds);
+  const minutes = Math.floor(seconds / 60);
+  const hours = Math.floor(minutes / 60);
+  const days = Math.floor(hours / 24);
+  const s = seconds % 60;
+  const m = minutes % 60;
+  const h = hours % 24;
+  let result = '';
+  if (days > 0) result += days + ' ngày ';
+  if (hours > 0 || days > 0) result += (h < 10 ? '0' : '') + h + ':';
+  result += (m < 10 ? '0' : '') + m + ':';
+  result += (s < 10 ? '0' : '') + s;
+  return result;
+}
+
+function escapeHtml(text) {
+  return String(text).replace(/[&<>"']/g, c => ({ '&': '&amp;', '<': '&lt;', '>': '&gt;', '"': '&quot;', "'": '&#39;' })[c]);
+}
+
+function getJson(url) {
+  return fetch(url).then(r => {
+    if (!r.ok) throw new Error(r.status);
+    return r.json();
+  });
+}